@@ -0,0 +1,104 @@
+// compares the continuum lookup of KeyDistributer with a plain
+// std::lower_bound over {hash, endpoint} points, the previous layout.
+//
+// usage : ./continuum_bench [backends] [weight] [lookups]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "doobs_hash.h"
+#include "key_distributer.h"
+
+using namespace yarmproxy;
+
+struct CachePoint {
+  CachePoint(uint32_t hp, const Endpoint & ep) : hash_point(hp), endpoint(ep) {}
+  uint32_t hash_point;
+  Endpoint endpoint;
+  bool operator<(const CachePoint& r) const { return hash_point < r.hash_point; }
+};
+
+static Endpoint LowerBoundLocate(const std::vector<CachePoint>& points,
+                                 const char* key, size_t len) {
+  uint32_t hash = doobs_hash(key, len);
+  auto it = std::lower_bound(points.begin(), points.end(),
+                             CachePoint(hash, Endpoint()));
+  return it != points.end() ? it->endpoint : points.front().endpoint;
+}
+
+int main(int argc, char* argv[]) {
+  size_t backends = argc > 1 ? atoi(argv[1]) : 8;
+  size_t weight = argc > 2 ? atoi(argv[2]) : 20000;
+  size_t lookups = argc > 3 ? atoi(argv[3]) : 4000000;
+
+  std::vector<Config::Backend> config;
+  std::vector<CachePoint> points;
+  for(size_t i = 0; i < backends; ++i) {
+    config.emplace_back("10.0.0." + std::to_string(i + 1), 6379, weight);
+    Endpoint ep(boost::asio::ip::address_v4::from_string(config.back().host_),
+                6379);
+    char ss[64];
+    for(size_t k = 0; k < weight; ++k) {
+      snprintf(ss, 63, "%lu-%lu-%u", k, ep.address().to_v4().to_ulong(),
+               ep.port());
+      points.emplace_back(doobs_hash(ss, strlen(ss)), ep);
+    }
+  }
+  std::sort(points.begin(), points.end());
+  Config::Cluster cluster;
+  cluster.backends_ = config;
+  KeyDistributer distributer(cluster, std::set<Endpoint>());
+
+  // keys are generated up front, so that only the lookups are timed
+  std::mt19937 rng(2018);
+  std::vector<std::string> keys;
+  for(size_t i = 0; i < 1024 * 64; ++i) {
+    keys.push_back("user:" + std::to_string(rng()) + ":profile");
+  }
+
+  size_t mismatches = 0;
+  for(auto& key : keys) {
+    if (LowerBoundLocate(points, key.data(), key.size()) !=
+        distributer.LocateCacheNode(key.data(), key.size())) {
+      ++mismatches;
+    }
+  }
+
+  std::cout << "backends=" << backends << " weight=" << weight
+            << " points=" << points.size()
+            << " lookups=" << lookups
+            << " mismatches=" << mismatches << std::endl;
+
+  size_t checksum = 0;
+  for(int round = 0; round < 2; ++round) {
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < lookups; ++i) {
+      auto& key = keys[i % keys.size()];
+      checksum += LowerBoundLocate(points, key.data(), key.size()).port();
+    }
+    auto lower_bound_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < lookups; ++i) {
+      auto& key = keys[i % keys.size()];
+      checksum += distributer.LocateCacheNode(key.data(), key.size()).port();
+    }
+    auto eytzinger_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "round " << round
+              << " : lower_bound " << double(lower_bound_ns) / lookups
+              << " ns/lookup, eytzinger " << double(eytzinger_ns) / lookups
+              << " ns/lookup" << std::endl;
+  }
+  return checksum == 0;
+}
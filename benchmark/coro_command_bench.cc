@@ -0,0 +1,182 @@
+// times the execution of a command as a chain of callbacks, as the Command
+// classes, against its execution as a coroutine, as RedisCoroCommand. a
+// request creates a command, which writes the query, receives the reply and
+// writes it to the client, with `pipeline` commands in flight. the
+// completions are delivered as by the backend connections, to a weakly held
+// command. it also counts the coroutine frames allocated from the heap,
+// instead of recycled by the FramePool.
+//
+// build : needs -std=c++20, as the proxy built with YARMPROXY_COROUTINES=ON
+// usage : ./coro_command_bench [pipeline] [requests]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include "coro_task.h"
+
+using namespace yarmproxy;
+
+enum Event {
+  QUERY_WRITTEN,
+  REPLY_RECEIVED,
+  REPLY_WRITTEN,
+};
+
+class BenchCommand;
+
+// the io_service of a worker, completing the operations in their order
+class FakeIo {
+public:
+  void Post(std::weak_ptr<BenchCommand> command, Event event) {
+    pending_.emplace_back(std::move(command), event);
+  }
+  bool RunOne();
+
+  size_t finished_ = 0;
+private:
+  std::deque<std::pair<std::weak_ptr<BenchCommand>, Event>> pending_;
+};
+
+class BenchCommand : public std::enable_shared_from_this<BenchCommand> {
+public:
+  explicit BenchCommand(FakeIo& io) : io_(io) {}
+  virtual ~BenchCommand() {}
+  virtual void Start() = 0;
+  virtual void OnWriteQueryFinished(ErrorCode ec) = 0;
+  virtual void OnBackendReplyReceived(ErrorCode ec) = 0;
+  virtual void OnWriteReplyFinished(ErrorCode ec) = 0;
+protected:
+  FakeIo& io_;
+};
+
+bool FakeIo::RunOne() {
+  if (pending_.empty()) {
+    return false;
+  }
+  auto completion = std::move(pending_.front());
+  pending_.pop_front();
+  if (auto command = completion.first.lock()) {
+    switch(completion.second) {
+    case QUERY_WRITTEN:
+      command->OnWriteQueryFinished(ErrorCode::E_SUCCESS);
+      break;
+    case REPLY_RECEIVED:
+      command->OnBackendReplyReceived(ErrorCode::E_SUCCESS);
+      break;
+    case REPLY_WRITTEN:
+      command->OnWriteReplyFinished(ErrorCode::E_SUCCESS);
+      break;
+    }
+  }
+  return true;
+}
+
+class CallbackCommand : public BenchCommand {
+public:
+  using BenchCommand::BenchCommand;
+  void Start() override {
+    io_.Post(shared_from_this(), QUERY_WRITTEN);
+  }
+  void OnWriteQueryFinished(ErrorCode ec) override {
+    if (ec == ErrorCode::E_SUCCESS) {
+      io_.Post(shared_from_this(), REPLY_RECEIVED);
+    }
+  }
+  void OnBackendReplyReceived(ErrorCode ec) override {
+    if (ec == ErrorCode::E_SUCCESS) {
+      io_.Post(shared_from_this(), REPLY_WRITTEN);
+    }
+  }
+  void OnWriteReplyFinished(ErrorCode ec) override {
+    if (ec == ErrorCode::E_SUCCESS) {
+      ++io_.finished_;
+    }
+  }
+};
+
+class CoroCommand : public BenchCommand {
+public:
+  using BenchCommand::BenchCommand;
+  void Start() override {
+    task_ = Execute();
+  }
+  void OnWriteQueryFinished(ErrorCode ec) override {
+    query_written_.Complete(ec);
+  }
+  void OnBackendReplyReceived(ErrorCode ec) override {
+    reply_received_.Complete(ec);
+  }
+  void OnWriteReplyFinished(ErrorCode ec) override {
+    reply_written_.Complete(ec);
+  }
+
+private:
+  Task Execute() {
+    io_.Post(shared_from_this(), QUERY_WRITTEN);
+    ErrorCode ec = co_await query_written_;
+    if (ec != ErrorCode::E_SUCCESS) {
+      co_return;
+    }
+    io_.Post(shared_from_this(), REPLY_RECEIVED);
+    ec = co_await reply_received_;
+    if (ec != ErrorCode::E_SUCCESS) {
+      co_return;
+    }
+    io_.Post(shared_from_this(), REPLY_WRITTEN);
+    ec = co_await reply_written_;
+    if (ec == ErrorCode::E_SUCCESS) {
+      ++io_.finished_;
+    }
+  }
+
+  Completion query_written_;
+  Completion reply_received_;
+  Completion reply_written_;
+  Task task_;
+};
+
+// return : ns per request
+template <typename T>
+static double Run(size_t pipeline, size_t requests) {
+  FakeIo io;
+  std::deque<std::shared_ptr<BenchCommand>> active;
+  size_t created = 0;
+  auto begin = std::chrono::steady_clock::now();
+  while (io.finished_ < requests) {
+    while (active.size() < pipeline && created < requests) {
+      active.emplace_back(new T(io));
+      active.back()->Start();
+      ++created;
+    }
+    for(size_t i = 0; i < pipeline && io.RunOne(); ++i) {
+    }
+    while (!active.empty() && io.finished_ > created - active.size()) {
+      active.pop_front(); // the commands finish in their order
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / requests;
+}
+
+int main(int argc, char* argv[]) {
+  size_t pipeline = argc > 1 ? atoi(argv[1]) : 16;
+  size_t requests = argc > 2 ? atoi(argv[2]) : 2000000;
+
+  std::cout << "pipeline=" << pipeline << " requests=" << requests
+            << std::endl;
+  for(int round = 0; round < 3; ++round) {
+    double callback_ns = Run<CallbackCommand>(pipeline, requests);
+    size_t heap_frames = FramePool::heap_frames();
+    double coro_ns = Run<CoroCommand>(pipeline, requests);
+    printf("round %d, ns/request : callbacks %.1f, coroutine %.1f; "
+           "coroutine frames from the heap %zu\n", round,
+           callback_ns, coro_ns, FramePool::heap_frames() - heap_frames);
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+// compares the key distributions of KeyDistributer : build time, memory,
+// lookup cost, balance across equally weighted backends, and the fraction
+// of keys remapped when a backend is ejected or added. the ideal fractions
+// are 1/backends and 1/(backends + 1).
+//
+// usage : ./distribution_bench [backends] [weight] [keys]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "key_distributer.h"
+
+using namespace yarmproxy;
+
+static Config::Cluster MakeCluster(Config::Distribution distribution,
+                                   size_t backends, size_t weight) {
+  Config::Cluster cluster;
+  cluster.distribution_ = distribution;
+  for(size_t i = 0; i < backends; ++i) {
+    cluster.backends_.emplace_back("10.0.0." + std::to_string(i + 1), 6379,
+                                   weight);
+  }
+  return cluster;
+}
+
+static std::vector<Endpoint> Locate(const KeyDistributer& distributer,
+                                    const std::vector<std::string>& keys) {
+  std::vector<Endpoint> endpoints;
+  endpoints.reserve(keys.size());
+  for(auto& key : keys) {
+    endpoints.push_back(distributer.LocateCacheNode(key.data(), key.size()));
+  }
+  return endpoints;
+}
+
+static double Remapped(const std::vector<Endpoint>& before,
+                       const std::vector<Endpoint>& after) {
+  size_t moved = 0;
+  for(size_t i = 0; i < before.size(); ++i) {
+    moved += (before[i] != after[i]);
+  }
+  return double(moved) / before.size();
+}
+
+int main(int argc, char* argv[]) {
+  size_t backends = argc > 1 ? atoi(argv[1]) : 8;
+  size_t weight = argc > 2 ? atoi(argv[2]) : 50000;
+  size_t key_count = argc > 3 ? atoi(argv[3]) : 1000000;
+
+  std::mt19937 rng(2018);
+  std::vector<std::string> keys;
+  for(size_t i = 0; i < key_count; ++i) {
+    keys.push_back("user:" + std::to_string(rng()) + ":profile");
+  }
+
+  const struct {
+    const char* name;
+    Config::Distribution distribution;
+  } kDistributions[] = {
+    {"continuum", Config::Distribution::CONTINUUM},
+    {"ketama", Config::Distribution::KETAMA},
+    {"modula", Config::Distribution::MODULA},
+    {"jump", Config::Distribution::JUMP},
+    {"maglev", Config::Distribution::MAGLEV},
+    {"rendezvous", Config::Distribution::RENDEZVOUS},
+  };
+
+  std::cout << "backends=" << backends << " weight=" << weight
+            << " keys=" << key_count << std::endl;
+  std::cout << std::left << std::setw(13) << "distribution"
+            << std::setw(10) << "build_ms" << std::setw(12) << "memory"
+            << std::setw(10) << "ns/op" << std::setw(10) << "max/mean"
+            << std::setw(10) << "ejected" << "added" << std::endl;
+
+  size_t checksum = 0;
+  for(auto& d : kDistributions) {
+    Config::Cluster cluster = MakeCluster(d.distribution, backends, weight);
+    auto begin = std::chrono::steady_clock::now();
+    KeyDistributer distributer(cluster, std::set<Endpoint>());
+    auto build_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin).count() / 1000.0;
+
+    begin = std::chrono::steady_clock::now();
+    for(auto& key : keys) {
+      checksum += distributer.LocateCacheNode(key.data(), key.size()).port();
+    }
+    auto lookup_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<Endpoint> located = Locate(distributer, keys);
+    std::vector<size_t> loads(backends, 0);
+    for(auto& ep : located) {
+      ++loads[ep.address().to_v4().to_ulong() % 256 - 1];
+    }
+    double mean = double(key_count) / backends;
+
+    // eject a backend in the middle, or add one at the end
+    std::set<Endpoint> ejected;
+    ejected.insert(distributer.endpoints()[backends / 2]);
+    KeyDistributer without(cluster, ejected);
+    Config::Cluster larger = MakeCluster(d.distribution, backends + 1, weight);
+    KeyDistributer with(larger, std::set<Endpoint>());
+
+    std::cout << std::setw(13) << d.name
+              << std::setw(10) << build_ms
+              << std::setw(12) << distributer.memory_bytes()
+              << std::setw(10) << double(lookup_ns) / key_count
+              << std::setw(10)
+              << *std::max_element(loads.begin(), loads.end()) / mean
+              << std::setw(10) << Remapped(located, Locate(without, keys))
+              << Remapped(located, Locate(with, keys)) << std::endl;
+  }
+  return checksum == 0;
+}
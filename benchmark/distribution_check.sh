@@ -0,0 +1,31 @@
+#!/bin/bash
+# compares how yarmproxy and twemproxy(nutcracker) map a sample of keys to
+# servers, before moving the traffic of a nutcracker pool to yarmproxy. the
+# yarmproxy cluster should have the same servers, hash, hash_tag, and
+# `distribution ketama` or `distribution modula`.
+#
+# usage : ./distribution_check.sh yarmproxy.conf redis|memcached \
+#             nutcracker.conf pool [keys_file]
+
+if [ $# -lt 4 ]; then
+  echo "Usage: $0 yarmproxy.conf redis|memcached nutcracker.conf pool [keys_file]"
+  exit 1
+fi
+
+keys_file=$5
+if [ -z "$keys_file" ]; then
+  keys_file=distribution_check_keys.tmp
+  awk 'BEGIN { srand(2018); for (i = 0; i < 100000; ++i) {
+         if (i % 3 == 0) { printf "key:%d\n", i }
+         else if (i % 3 == 1) { printf "user:{%d}:profile\n", int(rand() * 1e6) }
+         else { printf "session_%x_%d\n", int(rand() * 1e9), i } } }' \
+      > $keys_file
+fi
+
+./key_mapping $1 $2 < $keys_file > distribution_check_yarm.tmp || exit 1
+./nutcracker_mapping.py $3 $4 < $keys_file > distribution_check_nc.tmp || exit 1
+
+paste -d ' ' distribution_check_yarm.tmp distribution_check_nc.tmp | awk '
+    { ++total; if ($2 != $4) { if (++diff <= 10) print "mismatch :", $1, $2, $4 } }
+    END { printf "%d of %d keys mapped to different servers\n", diff, total;
+          exit diff > 0 }'
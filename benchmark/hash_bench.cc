@@ -0,0 +1,123 @@
+// measures the throughput of the key hash functions over a few key lengths,
+// and how evenly each of them spreads keys over the backends of the
+// configured clusters, relative to the backend weights.
+//
+// usage : ./hash_bench [conf_file] [keys]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "key_distributer.h"
+#include "key_hash.h"
+
+using namespace yarmproxy;
+
+static void BenchThroughput() {
+  const size_t kKeyLengths[] = {8, 16, 32, 64, 128, 256};
+  const size_t kBytesPerRun = 256 * 1024 * 1024;
+
+  std::mt19937 rng(2018);
+  std::string buffer(4096 + 256, '\0');
+  for(auto& c : buffer) {
+    c = char('!' + rng() % 90);
+  }
+
+  printf("%-10s", "hash");
+  for(size_t len : kKeyLengths) {
+    printf("%12zuB", len);
+  }
+  printf("    (Mkeys/s)\n");
+
+  uint32_t checksum = 0;
+  for(size_t i = 0; kKeyHashNames[i] != nullptr; ++i) {
+    KeyHashFunction hash = GetKeyHashFunction(kKeyHashNames[i]);
+    printf("%-10s", kKeyHashNames[i]);
+    for(size_t len : kKeyLengths) {
+      size_t count = kBytesPerRun / len / 8;
+      auto begin = std::chrono::steady_clock::now();
+      for(size_t k = 0; k < count; ++k) {
+        // slide over the buffer, so that the keys differ
+        checksum += hash(buffer.data() + (k & 4095), len);
+      }
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - begin;
+      printf("%13.2f", count / elapsed.count() / 1e6);
+    }
+    printf("\n");
+  }
+  printf("checksum=%u\n\n", checksum);
+}
+
+static void BenchSpread(const Config::Cluster& cluster, size_t index,
+                        size_t keys) {
+  size_t total_weight = 0;
+  std::map<Endpoint, size_t> weights;
+  for(auto& backend : cluster.backends_) {
+    weights[Endpoint(boost::asio::ip::address_v4::from_string(backend.host_),
+                     backend.port_)] += backend.weight_;
+    total_weight += backend.weight_;
+  }
+
+  printf("cluster #%zu, backends=%zu, configured hash=%s, keys=%zu\n", index,
+         weights.size(), cluster.hash_.c_str(), keys);
+  printf("%-10s%12s%12s%12s%12s\n", "hash", "build(ms)", "min/share",
+         "max/share", "stddev");
+
+  for(size_t i = 0; kKeyHashNames[i] != nullptr; ++i) {
+    Config::Cluster hashed_cluster(cluster);
+    hashed_cluster.hash_ = kKeyHashNames[i];
+    auto begin = std::chrono::steady_clock::now();
+    KeyDistributer distributer(hashed_cluster, std::set<Endpoint>());
+    std::chrono::duration<double, std::milli> build_time =
+        std::chrono::steady_clock::now() - begin;
+
+    std::map<Endpoint, size_t> hits;
+    char key[64];
+    for(size_t k = 0; k < keys; ++k) {
+      int len = snprintf(key, sizeof(key), "user:%zu:profile", k);
+      ++hits[distributer.LocateCacheNode(key, len)];
+    }
+
+    // each backend's share of the keys, divided by its share of the weight
+    double min_ratio = 1e9, max_ratio = 0, sum = 0, sum2 = 0;
+    for(auto& it : weights) {
+      double expected = double(it.second) / total_weight;
+      double ratio = double(hits[it.first]) / keys / expected;
+      min_ratio = std::min(min_ratio, ratio);
+      max_ratio = std::max(max_ratio, ratio);
+      sum += ratio;
+      sum2 += ratio * ratio;
+    }
+    double mean = sum / weights.size();
+    printf("%-10s%12.1f%12.3f%12.3f%12.4f\n", kKeyHashNames[i],
+           build_time.count(), min_ratio, max_ratio,
+           std::sqrt(std::max(0.0, sum2 / weights.size() - mean * mean)));
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char* conf_file = argc > 1 ? argv[1] : "../proxy/yarmproxy.conf";
+  size_t keys = argc > 2 ? atoi(argv[2]) : 1000000;
+
+  BenchThroughput();
+
+  if (!Config::Instance().Initialize(conf_file)) {
+    std::cerr << "failed to load " << conf_file << std::endl;
+    return 1;
+  }
+  auto& clusters = Config::Instance().clusters();
+  for(size_t i = 0; i < clusters.size(); ++i) {
+    BenchSpread(clusters[i], i, keys);
+  }
+  return 0;
+}
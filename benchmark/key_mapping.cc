@@ -0,0 +1,44 @@
+// prints the backend of each key read from stdin, one per line, as
+// "<key> <ip>:<port>", by the clusters of a yarmproxy config. compared with
+// the output of nutcracker_mapping.py by distribution_check.sh, to verify
+// that both proxies map keys to the same servers.
+//
+// usage : ./key_mapping conf_file [redis|memcached] < keys
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+
+#include "config.h"
+#include "key_locator.h"
+#include "protocol_type.h"
+
+using namespace yarmproxy;
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage : " << argv[0] << " conf_file [redis|memcached]"
+              << " < keys" << std::endl;
+    return 1;
+  }
+  ProtocolType protocol = ProtocolType::REDIS;
+  if (argc > 2 && std::string(argv[2]) == "memcached") {
+    protocol = ProtocolType::MEMCACHED;
+  }
+
+  if (!Config::Instance().Initialize(argv[1])) {
+    std::cerr << "failed to load " << argv[1] << std::endl;
+    return 1;
+  }
+  KeyLocator locator;
+  locator.Initialize(std::set<Endpoint>(),
+                     std::map<size_t, redis::ClusterSlots>());
+
+  std::string key;
+  while (std::getline(std::cin, key)) {
+    std::cout << key << ' '
+              << locator.Locate(key.data(), key.size(), protocol) << '\n';
+  }
+  return 0;
+}
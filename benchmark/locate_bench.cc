@@ -0,0 +1,174 @@
+// times KeyLocator::LocateBatch and KeyLocator::Locate over MGET sized
+// batches of keys, against the previous namespace resolution, which built
+// the "<protocol>/<namespace>" string of every key with an ostringstream and
+// looked it up in a map.
+//
+// usage : ./locate_bench [conf_file] [batch_size] [batches]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "key_distributer.h"
+#include "key_hash.h"
+#include "key_locator.h"
+#include "protocol_type.h"
+
+using namespace yarmproxy;
+
+class LegacyLocator {
+public:
+  LegacyLocator() {
+    for(auto& cluster : Config::Instance().clusters()) {
+      std::shared_ptr<KeyDistributer> continuum(new KeyDistributer(
+          cluster, std::set<Endpoint>()));
+      for(auto& ns : cluster.namespaces_) {
+        std::ostringstream oss;
+        oss << ProtocolNs(cluster.protocol_) << "/"
+            << (ns == "_" ? "" : ns.c_str());
+        namespace_continum_.emplace(oss.str(), continuum);
+      }
+    }
+  }
+
+  Endpoint Locate(const char * key, size_t len, ProtocolType protocol) {
+    std::shared_ptr<KeyDistributer> continuum;
+    auto it = namespace_continum_.find(KeyNamespace(key, len, protocol));
+    if (it == namespace_continum_.end()) {
+      // the previous code looked up "0/" here, which was never registered
+      continuum = namespace_continum_[std::string(ProtocolNs(protocol)) + "/"];
+    } else {
+      continuum = it->second;
+    }
+    return continuum->LocateCacheNode(key, len);
+  }
+
+private:
+  static const char * ProtocolNs(ProtocolType protocol) {
+    return protocol == ProtocolType::MEMCACHED ? "m" : "r";
+  }
+  static std::string KeyNamespace(const char * key, size_t len,
+                                  ProtocolType protocol) {
+    std::ostringstream oss;
+    oss << ProtocolNs(protocol) << "/";
+    const char * p = static_cast<const char *>(memchr(key, ':',
+          std::min(int(len), Config::Instance().max_namespace_length() + 1)));
+    if (p != nullptr) {
+      oss << std::string(key, p - key);
+    }
+    return oss.str();
+  }
+
+  std::map<std::string, std::shared_ptr<KeyDistributer>> namespace_continum_;
+};
+
+int main(int argc, char* argv[]) {
+  const char* conf_file = argc > 1 ? argv[1] : "../proxy/yarmproxy.conf";
+  size_t batch_size = argc > 2 ? atoi(argv[2]) : 500;
+  size_t batches = argc > 3 ? atoi(argv[3]) : 2000;
+
+  if (!Config::Instance().Initialize(conf_file)) {
+    std::cerr << "failed to load " << conf_file << std::endl;
+    return 1;
+  }
+
+  KeyLocator locator;
+  locator.Initialize(std::set<Endpoint>(),
+                     std::map<size_t, redis::ClusterSlots>());
+  LegacyLocator legacy;
+
+  // keys of the configured redis namespaces, plus some out of any of them
+  std::vector<std::string> prefixes = {"", "unknown:"};
+  for(auto& cluster : Config::Instance().clusters()) {
+    if (cluster.protocol_ != ProtocolType::REDIS) {
+      continue;
+    }
+    for(auto& ns : cluster.namespaces_) {
+      if (ns != "_") {
+        prefixes.push_back(ns + ":");
+      }
+    }
+  }
+  std::mt19937 rng(2018);
+  std::vector<std::string> keys;
+  for(size_t i = 0; i < 64 * 1024; ++i) {
+    keys.push_back(prefixes[rng() % prefixes.size()] + "user:" +
+                   std::to_string(rng()));
+  }
+
+  std::vector<KeyLocator::Key> key_spans;
+  for(auto& key : keys) {
+    key_spans.emplace_back(key.data(), key.size());
+  }
+  std::vector<uint16_t> endpoint_indexes(keys.size());
+  locator.LocateBatch(key_spans.data(), key_spans.size(), ProtocolType::REDIS,
+                      endpoint_indexes.data());
+
+  size_t mismatches = 0;
+  for(size_t i = 0; i < keys.size(); ++i) {
+    auto& key = keys[i];
+    Endpoint ep = legacy.Locate(key.data(), key.size(), ProtocolType::REDIS);
+    if (locator.Locate(key.data(), key.size(), ProtocolType::REDIS) != ep ||
+        locator.endpoint(endpoint_indexes[i]) != ep) {
+      ++mismatches;
+    }
+  }
+  std::cout << "namespaces=" << prefixes.size() - 1
+            << " batch_size=" << batch_size << " batches=" << batches
+            << " mismatches=" << mismatches << std::endl;
+
+  size_t checksum = 0;
+  for(int round = 0; round < 2; ++round) {
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < batches; ++b) {
+      size_t offset = (b * batch_size) % (keys.size() - batch_size);
+      locator.LocateBatch(key_spans.data() + offset, batch_size,
+                          ProtocolType::REDIS, endpoint_indexes.data());
+      checksum += locator.endpoint(endpoint_indexes[batch_size - 1]).port();
+    }
+    std::chrono::duration<double, std::micro> batch =
+        std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < batches; ++b) {
+      size_t offset = (b * batch_size) % (keys.size() - batch_size);
+      for(size_t i = 0; i < batch_size; ++i) {
+        auto& key = keys[offset + i];
+        checksum += locator.Locate(key.data(), key.size(),
+                                   ProtocolType::REDIS).port();
+      }
+    }
+    std::chrono::duration<double, std::micro> fast =
+        std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < batches; ++b) {
+      size_t offset = (b * batch_size) % (keys.size() - batch_size);
+      for(size_t i = 0; i < batch_size; ++i) {
+        auto& key = keys[offset + i];
+        checksum += legacy.Locate(key.data(), key.size(),
+                                  ProtocolType::REDIS).port();
+      }
+    }
+    std::chrono::duration<double, std::micro> slow =
+        std::chrono::steady_clock::now() - begin;
+
+    printf("round %d, ns/key : LocateBatch %.1f, Locate %.1f, "
+           "ostringstream+map %.1f\n", round,
+           batch.count() * 1000 / batches / batch_size,
+           fast.count() * 1000 / batches / batch_size,
+           slow.count() * 1000 / batches / batch_size);
+  }
+  std::cout << "checksum=" << checksum << std::endl;
+  return 0;
+}
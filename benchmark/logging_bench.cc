@@ -0,0 +1,86 @@
+// times a log statement at the caller, as a worker logs: a typical record of
+// a string, a pointer, an integer and an endpoint-like string, pushed into
+// the ring of the thread by LOG_INFO, against the synchronous LOG_S(INFO) of
+// loguru, which formats and writes the record under its lock. the threads
+// log in bursts, with a pause for the logging thread to drain the rings.
+// it also times a LOG_DEBUG disabled at runtime.
+//
+// usage : ./logging_bench [threads] [bursts] [records_per_burst]
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+static const char* kLogFile = "./logging_bench.log";
+
+// return : ns per record at the callers
+template <typename LogFunc>
+static double Run(size_t threads, size_t bursts, size_t records,
+                  LogFunc log) {
+  std::atomic<uint64_t> total_ns(0);
+  std::vector<std::thread> workers;
+  for(size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+          std::string ep("127.0.0.1:6379");
+          uint64_t ns = 0;
+          for(size_t b = 0; b < bursts; ++b) {
+            auto begin = std::chrono::steady_clock::now();
+            for(size_t r = 0; r < records; ++r) {
+              log(&ep, r, ep);
+            }
+            ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - begin).count();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          }
+          total_ns += ns;
+          (void)t;
+        });
+  }
+  for(auto& worker : workers) {
+    worker.join();
+  }
+  return double(total_ns) / (threads * bursts * records);
+}
+
+int main(int argc, char* argv[]) {
+  size_t threads = argc > 1 ? atoi(argv[1]) : 2;
+  size_t bursts = argc > 2 ? atoi(argv[2]) : 20;
+  size_t records = argc > 3 ? atoi(argv[3]) : 2000;
+
+  LOG_INIT(kLogFile, "INFO");
+  loguru::g_stderr_verbosity = loguru::Verbosity_OFF;
+
+  printf("threads=%zu bursts=%zu records_per_burst=%zu\n", threads, bursts,
+         records);
+  for(int round = 0; round < 2; ++round) {
+    double async_ns = Run(threads, bursts, records,
+        [](const void* ptr, size_t r, const std::string& ep) {
+          LOG_INFO << "BackendConn::HandleRead ok, backend=" << ptr
+                   << " bytes=" << r << " ep=" << ep;
+        });
+    double sync_ns = Run(threads, bursts, records,
+        [](const void* ptr, size_t r, const std::string& ep) {
+          LOG_S(INFO) << "BackendConn::HandleRead ok, backend=" << ptr
+                      << " bytes=" << r << " ep=" << ep;
+        });
+    double disabled_ns = Run(threads, 1, records * bursts,
+        [](const void* ptr, size_t r, const std::string& ep) {
+          LOG_DEBUG << "BackendConn::HandleRead ok, backend=" << ptr
+                    << " bytes=" << r << " ep=" << ep;
+        });
+    printf("round %d, ns/record at the caller : async rings %.1f, "
+           "loguru %.1f, disabled debug %.2f\n", round, async_ns, sync_ns,
+           disabled_ns);
+  }
+  LOG_SHUTDOWN();
+  unlink(kLogFile);
+  return 0;
+}
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+# prints the server of each key read from stdin, one per line, as
+# "<key> <ip>:<port>", the way twemproxy(nutcracker) maps keys to the servers
+# of a pool. it's a port of nc_hashkit and nc_ketama/nc_modula/nc_random,
+# to check key_mapping, see distribution_check.sh
+#
+# usage : ./nutcracker_mapping.py nutcracker.conf pool < keys
+
+import hashlib
+import math
+import random
+import struct
+import sys
+
+M32 = 0xffffffff
+M64 = 0xffffffffffffffff
+
+
+def signed(b):
+    # twemproxy converts the key chars, which are signed
+    return b - 256 if b >= 128 else b
+
+
+def fnv1_64(key):
+    h = 0xcbf29ce484222325
+    for b in key:
+        h = (h * 0x100000001b3) & M64
+        h ^= signed(b) & M64
+    return h & M32
+
+
+def fnv1a_64(key):
+    h = 0xcbf29ce484222325 & M32
+    for b in key:
+        h ^= signed(b) & M32
+        h = (h * (0x100000001b3 & M32)) & M32
+    return h
+
+
+def fnv1_32(key):
+    h = 2166136261
+    for b in key:
+        h = (h * 16777619) & M32
+        h ^= signed(b) & M32
+    return h
+
+
+def fnv1a_32(key):
+    h = 2166136261
+    for b in key:
+        h ^= signed(b) & M32
+        h = (h * 16777619) & M32
+    return h
+
+
+def one_at_a_time(key):
+    v = 0
+    for b in key:
+        v = (v + (signed(b) & M32)) & M32
+        v = (v + (v << 10)) & M32
+        v ^= v >> 6
+    v = (v + (v << 3)) & M32
+    v ^= v >> 11
+    v = (v + (v << 15)) & M32
+    return v
+
+
+def md5(key):
+    return struct.unpack('<I', hashlib.md5(key).digest()[:4])[0]
+
+
+def murmur(key):
+    m, r, length = 0x5bd1e995, 24, len(key)
+    h = ((0xdeadbeef * length) & M32) ^ length
+    i = 0
+    while length - i >= 4:
+        k = struct.unpack('<I', key[i:i + 4])[0]
+        k = (k * m) & M32
+        k ^= k >> r
+        k = (k * m) & M32
+        h = (h * m) & M32
+        h ^= k
+        i += 4
+    rest = key[i:]
+    if len(rest) == 3:
+        h ^= rest[2] << 16
+    if len(rest) >= 2:
+        h ^= rest[1] << 8
+    if len(rest) >= 1:
+        h ^= rest[0]
+        h = (h * m) & M32
+    h ^= h >> 13
+    h = (h * m) & M32
+    h ^= h >> 15
+    return h
+
+
+def crc16_table():
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        table.append(crc & 0xffff)
+    return table
+
+
+CRC16_TABLE = crc16_table()
+
+
+def crc16(key):
+    crc = 0
+    for b in key:
+        crc = ((crc << 8) ^ CRC16_TABLE[((crc >> 8) ^ b) & 0xff]) & M32
+    return crc
+
+
+def crc32a(key):
+    import zlib
+    return zlib.crc32(key) & M32
+
+
+def crc32(key):
+    return (crc32a(key) >> 16) & 0x7fff
+
+
+HASHES = {
+    'fnv1_64': fnv1_64, 'fnv1a_64': fnv1a_64, 'fnv1_32': fnv1_32,
+    'fnv1a_32': fnv1a_32, 'one_at_a_time': one_at_a_time, 'md5': md5,
+    'murmur': murmur, 'crc16': crc16, 'crc32': crc32, 'crc32a': crc32a,
+}
+
+
+def f32(x):
+    return struct.unpack('f', struct.pack('f', x))[0]
+
+
+def ketama_continuum(servers):
+    total_weight = sum(s['weight'] for s in servers)
+    continuum = []
+    for index, server in enumerate(servers):
+        pct = f32(f32(server['weight']) / f32(total_weight))
+        t = f32(f32(f32(pct * 160) / 4) * f32(len(servers)))
+        points = int(f32(math.floor(f32(t + 0.0000000001))) * 4)
+        for n in range(points // 4):
+            digest = hashlib.md5(b'%s-%d' % (server['name'], n)).digest()
+            for x in range(4):
+                value = struct.unpack('<I', digest[4 * x:4 * x + 4])[0]
+                continuum.append((value, index))
+    continuum.sort(key=lambda point: point[0])
+    return continuum
+
+
+def ketama_dispatch(continuum, h):
+    left, right = 0, len(continuum)
+    while left < right:
+        middle = (left + right) // 2
+        if continuum[middle][0] < h:
+            left = middle + 1
+        else:
+            right = middle
+    return continuum[0 if right == len(continuum) else right][1]
+
+
+def load_pool(conf_file, pool_name):
+    pool, servers, current = {}, [], None
+    for line in open(conf_file):
+        line = line.split('#')[0].rstrip()
+        if not line.strip():
+            continue
+        if not line[0].isspace():
+            current = line.rstrip(':').strip()
+            continue
+        if current != pool_name:
+            continue
+        text = line.strip()
+        if text.startswith('- '):
+            # "ip:port:weight [name]"
+            fields = text[2:].split()
+            host, port, weight = fields[0].rsplit(':', 2)
+            if len(fields) > 1:
+                name = fields[1]
+            elif port == '11211':
+                name = host
+            else:
+                name = host + ':' + port
+            servers.append({'address': host + ':' + port,
+                            'weight': int(weight), 'name': name.encode()})
+        elif ':' in text:
+            k, v = text.split(':', 1)
+            pool[k.strip()] = v.strip().strip('"\'')
+    if not servers:
+        sys.exit('no servers of pool %s in %s' % (pool_name, conf_file))
+    pool['servers'] = servers
+    return pool
+
+
+def hashed_part(key, tag):
+    if len(tag) == 2:
+        start = key.find(tag[:1])
+        if start >= 0:
+            end = key.find(tag[1:], start + 1)
+            if end - start > 1:
+                return key[start + 1:end]
+    return key
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('usage : %s nutcracker.conf pool < keys' % sys.argv[0])
+    pool = load_pool(sys.argv[1], sys.argv[2])
+    servers = pool['servers']
+    key_hash = HASHES[pool.get('hash', 'fnv1a_64')]
+    distribution = pool.get('distribution', 'ketama')
+    tag = pool.get('hash_tag', '').encode()
+    continuum = ketama_continuum(servers) if distribution == 'ketama' else None
+    modula = [i for i, s in enumerate(servers) for _ in range(s['weight'])]
+
+    out = sys.stdout
+    for line in sys.stdin.buffer:
+        key = line.rstrip(b'\r\n')
+        if len(servers) == 1:
+            index = 0
+        else:
+            part = hashed_part(key, tag)
+            h = key_hash(part) if part else 0
+            if distribution == 'ketama':
+                index = ketama_dispatch(continuum, h)
+            elif distribution == 'modula':
+                index = modula[h % len(modula)]
+            else:
+                index = random.randrange(len(servers))
+        out.write('%s %s\n' % (key.decode(errors='replace'),
+                               servers[index]['address']))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,210 @@
+// compares the CPU time per request of a worker serving its connections on
+// the asio reactor, and on the EpollReactor(epoll_reactor.h). the worker
+// echoes the requests as a client connection does, i.e. it reads some, writes
+// all it read, then reads again. a client thread writes a request on each of
+// the connections, then reads the replies, so that the worker handles the
+// readiness of several connections at once. the CPU time is of the worker
+// thread only, split into the user time, i.e. the reactor, and the system
+// time, i.e. the same recv, send and epoll_wait calls for both.
+//
+// usage : ./reactor_bench [connections] [rounds] [request_bytes]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "epoll_reactor.h"
+
+using namespace yarmproxy;
+
+template <typename Handler>
+static void AsyncWrite(boost::asio::ip::tcp::socket& socket, const char* data,
+                       size_t bytes, Handler&& handler) {
+  boost::asio::async_write(socket, boost::asio::buffer(data, bytes),
+                           std::forward<Handler>(handler));
+}
+
+template <typename Handler>
+static void AsyncWrite(ReactorSocket& socket, const char* data, size_t bytes,
+                       Handler&& handler) {
+  socket.async_write(data, bytes, std::forward<Handler>(handler));
+}
+
+static void Assign(boost::asio::ip::tcp::socket& socket, int fd) {
+  socket.assign(boost::asio::ip::tcp::v4(), fd);
+}
+
+static void Assign(ReactorSocket& socket, int fd) {
+  boost::system::error_code ec;
+  socket.assign(fd, ec);
+  if (ec) {
+    fprintf(stderr, "assign error %s\n", ec.message().c_str());
+    exit(1);
+  }
+}
+
+template <typename Socket>
+class EchoConn : public std::enable_shared_from_this<EchoConn<Socket>> {
+public:
+  EchoConn(boost::asio::io_service& io_context, int fd) : socket_(io_context) {
+    Assign(socket_, fd);
+  }
+  void Read() {
+    socket_.async_read_some(boost::asio::buffer(buffer_, sizeof(buffer_)),
+        std::bind(&EchoConn::HandleRead, this->shared_from_this(),
+                  std::placeholders::_1, std::placeholders::_2));
+  }
+
+private:
+  void HandleRead(const boost::system::error_code& ec, size_t bytes) {
+    if (ec) {
+      return;
+    }
+    AsyncWrite(socket_, buffer_, bytes,
+        std::bind(&EchoConn::HandleWrite, this->shared_from_this(),
+                  std::placeholders::_1, std::placeholders::_2));
+  }
+  void HandleWrite(const boost::system::error_code& ec, size_t) {
+    if (!ec) {
+      Read();
+    }
+  }
+
+  Socket socket_;
+  char buffer_[16 * 1024];
+};
+
+// return : the connected pairs of descriptors, the client ones first
+static std::vector<std::pair<int, int>> ConnectPairs(size_t count) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(listener, (sockaddr*)&addr, len) != 0 ||
+      listen(listener, 1024) != 0 ||
+      getsockname(listener, (sockaddr*)&addr, &len) != 0) {
+    perror("listen");
+    exit(1);
+  }
+  std::vector<std::pair<int, int>> pairs;
+  for(size_t i = 0; i < count; ++i) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(client, (sockaddr*)&addr, len) != 0) {
+      perror("connect");
+      exit(1);
+    }
+    int no_delay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    int server = accept(listener, nullptr, nullptr);
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    pairs.emplace_back(client, server);
+  }
+  close(listener);
+  return pairs;
+}
+
+static uint64_t Ns(const timeval& tv) {
+  return uint64_t(tv.tv_sec) * 1000000000 + uint64_t(tv.tv_usec) * 1000;
+}
+
+struct Result {
+  double user_ns;   // of the worker per request
+  double system_ns;
+  double wall_us;   // per round
+  double events_per_batch;
+};
+
+template <typename Socket>
+static Result Run(size_t connections, size_t rounds, size_t request_bytes) {
+  auto pairs = ConnectPairs(connections);
+  boost::asio::io_service io_context;
+  for(auto& pair : pairs) {
+    std::make_shared<EchoConn<Socket>>(io_context, pair.second)->Read();
+  }
+
+  rusage begin_usage, end_usage;
+  std::thread worker([&io_context, &begin_usage, &end_usage]() {
+        getrusage(RUSAGE_THREAD, &begin_usage);
+        io_context.run();
+        getrusage(RUSAGE_THREAD, &end_usage);
+      });
+
+  std::string request(request_bytes, 'q');
+  std::vector<char> reply(request_bytes);
+  auto begin = std::chrono::steady_clock::now();
+  for(size_t r = 0; r < rounds; ++r) {
+    for(auto& pair : pairs) {
+      if (write(pair.first, request.data(), request.size()) !=
+          ssize_t(request.size())) {
+        perror("write");
+        exit(1);
+      }
+    }
+    for(auto& pair : pairs) {
+      size_t received = 0;
+      while(received < request_bytes) {
+        ssize_t bytes = read(pair.first, reply.data() + received,
+                             request_bytes - received);
+        if (bytes <= 0) {
+          perror("read");
+          exit(1);
+        }
+        received += bytes;
+      }
+    }
+  }
+  auto wall = std::chrono::steady_clock::now() - begin;
+
+  Result result = {0, 0, 0, 0};
+  if (boost::asio::has_service<EpollReactor>(io_context)) {
+    auto& reactor = boost::asio::use_service<EpollReactor>(io_context);
+    result.events_per_batch = double(reactor.events()) / reactor.batches();
+  }
+  io_context.stop();
+  worker.join();
+  for(auto& pair : pairs) {
+    close(pair.first);
+  }
+  result.user_ns = double(Ns(end_usage.ru_utime) - Ns(begin_usage.ru_utime)) /
+                   (connections * rounds);
+  result.system_ns = double(Ns(end_usage.ru_stime) -
+                            Ns(begin_usage.ru_stime)) / (connections * rounds);
+  result.wall_us = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       wall).count() / 1000.0 / rounds;
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  size_t connections = argc > 1 ? atoi(argv[1]) : 64;
+  size_t rounds = argc > 2 ? atoi(argv[2]) : 5000;
+  size_t request_bytes = argc > 3 ? atoi(argv[3]) : 64;
+
+  printf("connections=%zu rounds=%zu request_bytes=%zu\n", connections, rounds,
+         request_bytes);
+  for(int round = 0; round < 3; ++round) {
+    Result asio = Run<boost::asio::ip::tcp::socket>(connections, rounds,
+                                                    request_bytes);
+    Result epoll = Run<ReactorSocket>(connections, rounds, request_bytes);
+    printf("round %d, worker ns/request user+system : asio %.0f+%.0f, "
+           "epoll reactor %.0f+%.0f (%.1f events/epoll_wait). us/round : "
+           "asio %.1f, epoll reactor %.1f\n", round, asio.user_ns,
+           asio.system_ns, epoll.user_ns, epoll.system_ns,
+           epoll.events_per_batch, asio.wall_us, epoll.wall_us);
+  }
+  return 0;
+}
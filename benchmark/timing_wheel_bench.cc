@@ -0,0 +1,172 @@
+// times the timeouts of the requests, armed by the client and backend
+// connections, on the TimingWheel of a worker against a steady_timer per
+// timeout, which was re-armed with expires_after and an async_wait of a
+// weak_ptr lambda. a request arms the client read timeout, the backend write
+// and read timeouts, and the client write timeout, and disarms all but the
+// first. it also counts the asio timer operations per request, and checks
+// that the wheel expires the timers on time.
+//
+// usage : ./timing_wheel_bench [connections] [requests]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "timing_wheel.h"
+
+using namespace yarmproxy;
+
+static const int kTimeout = 3000; // socket_rw_timeout in ms
+
+class AsioConn : public std::enable_shared_from_this<AsioConn> {
+public:
+  explicit AsioConn(boost::asio::io_service& io_context)
+      : read_timer_(io_context), write_timer_(io_context) {
+  }
+  void Arm(boost::asio::steady_timer& timer) {
+    timer.expires_after(std::chrono::milliseconds(kTimeout));
+    std::weak_ptr<AsioConn> wptr(shared_from_this());
+    timer.async_wait([wptr](const boost::system::error_code& ec) {
+          if (auto ptr = wptr.lock()) {
+            ptr->expired_ += !ec;
+          }
+        });
+    ++operations_;
+  }
+  void Disarm(boost::asio::steady_timer& timer) {
+    timer.cancel();
+    ++operations_;
+  }
+
+  boost::asio::steady_timer read_timer_;
+  boost::asio::steady_timer write_timer_;
+  size_t expired_ = 0;
+  static uint64_t operations_;
+};
+uint64_t AsioConn::operations_ = 0;
+
+struct WheelConn {
+  explicit WheelConn(TimingWheel& wheel)
+      : read_timer_(wheel, [this]() { ++expired_; })
+      , write_timer_(wheel, [this]() { ++expired_; }) {
+  }
+  WheelTimer read_timer_;
+  WheelTimer write_timer_;
+  size_t expired_ = 0;
+};
+
+// the timers armed with random timeouts expire no earlier than armed, and
+// at most `max_late` ms later
+static bool CheckExpiry(size_t timers, int max_late) {
+  boost::asio::io_service io_context;
+  TimingWheel wheel(io_context);
+  std::mt19937 rng(2018);
+  std::vector<std::chrono::steady_clock::time_point> deadlines(timers);
+  std::vector<std::chrono::steady_clock::time_point> expiries(timers);
+  std::vector<std::unique_ptr<WheelTimer>> wheel_timers;
+  for(size_t i = 0; i < timers; ++i) {
+    wheel_timers.emplace_back(new WheelTimer(wheel, [&expiries, i]() {
+          expiries[i] = std::chrono::steady_clock::now();
+        }));
+  }
+  for(size_t i = 0; i < timers; ++i) {
+    int timeout = 1 + rng() % (i % 8 == 0 ? 700 : 50);
+    deadlines[i] = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(timeout);
+    wheel_timers[i]->Arm(timeout);
+    if (i % 4 == 3) {
+      wheel_timers[i - 1]->Disarm(); // never expires
+    }
+  }
+  io_context.run();
+
+  bool ok = wheel.armed_timers() == 0;
+  for(size_t i = 0; i < timers; ++i) {
+    if (i % 4 == 2) {
+      ok = ok && expiries[i] == std::chrono::steady_clock::time_point();
+      continue;
+    }
+    auto late = expiries[i] - deadlines[i];
+    ok = ok && late > std::chrono::milliseconds(-1) &&
+         late < std::chrono::milliseconds(max_late);
+  }
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  size_t connections = argc > 1 ? atoi(argv[1]) : 1000;
+  size_t requests = argc > 2 ? atoi(argv[2]) : 1000000;
+
+  std::cout << "connections=" << connections << " requests=" << requests
+            << " expiry_check=" << (CheckExpiry(4096, 20) ? "ok" : "FAIL")
+            << std::endl;
+
+  for(int round = 0; round < 2; ++round) {
+    boost::asio::io_service asio_context;
+    std::vector<std::shared_ptr<AsioConn>> clients, backends;
+    for(size_t i = 0; i < connections; ++i) {
+      clients.emplace_back(new AsioConn(asio_context));
+      backends.emplace_back(new AsioConn(asio_context));
+    }
+    AsioConn::operations_ = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t r = 0; r < requests; ++r) {
+      AsioConn& client = *clients[r % connections];
+      AsioConn& backend = *backends[r % connections];
+      client.Arm(client.read_timer_);
+      backend.Arm(backend.write_timer_);
+      backend.Disarm(backend.write_timer_);
+      backend.Arm(backend.read_timer_);
+      backend.Disarm(backend.read_timer_);
+      client.Arm(client.write_timer_);
+      client.Disarm(client.write_timer_);
+      if (r % 256 == 255) {
+        asio_context.poll(); // runs the aborted handlers
+      }
+    }
+    asio_context.poll();
+    std::chrono::duration<double, std::nano> asio_time =
+        std::chrono::steady_clock::now() - begin;
+    uint64_t asio_operations = AsioConn::operations_;
+
+    boost::asio::io_service wheel_context;
+    TimingWheel wheel(wheel_context);
+    std::vector<std::unique_ptr<WheelConn>> wheel_clients, wheel_backends;
+    for(size_t i = 0; i < connections; ++i) {
+      wheel_clients.emplace_back(new WheelConn(wheel));
+      wheel_backends.emplace_back(new WheelConn(wheel));
+    }
+    begin = std::chrono::steady_clock::now();
+    for(size_t r = 0; r < requests; ++r) {
+      WheelConn& client = *wheel_clients[r % connections];
+      WheelConn& backend = *wheel_backends[r % connections];
+      client.read_timer_.Arm(kTimeout);
+      backend.write_timer_.Arm(kTimeout);
+      backend.write_timer_.Disarm();
+      backend.read_timer_.Arm(kTimeout);
+      backend.read_timer_.Disarm();
+      client.write_timer_.Arm(kTimeout);
+      client.write_timer_.Disarm();
+      if (r % 256 == 255) {
+        wheel_context.poll();
+      }
+    }
+    wheel_context.poll();
+    std::chrono::duration<double, std::nano> wheel_time =
+        std::chrono::steady_clock::now() - begin;
+
+    printf("round %d, ns/request : steady_timer %.1f, TimingWheel %.1f; "
+           "asio timer operations/request : steady_timer %.3f, "
+           "TimingWheel %.6f\n", round,
+           asio_time.count() / requests, wheel_time.count() / requests,
+           double(asio_operations) / requests,
+           double(wheel.driver_arms()) / requests);
+  }
+  return 0;
+}
@@ -1,5 +1,13 @@
 #include "allocator.h"
 
+#ifdef __linux__
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "logging.h"
 
 namespace yarmproxy {
@@ -12,7 +20,16 @@ Allocator::Allocator(int buffer_size, int reserved_space_size)
   if (reserved_space_size == 0) {
     reserved_space_ = nullptr;
   } else {
-    reserved_space_ = new char[reserved_space_size]; // TODO : page allignment
+#ifdef __linux__
+    // page aligned, and not touched until a slab is used, see BindToNode()
+    void* space = mmap(nullptr, reserved_space_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    reserved_space_ = space == MAP_FAILED ? new char[reserved_space_size] :
+                      static_cast<char*>(space);
+    reserved_space_mapped_ = space != MAP_FAILED;
+#else
+    reserved_space_ = new char[reserved_space_size];
+#endif
     for(auto p = reserved_space_; p < reserved_space_ + reserved_space_size;
         p += buffer_size) {
       free_slabs_.insert(p);
@@ -32,15 +49,37 @@ char* Allocator::Alloc() {
   }
 }
 
+bool Allocator::BindToNode(int node) {
+#ifdef __linux__
+  if (!reserved_space_mapped_ || node < 0 ||
+      node >= int(sizeof(unsigned long) * 8)) {
+    return false;
+  }
+  // preferred rather than bound, so that a full node doesn't fail the faults
+  unsigned long node_mask = 1UL << node;
+  if (syscall(SYS_mbind, reserved_space_, reserved_space_size_,
+              MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8, 0) != 0) {
+    LOG_WARN << "Allocator::BindToNode mbind error, node=" << node
+             << " errno=" << errno;
+    return false;
+  }
+  LOG_DEBUG << "Allocator::BindToNode node=" << node;
+  return true;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
 void Allocator::Release(char* slab) {
   if (reserved_space_ == nullptr || slab < reserved_space_ ||
       slab >= reserved_space_ + reserved_space_size_) {
-    LOG_INFO << "Allocator::Release delete buffer";
+    LOG_DEBUG << "Allocator::Release delete buffer";
     delete []slab;
   } else {
     free_slabs_.insert(slab);
-    LOG_INFO << "Allocator::Release recycle " << (void*)slab
-             << " free_count=" << free_slabs_.size();
+    LOG_DEBUG << "Allocator::Release recycle " << (void*)slab
+              << " free_count=" << free_slabs_.size();
   }
 }
 
@@ -10,6 +10,10 @@ public:
   Allocator(int buffer_size, int reserved_size);
   char* Alloc();
   void Release(char*);
+  // prefers the pages of the reserved space not touched yet on the NUMA node,
+  // before the worker thread pinned on it touches them
+  // return : false if not supported, e.g. no reserved space or not Linux
+  bool BindToNode(int node);
   int buffer_size() const {
     return buffer_size_;
   }
@@ -18,6 +22,7 @@ private:
 
   char* reserved_space_;
   int reserved_space_size_;
+  bool reserved_space_mapped_ = false;
 
   std::set<char*> free_slabs_;
 };
@@ -11,6 +11,9 @@
 
 namespace yarmproxy {
 
+// don't hedge queries larger than this, e.g. mget of plenty of keys
+static const size_t kMaxHedgeQueryBytes = 16 * 1024;
+
 BackendConn::BackendConn(WorkerContext& context,
       const Endpoint& endpoint)
     : context_(context)
@@ -18,8 +21,12 @@ BackendConn::BackendConn(WorkerContext& context,
           context.allocator_->buffer_size()))
     , remote_endpoint_(endpoint)
     , socket_(context.io_context_)
-    , write_timer_(context.io_context_)
-    , read_timer_(context.io_context_) {
+    , hedge_timer_(context.io_context_)
+    , write_timer_(*context.timing_wheel_,
+                   [this]() { OnTimeout(write_timeout_code_); })
+    , write_timeout_code_(ErrorCode::E_BACKEND_WRITE_TIMEOUT)
+    , read_timer_(*context.timing_wheel_,
+                  [this]() { OnTimeout(ErrorCode::E_BACKEND_READ_TIMEOUT); }) {
   ++g_stats_.backend_conns_;
   LOG_DEBUG << "BackendConn ctor, count=" << g_stats_.backend_conns_;
 }
@@ -30,6 +37,7 @@ BackendConn::~BackendConn() {
   if (socket_.is_open()) {
     socket_.close();
   }
+  DropHedge();
 
   context_.allocator_->Release(buffer_->data());
   delete buffer_;
@@ -40,6 +48,8 @@ void BackendConn::Close() {
     return;
   }
   socket_.close();
+  hedge_timer_.cancel();
+  DropHedge();
   aborted_ = true;
 }
 
@@ -53,12 +63,26 @@ void BackendConn::Abort(ErrorCode ec) {
   is_reading_reply_ = false;
 
   socket_.close();
-  write_timer_.cancel();
-  read_timer_.cancel();
+  hedge_timer_.cancel();
+  DropHedge();
+  write_timer_.Disarm();
+  read_timer_.Disarm();
   write_timer_canceled_ = true;
   read_timer_canceled_ = true;
 }
 
+void BackendConn::NotifyQuerySent(ErrorCode ec) {
+  if (auto handler = handler_.lock()) {
+    handler->OnWriteQueryFinished(shared_from_this(), ec);
+  }
+}
+
+void BackendConn::NotifyReplyReceived(ErrorCode ec) {
+  if (auto handler = handler_.lock()) {
+    handler->OnBackendReplyReceived(shared_from_this(), ec);
+  }
+}
+
 void BackendConn::SetReplyData(const char* data, size_t bytes, bool parsed) {
   // assert(is_reading_reply_ == false);
   buffer()->Reset();
@@ -66,10 +90,15 @@ void BackendConn::SetReplyData(const char* data, size_t bytes, bool parsed) {
 }
 
 void BackendConn::Reset() {
-  assert(no_recycle_ == false);
+  // the error reply of a circuit open connection doesn't prevent recycling it
+  assert(no_recycle_ == false || circuit_open_);
+  no_recycle_ = false;
   is_reading_reply_ = false;
   has_read_some_reply_ = false;
   reply_recv_complete_  = false;
+  hedgeable_ = false;
+  waiting_first_reply_ = false;
+  hedge_query_.clear();
 
   write_timer_canceled_ = false;
   read_timer_canceled_ = false;
@@ -82,6 +111,31 @@ void BackendConn::ReadReply() {
   read_timer_canceled_ = false;
   UpdateTimer(read_timer_, ErrorCode::E_BACKEND_READ_TIMEOUT);
 
+  if (hedgeable_ && !has_read_some_reply_) {
+    hedgeable_ = false; // at most one hedge for a query
+    hedge_budget_->OnRead();
+    auto delay = latency_estimator_->Percentile(hedge_percentile_);
+    if (delay > LatencyEstimator::Clock::duration::zero()) {
+      // wait for readability instead of reading, so that no data is consumed
+      // from the loser when the replica wins
+      waiting_first_reply_ = true;
+      std::weak_ptr<BackendConn> wptr(shared_from_this());
+      hedge_timer_.expires_after(delay);
+      hedge_timer_.async_wait([wptr](const boost::system::error_code& ec) {
+            if (auto ptr = wptr.lock()) {
+              ptr->OnHedgeTimeout(ec);
+            }
+          });
+      socket_.async_wait(ConnSocket::wait_read,
+          std::bind(&BackendConn::HandleReadable, shared_from_this(),
+              std::placeholders::_1));
+      return;
+    }
+  }
+  AsyncReadSome();
+}
+
+void BackendConn::AsyncReadSome() {
   socket_.async_read_some(
       boost::asio::buffer(buffer_->free_space_begin(),
           buffer_->free_space_size()),
@@ -98,15 +152,32 @@ void BackendConn::TryReadMoreReply() {
 }
 
 void BackendConn::WriteQuery(const char* data, size_t bytes) {
+  if (circuit_open_) {
+    std::weak_ptr<BackendConn> wptr(shared_from_this());
+    context_.io_context_.post([wptr]() {
+      if (auto ptr = wptr.lock()) {
+        ptr->NotifyQuerySent(ErrorCode::E_CIRCUIT_OPEN);
+      }
+    });
+    return;
+  }
   if (aborted_) {
     std::weak_ptr<BackendConn> wptr(shared_from_this());
     context_.io_context_.post([wptr]() {
       if (auto ptr = wptr.lock()) {
-        ptr->query_sent_callback_(ErrorCode::E_WRITE_QUERY);
+        ptr->NotifyQuerySent(ErrorCode::E_WRITE_QUERY);
       }
     });
     return;
   }
+  if (hedgeable_) {
+    if (hedge_query_.size() + bytes > kMaxHedgeQueryBytes) {
+      hedgeable_ = false;
+      hedge_query_.clear();
+    } else {
+      hedge_query_.append(data, bytes);
+    }
+  }
   if (!socket_.is_open()) {
     UpdateTimer(write_timer_, ErrorCode::E_BACKEND_CONNECT_TIMEOUT);
     write_timer_canceled_ = false;
@@ -119,7 +190,7 @@ void BackendConn::WriteQuery(const char* data, size_t bytes) {
   UpdateTimer(write_timer_, ErrorCode::E_BACKEND_WRITE_TIMEOUT);
   write_timer_canceled_ = false;
 
-  boost::asio::async_write(socket_, boost::asio::buffer(data, bytes),
+  AsyncWrite(socket_, data, bytes,
           std::bind(&BackendConn::HandleWrite, shared_from_this(), data, bytes,
               std::placeholders::_1, std::placeholders::_2));
 }
@@ -130,14 +201,14 @@ void BackendConn::HandleWrite(const char * data, const size_t bytes,
   if (aborted_) {
     return;
   }
-  write_timer_.cancel();
+  write_timer_.Disarm();
   write_timer_canceled_ = true;
 
   if (error) {
     LOG_INFO << "BackendConn::HandleWrite error, backend=" << this
              << " ep=" << remote_endpoint_ << " err=" << error.message();
     socket_.close();
-    query_sent_callback_(ErrorCode::E_WRITE_QUERY);
+    NotifyQuerySent(ErrorCode::E_WRITE_QUERY);
     return;
   }
 
@@ -146,14 +217,16 @@ void BackendConn::HandleWrite(const char * data, const size_t bytes,
     LOG_ERROR << "HandleWrite 向 backend 没写完, 继续写. backend=" << this;
     UpdateTimer(write_timer_, ErrorCode::E_BACKEND_WRITE_TIMEOUT);
     write_timer_canceled_ = false;
-    boost::asio::async_write(socket_,
-        boost::asio::buffer(data + bytes_transferred, bytes - bytes_transferred),
+    AsyncWrite(socket_, data + bytes_transferred, bytes - bytes_transferred,
         std::bind(&BackendConn::HandleWrite, shared_from_this(),
                   data + bytes_transferred, bytes - bytes_transferred,
                   std::placeholders::_1, std::placeholders::_2));
   } else {
     LOG_DEBUG << "HandleWrite 向 backend 写完, 触发回调. backend=" << this;
-    query_sent_callback_(ErrorCode::E_SUCCESS);
+    if (latency_estimator_ != nullptr) {
+      query_sent_time_ = LatencyEstimator::Clock::now();
+    }
+    NotifyQuerySent(ErrorCode::E_SUCCESS);
   }
 }
 
@@ -162,7 +235,7 @@ void BackendConn::HandleRead(const boost::system::error_code& error,
   if (aborted_) {
     return;
   }
-  read_timer_.cancel();
+  read_timer_.Disarm();
   read_timer_canceled_ = true;
 
   is_reading_reply_ = false;
@@ -170,8 +243,13 @@ void BackendConn::HandleRead(const boost::system::error_code& error,
     LOG_INFO << "HandleRead read error, backend=" << this
              << " ep=" << remote_endpoint_ << " err=" << error.message();
     socket_.close();
-    reply_received_callback_(ErrorCode::E_READ_REPLY);
+    NotifyReplyReceived(ErrorCode::E_READ_REPLY);
   } else {
+    if (!has_read_some_reply_ && latency_estimator_ != nullptr) {
+      // it's a lower bound of the latency if the hedge replica wins
+      latency_estimator_->AddSample(
+          LatencyEstimator::Clock::now() - query_sent_time_);
+    }
     has_read_some_reply_ = true;
     g_stats_.bytes_from_backends_ += bytes_transferred;
     LOG_DEBUG << "HandleRead read ok, bytes_transferred="
@@ -180,7 +258,23 @@ void BackendConn::HandleRead(const boost::system::error_code& error,
     buffer_->update_received_bytes(bytes_transferred);
     buffer_->dec_recycle_lock();
 
-    reply_received_callback_(ErrorCode::E_SUCCESS);
+    NotifyReplyReceived(ErrorCode::E_SUCCESS);
+  }
+}
+
+static void SetSocketOptions(ConnSocket& socket,
+                             boost::system::error_code& option_ec) {
+  boost::asio::ip::tcp::no_delay no_delay(true);
+  socket.set_option(no_delay, option_ec);
+
+  if (!option_ec) {
+    boost::asio::socket_base::keep_alive keep_alive(true);
+    socket.set_option(keep_alive, option_ec);
+  }
+
+  if (!option_ec) {
+    boost::asio::socket_base::linger linger(true, 0);
+    socket.set_option(linger, option_ec);
   }
 }
 
@@ -189,22 +283,11 @@ void BackendConn::HandleConnect(const char * data, size_t bytes,
   if (aborted_) {
     return;
   }
-  write_timer_.cancel();
+  write_timer_.Disarm();
   write_timer_canceled_ = true;
   boost::system::error_code option_ec;
   if (!connect_ec) {
-    boost::asio::ip::tcp::no_delay no_delay(true);
-    socket_.set_option(no_delay, option_ec);
-
-    if (!option_ec) {
-      boost::asio::socket_base::keep_alive keep_alive(true);
-      socket_.set_option(keep_alive, option_ec);
-    }
-
-    if (!option_ec) {
-      boost::asio::socket_base::linger linger(true, 0);
-      socket_.set_option(linger, option_ec);
-    }
+    SetSocketOptions(socket_, option_ec);
   }
 
   if (connect_ec || option_ec) {
@@ -214,27 +297,120 @@ void BackendConn::HandleConnect(const char * data, size_t bytes,
              << " endpoint=" << remote_endpoint_
              << " backend=" << this;
     ++g_stats_.backend_connect_errors_;
-    query_sent_callback_(ErrorCode::E_CONNECT);
+    NotifyQuerySent(ErrorCode::E_CONNECT);
     return;
   }
 
   UpdateTimer(write_timer_, ErrorCode::E_BACKEND_WRITE_TIMEOUT);
   write_timer_canceled_ = false;
-  boost::asio::async_write(socket_, boost::asio::buffer(data, bytes),
+  AsyncWrite(socket_, data, bytes,
       std::bind(&BackendConn::HandleWrite, shared_from_this(), data, bytes,
           std::placeholders::_1, std::placeholders::_2));
 }
 
 
-void BackendConn::OnTimeout(const boost::system::error_code& ec, ErrorCode timeout_code) {
-  if (aborted_) {
+void BackendConn::HandleReadable(const boost::system::error_code& error) {
+  if (aborted_ || hedge_switched_ ||
+      error == boost::asio::error::operation_aborted) {
+    return; // the hedge replica won
+  }
+  waiting_first_reply_ = false;
+  hedge_timer_.cancel();
+  DropHedge();
+  AsyncReadSome(); // the error, if any, is reported by the read
+}
+
+void BackendConn::OnHedgeTimeout(const boost::system::error_code& error) {
+  if (error || aborted_ || !waiting_first_reply_ || hedge_socket_) {
+    return;
+  }
+  if (!hedge_budget_->TryAcquire()) {
+    LOG_DEBUG << "BackendConn " << this << " no hedge budget, ep="
+              << remote_endpoint_;
+    return;
+  }
+  ++g_stats_.hedged_reads_;
+  LOG_DEBUG << "BackendConn " << this << " hedge the read of " << remote_endpoint_
+            << " to " << hedge_endpoint_;
+  hedge_socket_.reset(new ConnSocket(context_.io_context_));
+  hedge_socket_->async_connect(hedge_endpoint_,
+      std::bind(&BackendConn::HandleHedgeConnect, shared_from_this(),
+          hedge_socket_, std::placeholders::_1));
+}
+
+void BackendConn::HandleHedgeConnect(
+    std::shared_ptr<ConnSocket> hedge_socket,
+    const boost::system::error_code& error) {
+  if (aborted_ || hedge_socket != hedge_socket_) {
+    return;
+  }
+  boost::system::error_code option_ec;
+  if (!error) {
+    SetSocketOptions(*hedge_socket, option_ec);
+  }
+  if (error || option_ec) {
+    LOG_INFO << "BackendConn " << this << " hedge connect error, ep="
+             << hedge_endpoint_;
+    DropHedge();
     return;
   }
+  AsyncWrite(*hedge_socket, hedge_query_.data(), hedge_query_.size(),
+      std::bind(&BackendConn::HandleHedgeWrite, shared_from_this(),
+          hedge_socket, std::placeholders::_1, std::placeholders::_2));
+}
 
-  if (ec == boost::asio::error::operation_aborted) {
-    // timer was cancelled, take no action.
+void BackendConn::HandleHedgeWrite(
+    std::shared_ptr<ConnSocket> hedge_socket,
+    const boost::system::error_code& error, size_t) {
+  if (aborted_ || hedge_socket != hedge_socket_) {
     return;
   }
+  if (error) {
+    DropHedge();
+    return;
+  }
+  hedge_socket->async_wait(ConnSocket::wait_read,
+      std::bind(&BackendConn::HandleHedgeReadable, shared_from_this(),
+          hedge_socket, std::placeholders::_1));
+}
+
+void BackendConn::HandleHedgeReadable(
+    std::shared_ptr<ConnSocket> hedge_socket,
+    const boost::system::error_code& error) {
+  if (aborted_ || hedge_socket != hedge_socket_) {
+    return;
+  }
+  boost::system::error_code available_ec;
+  if (error || hedge_socket->available(available_ec) == 0 || available_ec) {
+    DropHedge(); // closed by the replica
+    return;
+  }
+
+  // the replica replies first, drop the primary connection which has a
+  // pending query, and go on reading from the replica
+  ++g_stats_.hedged_read_wins_;
+  LOG_DEBUG << "BackendConn " << this << " hedge won, ep=" << hedge_endpoint_;
+  waiting_first_reply_ = false;
+  hedge_switched_ = true;
+  socket_.close();
+  socket_ = std::move(*hedge_socket);
+  hedge_socket_.reset();
+  AsyncReadSome();
+}
+
+void BackendConn::DropHedge() {
+  if (hedge_socket_) {
+    hedge_socket_->close();
+    hedge_socket_.reset();
+  }
+}
+
+void BackendConn::OnTimeout(ErrorCode timeout_code) {
+  if (aborted_) {
+    return;
+  }
+  // the callbacks might release the last reference of this connection
+  std::shared_ptr<BackendConn> self(shared_from_this());
 
   LOG_WARN << "BackendConn " << this << " timeout. timeout_code=" << ErrorCodeString(timeout_code)
            << " endpoint=" << remote_endpoint_
@@ -246,21 +422,30 @@ void BackendConn::OnTimeout(const boost::system::error_code& ec, ErrorCode timeo
   case ErrorCode::E_BACKEND_CONNECT_TIMEOUT:
     if (!write_timer_canceled_) {
       ++g_stats_.backend_connect_timeouts_;
-      query_sent_callback_(timeout_code);
+      if (latency_estimator_ != nullptr) {
+        latency_estimator_->OnTimeout();
+      }
+      NotifyQuerySent(timeout_code);
       Abort(timeout_code);
     }
     break;
   case ErrorCode::E_BACKEND_WRITE_TIMEOUT:
     if (!write_timer_canceled_) {
       ++g_stats_.backend_write_timeouts_;
-      query_sent_callback_(timeout_code);
+      if (latency_estimator_ != nullptr) {
+        latency_estimator_->OnTimeout();
+      }
+      NotifyQuerySent(timeout_code);
       Abort(timeout_code);
     }
     break;
   case ErrorCode::E_BACKEND_READ_TIMEOUT:
     if (!read_timer_canceled_) {
       ++g_stats_.backend_read_timeouts_;
-      reply_received_callback_(timeout_code);
+      if (latency_estimator_ != nullptr) {
+        latency_estimator_->OnTimeout();
+      }
+      NotifyReplyReceived(timeout_code);
       Abort(timeout_code);
     }
     break;
@@ -270,20 +455,18 @@ void BackendConn::OnTimeout(const boost::system::error_code& ec, ErrorCode timeo
   }
 }
 
-void BackendConn::UpdateTimer(boost::asio::steady_timer& timer, ErrorCode timeout_code) {
-  int timeout = Config::Instance().socket_rw_timeout();
-  size_t canceled = timer.expires_after(std::chrono::milliseconds(timeout));
+void BackendConn::UpdateTimer(WheelTimer& timer, ErrorCode timeout_code) {
+  int timeout = (latency_estimator_ != nullptr &&
+                 latency_estimator_->enabled()) ?
+                latency_estimator_->Timeout() :
+                Config::Instance().socket_rw_timeout();
+  if (&timer == &write_timer_) {
+    write_timeout_code_ = timeout_code;
+  }
+  timer.Arm(timeout);
   LOG_DEBUG << "BackendConn UpdateTimer timeout=" << timeout
            << " backend=" << this
-           << " timeout_code=" << ErrorCodeString(timeout_code)
-           << " canceled=" << canceled;
-
-  std::weak_ptr<BackendConn> wptr(shared_from_this());
-  timer.async_wait([wptr, timeout_code](const boost::system::error_code& ec) {
-        if (auto ptr = wptr.lock()) {
-          ptr->OnTimeout(ec, timeout_code);
-        }
-      });
+           << " timeout_code=" << ErrorCodeString(timeout_code);
 }
 
 }
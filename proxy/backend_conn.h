@@ -3,11 +3,17 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include "backend_handler.h"
+#include "conn_socket.h"
+#include "hedge_budget.h"
+#include "latency_estimator.h"
 #include "read_buffer.h"
+#include "timing_wheel.h"
 
 namespace yarmproxy {
 using Endpoint = boost::asio::ip::tcp::endpoint;
@@ -17,9 +23,6 @@ class ReadBuffer;
 
 enum class ErrorCode;
 
-typedef std::function<void(ErrorCode ec)> BackendReplyReceivedCallback;
-typedef std::function<void(ErrorCode ec)> BackendQuerySentCallback;
-
 class BackendConn : public std::enable_shared_from_this<BackendConn> {
 public:
   BackendConn(WorkerContext& context, const Endpoint& endpoint);
@@ -32,11 +35,8 @@ public:
 
   void SetReplyData(const char* data, size_t bytes, bool parsed = true);
 
-  void SetReadWriteCallback(
-      const BackendQuerySentCallback& query_sent_callback,
-      const BackendReplyReceivedCallback& reply_received_callback) {
-    query_sent_callback_ = query_sent_callback;
-    reply_received_callback_ = reply_received_callback;
+  void SetHandler(std::weak_ptr<BackendHandler> handler) {
+    handler_ = std::move(handler);
   }
 private:
   void HandleWrite(const char * buf, const size_t bytes,
@@ -70,7 +70,8 @@ public:
     return reply_recv_complete_;
   }
   bool recyclable() const {
-    return !no_recycle_ && finished();
+    // a connection switched to the hedge replica can't serve the endpoint
+    return !no_recycle_ && !hedge_switched_ && finished();
   }
   bool has_read_some_reply() const {
     return has_read_some_reply_;
@@ -78,14 +79,53 @@ public:
   bool error() const {
     return no_recycle_;
   }
+  // fail all queries immediately, used when the circuit breaker is open
+  void set_circuit_open() {
+    circuit_open_ = true;
+  }
+  bool circuit_open() const {
+    return circuit_open_;
+  }
+  // owned by the BackendConnPool, which outlives its connections
+  void set_latency_estimator(LatencyEstimator* estimator) {
+    latency_estimator_ = estimator;
+  }
+  // hedging is disabled if percentile is 0. budget is owned by the pool too
+  void set_hedging(const Endpoint& replica, int percentile,
+                   HedgeBudget* budget) {
+    hedge_endpoint_ = replica;
+    hedge_percentile_ = percentile;
+    hedge_budget_ = budget;
+  }
+  // called by idempotent read commands before writing the query, so that
+  // the query could be resent to the replica if the reply is late
+  void set_hedgeable() {
+    hedgeable_ = hedge_percentile_ > 0 && latency_estimator_ != nullptr;
+  }
+private:
+  void AsyncReadSome();
+  void HandleReadable(const boost::system::error_code& error);
+
+  void OnHedgeTimeout(const boost::system::error_code& error);
+  void HandleHedgeConnect(
+      std::shared_ptr<ConnSocket> hedge_socket,
+      const boost::system::error_code& error);
+  void HandleHedgeWrite(
+      std::shared_ptr<ConnSocket> hedge_socket,
+      const boost::system::error_code& error, size_t bytes_transferred);
+  void HandleHedgeReadable(
+      std::shared_ptr<ConnSocket> hedge_socket,
+      const boost::system::error_code& error);
+  void DropHedge();
 private:
   WorkerContext& context_;
   ReadBuffer* buffer_;
   Endpoint remote_endpoint_;
-  boost::asio::ip::tcp::socket socket_;
+  ConnSocket socket_;
 
-  BackendReplyReceivedCallback reply_received_callback_;
-  BackendQuerySentCallback query_sent_callback_;
+  std::weak_ptr<BackendHandler> handler_;
+  void NotifyQuerySent(ErrorCode ec);
+  void NotifyReplyReceived(ErrorCode ec);
 
   // TODO : merge them into a flags var?
   bool no_recycle_          = false; // is it redundant with aborted_?
@@ -93,14 +133,29 @@ private:
   bool is_reading_reply_    = false;
   bool has_read_some_reply_ = false;
   bool reply_recv_complete_ = false;
-
-  boost::asio::steady_timer write_timer_;
+  bool circuit_open_        = false;
+
+  LatencyEstimator* latency_estimator_ = nullptr;
+  LatencyEstimator::Clock::time_point query_sent_time_;
+
+  Endpoint hedge_endpoint_;
+  int hedge_percentile_ = 0;
+  HedgeBudget* hedge_budget_ = nullptr;
+  bool hedgeable_           = false;
+  bool waiting_first_reply_ = false; // waiting the primary or the replica
+  bool hedge_switched_      = false; // the replica replied first
+  std::string hedge_query_;          // copy of the query for resending
+  std::shared_ptr<ConnSocket> hedge_socket_;
+  boost::asio::steady_timer hedge_timer_;
+
+  WheelTimer write_timer_; // of the connect, or of the write
+  ErrorCode write_timeout_code_;
   bool write_timer_canceled_ = false;
-  boost::asio::steady_timer read_timer_;
+  WheelTimer read_timer_;
   bool read_timer_canceled_ = false;
 
-  void UpdateTimer(boost::asio::steady_timer& timer, ErrorCode timeout_code);
-  void OnTimeout(const boost::system::error_code& error, ErrorCode timeout_code);
+  void UpdateTimer(WheelTimer& timer, ErrorCode timeout_code);
+  void OnTimeout(ErrorCode timeout_code);
 };
 
 }
@@ -0,0 +1,26 @@
+#ifndef _YARMPROXY_BACKEND_HANDLER_H_
+#define _YARMPROXY_BACKEND_HANDLER_H_
+
+#include <memory>
+
+namespace yarmproxy {
+
+class BackendConn;
+enum class ErrorCode;
+
+// the receiver of the completions of the query and the reply of a backend
+// connection, i.e. a command. it's held weakly, so that the completions for
+// a destroyed handler are dropped, and it's statically typed, so that it
+// costs no std::function allocation per query.
+class BackendHandler {
+public:
+  virtual ~BackendHandler() {}
+  virtual void OnWriteQueryFinished(std::shared_ptr<BackendConn> backend,
+                                    ErrorCode ec) = 0;
+  virtual void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
+                                      ErrorCode ec) = 0;
+};
+
+}
+
+#endif // _YARMPROXY_BACKEND_HANDLER_H_
@@ -0,0 +1,81 @@
+#include "backend_monitor.h"
+
+#include <memory>
+
+#include "logging.h"
+
+#include "config.h"
+#include "stats.h"
+
+namespace yarmproxy {
+
+void BackendMonitor::Eject(const Endpoint& ep) {
+  io_context_.post([this, ep]() {
+        DoEject(ep);
+      });
+}
+
+void BackendMonitor::DoEject(const Endpoint& ep) {
+  if (!ejected_backends_.insert(ep).second) {
+    return; // already ejected, reported by another worker
+  }
+  ++g_stats_.ejected_backends_;
+  ++g_stats_.backend_ejections_;
+  LOG_WARN << "BackendMonitor eject backend " << ep
+           << ", ejected_backends=" << ejected_backends_.size();
+
+  on_ejected_changed_();
+  ScheduleProbe(ep);
+}
+
+void BackendMonitor::ScheduleProbe(const Endpoint& ep) {
+  std::shared_ptr<boost::asio::steady_timer> timer(
+      new boost::asio::steady_timer(io_context_));
+  timer->expires_after(std::chrono::milliseconds(
+      Config::Instance().backend_retry_interval()));
+  timer->async_wait([this, timer, ep](const boost::system::error_code& ec) {
+        if (!ec) {
+          Probe(ep);
+        }
+      });
+}
+
+void BackendMonitor::Probe(const Endpoint& ep) {
+  std::shared_ptr<boost::asio::ip::tcp::socket> socket(
+      new boost::asio::ip::tcp::socket(io_context_));
+  std::shared_ptr<boost::asio::steady_timer> timer(
+      new boost::asio::steady_timer(io_context_));
+
+  timer->expires_after(std::chrono::milliseconds(
+      Config::Instance().socket_rw_timeout()));
+  timer->async_wait([socket](const boost::system::error_code& ec) {
+        if (!ec) {
+          socket->close(); // connect timeout, abort the probe
+        }
+      });
+
+  socket->async_connect(ep, [this, socket, timer, ep](
+        const boost::system::error_code& ec) {
+        timer->cancel();
+        socket->close();
+        OnProbeFinished(ep, !ec);
+      });
+}
+
+void BackendMonitor::OnProbeFinished(const Endpoint& ep, bool ok) {
+  if (!ok) {
+    LOG_INFO << "BackendMonitor probe failed, backend=" << ep;
+    ScheduleProbe(ep);
+    return;
+  }
+
+  ejected_backends_.erase(ep);
+  --g_stats_.ejected_backends_;
+  ++g_stats_.backend_recoveries_;
+  LOG_WARN << "BackendMonitor backend " << ep << " recovered"
+           << ", ejected_backends=" << ejected_backends_.size();
+  on_ejected_changed_();
+}
+
+}
+
@@ -0,0 +1,44 @@
+#ifndef _YARMPROXY_BACKEND_MONITOR_H_
+#define _YARMPROXY_BACKEND_MONITOR_H_
+
+#include <functional>
+#include <set>
+
+#include <boost/asio.hpp>
+
+namespace yarmproxy {
+
+using Endpoint = boost::asio::ip::tcp::endpoint;
+
+// Keeps the set of ejected backends, and probes them periodically. All the
+// members except Eject() should be accessed in the thread running io_context.
+class BackendMonitor {
+public:
+  BackendMonitor(boost::asio::io_service& io_context,
+                 const std::function<void()>& on_ejected_changed)
+      : io_context_(io_context)
+      , on_ejected_changed_(on_ejected_changed) {
+  }
+
+  // thread-safe, called by workers when a backend keeps failing
+  void Eject(const Endpoint& ep);
+
+  const std::set<Endpoint>& ejected_backends() const {
+    return ejected_backends_;
+  }
+
+private:
+  void DoEject(const Endpoint& ep);
+  void ScheduleProbe(const Endpoint& ep);
+  void Probe(const Endpoint& ep);
+  void OnProbeFinished(const Endpoint& ep, bool ok);
+
+  boost::asio::io_service& io_context_;
+  std::function<void()> on_ejected_changed_;
+  std::set<Endpoint> ejected_backends_;
+};
+
+}
+
+#endif // _YARMPROXY_BACKEND_MONITOR_H_
+
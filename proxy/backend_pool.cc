@@ -1,8 +1,12 @@
 #include "backend_pool.h"
 
 #include "backend_conn.h"
+#include "backend_monitor.h"
 #include "config.h"
+#include "key_locator.h"
 #include "logging.h"
+#include "stats.h"
+#include "worker_pool.h"
 
 namespace yarmproxy {
 
@@ -12,15 +16,37 @@ std::shared_ptr<BackendConn> BackendConnPool::Allocate(const Endpoint & ep){
   //return backend;
   }
   std::shared_ptr<BackendConn> backend;
-  auto it = conn_map_.find(ep);
-  if ((it != conn_map_.end()) && (!it->second.empty())) {
-    backend = it->second.front();
-    it->second.pop();
-    LOG_DEBUG << "BackendConnPool::Allocate reuse, backend=" << backend << " ep=" << ep << ", idles=" << it->second.size();
+  EndpointState& state = endpoint_states_[ep];
+  if (Config::Instance().circuit_breaker_error_rate() > 0 &&
+      !state.circuit_breaker_.AllowRequest(CircuitBreaker::Clock::now())) {
+    if (!state.circuit_open_conns_.empty()) {
+      backend = state.circuit_open_conns_.front();
+      state.circuit_open_conns_.pop();
+    } else {
+      backend.reset(new BackendConn(context_, ep));
+      backend->set_circuit_open();
+    }
+    LOG_DEBUG << "BackendConnPool::Allocate circuit open, backend=" << backend << " ep=" << ep;
+  } else if (!state.idle_conns_.empty()) {
+    backend = state.idle_conns_.front();
+    state.idle_conns_.pop();
+    LOG_DEBUG << "BackendConnPool::Allocate reuse, backend=" << backend << " ep=" << ep << ", idles=" << state.idle_conns_.size();
   } else {
     backend.reset(new BackendConn(context_, ep));
     LOG_DEBUG << "BackendConnPool::Allocate create, backend=" << backend << " ep=" << ep;
   }
+  if (!backend->circuit_open()) {
+    ++state.in_flight_;
+    const auto& locator = context_.key_locator_;
+    if (state.key_locator_.owner_before(locator) ||
+        locator.owner_before(state.key_locator_)) {
+      state.key_locator_ = locator;
+      UpdateBackendOptions(locator->backend_options(ep), state);
+    }
+    backend->set_latency_estimator(&state.latency_estimator_);
+    backend->set_hedging(state.hedge_replica_, state.hedge_percentile_,
+                         &state.hedge_budget_);
+  }
   auto res = active_conns_.insert(std::make_pair(backend, ep));
   assert(res.second);
   return backend;
@@ -40,10 +66,31 @@ void BackendConnPool::Release(std::shared_ptr<BackendConn> backend) {
     return;
   }
 
-  const Endpoint & ep = ep_it->second;
+  const Endpoint ep = ep_it->second;
   LOG_DEBUG << "BackendConnPool::Release backend=" << backend << " ep=" << ep;
   active_conns_.erase(ep_it);
 
+  EndpointState& state = endpoint_states_[ep];
+  if (backend->circuit_open()) {
+    // never connected. recycled once its error reply is written, i.e. no
+    // completion of its query is pending any more
+    if (backend->finished() && state.circuit_open_conns_.size() <
+            Config::Instance().worker_max_idle_backends()) {
+      backend->Reset();
+      state.circuit_open_conns_.push(backend);
+    } else {
+      backend->Close();
+    }
+    return;
+  }
+
+  --state.in_flight_;
+  if (backend->error()) {
+    OnBackendFailure(ep, state);
+  } else if (backend->has_read_some_reply()) {
+    OnBackendSuccess(state);
+  }
+
   if (!backend->recyclable()) {
     LOG_DEBUG << "BackendConnPool::Release unrecyclable backend=" << backend
              << " finished=" << backend->finished()
@@ -52,24 +99,117 @@ void BackendConnPool::Release(std::shared_ptr<BackendConn> backend) {
     return;
   }
 
-  const auto it = conn_map_.find(ep);
-  if (it == conn_map_.end()) {
+  if (state.idle_conns_.size() >= Config::Instance().worker_max_idle_backends()){
+    LOG_WARN << "BackendConnPool::Release overflow, backend=" << backend
+             << " ep=" << ep << " destroyed, pool_size=" << state.idle_conns_.size();
+    backend->Close();
+  } else {
     backend->Reset();
-    conn_map_[ep].push(backend);
-    LOG_DEBUG << "BackendConnPool::Release ok, backend=" << backend << " ep=" << ep << " pool_size=1";
+    state.idle_conns_.push(backend);
+    LOG_DEBUG << "BackendConnPool::Release ok, backend=" << backend
+              << " ep=" << ep << " pool_size=" << state.idle_conns_.size();
+  }
+}
+
+Endpoint BackendConnPool::SelectReadEndpoint(const Endpoint& primary) {
+  const KeyLocator::BackendOptions* options =
+      context_.key_locator_->backend_options(primary);
+  if (options == nullptr || !options->read_from_replicas_ ||
+      options->replicas_.empty()) {
+    return primary;
+  }
+
+  auto now = CircuitBreaker::Clock::now();
+  size_t chosen = PowerOfTwoChoices(options->replicas_.size(), random_,
+      [&](size_t i) {
+        return ReadCost(i == 0 ? primary : options->replicas_[i - 1], now);
+      });
+  return chosen == 0 ? primary : options->replicas_[chosen - 1];
+}
+
+Endpoint BackendConnPool::SelectReadEndpoint(const Endpoint& primary,
+                                            const char* key, size_t len,
+                                            ProtocolType protocol,
+                                            KeyLocator::LoadSum* load_sum) {
+  const auto& locator = context_.key_locator_;
+  const KeyLocator::BackendOptions* options =
+      locator->backend_options(primary);
+  if (options == nullptr || options->bounded_load_ <= 0) {
+    return SelectReadEndpoint(primary);
+  }
+
+  bool spilled = false;
+  Endpoint ep = locator->LocateBounded(key, len, protocol,
+      options->bounded_load_, [this](const Endpoint& ep) {
+        auto it = endpoint_states_.find(ep);
+        return it == endpoint_states_.end() ? size_t(0) : it->second.in_flight_;
+      }, load_sum, &spilled);
+  ++g_stats_.bounded_load_reads_;
+  if (spilled) {
+    ++g_stats_.bounded_load_spills_;
+    LOG_DEBUG << "BackendConnPool::SelectReadEndpoint spill from " << primary
+              << " to " << ep;
+  }
+  return SelectReadEndpoint(ep);
+}
+
+bool BackendConnPool::LoadBounded(const Endpoint& primary) const {
+  const KeyLocator::BackendOptions* options =
+      context_.key_locator_->backend_options(primary);
+  return options != nullptr && options->bounded_load_ > 0;
+}
+
+uint64_t BackendConnPool::ReadCost(const Endpoint& ep,
+                                   CircuitBreaker::Clock::time_point now) {
+  EndpointState& state = endpoint_states_[ep];
+  if (state.circuit_breaker_.IsOpen(now)) {
+    return UINT64_MAX;
+  }
+  // endpoints without latency samples yet are preferred, to learn about them
+  return (state.in_flight_ + 1) *
+         uint64_t(state.latency_estimator_.srtt() + 1);
+}
+
+void BackendConnPool::UpdateBackendOptions(
+    const KeyLocator::BackendOptions* options, EndpointState& state) {
+  if (options == nullptr) {
+    state.latency_estimator_.set_timeout_range(0, 0);
+    state.hedge_percentile_ = 0;
+    return;
+  }
+  state.latency_estimator_.set_timeout_range(options->min_timeout_,
+                                             options->max_timeout_);
+  if (options->hedge_percentile_ > 0 && !options->replicas_.empty()) {
+    state.hedge_percentile_ = options->hedge_percentile_;
+    state.hedge_replica_ = options->replicas_.front();
+    state.hedge_budget_.set_ratio(options->hedge_budget_);
   } else {
-    if (it->second.size() >= Config::Instance().worker_max_idle_backends()){
-      LOG_WARN << "BackendConnPool::Release overflow, backend=" << backend
-               << " ep=" << ep << " destroyed, pool_size=" << it->second.size();
-      backend->Close();
-    } else {
-      backend->Reset();
-      it->second.push(backend);
-      LOG_DEBUG << "BackendConnPool::Release ok, backend=" << backend
-                << " ep=" << ep << " pool_size=" << it->second.size();
-    }
+    state.hedge_percentile_ = 0;
   }
 }
 
+void BackendConnPool::OnBackendFailure(const Endpoint& ep,
+                                       EndpointState& state) {
+  state.circuit_breaker_.OnRequestFinished(false,
+                                           CircuitBreaker::Clock::now());
+
+  int limit = Config::Instance().backend_failure_limit();
+  if (limit <= 0 || context_.backend_monitor_ == nullptr) {
+    return;
+  }
+  if (++state.consecutive_failures_ >= limit) {
+    LOG_WARN << "BackendConnPool backend " << ep << " failed "
+             << state.consecutive_failures_ << " times in a row, eject it";
+    state.consecutive_failures_ = 0;
+    context_.backend_monitor_->Eject(ep);
+  }
+}
+
+void BackendConnPool::OnBackendSuccess(EndpointState& state) {
+  state.circuit_breaker_.OnRequestFinished(true,
+                                           CircuitBreaker::Clock::now());
+  state.consecutive_failures_ = 0;
+}
+
 }
 
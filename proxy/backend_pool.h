@@ -4,9 +4,16 @@
 #include <map>
 #include <memory>
 #include <queue>
+#include <random>
+#include <stdint.h>
 
 #include <boost/asio/ip/tcp.hpp>
 
+#include "circuit_breaker.h"
+#include "hedge_budget.h"
+#include "key_locator.h"
+#include "latency_estimator.h"
+
 namespace yarmproxy {
 
 using Endpoint = boost::asio::ip::tcp::endpoint;
@@ -21,10 +28,67 @@ public:
   std::shared_ptr<BackendConn> Allocate(const Endpoint & ep);
   void Release(std::shared_ptr<BackendConn> conn);
 
+  // endpoint to read the keys of `primary` from, a member of its replica set
+  // chosen by power of two choices if read_from_replicas is on
+  Endpoint SelectReadEndpoint(const Endpoint& primary);
+  // the same for `key` located at `primary`, which first spills to another
+  // primary if the cluster has a bounded_load and `primary` is at the bound
+  // of its in-flight reads, see KeyLocator::LocateBounded(). the commands of
+  // several keys pass a `load_sum` kept over their keys
+  Endpoint SelectReadEndpoint(const Endpoint& primary, const char* key,
+                              size_t len, ProtocolType protocol,
+                              KeyLocator::LoadSum* load_sum = nullptr);
+  // whether the reads of the keys located at `primary` are load bounded
+  bool LoadBounded(const Endpoint& primary) const;
+
+  // power of two choices among a primary, candidate 0, and its `replicas`,
+  // 1 to `replicas` : the cheaper of two distinct random candidates, or the
+  // primary if both are unavailable, i.e. cost UINT64_MAX
+  template <typename Cost>
+  static size_t PowerOfTwoChoices(size_t replicas, std::minstd_rand& random,
+                                  const Cost& cost) {
+    if (replicas == 0) {
+      return 0;
+    }
+    size_t i = random() % (replicas + 1);
+    size_t j = random() % replicas;
+    if (j >= i) {
+      ++j;
+    }
+    uint64_t cost_i = cost(i);
+    uint64_t cost_j = cost(j);
+    if (cost_i == UINT64_MAX && cost_j == UINT64_MAX) {
+      return 0;
+    }
+    return cost_i <= cost_j ? i : j;
+  }
+
 private:
+  struct EndpointState {
+    std::queue<std::shared_ptr<BackendConn>> idle_conns_;
+    // failing the queries while the circuit breaker is open, recycled so
+    // that the fast fail constructs no connection
+    std::queue<std::shared_ptr<BackendConn>> circuit_open_conns_;
+    int consecutive_failures_ = 0;
+    size_t in_flight_ = 0; // allocated connections
+    CircuitBreaker circuit_breaker_;
+    LatencyEstimator latency_estimator_;
+    int hedge_percentile_ = 0;
+    Endpoint hedge_replica_;
+    HedgeBudget hedge_budget_;
+    std::weak_ptr<KeyLocator> key_locator_; // where the options are from
+  };
+
+  void UpdateBackendOptions(const KeyLocator::BackendOptions* options,
+                            EndpointState& state);
+  void OnBackendFailure(const Endpoint& ep, EndpointState& state);
+  void OnBackendSuccess(EndpointState& state);
+  uint64_t ReadCost(const Endpoint& ep, CircuitBreaker::Clock::time_point now);
+
   WorkerContext& context_;
-  std::map<Endpoint, std::queue<std::shared_ptr<BackendConn>>> conn_map_;  // rename to idle_conns_
+  std::map<Endpoint, EndpointState> endpoint_states_;
   std::map<std::shared_ptr<BackendConn>, Endpoint> active_conns_;
+  std::minstd_rand random_;
 };
 
 }
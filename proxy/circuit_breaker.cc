@@ -0,0 +1,83 @@
+#include "circuit_breaker.h"
+
+#include "logging.h"
+
+#include "config.h"
+#include "stats.h"
+
+namespace yarmproxy {
+
+bool CircuitBreaker::AllowRequest(Clock::time_point now) {
+  if (state_ == CLOSED) {
+    return true;
+  }
+  if (now < retry_at_) {
+    ++g_stats_.circuit_breaker_rejections_;
+    return false;
+  }
+  // half-open, let a trial request pass, and hold the others for another
+  // `open_time` in case the trial gets no result at all
+  state_ = HALF_OPEN;
+  retry_at_ = now + std::chrono::milliseconds(
+      Config::Instance().circuit_breaker_open_time());
+  return true;
+}
+
+void CircuitBreaker::OnRequestFinished(bool ok, Clock::time_point now) {
+  const auto& conf = Config::Instance();
+  if (conf.circuit_breaker_error_rate() <= 0) {
+    return;
+  }
+
+  switch(state_) {
+  case HALF_OPEN:
+    if (ok) {
+      LOG_WARN << "CircuitBreaker " << this << " trial ok, closed";
+      Reset(now);
+    } else {
+      Trip(now);
+    }
+    return;
+  case OPEN:
+    // results of the requests issued before tripping
+    return;
+  case CLOSED:
+  default:
+    break;
+  }
+
+  if (now - window_start_ >= std::chrono::milliseconds(
+          conf.circuit_breaker_window())) {
+    window_start_ = now;
+    requests_ = 0;
+    failures_ = 0;
+  }
+  ++requests_;
+  if (!ok) {
+    ++failures_;
+  }
+
+  if (requests_ >= size_t(conf.circuit_breaker_min_requests()) &&
+      failures_ * 100 >= requests_ * conf.circuit_breaker_error_rate()) {
+    LOG_WARN << "CircuitBreaker " << this << " tripped, failures="
+             << failures_ << " requests=" << requests_;
+    Trip(now);
+  }
+}
+
+void CircuitBreaker::Trip(Clock::time_point now) {
+  ++g_stats_.circuit_breaker_trips_;
+  state_ = OPEN;
+  retry_at_ = now + std::chrono::milliseconds(
+      Config::Instance().circuit_breaker_open_time());
+}
+
+void CircuitBreaker::Reset(Clock::time_point now) {
+  state_ = CLOSED;
+  window_start_ = now;
+  requests_ = 0;
+  failures_ = 0;
+}
+
+}
+
@@ -0,0 +1,48 @@
+#ifndef _YARMPROXY_CIRCUIT_BREAKER_H_
+#define _YARMPROXY_CIRCUIT_BREAKER_H_
+
+#include <chrono>
+
+namespace yarmproxy {
+
+// Per worker, per endpoint circuit breaker. It trips when the failure rate
+// in a window exceeds the configured threshold, rejects requests while it's
+// open, and lets one trial request pass every `open_time` when half-open.
+class CircuitBreaker {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum State {
+    CLOSED    = 0,
+    OPEN      = 1,
+    HALF_OPEN = 2,
+  };
+
+  bool AllowRequest(Clock::time_point now);
+  void OnRequestFinished(bool ok, Clock::time_point now);
+
+  State state() const {
+    return state_;
+  }
+  // rejecting requests, without moving to half-open
+  bool IsOpen(Clock::time_point now) const {
+    return state_ != CLOSED && now < retry_at_;
+  }
+
+private:
+  void Trip(Clock::time_point now);
+  void Reset(Clock::time_point now);
+
+  State state_ = CLOSED;
+
+  Clock::time_point window_start_;
+  size_t requests_ = 0;
+  size_t failures_ = 0;
+
+  Clock::time_point retry_at_; // when the next trial request is allowed
+};
+
+}
+
+#endif // _YARMPROXY_CIRCUIT_BREAKER_H_
+
@@ -1,5 +1,6 @@
 #include "client_conn.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <memory>
@@ -21,8 +22,9 @@ ClientConnection::ClientConnection(WorkerContext& context)
     , buffer_(new ReadBuffer(context.allocator_->Alloc(),
                       context.allocator_->buffer_size()))
     , context_(context)
-    , read_timer_(context.io_context_)
-    , write_timer_(context.io_context_) {
+    , read_timer_(*context.timing_wheel_, [this]() { OnTimeout(READ_TIMER); })
+    , write_timer_(*context.timing_wheel_,
+                   [this]() { OnTimeout(WRITE_TIMER); }) {
   ++g_stats_.client_conns_;
   LOG_DEBUG << "client ctor. count=" << g_stats_.client_conns_;
 }
@@ -38,44 +40,34 @@ ClientConnection::~ClientConnection() {
   LOG_DEBUG << "client dtor. count=" << g_stats_.client_conns_;
 }
 
-void ClientConnection::OnTimeout(const boost::system::error_code& ec,
-                                 TimerType timer_type) {
-  if (ec != boost::asio::error::operation_aborted) {
-    // timer was not cancelled, take necessary action.
-    LOG_WARN << "client OnTimeout, timer="
-             << (timer_type == READ_TIMER ? "READ" : "WRITE");
-    if (timer_type == READ_TIMER) {
-      ++g_stats_.client_read_timeouts_;
-    } else {
-      ++g_stats_.client_write_timeouts_;
-    }
-    Abort();
+void ClientConnection::OnTimeout(TimerType timer_type) {
+  // a disarmed timer never expires. hold this connection while aborting it
+  std::shared_ptr<ClientConnection> self(shared_from_this());
+  LOG_WARN << "client OnTimeout, timer="
+           << (timer_type == READ_TIMER ? "READ" : "WRITE");
+  if (timer_type == READ_TIMER) {
+    ++g_stats_.client_read_timeouts_;
+  } else {
+    ++g_stats_.client_write_timeouts_;
   }
+  Abort();
 }
 
 void ClientConnection::UpdateTimer(TimerType timer_type) {
   if (aborted_) {
     return;
   }
-  boost::asio::steady_timer& timer = 
-      timer_type == READ_TIMER ? read_timer_ : write_timer_;
+  WheelTimer& timer = timer_type == READ_TIMER ? read_timer_ : write_timer_;
 
   int timeout = (timer_type == READ_TIMER && 
       buffer_->unparsed_received_bytes() == 0) ?
       Config::Instance().client_idle_timeout() :
       Config::Instance().socket_rw_timeout();
 
-  timer.expires_after(std::chrono::milliseconds(timeout));
+  timer.Arm(timeout);
   LOG_DEBUG << "client UpdateTimer "
             << (timer_type == READ_TIMER ? "READ" : "WRITE")
             << " timeout=" << timeout;
-
-  std::weak_ptr<ClientConnection> wptr(shared_from_this());
-  timer.async_wait([wptr, timer_type](const boost::system::error_code& ec) {
-        if (auto ptr = wptr.lock()) {
-          ptr->OnTimeout(ec, timer_type);
-        }
-      });
 }
 
 void ClientConnection::StartRead() {
@@ -115,8 +107,16 @@ void ClientConnection::RotateReplyingCommand() {
   }
 
   active_cmd_queue_.pop_front();
-
-  if (!active_cmd_queue_.empty()) {
+  window_bytes_ -= active_cmd_bytes_.front();
+  active_cmd_bytes_.pop_front();
+  key_order_.PopCommand();
+
+  if (active_cmd_queue_.empty()) {
+    // the pipeline window, or the order of the keys, might have stopped the
+    // parsing of the commands received. the rotating command still holds
+    // this connection
+    ProcessUnparsedQuery();
+  } else {
     active_cmd_queue_.front()->StartWriteReply();
 
     if (!active_cmd_queue_.back()->query_recv_complete()) {
@@ -132,48 +132,76 @@ void ClientConnection::RotateReplyingCommand() {
 }
 
 void ClientConnection::WriteReply(const char* data, size_t bytes,
-                                  const WriteReplyCallback& callback) {
+                                  const std::shared_ptr<Command>& command,
+                                  const std::shared_ptr<BackendConn>& backend) {
   if (is_writing_reply_) {
     assert(false);
   }
   std::shared_ptr<ClientConnection> client_conn(shared_from_this());
-  auto cb_wrap = [client_conn, data, bytes, callback](
+  std::weak_ptr<Command> command_wptr(command);
+  std::weak_ptr<BackendConn> backend_wptr(backend);
+  auto cb_wrap = [client_conn, data, bytes, command_wptr, backend_wptr](
       const boost::system::error_code& error, size_t bytes_transferred) {
-    client_conn->write_timer_.cancel();
+    client_conn->write_timer_.Disarm();
     if (!error) {
       g_stats_.bytes_to_clients_ += bytes_transferred;
     }
     if (!error && bytes_transferred < bytes) {
-      client_conn->WriteReply(data + bytes_transferred, bytes - bytes_transferred, callback);
+      client_conn->WriteReply(data + bytes_transferred,
+                              bytes - bytes_transferred, command_wptr.lock(),
+                              backend_wptr.lock());
     } else {
       client_conn->is_writing_reply_ = false;
-      callback(error ? ErrorCode::E_WRITE_REPLY : ErrorCode::E_SUCCESS);
+      if (auto command = command_wptr.lock()) {
+        command->OnWriteReplyFinished(backend_wptr.lock(), error ?
+            ErrorCode::E_WRITE_REPLY : ErrorCode::E_SUCCESS);
+      }
     }
   };
 
   is_writing_reply_ = true;
   UpdateTimer(WRITE_TIMER);
-  boost::asio::async_write(socket_, boost::asio::buffer(data, bytes), cb_wrap);
+  AsyncWrite(socket_, data, bytes, cb_wrap);
 }
 
 void ClientConnection::ProcessUnparsedQuery() {
-  // TODO : pipeline中多个请求存在时序问题, 后面的command可能在另一个
-  //   连接中先被执行, test/redis/del_pipeline_1.sh 可重现该问题
-  static const size_t kPipelineActiveLimit = 16; // TODO : config it?
-  while(active_cmd_queue_.size() < kPipelineActiveLimit
-        && buffer_->unparsed_received_bytes() > 0) {
+  // The commands are executed in parallel on different backend connections.
+  // A command on the keys of an earlier active command, either of them
+  // writing, waits until the earlier one is finished, and the parsing is
+  // resumed by RotateReplyingCommand. test/redis/del_pipeline_1.sh reproduced
+  // the reordering without it.
+  //
+  // The replies of the commands after the first one are kept in their
+  // backend buffers until their turn, so the pipeline depth is bounded by
+  // the bytes of these buffers rather than by the count of commands.
+  const size_t window = Config::Instance().pipeline_window();
+  while(buffer_->unparsed_received_bytes() > 0) {
+    if (!active_cmd_queue_.empty() && window_bytes_ >= window) {
+      // resumed by RotateReplyingCommand
+      ++g_stats_.pipeline_window_stalls_;
+      break;
+    }
     std::shared_ptr<Command> command;
+    key_order_.BeginCommand();
     size_t parsed_bytes = Command::CreateCommand(shared_from_this(),
                buffer_->unprocessed_data(), buffer_->received_bytes(),
                &command);
 
     if (parsed_bytes == 0) {
+      if (key_order_.conflicted()) {
+        ++g_stats_.key_order_waits_;
+      }
       TryReadMoreQuery("client_conn_2");
       break;
     }
     buffer_->update_parsed_bytes(parsed_bytes);
 
     active_cmd_queue_.push_back(command);
+    size_t bytes = std::max(command->backend_count(), size_t(1)) *
+                   context_.allocator_->buffer_size();
+    active_cmd_bytes_.push_back(bytes);
+    window_bytes_ += bytes;
+    key_order_.PushCommand();
     bool no_callback = command->StartWriteQuery(); // rename to StartWriteQuery
     buffer_->update_processed_bytes(buffer_->unprocessed_bytes());
 
@@ -190,7 +218,7 @@ void ClientConnection::ProcessUnparsedQuery() {
 
 void ClientConnection::HandleRead(const boost::system::error_code& error,
                                   size_t bytes_transferred) {
-  read_timer_.cancel();
+  read_timer_.Disarm();
   if (aborted_) {
     return;
   }
@@ -267,12 +295,15 @@ void ClientConnection::Abort() {
   LOG_WARN << "client " << this << " Abort";
 
   aborted_ = true;
-  read_timer_.cancel();
-  write_timer_.cancel();
+  read_timer_.Disarm();
+  write_timer_.Disarm();
   socket_.close();
 
   // keep this line at end to avoid earyly deref.
   active_cmd_queue_.clear();
+  active_cmd_bytes_.clear();
+  window_bytes_ = 0;
+  key_order_.Clear();
 }
 
 }
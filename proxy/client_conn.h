@@ -9,8 +9,13 @@
 
 #include <boost/asio.hpp>
 
+#include "conn_socket.h"
+#include "key_order_tracker.h"
+#include "timing_wheel.h"
+
 namespace yarmproxy {
 
+class BackendConn;
 class BackendConnPool;
 class Command;
 class WorkerContext;
@@ -18,8 +23,6 @@ class ReadBuffer;
 
 enum class ErrorCode;
 
-typedef std::function<void(ErrorCode ec)> WriteReplyCallback;
-
 class ClientConnection : public std::enable_shared_from_this<ClientConnection> {
 public:
   ClientConnection(WorkerContext& context);
@@ -29,7 +32,7 @@ public:
     return context_;
   }
 
-  boost::asio::ip::tcp::socket& socket() {
+  ConnSocket& socket() {
     return socket_;
   }
   void StartRead();
@@ -38,11 +41,19 @@ public:
   void Abort();
 
 public:
-  void WriteReply(const char* data, size_t bytes, const WriteReplyCallback& cb);
-  bool IsFirstCommand(std::shared_ptr<Command> cmd) {
-    return cmd == active_cmd_queue_.front();
+  // calls OnWriteReplyFinished of the command, with the backend whose
+  // buffer holds the reply, unless the command is destroyed
+  void WriteReply(const char* data, size_t bytes,
+                  const std::shared_ptr<Command>& command,
+                  const std::shared_ptr<BackendConn>& backend);
+  bool IsFirstCommand(const Command* cmd) {
+    return cmd == active_cmd_queue_.front().get();
   }
   void RotateReplyingCommand();
+  // the order of the active commands on their keys
+  KeyOrderTracker& key_order() {
+    return key_order_;
+  }
 
   // caller : track caller for debuging
   void TryReadMoreQuery(const char* caller = "");
@@ -57,7 +68,7 @@ public:
   }
 
 private:
-  boost::asio::ip::tcp::socket socket_;
+  ConnSocket socket_;
   ReadBuffer* buffer_;
 
 protected:
@@ -65,6 +76,10 @@ protected:
 
 private:
   std::list<std::shared_ptr<Command>> active_cmd_queue_;
+  // the pipeline window bytes held by each active command, and their sum
+  std::list<size_t> active_cmd_bytes_;
+  size_t window_bytes_ = 0;
+  KeyOrderTracker key_order_;
   bool is_reading_query_ = false;
   bool is_writing_reply_ = false;
   bool aborted_ = false;
@@ -78,11 +93,11 @@ private:
     READ_TIMER,
     WRITE_TIMER,
   };
-  boost::asio::steady_timer read_timer_;
-  boost::asio::steady_timer write_timer_;
+  WheelTimer read_timer_;
+  WheelTimer write_timer_;
 
   void UpdateTimer(TimerType type);
-  void OnTimeout(const boost::system::error_code& error, TimerType type);
+  void OnTimeout(TimerType type);
 };
 
 }
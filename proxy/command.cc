@@ -12,9 +12,14 @@
 #include "backend_conn.h"
 #include "backend_pool.h"
 #include "client_conn.h"
+#include "command_table.h"
 #include "config.h"
 #include "key_locator.h"
+#include "key_order_tracker.h"
 #include "read_buffer.h"
+#include "redis_cluster.h"
+#include "redis_cluster_monitor.h"
+#include "stats.h"
 #include "worker_pool.h"
 
 #include "error_command.h"
@@ -26,8 +31,8 @@
 
 #include "redis_protocol.h"
 #include "redis_basic_command.h"
-#include "redis_del_command.h"
-#include "redis_mset_command.h"
+#include "redis_coro_command.h"
+#include "redis_fanout_command.h"
 #include "redis_mget_command.h"
 #include "redis_set_command.h"
 
@@ -50,96 +55,150 @@ std::shared_ptr<KeyLocator> Command::key_locator() {
   return client_conn_->context().key_locator_;
 }
 
-enum class RedisCommandType {
-  RCT_BASIC,
-  RCT_SET,
-  RCT_MSET,
-  RCT_MGET,
-  RCT_DEL,
-  RCT_YARMSTATS,
-  RCT_UNSUPPORTED,
-};
+// tells if the keys of a multi-key command are all on one endpoint, and in
+// one slot of a redis cluster, so that the command can be forwarded as is,
+// with its reply, like a single key command. the keys are located a few at a
+// time, to give up early on the commands to fan out, which locate their keys
+// again
+class SingleEndpointChecker {
+public:
+  SingleEndpointChecker(const KeyLocator& locator, ProtocolType protocol)
+      : locator_(locator), protocol_(protocol) {
+  }
+  // return : false once the keys are known to be on different endpoints
+  bool Add(const char* key, size_t len) {
+    keys_[count_++] = KeyLocator::Key(key, len);
+    return count_ < kBatchSize || Flush();
+  }
+  bool Finish() {
+    return Flush() && endpoint_ != 0;
+  }
 
-static RedisCommandType GetRedisCommandType(const redis::Bulk& bulk) {
-  static const std::map<std::string, RedisCommandType> kCommandNameType = {
-      {"get",         RedisCommandType::RCT_BASIC},
-      {"getset",      RedisCommandType::RCT_BASIC},
-      {"getrange",    RedisCommandType::RCT_BASIC},
-      {"ttl",         RedisCommandType::RCT_BASIC},
-      {"incr",        RedisCommandType::RCT_BASIC},
-      {"incrby",      RedisCommandType::RCT_BASIC},
-      {"incrbyfloat", RedisCommandType::RCT_BASIC},
-      {"decr",        RedisCommandType::RCT_BASIC},
-      {"decrby",      RedisCommandType::RCT_BASIC},
-      {"strlen",      RedisCommandType::RCT_BASIC},
-
-      {"set",      RedisCommandType::RCT_SET},
-      {"append",   RedisCommandType::RCT_SET},
-      {"setrange", RedisCommandType::RCT_SET},
-      {"setnx",    RedisCommandType::RCT_SET},
-      {"psetex",   RedisCommandType::RCT_SET},
-      {"setex",    RedisCommandType::RCT_SET},
-
-      {"mset",   RedisCommandType::RCT_MSET},
-
-      {"mget",   RedisCommandType::RCT_MGET},
-
-      {"del",      RedisCommandType::RCT_DEL},
-      {"exists",   RedisCommandType::RCT_DEL},
-      {"touch",    RedisCommandType::RCT_DEL},
-
-      {"yarmstats", RedisCommandType::RCT_YARMSTATS},
-    };
-
-  std::string cmd_name(bulk.payload_data(), bulk.payload_size());
-  std::transform(cmd_name.begin(), cmd_name.end(), cmd_name.begin(), tolower);
-  auto it = kCommandNameType.find(cmd_name);
-  if (it != kCommandNameType.cend()) {
-    return it->second;
-  }
-  return RedisCommandType::RCT_UNSUPPORTED;
-}
+private:
+  bool Flush() {
+    uint16_t endpoints[kBatchSize];
+    locator_.LocateBatch(keys_, count_, protocol_, endpoints);
+    for(size_t i = 0; i < count_; ++i) {
+      if (endpoints[i] == 0 || (endpoint_ != 0 && endpoints[i] != endpoint_)) {
+        return false;
+      }
+      endpoint_ = endpoints[i];
+      if (locator_.has_redis_cluster()) {
+        int slot = locator_.ClusterSlot(keys_[i].first, keys_[i].second,
+                                        protocol_);
+        if (i + total_ > 0 && slot != slot_) {
+          return false;
+        }
+        slot_ = slot;
+      }
+    }
+    total_ += count_;
+    count_ = 0;
+    return true;
+  }
 
-enum class MemcCommandType {
-  MCT_GET,
-  MCT_SET,
-  MCT_BASIC,
-  MCT_YARMSTATS,
-  MCT_UNSUPPORTED,
+  static const size_t kBatchSize = 8;
+  const KeyLocator& locator_;
+  ProtocolType protocol_;
+  KeyLocator::Key keys_[kBatchSize];
+  size_t count_ = 0;
+  size_t total_ = 0; // keys flushed
+  uint16_t endpoint_ = 0;
+  int slot_ = -1;
 };
 
-static MemcCommandType GetMemcCommandType(const char* cmd_line, size_t size) {
-  static const std::map<std::string, MemcCommandType> kCommandNameType = {
-      {"get",     MemcCommandType::MCT_GET},
-      {"gets",    MemcCommandType::MCT_GET},
-
-      {"set",     MemcCommandType::MCT_SET},
-      {"add",     MemcCommandType::MCT_SET},
-      {"replace", MemcCommandType::MCT_SET},
-      {"append",  MemcCommandType::MCT_SET},
-      {"prepend", MemcCommandType::MCT_SET},
-      {"cas",     MemcCommandType::MCT_SET},
+static bool IsSingleEndpoint(std::shared_ptr<ClientConnection> client,
+                             const redis::BulkArray& ba,
+                             const RedisCommandSpec& spec) {
+  if (!ba.completed() || ba.total_bulks() <= size_t(spec.first_key_)) {
+    return false;
+  }
+  SingleEndpointChecker checker(*client->context().key_locator_,
+                                ProtocolType::REDIS);
+  const size_t last_key = spec.last_key(ba.total_bulks());
+  for(size_t i = spec.first_key_; i <= last_key; i += spec.key_step_) {
+    if (!checker.Add(ba[i].payload_data(), ba[i].payload_size())) {
+      return false;
+    }
+  }
+  return checker.Finish();
+}
 
-      {"delete",  MemcCommandType::MCT_BASIC},
-      {"incr",    MemcCommandType::MCT_BASIC},
-      {"decr",    MemcCommandType::MCT_BASIC},
-      {"touch",   MemcCommandType::MCT_BASIC},
+// return : bytes parsed, 0 if no adquate data to parse
+static size_t CreateFanoutCommand(std::shared_ptr<ClientConnection> client,
+                                  const redis::BulkArray& ba,
+                                  const RedisCommandSpec& spec,
+                                  std::shared_ptr<Command>* command) {
+  size_t taken_bytes = RedisFanoutCommand::TakenBytes(ba, spec);
+  if (taken_bytes == 0) {
+    return 0;
+  }
+  if (IsSingleEndpoint(client, ba, spec)) {
+    command->reset(new RedisBasicCommand(client, ba, spec));
+    return ba.total_size();
+  }
+  command->reset(new RedisFanoutCommand(client, ba, spec));
+  return taken_bytes;
+}
 
-      {"yarmstats", MemcCommandType::MCT_YARMSTATS},
-    };
+// "<name> <arg>* <key>*\r\n", e.g. "get <key>*\r\n" or
+// "gat <exptime> <key>*\r\n"
+static bool IsSingleEndpoint(std::shared_ptr<ClientConnection> client,
+                             const char* cmd_line, size_t size,
+                             const MemcCommandSpec& spec) {
+  SingleEndpointChecker checker(*client->context().key_locator_,
+                                ProtocolType::MEMCACHED);
+  const char* end = cmd_line + size - (sizeof("\r\n") - 1);
+  const char* key = spec.first_key(cmd_line, end);
+  while (key < end) {
+    const char* p = static_cast<const char*>(memchr(key, ' ', end - key));
+    const char* key_end = p == nullptr ? end : p;
+    if (key_end > key && !checker.Add(key, key_end - key)) {
+      return false;
+    }
+    key = key_end + 1;
+  }
+  return checker.Finish();
+}
 
-  const char * p = static_cast<const char *>(memchr(cmd_line, ' ', size));
-  if (p == nullptr) {
-    p = cmd_line + size;
+// whether the command in `ba` may start, after the earlier commands of the
+// client on its keys. the keys not received yet are unknown.
+static bool OrderKeys(KeyOrderTracker& tracker, const redis::BulkArray& ba,
+                      const RedisCommandSpec& spec) {
+  bool write = (spec.flags_ & kCommandReadOnly) == 0;
+  size_t last_key = spec.last_key(ba.total_bulks());
+  for(size_t i = spec.first_key_; i <= last_key; i += spec.key_step_) {
+    if (i >= ba.present_bulks() || !ba[i].completed()) {
+      return tracker.AddUnknownKeys();
+    }
+    if (!tracker.AddKey(ba[i].payload_data(), ba[i].payload_size(), write)) {
+      return false;
+    }
   }
-  auto it = kCommandNameType.find(std::string(cmd_line, p - cmd_line));
-  if (it != kCommandNameType.cend()) {
-    return it->second;
+  return true;
+}
+
+static bool OrderKeys(KeyOrderTracker& tracker, const char* cmd_line,
+                      size_t size, const MemcCommandSpec& spec) {
+  bool write = (spec.flags_ & kCommandReadOnly) == 0;
+  const char* end = cmd_line + size - (sizeof("\r\n") - 1);
+  const char* key = spec.first_key(cmd_line, end);
+  while (key < end) {
+    const char* p = static_cast<const char*>(memchr(key, ' ', end - key));
+    const char* key_end = p == nullptr ? end : p;
+    if (key_end > key && !tracker.AddKey(key, key_end - key, write)) {
+      return false;
+    }
+    if (!spec.multi_key_) {
+      break;
+    }
+    key = key_end + 1;
   }
-  return MemcCommandType::MCT_UNSUPPORTED;
+  return true;
 }
 
-// return : bytes parsed, 0 if no adquate data to parse
+// return : bytes parsed, 0 if no adquate data to parse, or if the command
+//   waits for the earlier ones on its keys
 size_t Command::CreateCommand(std::shared_ptr<ClientConnection> client,
                            const char* buf, size_t size,
                            std::shared_ptr<Command>* command) {
@@ -173,12 +232,37 @@ size_t Command::CreateCommand(std::shared_ptr<ClientConnection> client,
       return 0;
     }
 
-    switch(GetRedisCommandType(ba[0])) {
+    const RedisCommandSpec* spec = LookupRedisCommand(ba[0].payload_data(),
+                                                      ba[0].payload_size());
+    if (spec == nullptr) {
+      command->reset(new ErrorCommand(client,
+            std::string("-ERR YarmProxy unsupported redis command:[") +
+                ba[0].to_string() + "]\r\n"));
+      return size;
+    }
+    if (!spec->CheckArity(ba.total_bulks())) {
+      if (!ba.completed()) {
+        return 0;
+      }
+      command->reset(new ErrorCommand(client,
+            std::string("-ERR wrong number of arguments for '") +
+                spec->name_ + "' command\r\n"));
+      return ba.total_size();
+    }
+    if (spec->first_key_ > 0 && !OrderKeys(client->key_order(), ba, *spec)) {
+      return 0;
+    }
+
+    switch(spec->type_) {
     case RedisCommandType::RCT_BASIC:
       if (!ba.completed()) {
         return 0;
       }
-      command->reset(new RedisBasicCommand(client, ba));
+#ifdef YARMPROXY_WITH_COROUTINES
+      command->reset(new RedisCoroCommand(client, ba, *spec));
+#else
+      command->reset(new RedisBasicCommand(client, ba, *spec));
+#endif
       return ba.total_size();
     case RedisCommandType::RCT_SET:
       if (ba.present_bulks() < 2 || !ba[1].completed()) {
@@ -186,43 +270,24 @@ size_t Command::CreateCommand(std::shared_ptr<ClientConnection> client,
       }
       command->reset(new RedisSetCommand(client, ba));
       return ba.parsed_size();
-    case RedisCommandType::RCT_MSET:
-      if (ba.present_bulks() < 3) {
-        return 0;
-      }
-      command->reset(new RedisMsetCommand(client, ba));
-      if (ba.present_bulks() % 2 == 0) {
-        return ba.parsed_size() - ba.back().total_size();
-      } else {
-        return ba.parsed_size();
-      }
     case RedisCommandType::RCT_MGET:
       if (!ba.completed()) { // TODO : support incomplete mget bulk_array
         return 0;
       }
+      if (IsSingleEndpoint(client, ba, *spec)) {
+        command->reset(new RedisBasicCommand(client, ba, *spec));
+        return ba.total_size();
+      }
       command->reset(new RedisMgetCommand(client, ba));
       return ba.total_size();
-    case RedisCommandType::RCT_DEL:
-      if (ba.present_bulks() < 2 || !ba[1].completed()) {
-        return 0;
-      }
-      command->reset(new RedisDelCommand(client, ba));
-      if (ba.back().completed()) {
-        return ba.parsed_size();
-      } else {
-        return ba.parsed_size() - ba.back().total_size();
-      }
+    case RedisCommandType::RCT_FANOUT:
+      return CreateFanoutCommand(client, ba, *spec, command);
     case RedisCommandType::RCT_YARMSTATS:
       if (!ba.completed()) {
         return 0;
       }
       command->reset(new StatsCommand(client, ProtocolType::REDIS));
       return ba.total_size();
-    default:
-      command->reset(new ErrorCommand(client,
-            std::string("-ERR YarmProxy unsupported redis command:[") +
-                ba[0].to_string() + "]\r\n"));
-      return size;
     }
   }
 
@@ -233,9 +298,36 @@ size_t Command::CreateCommand(std::shared_ptr<ClientConnection> client,
   // TODO : support memcached noreply mode
   size_t cmd_line_bytes = p - buf + 1;
   size_t body_bytes = 0;
-  switch(GetMemcCommandType(buf, cmd_line_bytes)) {
+  const char* line_end = p > buf && *(p - 1) == '\r' ? p - 1 : p;
+  const char* name_end = static_cast<const char*>(
+      memchr(buf, ' ', line_end - buf));
+  if (name_end == nullptr) { // a command without arguments
+    name_end = line_end;
+  }
+  const MemcCommandSpec* spec = LookupMemcCommand(buf, name_end - buf);
+  if (spec == nullptr) {
+    command->reset(new ErrorCommand(client,
+          std::string("YarmProxy Unsupported Request [") +
+            std::string(buf,cmd_line_bytes) + "]\r\n"));
+    LOG_WARN << "ErrorCommand(" << std::string(buf, cmd_line_bytes) << ") len="
+             << cmd_line_bytes << " client_conn=" << client;
+    return size;
+  }
+  if (!spec->CheckArity(buf, line_end)) {
+    command->reset(new ErrorCommand(client, "ERROR\r\n"));
+    return cmd_line_bytes;
+  }
+  if (spec->first_key_ > 0 &&
+      !OrderKeys(client->key_order(), buf, cmd_line_bytes, *spec)) {
+    return 0;
+  }
+  switch(spec->type_) {
   case MemcCommandType::MCT_GET:
-    command->reset(new MemcGetCommand(client, buf, cmd_line_bytes));
+    if (IsSingleEndpoint(client, buf, cmd_line_bytes, *spec)) {
+      command->reset(new MemcBasicCommand(client, buf, cmd_line_bytes, *spec));
+      return cmd_line_bytes;
+    }
+    command->reset(new MemcGetCommand(client, buf, cmd_line_bytes, *spec));
     return cmd_line_bytes;
   case MemcCommandType::MCT_SET:
     command->reset(new MemcSetCommand(client, buf, cmd_line_bytes,
@@ -248,19 +340,13 @@ size_t Command::CreateCommand(std::shared_ptr<ClientConnection> client,
     }
     return cmd_line_bytes + body_bytes;
   case MemcCommandType::MCT_BASIC:
-    command->reset(new MemcBasicCommand(client, buf));
+    command->reset(new MemcBasicCommand(client, buf, cmd_line_bytes, *spec));
     return cmd_line_bytes;
   case MemcCommandType::MCT_YARMSTATS:
-    command->reset(new StatsCommand(client, ProtocolType::MEMCACHED));
-    return cmd_line_bytes;
-  default:
-    command->reset(new ErrorCommand(client,
-          std::string("YarmProxy Unsupported Request [") +
-            std::string(buf,cmd_line_bytes) + "]\r\n"));
-    LOG_WARN << "ErrorCommand(" << std::string(buf, cmd_line_bytes) << ") len="
-             << cmd_line_bytes << " client_conn=" << client;
-    return size;
+    break;
   }
+  command->reset(new StatsCommand(client, ProtocolType::MEMCACHED));
+  return cmd_line_bytes;
 }
 
 const std::string& Command::MemcErrorReply(ErrorCode ec) {
@@ -272,6 +358,7 @@ const std::string& Command::MemcErrorReply(ErrorCode ec) {
   static const std::string kErrorConnectTimeout("ERROR Backend Connect Timeout\r\n");
   static const std::string kErrorWriteTimeout("ERROR Backend Write Timeout\r\n");
   static const std::string kErrorReadTimeout("ERROR Backend Read Timeout\r\n");
+  static const std::string kErrorCircuitOpen("ERROR Backend Circuit Open\r\n");
   static const std::string kErrorDefault("ERROR Backend Unknown Error\r\n");
   switch(ec) {
   case ErrorCode::E_CONNECT:
@@ -290,6 +377,8 @@ const std::string& Command::MemcErrorReply(ErrorCode ec) {
     return kErrorWriteTimeout;
   case ErrorCode::E_BACKEND_READ_TIMEOUT:
     return kErrorReadTimeout;
+  case ErrorCode::E_CIRCUIT_OPEN:
+    return kErrorCircuitOpen;
   default:
     return kErrorDefault;
   }
@@ -303,6 +392,7 @@ const std::string& Command::RedisErrorReply(ErrorCode ec) {
   static const std::string kErrorConnectTimeout("-Backend Connect Timeout\r\n");
   static const std::string kErrorWriteTimeout("-Backend Write Timeout\r\n");
   static const std::string kErrorReadTimeout("-Backend Read Timeout\r\n");
+  static const std::string kErrorCircuitOpen("-Backend Circuit Open\r\n");
   static const std::string kErrorDefault("-Backend Unknown Error\r\n");
   switch(ec) {
   case ErrorCode::E_CONNECT:
@@ -321,6 +411,8 @@ const std::string& Command::RedisErrorReply(ErrorCode ec) {
     return kErrorWriteTimeout;
   case ErrorCode::E_BACKEND_READ_TIMEOUT:
     return kErrorReadTimeout;
+  case ErrorCode::E_CIRCUIT_OPEN:
+    return kErrorCircuitOpen;
   default:
     return kErrorDefault;
   }
@@ -334,9 +426,7 @@ bool Command::StartWriteQuery() {
   assert(replying_backend_);
   check_query_recv_complete();
 
-  replying_backend_->SetReadWriteCallback(
-      WeakBind(&Command::OnWriteQueryFinished, replying_backend_),
-      WeakBind(&Command::OnBackendReplyReceived, replying_backend_));
+  replying_backend_->SetHandler(shared_from_this());
 
   LOG_DEBUG << "Command " << this << " StartWriteQuery backend=" << replying_backend_
            << " ep=" << replying_backend_->remote_endpoint();
@@ -353,7 +443,7 @@ bool Command::ContinueWriteQuery() {
     if (!query_recv_complete()) {
       return true; // no callback, try read more query directly
     }
-    if (client_conn_->IsFirstCommand(shared_from_this())) {
+    if (client_conn_->IsFirstCommand(this)) {
       // write reply
       TryWriteReply(replying_backend_);
     } else {
@@ -405,8 +495,99 @@ void Command::OnWriteQueryFinished(std::shared_ptr<BackendConn> backend,
   }
 }
 
+bool Command::IsRedirectable(std::shared_ptr<BackendConn> backend) {
+  const KeyLocator::BackendOptions* options =
+      key_locator()->backend_options(backend->remote_endpoint());
+  return options != nullptr && options->redis_cluster_;
+}
+
+void Command::KeepQueryForRedirection(const char* data, size_t bytes) {
+  if (IsRedirectable(replying_backend_)) {
+    redirection_.query_.assign(data, bytes);
+  }
+}
+
+bool Command::FollowRedirection(Redirection* redirection,
+                                std::shared_ptr<BackendConn>* backend_ptr) {
+  static const size_t kMaxRedirections = 5;
+  std::shared_ptr<BackendConn> backend = *backend_ptr;
+  ReadBuffer* buffer = backend->buffer();
+
+  if (redirection->asking_) {
+    static const char kOk[] = "+OK\r\n";
+    if (buffer->unparsed_bytes() < sizeof(kOk) - 1) {
+      backend->TryReadMoreReply();
+      return true;
+    }
+    redirection->asking_ = false;
+    if (memcmp(buffer->unparsed_data(), kOk, sizeof(kOk) - 1) != 0) {
+      // forward the error of ASKING, and drop the connection with the reply
+      // of the query pending
+      backend->set_no_recycle();
+      redirection->query_.clear();
+      return false;
+    }
+    buffer->update_parsed_bytes(sizeof(kOk) - 1);
+    buffer->update_processed_bytes(sizeof(kOk) - 1);
+    if (buffer->unparsed_bytes() == 0) {
+      backend->TryReadMoreReply();
+      return true;
+    }
+  }
+
+  bool ask = false;
+  Endpoint target;
+  size_t line = redis::ParseRedirection(buffer->unparsed_data(),
+                                        buffer->unparsed_bytes(), &ask, &target);
+  if (line == 0 || redirection->count_ >= int(kMaxRedirections)) {
+    if (buffer->unparsed_bytes() == 0 || (*buffer->unparsed_data() == '-' &&
+        !memchr(buffer->unparsed_data(), '\n', buffer->unparsed_bytes()))) {
+      backend->TryReadMoreReply(); // maybe a redirection
+      return true;
+    }
+    redirection->query_.clear(); // no redirection
+    return false;
+  }
+
+  ++redirection->count_;
+  ++g_stats_.redis_cluster_redirections_;
+  LOG_DEBUG << "Command " << this << " redirected from "
+            << backend->remote_endpoint() << " to " << target
+            << " ask=" << ask;
+  buffer->update_parsed_bytes(line);
+  buffer->update_processed_bytes(line);
+  backend->set_reply_recv_complete();
+  if (!ask && client_conn_->context().redis_cluster_monitor_ != nullptr) {
+    client_conn_->context().redis_cluster_monitor_->RequestRefresh();
+  }
+
+  // allocated before releasing, so that it's not the same connection
+  *backend_ptr = backend_pool()->Allocate(target);
+  backend_pool()->Release(backend);
+  backend = *backend_ptr;
+  backend->SetHandler(shared_from_this());
+
+  client_conn_->buffer()->inc_recycle_lock(); // OnWriteQueryFinished unlocks
+  if (ask) {
+    static const char kAsking[] = "*1\r\n$6\r\nASKING\r\n";
+    redirection->asking_ = true;
+    redirection->asking_query_.assign(kAsking, sizeof(kAsking) - 1);
+    redirection->asking_query_.append(redirection->query_);
+    backend->WriteQuery(redirection->asking_query_.data(),
+                        redirection->asking_query_.size());
+  } else {
+    backend->WriteQuery(redirection->query_.data(),
+                        redirection->query_.size());
+  }
+  return true;
+}
+
 void Command::OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
                                      ErrorCode ec) {
+  if (ec == ErrorCode::E_SUCCESS && redirectable() &&
+      backend == replying_backend_ && FollowRedirection(backend)) {
+    return;
+  }
   if (ec == ErrorCode::E_SUCCESS && !ParseReply(backend)) {
     ec = ErrorCode::E_PROTOCOL;
   }
@@ -422,7 +603,7 @@ void Command::OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
     return;
   }
 
-  if (client_conn_->IsFirstCommand(shared_from_this())) {
+  if (client_conn_->IsFirstCommand(this)) {
     // write reply
     TryWriteReply(backend);
   } else {
@@ -479,7 +660,7 @@ void Command::OnBackendRecoverableError(std::shared_ptr<BackendConn> backend, Er
   backend->set_no_recycle();
 
   if (query_recv_complete()) {
-    if (client_conn_->IsFirstCommand(shared_from_this())) {
+    if (client_conn_->IsFirstCommand(this)) {
       // write reply
       TryWriteReply(backend);
     } else {
@@ -499,59 +680,101 @@ void Command::OnBackendRecoverableError(std::shared_ptr<BackendConn> backend, Er
   }
 }
 
+// parses a reply of one element, or a flat array of them, e.g. the reply of
+// a multi-key command forwarded as is. the parsed part is streamed to the
+// client, so the array elements are parsed as they are received
 bool Command::ParseRedisSimpleReply(std::shared_ptr<BackendConn> backend) {
-  size_t unparsed_bytes = backend->buffer()->unparsed_bytes();
-  if (unparsed_bytes == 0) { // bottom-half of a bulk string
-    if (backend->buffer()->parsed_unreceived_bytes() == 0) {
-      backend->set_reply_recv_complete();
+  ReadBuffer* buffer = backend->buffer();
+  while (true) {
+    if (buffer->parsed_unreceived_bytes() > 0) {
+      return true; // bottom-half of a bulk string
+    }
+    size_t unparsed_bytes = buffer->unparsed_bytes();
+    if (unparsed_bytes == 0) {
+      if (reply_array_pending_ == 0) {
+        backend->set_reply_recv_complete(); // its last bulk string received
+      }
+      return true;
     }
-    return true;
-  }
-
-  const char * entry = backend->buffer()->unparsed_data();
-  if (entry[0] != ':' && entry[0] != '+' &&
-      entry[0] != '-' && entry[0] != '$') {
-    LOG_WARN << "RedisBasicCommand ParseReply error ["
-             << std::string(entry, unparsed_bytes) << "]";
-    return false;
-  }
-
-  const char * p = static_cast<const char *>(
-                       memchr(entry, '\n', unparsed_bytes));
-  if (p == nullptr) {
-    return true;
-  }
 
-  if (entry[0] == '$') {
-    redis::Bulk bulk(entry, unparsed_bytes);
-    if (bulk.present_size() < 0) {
+    const char * entry = buffer->unparsed_data();
+    if (entry[0] != ':' && entry[0] != '+' && entry[0] != '-' &&
+        entry[0] != '$' && entry[0] != '*') {
+      LOG_WARN << "RedisBasicCommand ParseReply error ["
+               << std::string(entry, unparsed_bytes) << "]";
       return false;
     }
-    if (bulk.present_size() == 0) {
+
+    const char * p = static_cast<const char *>(
+                         memchr(entry, '\n', unparsed_bytes));
+    if (p == nullptr) {
       return true;
     }
-    if (bulk.completed()) {
-      LOG_DEBUG << "ParseReply bulk completed";
-      backend->set_reply_recv_complete();
+
+    if (entry[0] == '*') {
+      if (reply_array_pending_ > 0) {
+        LOG_WARN << "RedisBasicCommand ParseReply nested array unsupported";
+        return false;
+      }
+      long long elements = strtoll(entry + 1, nullptr, 10);
+      reply_array_pending_ = elements > 0 ? size_t(elements) : 0;
+      buffer->update_parsed_bytes(p - entry + 1);
+    } else {
+      if (entry[0] == '$') {
+        redis::Bulk bulk(entry, unparsed_bytes);
+        if (bulk.present_size() < 0) {
+          return false;
+        }
+        if (bulk.present_size() == 0) {
+          return true;
+        }
+        buffer->update_parsed_bytes(bulk.total_size());
+      } else {
+        buffer->update_parsed_bytes(p - entry + 1);
+      }
+      if (reply_array_pending_ > 0) {
+        --reply_array_pending_;
+      }
     }
-    backend->buffer()->update_parsed_bytes(bulk.total_size());
-  } else {
-    backend->set_reply_recv_complete();
-    backend->buffer()->update_parsed_bytes(p - entry + 1);
-  }
 
-  LOG_DEBUG << "Command ParseReply ok, resp.size=" << p - entry + 1
-            << " backend=" << backend;
-  return true;
+    LOG_DEBUG << "Command ParseReply ok, resp.size=" << p - entry + 1
+              << " backend=" << backend;
+    if (reply_array_pending_ == 0) {
+      if (buffer->parsed_unreceived_bytes() == 0) {
+        backend->set_reply_recv_complete();
+      }
+      return true;
+    }
+  }
 }
 
+// parses a one line reply, or the "VALUE" entries and "END" of a forwarded
+// get/gets
 bool Command::ParseMemcSimpleReply(std::shared_ptr<BackendConn> backend) {
-  const char * entry = backend->buffer()->unparsed_data();
-  const char * p = static_cast<const char *>(memchr(entry, '\n',
-                       backend->buffer()->unparsed_bytes()));
-  if (p != nullptr) {
-    backend->buffer()->update_parsed_bytes(p - entry + 1);
+  static const char kValue[] = "VALUE ";
+  ReadBuffer* buffer = backend->buffer();
+  while (buffer->parsed_unreceived_bytes() == 0 &&
+         buffer->unparsed_bytes() > 0) {
+    const char * entry = buffer->unparsed_data();
+    const char * p = static_cast<const char *>(memchr(entry, '\n',
+                         buffer->unparsed_bytes()));
+    if (p == nullptr) {
+      return true;
+    }
+    if (size_t(p - entry) > sizeof(kValue) &&
+        memcmp(entry, kValue, sizeof(kValue) - 1) == 0) {
+      // "VALUE <key> <flags> <bytes> [<cas unique>]\r\n<data>\r\n"
+      const char * q = entry + sizeof(kValue) - 1;
+      for(int spaces = 0; spaces < 2 && q < p; ++q) {
+        spaces += (*q == ' ');
+      }
+      size_t body_bytes = strtoul(q, nullptr, 10);
+      buffer->update_parsed_bytes(p - entry + 1 + body_bytes + 2);
+      continue;
+    }
+    buffer->update_parsed_bytes(p - entry + 1);
     backend->set_reply_recv_complete();
+    return true;
   }
   return true;
 }
@@ -583,7 +806,7 @@ void Command::TryWriteReply(std::shared_ptr<BackendConn> backend) {
     has_written_some_reply_ = true;
     backend->buffer()->inc_recycle_lock();
     client_conn_->WriteReply(backend->buffer()->unprocessed_data(),
-        unprocessed, WeakBind(&Command::OnWriteReplyFinished, backend));
+        unprocessed, shared_from_this(), backend);
     backend->buffer()->update_processed_bytes(unprocessed);
   }
 }
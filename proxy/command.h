@@ -9,6 +9,7 @@
 #include <vector>
 #include <string>
 
+#include "backend_handler.h"
 #include "protocol_type.h"
 namespace yarmproxy {
 
@@ -19,9 +20,8 @@ class ClientConnection;
 
 enum class ErrorCode;
 
-typedef std::function<void(ErrorCode ec)> WriteReplyCallback;
-
-class Command : public std::enable_shared_from_this<Command> {
+class Command : public BackendHandler,
+                public std::enable_shared_from_this<Command> {
 public:
   static size_t CreateCommand(std::shared_ptr<ClientConnection> client,
                            const char* buf, size_t size,
@@ -29,12 +29,12 @@ public:
   virtual ~Command();
   virtual bool StartWriteQuery();
   virtual bool ContinueWriteQuery();
-  virtual void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
-                                      ErrorCode ec);
+  void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
+                              ErrorCode ec) override;
   virtual void StartWriteReply();
 
-  virtual void OnWriteQueryFinished(std::shared_ptr<BackendConn> backend,
-                                    ErrorCode ec);
+  void OnWriteQueryFinished(std::shared_ptr<BackendConn> backend,
+                            ErrorCode ec) override;
   virtual void OnWriteReplyFinished(std::shared_ptr<BackendConn> backend,
                                     ErrorCode ec);
 
@@ -50,6 +50,9 @@ public:
 
   virtual bool ParseUnparsedPart() { return true; }
   virtual bool ProcessUnparsedPart() { return true; }
+
+  // the backends whose buffers keep the reply until its turn to be written
+  virtual size_t backend_count() const { return 1; }
 protected:
   Command(std::shared_ptr<ClientConnection> client, ProtocolType protocol);
 
@@ -57,28 +60,46 @@ protected:
   std::shared_ptr<KeyLocator> key_locator();
 
   void TryWriteReply(std::shared_ptr<BackendConn> backend);
+  // a query kept to be resent on the MOVED/ASK redirections of a redis
+  // cluster node
+  struct Redirection {
+    std::string query_;        // empty if the query can't be redirected
+    std::string asking_query_; // ASKING and the query, for ASK
+    int count_ = 0;
+    bool asking_ = false;      // expecting the +OK of ASKING
+  };
+  // whether the queries to the backend follow MOVED/ASK redirections, i.e.
+  // it's a redis cluster node
+  bool IsRedirectable(std::shared_ptr<BackendConn> backend);
+  // keeps a copy of the query, to resend it on MOVED/ASK redirections if
+  // the replying backend is a redis cluster node
+  void KeepQueryForRedirection(const char* data, size_t bytes);
   virtual void OnBackendRecoverableError(std::shared_ptr<BackendConn> backend, ErrorCode ec);
 
   const std::string& ErrorReply(ErrorCode ec);
   static const std::string& RedisErrorReply(ErrorCode ec);
   static const std::string& MemcErrorReply(ErrorCode ec);
 
-  typedef void(Command::*BackendCallback)(std::shared_ptr<BackendConn> backend, ErrorCode ec);
-  WriteReplyCallback WeakBind(BackendCallback mem_func, std::shared_ptr<BackendConn> backend) {
-    std::weak_ptr<Command> cmd_wptr(shared_from_this());
-    std::weak_ptr<BackendConn> backend_wptr(backend);
-    return [cmd_wptr, mem_func, backend_wptr](ErrorCode ec) {
-          if (auto cmd_ptr = cmd_wptr.lock()) {
-            auto backend = backend_wptr.lock();
-            ((*cmd_ptr).*mem_func)(backend, ec);
-          }
-        };
-  }
   virtual void RotateReplyingBackend();
   virtual bool ParseReply(std::shared_ptr<BackendConn> backend);
 
+  // whether a MOVED/ASK reply of the replying backend is followed
+  bool redirectable() const {
+    return !redirection_.query_.empty();
+  }
+  bool FollowRedirection(std::shared_ptr<BackendConn> backend) {
+    assert(backend == replying_backend_);
+    return FollowRedirection(&redirection_, &replying_backend_);
+  }
+  // follows a MOVED/ASK reply of `*backend`, e.g. the backend of a subquery
+  // of a multi-key command : the query is resent to the node of its slot,
+  // on a connection replacing `*backend`
+  // return : true if the reply is consumed to follow a redirection
+  bool FollowRedirection(Redirection* redirection,
+                         std::shared_ptr<BackendConn>* backend);
+
 private:
-  static bool ParseRedisSimpleReply(std::shared_ptr<BackendConn> backend);
+  bool ParseRedisSimpleReply(std::shared_ptr<BackendConn> backend);
   static bool ParseMemcSimpleReply(std::shared_ptr<BackendConn> backend);
 
 protected:
@@ -88,6 +109,11 @@ protected:
   bool is_writing_reply_ = false;
 private:
   ProtocolType protocol_;
+
+  Redirection redirection_;
+
+  // elements of an array reply not parsed yet, e.g. of a forwarded mget
+  size_t reply_array_pending_ = 0;
 };
 
 }
@@ -0,0 +1,195 @@
+#include "command_table.h"
+
+#include <stdint.h>
+
+namespace yarmproxy {
+
+// The command names are looked up in a perfect hash table, generated at
+// compile time. The hash of a name takes its size, and its first two and
+// last two bytes, case insensitive, multiplied by a constant chosen so that
+// no two commands collide. A command added to a table is checked by the
+// compiler, which tries the constants until one has no collision.
+
+static const size_t kSlotBits = 8;
+static const size_t kSlots = 1 << kSlotBits;
+
+static constexpr uint32_t NameKey(const char* name, size_t size) {
+  return (((uint32_t(name[0] | 0x20) * 31 + uint32_t(name[1] | 0x20)) * 31 +
+           uint32_t(name[size - 2] | 0x20)) * 31 +
+          uint32_t(name[size - 1] | 0x20)) + uint32_t(size);
+}
+
+static constexpr size_t Slot(uint32_t key, uint32_t multiplier) {
+  return uint32_t(key * multiplier) >> (32 - kSlotBits);
+}
+
+static constexpr uint32_t Multiplier(size_t attempt) {
+  return uint32_t(0x9e3779b9u * uint32_t(attempt + 1)) | 1;
+}
+
+template<typename Spec>
+static constexpr size_t SpecSlot(const Spec& spec, uint32_t multiplier) {
+  return Slot(NameKey(spec.name_, spec.name_size_), multiplier);
+}
+
+template<typename Spec, size_t N>
+static constexpr bool CollidesWith(const Spec (&specs)[N],
+                                   uint32_t multiplier, size_t i, size_t j) {
+  return j < N && (SpecSlot(specs[i], multiplier) ==
+                       SpecSlot(specs[j], multiplier) ||
+                   CollidesWith(specs, multiplier, i, j + 1));
+}
+
+template<typename Spec, size_t N>
+static constexpr bool HasCollision(const Spec (&specs)[N],
+                                   uint32_t multiplier, size_t i) {
+  return i < N && (CollidesWith(specs, multiplier, i, i + 1) ||
+                   HasCollision(specs, multiplier, i + 1));
+}
+
+// 0 if none of the attempts is collision free
+template<typename Spec, size_t N>
+static constexpr uint32_t FindMultiplier(const Spec (&specs)[N],
+                                         size_t attempt) {
+  return attempt >= 256 ? 0 :
+         !HasCollision(specs, Multiplier(attempt), 0) ? Multiplier(attempt) :
+         FindMultiplier(specs, attempt + 1);
+}
+
+template<size_t... I> struct IndexSequence {};
+template<size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+template<size_t... I>
+struct MakeIndexSequence<0, I...> : IndexSequence<I...> {};
+
+struct SlotTable {
+  uint8_t entries_[kSlots]; // index into the specs + 1, 0 if empty
+};
+
+template<typename Spec, size_t N>
+static constexpr uint8_t SlotEntry(const Spec (&specs)[N],
+                                   uint32_t multiplier, size_t slot,
+                                   size_t i) {
+  return i == N ? 0 :
+         SpecSlot(specs[i], multiplier) == slot ? uint8_t(i + 1) :
+         SlotEntry(specs, multiplier, slot, i + 1);
+}
+
+template<typename Spec, size_t N, size_t... I>
+static constexpr SlotTable MakeSlotTable(const Spec (&specs)[N],
+                                         uint32_t multiplier,
+                                         IndexSequence<I...>) {
+  return SlotTable{{SlotEntry(specs, multiplier, I, 0)...}};
+}
+
+// `case_mask` is 0x20 to ignore the case of the letters
+template<typename Spec, size_t N>
+static const Spec* Lookup(const Spec (&specs)[N], const SlotTable& slots,
+                          uint32_t multiplier, const char* name, size_t size,
+                          char case_mask) {
+  if (size < 2) {
+    return nullptr;
+  }
+  uint8_t entry = slots.entries_[Slot(NameKey(name, size), multiplier)];
+  if (entry == 0 || specs[entry - 1].name_size_ != size) {
+    return nullptr;
+  }
+  const Spec& spec = specs[entry - 1];
+  for(size_t i = 0; i < size; ++i) {
+    if ((name[i] | case_mask) != spec.name_[i]) {
+      return nullptr;
+    }
+  }
+  return &spec;
+}
+
+using RCT = RedisCommandType;
+
+// name, type, arity, first key, last key, key step, flags, reply merge
+static constexpr RedisCommandSpec kRedisCommands[] = {
+  {"get",         RCT::RCT_BASIC, 2, 1, 1, 1, kCommandReadOnly},
+  {"getset",      RCT::RCT_BASIC, 3, 1, 1, 1, kCommandWrite},
+  {"getrange",    RCT::RCT_BASIC, 4, 1, 1, 1, kCommandReadOnly},
+  {"ttl",         RCT::RCT_BASIC, 2, 1, 1, 1, kCommandReadOnly},
+  {"incr",        RCT::RCT_BASIC, 2, 1, 1, 1, kCommandWrite},
+  {"incrby",      RCT::RCT_BASIC, 3, 1, 1, 1, kCommandWrite},
+  {"incrbyfloat", RCT::RCT_BASIC, 3, 1, 1, 1, kCommandWrite},
+  {"decr",        RCT::RCT_BASIC, 2, 1, 1, 1, kCommandWrite},
+  {"decrby",      RCT::RCT_BASIC, 3, 1, 1, 1, kCommandWrite},
+  {"strlen",      RCT::RCT_BASIC, 2, 1, 1, 1, kCommandReadOnly},
+
+  {"set",         RCT::RCT_SET, -3, 1, 1, 1, kCommandWrite},
+  {"append",      RCT::RCT_SET,  3, 1, 1, 1, kCommandWrite},
+  {"setrange",    RCT::RCT_SET,  4, 1, 1, 1, kCommandWrite},
+  {"setnx",       RCT::RCT_SET,  3, 1, 1, 1, kCommandWrite},
+  {"psetex",      RCT::RCT_SET,  4, 1, 1, 1, kCommandWrite},
+  {"setex",       RCT::RCT_SET,  4, 1, 1, 1, kCommandWrite},
+
+  {"mget",        RCT::RCT_MGET, -2, 1, -1, 1, kCommandReadOnly},
+
+  {"mset",        RCT::RCT_FANOUT, -3, 1, -1, 2, kCommandWrite,
+                  RedisReplyMerge::ALL_OK},
+  // atomic per backend only, as a redis cluster rejects cross slot keys
+  {"msetnx",      RCT::RCT_FANOUT, -3, 1, -1, 2, kCommandWrite,
+                  RedisReplyMerge::ALL_ONE},
+  {"del",         RCT::RCT_FANOUT, -2, 1, -1, 1, kCommandWrite,
+                  RedisReplyMerge::SUM},
+  {"unlink",      RCT::RCT_FANOUT, -2, 1, -1, 1, kCommandWrite,
+                  RedisReplyMerge::SUM},
+  {"exists",      RCT::RCT_FANOUT, -2, 1, -1, 1, kCommandReadOnly,
+                  RedisReplyMerge::SUM},
+  // updates the access time, so not served by replicas
+  {"touch",       RCT::RCT_FANOUT, -2, 1, -1, 1, kCommandWrite,
+                  RedisReplyMerge::SUM},
+
+  {"yarmstats",   RCT::RCT_YARMSTATS, -1, 0, 0, 0, 0},
+};
+
+static constexpr uint32_t kRedisMultiplier = FindMultiplier(kRedisCommands, 0);
+static_assert(kRedisMultiplier != 0,
+              "redis command names collide, increase kSlotBits");
+static constexpr SlotTable kRedisSlots = MakeSlotTable(
+    kRedisCommands, kRedisMultiplier, MakeIndexSequence<kSlots>());
+
+using MCT = MemcCommandType;
+
+// name, type, first key, multi key, flags
+static constexpr MemcCommandSpec kMemcCommands[] = {
+  {"get",       MCT::MCT_GET, 1, true, kCommandReadOnly},
+  {"gets",      MCT::MCT_GET, 1, true, kCommandReadOnly},
+  // "gat <exptime> <key>*", updates the expiration time
+  {"gat",       MCT::MCT_GET, 2, true, kCommandWrite},
+  {"gats",      MCT::MCT_GET, 2, true, kCommandWrite},
+
+  {"set",       MCT::MCT_SET, 1, false, kCommandWrite},
+  {"add",       MCT::MCT_SET, 1, false, kCommandWrite},
+  {"replace",   MCT::MCT_SET, 1, false, kCommandWrite},
+  {"append",    MCT::MCT_SET, 1, false, kCommandWrite},
+  {"prepend",   MCT::MCT_SET, 1, false, kCommandWrite},
+  {"cas",       MCT::MCT_SET, 1, false, kCommandWrite},
+
+  {"delete",    MCT::MCT_BASIC, 1, false, kCommandWrite},
+  {"incr",      MCT::MCT_BASIC, 1, false, kCommandWrite},
+  {"decr",      MCT::MCT_BASIC, 1, false, kCommandWrite},
+  {"touch",     MCT::MCT_BASIC, 1, false, kCommandWrite},
+
+  {"yarmstats", MCT::MCT_YARMSTATS, 0, false, 0},
+};
+
+static constexpr uint32_t kMemcMultiplier = FindMultiplier(kMemcCommands, 0);
+static_assert(kMemcMultiplier != 0,
+              "memcached command names collide, increase kSlotBits");
+static constexpr SlotTable kMemcSlots = MakeSlotTable(
+    kMemcCommands, kMemcMultiplier, MakeIndexSequence<kSlots>());
+
+const RedisCommandSpec* LookupRedisCommand(const char* name, size_t size) {
+  return Lookup(kRedisCommands, kRedisSlots, kRedisMultiplier, name, size,
+                0x20);
+}
+
+const MemcCommandSpec* LookupMemcCommand(const char* name, size_t size) {
+  return Lookup(kMemcCommands, kMemcSlots, kMemcMultiplier, name, size, 0);
+}
+
+}
+
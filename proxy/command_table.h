@@ -0,0 +1,122 @@
+#ifndef _YARMPROXY_COMMAND_TABLE_H_
+#define _YARMPROXY_COMMAND_TABLE_H_
+
+#include <stddef.h>
+
+namespace yarmproxy {
+
+// the Command class a request is dispatched to
+enum class RedisCommandType {
+  RCT_BASIC,
+  RCT_SET,
+  RCT_MGET,
+  RCT_FANOUT, // RedisFanoutCommand, by key_step_ and reply_merge_
+  RCT_YARMSTATS,
+};
+
+enum class MemcCommandType {
+  MCT_GET,
+  MCT_SET,
+  MCT_BASIC,
+  MCT_YARMSTATS,
+};
+
+// command flags
+static const int kCommandReadOnly = 1; // could be served by a replica,
+                                       // or resent by a hedged read
+static const int kCommandWrite = 2;
+
+// how the replies of the backends of a fanned out command are merged into
+// one. the first error reply of any backend is replied instead
+enum class RedisReplyMerge {
+  NONE,    // not fanned out
+  ALL_OK,  // +OK, e.g. mset
+  SUM,     // the sum of the integer replies, e.g. del or exists
+  ALL_ONE, // :1 if every backend replies :1, or :0, e.g. msetnx per backend
+};
+
+struct RedisCommandSpec {
+  constexpr RedisCommandSpec(const char* name, RedisCommandType type,
+                             int arity, int first_key, int last_key,
+                             int key_step, int flags,
+                             RedisReplyMerge merge = RedisReplyMerge::NONE)
+      : name_(name), name_size_(NameSize(name)), type_(type), arity_(arity)
+      , first_key_(first_key), last_key_(last_key), key_step_(key_step)
+      , flags_(flags), reply_merge_(merge) {
+  }
+  static constexpr size_t NameSize(const char* name) {
+    return *name == '\0' ? 0 : 1 + NameSize(name + 1);
+  }
+
+  // whether a request of `bulks`, including the name, has a valid arity,
+  // with whole key groups, e.g. the key and value pairs of mset
+  bool CheckArity(size_t bulks) const {
+    if (arity_ >= 0) {
+      return bulks == size_t(arity_);
+    }
+    return bulks >= size_t(-arity_) &&
+           (key_step_ <= 1 || (bulks - first_key_) % key_step_ == 0);
+  }
+  // the index of the last key bulk, of a request of `bulks`
+  size_t last_key(size_t bulks) const {
+    return last_key_ >= 0 ? size_t(last_key_) : bulks + last_key_;
+  }
+
+  const char* name_; // lowercase
+  size_t name_size_;
+  RedisCommandType type_;
+  int arity_;     // bulks including the name, -N for N or more, as redis
+  int first_key_; // bulk index of the first key
+  int last_key_;  // bulk index of the last key, negative from the end
+  int key_step_;  // bulks from a key to the next
+  int flags_;
+  RedisReplyMerge reply_merge_;
+};
+
+struct MemcCommandSpec {
+  constexpr MemcCommandSpec(const char* name, MemcCommandType type,
+                            int first_key, bool multi_key, int flags)
+      : name_(name), name_size_(RedisCommandSpec::NameSize(name)), type_(type)
+      , first_key_(first_key), multi_key_(multi_key), flags_(flags) {
+  }
+
+  // the first key of a command line of tokens separated by a space, which
+  // ends at `end`, `end` if absent
+  const char* first_key(const char* cmd_line, const char* end) const {
+    const char* p = cmd_line;
+    for(int i = 0; i < first_key_ && p < end; ++i) {
+      while(p < end && *p != ' ') {
+        ++p;
+      }
+      ++p;
+    }
+    return p < end ? p : end;
+  }
+  // whether a command line ending at `end` has its first key, e.g. not the
+  // "gat 100" or "delete" without one memcached replies ERROR to
+  bool CheckArity(const char* cmd_line, const char* end) const {
+    if (first_key_ == 0) {
+      return true;
+    }
+    const char* key = first_key(cmd_line, end);
+    return key < end && *key != ' ';
+  }
+
+  const char* name_;
+  size_t name_size_;
+  MemcCommandType type_;
+  int first_key_;  // token index of the first key, e.g. 2 of "gat <exptime>"
+  bool multi_key_; // the keys are all the tokens from first_key_, or one
+  int flags_;
+};
+
+// the spec of the command name, case insensitive, nullptr if unsupported.
+// a perfect hash table lookup, without allocation
+const RedisCommandSpec* LookupRedisCommand(const char* name, size_t size);
+// the name is case sensitive, as memcached
+const MemcCommandSpec* LookupMemcCommand(const char* name, size_t size);
+
+}
+
+#endif // _YARMPROXY_COMMAND_TABLE_H_
+
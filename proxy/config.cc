@@ -8,6 +8,7 @@
 #include <boost/asio/ip/tcp.hpp>
 
 #include "logging.h"
+#include "key_hash.h"
 #include "protocol_type.h"
 
 namespace yarmproxy {
@@ -22,6 +23,9 @@ bool Config::ApplyTokens(const std::vector<std::string>& tokens) {
   if (context_ == "/worker") {
     return ApplyWorkerTokens(tokens);
   }
+  if (context_ == "/circuit_breaker") {
+    return ApplyCircuitBreakerTokens(tokens);
+  }
   error_msg_ = "unknown context ";
   error_msg_.append(context_);
   return false;
@@ -93,6 +97,39 @@ bool Config::ApplyGlobalTokens(const std::vector<std::string>& tokens) {
     }
   }
 
+  if (tokens.size() == 2 && tokens[0] == "backend_failure_limit") {
+    try {
+      backend_failure_limit_ = std::stoi(tokens[1]);
+      if (backend_failure_limit_ >= 0) {
+        return true;
+      }
+    } catch (...) {}
+    error_msg_ = "non-negative integer required";
+    return false;
+  }
+
+  if (tokens.size() == 2 && tokens[0] == "backend_retry_interval") {
+    try {
+      backend_retry_interval_ = std::stoi(tokens[1]);
+      if (backend_retry_interval_ > 0) {
+        return true;
+      }
+    } catch (...) {}
+    error_msg_ = "positive integer required";
+    return false;
+  }
+
+  if (tokens.size() == 2 && tokens[0] == "redis_cluster_refresh_interval") {
+    try {
+      redis_cluster_refresh_interval_ = std::stoi(tokens[1]);
+      if (redis_cluster_refresh_interval_ > 0) {
+        return true;
+      }
+    } catch (...) {}
+    error_msg_ = "positive integer required";
+    return false;
+  }
+
   if (tokens.size() == 2 && tokens[0] == "max_namespace_length") {
     try {
       max_namespace_length_ = std::stoi(tokens[1]);
@@ -125,6 +162,12 @@ bool Config::ApplyGlobalTokens(const std::vector<std::string>& tokens) {
     return true;
   }
 
+  if (tokens.size() == 2 && tokens[0] == "circuit_breaker" &&
+      tokens[1] == "{") {
+    PushSubcontext(tokens[0]);
+    return true;
+  }
+
 //if (tokens.size() == 2 && tokens[1] == "{") {
 //  PushSubcontext(tokens[0]);
 //  return true;
@@ -156,9 +199,11 @@ bool Config::ApplyWorkerTokens(const std::vector<std::string>& tokens) {
     }
     return true;
   } else if (tokens[0] == "cpu_affinity") {
-    // TODO : support cpu affinity
     worker_cpu_affinity_ = tokens[1] == "on" || tokens[1] == "1";
     return true;
+  } else if (tokens[0] == "incoming_cpu") {
+    worker_incoming_cpu_ = tokens[1] == "on" || tokens[1] == "1";
+    return true;
   } else if (tokens[0] == "buffer_size") {
     try {
       int sz = std::stoi(tokens[1]);
@@ -173,6 +218,19 @@ bool Config::ApplyWorkerTokens(const std::vector<std::string>& tokens) {
       return false;
     }
     return true;
+  } else if (tokens[0] == "pipeline_window") {
+    try {
+      int sz = std::stoi(tokens[1]);
+      if (sz < 1) {
+        error_msg_ = "bad pipeline window";
+        return false;
+      }
+      pipeline_window_ = size_t(sz) * 1024;
+    } catch (...) {
+      error_msg_ = "bad number";
+      return false;
+    }
+    return true;
   } else if (tokens[0] == "reserved_buffer_space") {
     try {
       int sz = std::stoi(tokens[1]);
@@ -191,6 +249,69 @@ bool Config::ApplyWorkerTokens(const std::vector<std::string>& tokens) {
   return false;
 }
 
+bool Config::ApplyCircuitBreakerTokens(
+    const std::vector<std::string>& tokens) {
+  if (tokens.size() == 1 && tokens[0] == "}") {
+    if (context_.empty()) {
+      return false;
+    }
+    PopSubcontext();
+    return true;
+  }
+  if (tokens.size() != 2) {
+    error_msg_ = "bad token count";
+    return false;
+  }
+
+  int value = 0;
+  try {
+    value = std::stoi(tokens[1]);
+  } catch (...) {
+    error_msg_ = "bad number";
+    return false;
+  }
+  if (value < 0) {
+    error_msg_ = "non-negative integer required";
+    return false;
+  }
+
+  if (tokens[0] == "error_rate") {
+    if (value > 100) {
+      error_msg_ = "error_rate should be in [0, 100]";
+      return false;
+    }
+    circuit_breaker_error_rate_ = value;
+    return true;
+  } else if (tokens[0] == "min_requests") {
+    circuit_breaker_min_requests_ = value;
+    return true;
+  } else if (tokens[0] == "window") {
+    circuit_breaker_window_ = value;
+    return true;
+  } else if (tokens[0] == "open_time") {
+    circuit_breaker_open_time_ = value;
+    return true;
+  }
+  error_msg_ = "unknown directive";
+  return false;
+}
+
+static bool ParseHostPort(const std::string& endpoint,
+                          std::string* host, int* port) {
+  size_t pos = endpoint.find_first_of(':');
+  if (pos == std::string::npos) {
+    return false;
+  }
+  try {
+    *host = endpoint.substr(0, pos);
+    boost::asio::ip::make_address_v4(*host);
+    *port = std::stoi(endpoint.substr(pos + 1));
+  } catch (...) {
+    return false;
+  }
+  return *port > 0;
+}
+
 bool Config::ApplyClusterTokens(const std::vector<std::string>& tokens) {
   if (tokens.size() == 1 && tokens[0] == "}") {
     if (context_.empty()) {
@@ -205,6 +326,10 @@ bool Config::ApplyClusterTokens(const std::vector<std::string>& tokens) {
       if (tokens[1] == "redis") {
         clusters_.back().protocol_ = ProtocolType::REDIS;
         return true;
+      } else if (tokens[1] == "redis_cluster") {
+        clusters_.back().protocol_ = ProtocolType::REDIS;
+        clusters_.back().redis_cluster_ = true;
+        return true;
       } else if (tokens[1] == "memcached") {
         clusters_.back().protocol_ = ProtocolType::MEMCACHED;
         return true;
@@ -226,26 +351,119 @@ bool Config::ApplyClusterTokens(const std::vector<std::string>& tokens) {
           std::back_inserter(clusters_.back().namespaces_));
       return true;
     }
+  } else if (tokens[0] == "adaptive_timeout") {
+    if (tokens.size() == 3) {
+      int min_timeout = 0;
+      int max_timeout = 0;
+      try {
+        min_timeout = std::stoi(tokens[1]);
+        max_timeout = std::stoi(tokens[2]);
+      } catch (...) {
+        error_msg_ = "bad number";
+        return false;
+      }
+      if (min_timeout <= 0 || max_timeout < min_timeout) {
+        error_msg_ = "0 < min_timeout <= max_timeout required";
+        return false;
+      }
+      clusters_.back().min_timeout_ = min_timeout;
+      clusters_.back().max_timeout_ = max_timeout;
+      return true;
+    }
   } else if (tokens[0] == "backends") {
     if (tokens.size() == 2 && tokens[1] == "{") {
       PushSubcontext(tokens[0]);
       return true;
     }
+  } else if (tokens[0] == "hash") {
+    if (tokens.size() == 2) {
+      if (GetKeyHashFunction(tokens[1]) == nullptr) {
+        error_msg_ = "unsupported hash function";
+        return false;
+      }
+      clusters_.back().hash_ = tokens[1];
+      return true;
+    }
+  } else if (tokens[0] == "distribution") {
+    if (tokens.size() == 2) {
+      if (tokens[1] == "continuum") {
+        clusters_.back().distribution_ = Distribution::CONTINUUM;
+      } else if (tokens[1] == "ketama") {
+        clusters_.back().distribution_ = Distribution::KETAMA;
+      } else if (tokens[1] == "modula") {
+        clusters_.back().distribution_ = Distribution::MODULA;
+      } else if (tokens[1] == "random") {
+        clusters_.back().distribution_ = Distribution::RANDOM;
+      } else if (tokens[1] == "jump") {
+        clusters_.back().distribution_ = Distribution::JUMP;
+      } else if (tokens[1] == "maglev") {
+        clusters_.back().distribution_ = Distribution::MAGLEV;
+      } else if (tokens[1] == "rendezvous") {
+        clusters_.back().distribution_ = Distribution::RENDEZVOUS;
+      } else {
+        error_msg_ = "unsupported distribution";
+        return false;
+      }
+      return true;
+    }
+  } else if (tokens[0] == "hash_tag") {
+    if (tokens.size() == 2) {
+      if (tokens[1].size() != 2) {
+        error_msg_ = "hash_tag should be 2 characters";
+        return false;
+      }
+      clusters_.back().hash_tag_ = tokens[1];
+      return true;
+    }
+  } else if (tokens[0] == "read_from_replicas") {
+    if (tokens.size() == 2) {
+      clusters_.back().read_from_replicas_ = tokens[1] == "on" ||
+                                             tokens[1] == "1";
+      return true;
+    }
+  } else if (tokens[0] == "hedged_reads") {
+    if (tokens.size() == 3) {
+      int percentile = 0;
+      int budget = 0;
+      try {
+        percentile = std::stoi(tokens[1]);
+        budget = std::stoi(tokens[2]);
+      } catch (...) {
+        error_msg_ = "bad number";
+        return false;
+      }
+      if (percentile <= 0 || percentile >= 100 ||
+          budget <= 0 || budget > 100) {
+        error_msg_ = "percentile in (0, 100) and budget in (0, 100] required";
+        return false;
+      }
+      clusters_.back().hedge_percentile_ = percentile;
+      clusters_.back().hedge_budget_ = budget;
+      return true;
+    }
+  } else if (tokens[0] == "bounded_load") {
+    if (tokens.size() == 2) {
+      int percent = 0;
+      try {
+        percent = std::stoi(tokens[1]);
+      } catch (...) {
+        error_msg_ = "bad number";
+        return false;
+      }
+      if (percent <= 0) {
+        error_msg_ = "positive bounded_load percent required";
+        return false;
+      }
+      clusters_.back().bounded_load_ = percent;
+      return true;
+    }
   } else if (tokens[0] == "backend") {
     if (context_ == "/cluster/backends") {
-      if (tokens.size() == 3) {
-        size_t pos = tokens[1].find_first_of(':');
-        if (pos == std::string::npos) {
-          error_msg_ = "endpoint bad format";
-          return false;
-        }
-        std::string host = tokens[1].substr(0, pos);
+      if (tokens.size() >= 3) {
+        std::string host;
         int port = 0;
         int weight = 0;
-        try {
-          boost::asio::ip::make_address_v4(host);
-          port = std::stoi(tokens[1].substr(pos + 1));
-        } catch (...) {
+        if (!ParseHostPort(tokens[1], &host, &port)) {
           error_msg_ = "bad endpoint";
           return false;
         }
@@ -255,12 +473,22 @@ bool Config::ApplyClusterTokens(const std::vector<std::string>& tokens) {
           error_msg_ = "bad weight";
           return false;
         }
-        if (port <= 0 || weight <= 0) {
+        if (weight <= 0) {
           error_msg_ = "illegal value";
           return false;
         }
         clusters_.back().backends_.emplace_back(
             std::move(host), port, weight);
+        for(size_t i = 3; i < tokens.size(); ++i) {
+          std::string replica_host;
+          int replica_port = 0;
+          if (!ParseHostPort(tokens[i], &replica_host, &replica_port)) {
+            error_msg_ = "bad replica endpoint";
+            return false;
+          }
+          clusters_.back().backends_.back().replicas_.emplace_back(
+              std::move(replica_host), replica_port);
+        }
         return true;
       }
     } else {
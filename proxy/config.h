@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace yarmproxy {
@@ -42,11 +43,48 @@ public:
     std::string host_;
     int port_;
     size_t weight_;
+    // optional read replicas, host & port
+    std::vector<std::pair<std::string, int>> replicas_;
+  };
+  // how keys are mapped to the backends of a cluster
+  enum class Distribution {
+    CONTINUUM, // yarmproxy's consistent hash continuum
+    KETAMA,    // twemproxy(nutcracker) compatible ketama
+    MODULA,    // twemproxy compatible, hash modulo the total weight
+    RANDOM,    // a random backend for each key
+    JUMP,      // jump consistent hash, no memory. weights are ignored
+    MAGLEV,    // maglev lookup table, O(1) lookup
+    RENDEZVOUS,// weighted rendezvous(highest random weight), O(backends)
   };
   struct Cluster {
     ProtocolType protocol_;
+    // `protocol redis_cluster`, a Redis Cluster whose slot table is fetched
+    // from the backends, which are only the seed nodes
+    bool redis_cluster_ = false;
+    std::string hash_ = "doobs"; // see kKeyHashNames
+    // two characters, e.g. "{}". only the part of a key between them is
+    // hashed if present, so keys sharing a tag go to the same backend
+    std::string hash_tag_;
+    Distribution distribution_ = Distribution::CONTINUUM;
     std::vector<std::string> namespaces_;
     std::vector<Backend>     backends_;
+    // adaptive backend timeout range in milliseconds, the global
+    // socket_rw_timeout is used if max_timeout_ is 0
+    int min_timeout_ = 0;
+    int max_timeout_ = 0;
+    // hedge idempotent reads to the first replica of a backend, if the
+    // backend doesn't reply within the percentile of its recent latency.
+    // hedges are limited to hedge_budget_ percent of the reads
+    int hedge_percentile_ = 0; // 0 : disabled
+    int hedge_budget_ = 0;
+    // route reads to the backend or one of its replicas, whichever is less
+    // loaded, by power of two choices. writes always go to the backend
+    bool read_from_replicas_ = false;
+    // bound the in-flight reads of each backend to (100 + bounded_load_)
+    // percent of the average, a read over the bound spills to the next
+    // backend clockwise of its key. for read-through caches only, where a
+    // miss on the spill backend is acceptable
+    int bounded_load_ = 0; // 0 : disabled
   };
 
   const std::string& config_file() const {
@@ -69,6 +107,9 @@ public:
   bool worker_cpu_affinity() const {
     return worker_cpu_affinity_;
   }
+  bool worker_incoming_cpu() const {
+    return worker_incoming_cpu_;
+  }
   size_t worker_max_idle_backends() const {
     return worker_max_idle_backends_;
   }
@@ -79,12 +120,37 @@ public:
   int socket_rw_timeout() const {
     return socket_rw_timeout_;
   }
+  int backend_failure_limit() const {
+    return backend_failure_limit_;
+  }
+  int backend_retry_interval() const {
+    return backend_retry_interval_;
+  }
+  int redis_cluster_refresh_interval() const {
+    return redis_cluster_refresh_interval_;
+  }
+
+  int circuit_breaker_error_rate() const {
+    return circuit_breaker_error_rate_;
+  }
+  int circuit_breaker_min_requests() const {
+    return circuit_breaker_min_requests_;
+  }
+  int circuit_breaker_window() const {
+    return circuit_breaker_window_;
+  }
+  int circuit_breaker_open_time() const {
+    return circuit_breaker_open_time_;
+  }
   size_t buffer_size() const {
     return buffer_size_;
   }
   size_t reserved_buffer_space() const {
     return reserved_buffer_space_;
   }
+  size_t pipeline_window() const {
+    return pipeline_window_;
+  }
 
   const std::vector<Cluster>& clusters() const {
     return clusters_;
@@ -108,11 +174,27 @@ private:
   int client_idle_timeout_ = 60000; // 60,000ms(one minute)
   int socket_rw_timeout_   = 500;   // 500 ms
 
+  int backend_failure_limit_  = 0;     // 0 : never eject failing backends
+  int backend_retry_interval_ = 10000; // 10,000ms
+
+  int redis_cluster_refresh_interval_ = 10000; // 10,000ms
+
+  // per worker, per backend circuit breaker
+  int circuit_breaker_error_rate_   = 0;    // in percent, 0 : disabled
+  int circuit_breaker_min_requests_ = 20;
+  int circuit_breaker_window_       = 1000; // ms
+  int circuit_breaker_open_time_    = 1000; // ms
+
   // per worker config
   size_t worker_max_idle_backends_  = 64;
   size_t buffer_size_            = 4096;
   size_t reserved_buffer_space_  = 0;
+  // the backend buffer bytes the pipelined commands of a client may hold
+  size_t pipeline_window_        = 256 * 1024;
   bool worker_cpu_affinity_      = false;
+  // hands an accepted client to the worker of the CPU its packets are
+  // received on, if the workers are pinned
+  bool worker_incoming_cpu_      = false;
 
   std::vector<Cluster> clusters_;
 private:
@@ -122,6 +204,7 @@ private:
   bool ApplyGlobalTokens(const std::vector<std::string>& tokens);
   bool ApplyClusterTokens(const std::vector<std::string>& tokens);
   bool ApplyWorkerTokens(const std::vector<std::string>& tokens);
+  bool ApplyCircuitBreakerTokens(const std::vector<std::string>& tokens);
 
   void PushSubcontext(const std::string& subcontext);
   void PopSubcontext();
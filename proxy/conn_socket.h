@@ -0,0 +1,38 @@
+#ifndef _YARMPROXY_CONN_SOCKET_H_
+#define _YARMPROXY_CONN_SOCKET_H_
+
+#include <stddef.h>
+
+#include <utility>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+
+#include "epoll_reactor.h"
+
+namespace yarmproxy {
+
+// the socket of the client and backend connections, a socket of the epoll
+// reactor of the worker if built with YARMPROXY_EPOLL_REACTOR, or an asio one
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+typedef ReactorSocket ConnSocket;
+#else
+typedef boost::asio::ip::tcp::socket ConnSocket;
+#endif
+
+// writes all the bytes, then calls handler(error, bytes_transferred)
+template <typename Handler>
+inline void AsyncWrite(ConnSocket& socket, const char* data, size_t bytes,
+                       Handler&& handler) {
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+  socket.async_write(data, bytes, std::forward<Handler>(handler));
+#else
+  boost::asio::async_write(socket, boost::asio::buffer(data, bytes),
+                           std::forward<Handler>(handler));
+#endif
+}
+
+}
+
+#endif // _YARMPROXY_CONN_SOCKET_H_
@@ -0,0 +1,40 @@
+#include "coro_task.h"
+
+#ifdef YARMPROXY_WITH_COROUTINES
+
+#include <new>
+
+namespace yarmproxy {
+
+thread_local FramePool::FreeFrame* FramePool::free_frames_[kClasses] = {};
+thread_local size_t FramePool::heap_frames_ = 0;
+
+void* FramePool::Alloc(size_t size) {
+  size_t cls = (size + kGranule - 1) / kGranule;
+  if (cls < kClasses && free_frames_[cls] != nullptr) {
+    FreeFrame* frame = free_frames_[cls];
+    free_frames_[cls] = frame->next_;
+    return frame;
+  }
+  ++heap_frames_;
+  return ::operator new(cls < kClasses ? cls * kGranule : size);
+}
+
+void FramePool::Free(void* frame, size_t size) {
+  size_t cls = (size + kGranule - 1) / kGranule;
+  if (cls >= kClasses) {
+    ::operator delete(frame);
+    return;
+  }
+  FreeFrame* free_frame = static_cast<FreeFrame*>(frame);
+  free_frame->next_ = free_frames_[cls];
+  free_frames_[cls] = free_frame;
+}
+
+size_t FramePool::heap_frames() {
+  return heap_frames_;
+}
+
+}
+
+#endif // YARMPROXY_WITH_COROUTINES
@@ -0,0 +1,138 @@
+#ifndef _YARMPROXY_CORO_TASK_H_
+#define _YARMPROXY_CORO_TASK_H_
+
+#ifdef YARMPROXY_WITH_COROUTINES
+
+#include <stddef.h>
+
+#include <coroutine>
+#include <exception>
+
+#include "error_code.h"
+
+namespace yarmproxy {
+
+// The coroutine frames of a worker, recycled by size class. A worker is a
+// thread, so the pool is thread local, and a frame is never shared by two
+// workers while it's in use. The frames of a class are allocated once, and
+// kept for the next commands, so that a command executed as a coroutine
+// costs no frame allocation in the steady state.
+class FramePool {
+public:
+  static void* Alloc(size_t size);
+  static void Free(void* frame, size_t size);
+
+  // the frames the worker allocated from the heap, i.e. not recycled
+  static size_t heap_frames();
+
+private:
+  static const size_t kGranule = 64;
+  static const size_t kClasses = 32; // the larger frames aren't pooled
+
+  struct FreeFrame {
+    FreeFrame* next_;
+  };
+  static thread_local FreeFrame* free_frames_[kClasses];
+  static thread_local size_t heap_frames_;
+};
+
+// A coroutine started eagerly, e.g. the execution of a command, owned by its
+// Task. It's suspended at its end, and destroyed with the Task, so that the
+// owner destroys a suspended coroutine whose completions never come, e.g.
+// when the client connection is aborted.
+class Task {
+public:
+  struct promise_type {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    static void* operator new(size_t size) {
+      return FramePool::Alloc(size);
+    }
+    static void operator delete(void* frame, size_t size) {
+      FramePool::Free(frame, size);
+    }
+  };
+
+  Task() {}
+  Task(Task&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      Destroy();
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+  ~Task() {
+    Destroy();
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  bool done() const {
+    return !handle_ || handle_.done();
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+  void Destroy() {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = nullptr;
+    }
+  }
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// A completion awaited by one coroutine, e.g. of the query written to a
+// backend. It's completed by a callback, which resumes the awaiting
+// coroutine in place. If it's completed before awaited, the error code is
+// kept, and the next co_await returns it without suspending.
+//
+// NOTE : g++ 12 miscompiles a co_await within a condition, so the result is
+// assigned to a variable before it's tested.
+class Completion {
+public:
+  bool await_ready() const noexcept {
+    return completed_;
+  }
+  void await_suspend(std::coroutine_handle<> waiter) noexcept {
+    waiter_ = waiter;
+  }
+  ErrorCode await_resume() noexcept {
+    completed_ = false;
+    return ec_;
+  }
+
+  void Complete(ErrorCode ec) {
+    ec_ = ec;
+    completed_ = true;
+    if (waiter_) {
+      std::coroutine_handle<> waiter = waiter_;
+      waiter_ = nullptr;
+      waiter.resume();
+    }
+  }
+  bool completed() const {
+    return completed_;
+  }
+
+private:
+  std::coroutine_handle<> waiter_;
+  ErrorCode ec_ = ErrorCode::E_SUCCESS;
+  bool completed_ = false;
+};
+
+}
+
+#endif // YARMPROXY_WITH_COROUTINES
+
+#endif // _YARMPROXY_CORO_TASK_H_
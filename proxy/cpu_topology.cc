@@ -0,0 +1,136 @@
+#include "cpu_topology.h"
+
+#include <dirent.h>
+
+#ifdef _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace yarmproxy {
+
+bool CpuTopology::ParseCpuList(const std::string& list,
+                               std::vector<int>* cpus) {
+  std::istringstream ranges(list.substr(0, list.find('\n')));
+  std::string range;
+  while(std::getline(ranges, range, ',')) {
+    int first, last;
+    char extra;
+    int fields = sscanf(range.c_str(), "%d-%d%c", &first, &last, &extra);
+    if (fields == 1 && sscanf(range.c_str(), "%d%c", &first, &extra) == 1) {
+      last = first;
+    } else if (fields != 2) {
+      return false;
+    }
+    if (first < 0 || last < first) {
+      return false;
+    }
+    for(int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+  return true;
+}
+
+std::vector<int> CpuTopology::AllowedCpus() {
+  std::vector<int> cpus;
+#ifdef _GNU_SOURCE
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &mask)) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+#endif
+  for(unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+    cpus.push_back(int(cpu));
+  }
+  return cpus;
+}
+
+bool CpuTopology::Load(const std::string& node_dir,
+                       const std::vector<int>& allowed_cpus) {
+  nodes_.clear();
+  std::set<int> allowed(allowed_cpus.begin(), allowed_cpus.end());
+  if (allowed.empty()) {
+    return false;
+  }
+
+  DIR* dir = opendir(node_dir.c_str());
+  if (dir != nullptr) {
+    while(dirent* entry = readdir(dir)) {
+      std::string name(entry->d_name);
+      if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+          name.find_first_not_of("0123456789", 4) != std::string::npos) {
+        continue;
+      }
+      std::ifstream file(node_dir + "/" + name + "/cpulist");
+      std::string list;
+      std::vector<int> cpus;
+      if (!std::getline(file, list) || !ParseCpuList(list, &cpus)) {
+        continue;
+      }
+      Node node;
+      node.id_ = std::atoi(name.c_str() + 4);
+      for(int cpu : cpus) {
+        if (allowed.count(cpu) > 0) {
+          node.cpus_.push_back(cpu);
+        }
+      }
+      if (!node.cpus_.empty()) { // not a memory only node
+        std::sort(node.cpus_.begin(), node.cpus_.end());
+        nodes_.push_back(std::move(node));
+      }
+    }
+    closedir(dir);
+  }
+
+  if (nodes_.empty()) {
+    Node node;
+    node.id_ = 0;
+    node.cpus_.assign(allowed.begin(), allowed.end());
+    nodes_.push_back(std::move(node));
+  }
+  std::sort(nodes_.begin(), nodes_.end(), [](const Node& a, const Node& b) {
+        return a.id_ < b.id_;
+      });
+  return true;
+}
+
+bool CpuTopology::Load() {
+  return Load("/sys/devices/system/node", AllowedCpus());
+}
+
+int CpuTopology::NodeOfCpu(int cpu) const {
+  for(const auto& node : nodes_) {
+    if (std::binary_search(node.cpus_.begin(), node.cpus_.end(), cpu)) {
+      return node.id_;
+    }
+  }
+  return -1;
+}
+
+std::vector<int> CpuTopology::PlaceWorkers(size_t workers) const {
+  std::vector<int> cpus;
+  if (nodes_.empty()) {
+    return cpus;
+  }
+  for(size_t i = 0; i < workers; ++i) {
+    const Node& node = nodes_[i % nodes_.size()];
+    cpus.push_back(node.cpus_[(i / nodes_.size()) % node.cpus_.size()]);
+  }
+  return cpus;
+}
+
+}
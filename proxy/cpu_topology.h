@@ -0,0 +1,50 @@
+#ifndef _YARMPROXY_CPU_TOPOLOGY_H_
+#define _YARMPROXY_CPU_TOPOLOGY_H_
+
+#include <string>
+#include <vector>
+
+namespace yarmproxy {
+
+// The NUMA nodes of the CPUs the process may run on, read from sysfs. The
+// workers are pinned by it, spread over the nodes, so that each one works on
+// the memory of its own node.
+class CpuTopology {
+public:
+  struct Node {
+    int id_;
+    std::vector<int> cpus_; // ascending
+  };
+
+  // reads the cpulist of each node under node_dir, keeping only the allowed
+  // CPUs and the nodes with some of them. without any node directory, e.g.
+  // a kernel built without NUMA, all the allowed CPUs are in the node 0.
+  // return : false if no CPU is allowed
+  bool Load(const std::string& node_dir, const std::vector<int>& allowed_cpus);
+  // loads /sys/devices/system/node with the affinity of the process
+  bool Load();
+
+  // the CPUs of the affinity mask of the calling thread
+  static std::vector<int> AllowedCpus();
+  // parses a sysfs cpu list, e.g. "0-3,8,10-11"
+  static bool ParseCpuList(const std::string& list, std::vector<int>* cpus);
+
+  const std::vector<Node>& nodes() const {
+    return nodes_;
+  }
+  // return : -1 if the CPU isn't allowed
+  int NodeOfCpu(int cpu) const;
+
+  // the CPU of each of the workers. the worker i is on the node
+  // i % nodes().size(), and the workers of a node take its CPUs in their
+  // sysfs order, i.e. usually the physical cores before their siblings, and
+  // share them if they outnumber them
+  std::vector<int> PlaceWorkers(size_t workers) const;
+
+private:
+  std::vector<Node> nodes_;
+};
+
+}
+
+#endif // _YARMPROXY_CPU_TOPOLOGY_H_
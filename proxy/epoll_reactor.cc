@@ -0,0 +1,434 @@
+#include "epoll_reactor.h"
+
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+namespace yarmproxy {
+
+boost::asio::io_service::id EpollReactor::id;
+
+static boost::system::error_code LastError() {
+  return boost::system::error_code(errno,
+             boost::asio::error::get_system_category());
+}
+
+EpollReactor::EpollReactor(boost::asio::io_service& io_service)
+    : boost::asio::io_service::service(io_service)
+    , io_service_(io_service)
+    , epoll_descriptor_(io_service) {
+  int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    throw boost::system::system_error(LastError(), "epoll_create1");
+  }
+  epoll_descriptor_.assign(epoll_fd);
+}
+
+EpollReactor::~EpollReactor() {
+}
+
+void EpollReactor::shutdown_service() {
+  // a socket might be destroyed with the handlers of another one
+  for(size_t slot = 0; slot < sockets_.size(); ++slot) {
+    if (sockets_[slot] != nullptr) {
+      sockets_[slot]->ReleaseHandlers();
+    }
+  }
+  completions_.clear();
+}
+
+uint32_t EpollReactor::Register(ReactorSocket* socket) {
+  uint32_t slot;
+  if (free_slots_.empty()) {
+    slot = uint32_t(sockets_.size());
+    sockets_.push_back(socket);
+    generations_.push_back(0);
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    sockets_[slot] = socket;
+  }
+  return slot;
+}
+
+void EpollReactor::Unregister(uint32_t slot) {
+  sockets_[slot] = nullptr;
+  ++generations_[slot];
+  free_slots_.push_back(slot);
+}
+
+bool EpollReactor::Watch(int fd, uint32_t slot, bool added,
+                         boost::system::error_code& ec) {
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.u64 = (uint64_t(generations_[slot]) << 32) | slot;
+  if (::epoll_ctl(epoll_descriptor_.native_handle(),
+                  added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) != 0) {
+    ec = LastError();
+    return false;
+  }
+  if (!watching_) {
+    AsyncWait();
+  }
+  return true;
+}
+
+void EpollReactor::AsyncWait() {
+  watching_ = true;
+  epoll_descriptor_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+      [this](const boost::system::error_code& ec) {
+        OnEpollReadable(ec);
+      });
+}
+
+void EpollReactor::OnEpollReadable(const boost::system::error_code& ec) {
+  if (ec) {
+    return; // the io_service is destroyed
+  }
+  int count = ::epoll_wait(epoll_descriptor_.native_handle(), ready_events_,
+                           kMaxEvents, 0);
+  if (count < 0) {
+    if (errno != EINTR) {
+      LOG_ERROR << "EpollReactor epoll_wait error=" << errno;
+    }
+    count = 0;
+  }
+  ++batches_;
+  events_ += count;
+
+  in_reactor_ = true;
+  for(int i = 0; i < count; ++i) {
+    uint64_t data = ready_events_[i].data.u64;
+    uint32_t slot = uint32_t(data);
+    if (sockets_[slot] != nullptr && generations_[slot] == data >> 32) {
+      sockets_[slot]->OnEvents(ready_events_[i].events);
+    }
+  }
+  RunCompletions();
+
+  if (count == kMaxEvents) {
+    // the rest of the events raise no new edge of the epoll descriptor.
+    // they're drained after the handlers queued meanwhile
+    io_service_.post([this]() {
+          OnEpollReadable(boost::system::error_code());
+        });
+  } else {
+    AsyncWait();
+  }
+}
+
+void EpollReactor::Schedule(uint32_t slot, int op_type) {
+  completions_.push_back(Completion{slot, generations_[slot], op_type});
+  if (!in_reactor_) {
+    PostCompletions();
+  }
+}
+
+void EpollReactor::RunCompletions() {
+  in_reactor_ = true;
+  // the completions of the operations the handlers start are run by the
+  // next turn, after the other handlers of the io_service
+  running_completions_.swap(completions_);
+  for(const Completion& completion : running_completions_) {
+    ReactorSocket* socket = sockets_[completion.slot_];
+    if (socket != nullptr &&
+        generations_[completion.slot_] == completion.generation_) {
+      socket->Complete(completion.op_type_);
+    }
+  }
+  running_completions_.clear();
+  in_reactor_ = false;
+
+  if (!completions_.empty()) {
+    PostCompletions();
+  }
+}
+
+void EpollReactor::PostCompletions() {
+  if (completions_posted_) {
+    return;
+  }
+  completions_posted_ = true;
+  io_service_.post([this]() {
+        completions_posted_ = false;
+        RunCompletions();
+      });
+}
+
+ReactorSocket::ReactorSocket(boost::asio::io_service& io_service)
+    : reactor_(boost::asio::use_service<EpollReactor>(io_service)) {
+}
+
+ReactorSocket::~ReactorSocket() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  if (slot_ != EpollReactor::kNoSlot) {
+    reactor_.Unregister(slot_);
+  }
+}
+
+ReactorSocket& ReactorSocket::operator=(ReactorSocket&& other) {
+  assert(other.ops_[READ_OP].state_ == IDLE &&
+         other.ops_[WAIT_OP].state_ == IDLE &&
+         other.ops_[WRITE_OP].state_ == IDLE);
+  close();
+  int fd = other.fd_;
+  if (fd < 0) {
+    return *this;
+  }
+  bool readable = other.readable_;
+  bool writable = other.writable_;
+  bool peer_closed = other.peer_closed_;
+  other.fd_ = -1;
+  other.readable_ = other.writable_ = other.peer_closed_ = false;
+
+  // the events of the descriptor are reported to this socket from now on
+  boost::system::error_code ec;
+  if (Open(fd, true, ec)) {
+    readable_ = readable;
+    writable_ = writable;
+    peer_closed_ = peer_closed;
+  } else {
+    LOG_WARN << "ReactorSocket move error=" << ec.message();
+    ::close(fd);
+  }
+  return *this;
+}
+
+bool ReactorSocket::Open(int fd, bool added, boost::system::error_code& ec) {
+  if (slot_ == EpollReactor::kNoSlot) {
+    slot_ = reactor_.Register(this);
+  }
+  if (!reactor_.Watch(fd, slot_, added, ec)) {
+    return false;
+  }
+  fd_ = fd;
+  readable_ = writable_ = true;
+  peer_closed_ = false;
+  return true;
+}
+
+void ReactorSocket::assign(int fd, boost::system::error_code& ec) {
+  assert(fd_ < 0);
+  int non_blocking = 1;
+  if (::ioctl(fd, FIONBIO, &non_blocking) != 0) {
+    ec = LastError();
+    return;
+  }
+  Open(fd, false, ec);
+}
+
+void ReactorSocket::close() {
+  if (fd_ >= 0) {
+    ::close(fd_); // which removes it from the epoll set
+    fd_ = -1;
+  }
+  readable_ = writable_ = peer_closed_ = false;
+  for(int type = 0; type < OP_TYPES; ++type) {
+    if (ops_[type].state_ == PENDING) {
+      ops_[type].connecting_ = false;
+      Schedule(OpType(type), boost::asio::error::operation_aborted);
+    }
+  }
+}
+
+size_t ReactorSocket::available(boost::system::error_code& ec) const {
+  int bytes = 0;
+  if (::ioctl(fd_, FIONREAD, &bytes) != 0) {
+    ec = LastError();
+    return 0;
+  }
+  ec = boost::system::error_code();
+  return size_t(bytes);
+}
+
+void ReactorSocket::StartConnect(
+    const boost::asio::ip::tcp::endpoint& endpoint) {
+  Op& op = ops_[WRITE_OP];
+  assert(op.state_ == IDLE);
+  op.state_ = PENDING;
+
+  bool opened = fd_ < 0;
+  int fd = fd_;
+  if (opened) {
+    fd = ::socket(endpoint.protocol().family(),
+                  SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+      Schedule(WRITE_OP, LastError());
+      return;
+    }
+  }
+  int ret = ::connect(fd, endpoint.data(), endpoint.size());
+  boost::system::error_code ec;
+  if (ret != 0 && errno != EINPROGRESS && errno != EINTR) {
+    ec = LastError();
+  } else if (opened) {
+    // watched once connecting, as an unconnected socket is reported hung up
+    Open(fd, false, ec);
+  }
+  if (ec) {
+    if (opened) {
+      ::close(fd);
+    }
+    Schedule(WRITE_OP, ec);
+    return;
+  }
+  readable_ = false;
+  writable_ = ret == 0;
+  op.connecting_ = true;
+  Perform(WRITE_OP);
+}
+
+void ReactorSocket::StartOp(OpType type) {
+  Op& op = ops_[type];
+  assert(op.state_ == IDLE);
+  op.state_ = PENDING;
+  op.transferred_ = 0;
+  if (fd_ < 0) {
+    Schedule(type, boost::asio::error::bad_descriptor);
+    return;
+  }
+  Perform(type);
+}
+
+void ReactorSocket::Perform(OpType type) {
+  Op& op = ops_[type];
+  switch(type) {
+  case READ_OP:
+    if (op.bytes_ == 0) {
+      Schedule(type, boost::system::error_code());
+      return;
+    }
+    while(readable_) {
+      ssize_t bytes = ::recv(fd_, op.data_, op.bytes_, 0);
+      if (bytes > 0) {
+        // a short read has drained the socket, and the data received later
+        // raises a new edge. but no edge follows the hang up, which may have
+        // come with this data, so the next read returns the eof
+        readable_ = peer_closed_ || size_t(bytes) == op.bytes_;
+        op.transferred_ = size_t(bytes);
+        Schedule(type, boost::system::error_code());
+        return;
+      } else if (bytes == 0) {
+        Schedule(type, boost::asio::error::eof);
+        return;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        readable_ = false;
+      } else if (errno != EINTR) {
+        Schedule(type, LastError());
+        return;
+      }
+    }
+    break;
+  case WAIT_OP:
+    while(readable_) {
+      char byte;
+      ssize_t bytes = ::recv(fd_, &byte, 1, MSG_PEEK);
+      if (bytes >= 0 ||
+          (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // the error, if any, is reported by the read
+        Schedule(type, boost::system::error_code());
+        return;
+      } else if (errno != EINTR) {
+        readable_ = false;
+      }
+    }
+    break;
+  case WRITE_OP:
+    if (op.connecting_) {
+      if (writable_) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+          error = errno;
+        }
+        op.connecting_ = false;
+        Schedule(type, boost::system::error_code(error,
+                           boost::asio::error::get_system_category()));
+      }
+      return;
+    }
+    // unlike a short read, a short write is retried until EAGAIN, which
+    // makes sure a new edge is raised once there's free space
+    while(op.transferred_ < op.bytes_ && writable_) {
+      ssize_t bytes = ::send(fd_, op.data_ + op.transferred_,
+                             op.bytes_ - op.transferred_, MSG_NOSIGNAL);
+      if (bytes >= 0) {
+        op.transferred_ += size_t(bytes);
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        writable_ = false;
+      } else if (errno != EINTR) {
+        Schedule(type, LastError());
+        return;
+      }
+    }
+    if (op.transferred_ == op.bytes_) {
+      Schedule(type, boost::system::error_code());
+    }
+    break;
+  default:
+    assert(false);
+    break;
+  }
+}
+
+void ReactorSocket::Schedule(OpType type,
+                             const boost::system::error_code& ec) {
+  Op& op = ops_[type];
+  op.state_ = SCHEDULED;
+  op.ec_ = ec;
+  if (slot_ == EpollReactor::kNoSlot) {
+    slot_ = reactor_.Register(this);
+  }
+  reactor_.Schedule(slot_, type);
+}
+
+void ReactorSocket::OnEvents(uint32_t events) {
+  if (fd_ < 0) {
+    return; // a stale event of a closed descriptor
+  }
+  if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    peer_closed_ = true;
+  }
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    readable_ = true;
+  }
+  if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+    writable_ = true;
+  }
+  for(int type = 0; type < OP_TYPES; ++type) {
+    if (ops_[type].state_ == PENDING) {
+      Perform(OpType(type));
+    }
+  }
+}
+
+void ReactorSocket::Complete(int type) {
+  Op& op = ops_[type];
+  if (op.state_ != SCHEDULED) {
+    return;
+  }
+  ReactorHandler handler(std::move(op.handler_));
+  boost::system::error_code ec = op.ec_;
+  op.state_ = IDLE;
+  // the handler might start the next operation, or destroy this socket
+  handler(ec, op.transferred_);
+}
+
+void ReactorSocket::ReleaseHandlers() {
+  // moved out first, as destroying a handler might destroy this socket
+  ReactorHandler read_handler(std::move(ops_[READ_OP].handler_));
+  ReactorHandler wait_handler(std::move(ops_[WAIT_OP].handler_));
+  ReactorHandler write_handler(std::move(ops_[WRITE_OP].handler_));
+  for(int type = 0; type < OP_TYPES; ++type) {
+    ops_[type].state_ = IDLE;
+  }
+}
+
+}
+
+#endif // YARMPROXY_WITH_EPOLL_REACTOR
@@ -0,0 +1,312 @@
+#ifndef _YARMPROXY_EPOLL_REACTOR_H_
+#define _YARMPROXY_EPOLL_REACTOR_H_
+
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+namespace yarmproxy {
+
+class ReactorSocket;
+
+// The completion handler of a socket operation, called as
+// handler(error, bytes_transferred). It's stored in place, e.g. a member
+// function of a connection bound to the connection, so that starting an
+// operation allocates nothing.
+class ReactorHandler {
+public:
+  static const size_t kMaxBytes = 96;
+
+  ReactorHandler() {}
+  ReactorHandler(ReactorHandler&& other) {
+    if (other.manage_ != nullptr) {
+      other.manage_(&other, this);
+      std::swap(invoke_, other.invoke_);
+      std::swap(manage_, other.manage_);
+    }
+  }
+  ~ReactorHandler() {
+    if (manage_ != nullptr) {
+      manage_(this, nullptr);
+    }
+  }
+  ReactorHandler(const ReactorHandler&) = delete;
+  ReactorHandler& operator=(const ReactorHandler&) = delete;
+
+  template <typename Handler>
+  void Set(Handler&& handler) {
+    typedef typename std::decay<Handler>::type Stored;
+    static_assert(sizeof(Stored) <= kMaxBytes, "too large reactor handler");
+    static_assert(alignof(Stored) <= alignof(Storage),
+                  "over-aligned reactor handler");
+    assert(manage_ == nullptr);
+    new (&storage_) Stored(std::forward<Handler>(handler));
+    invoke_ = &Invoke<Stored>;
+    manage_ = &Manage<Stored>;
+  }
+  void operator()(const boost::system::error_code& ec, size_t bytes) {
+    invoke_(this, ec, bytes);
+  }
+
+private:
+  typedef typename std::aligned_storage<kMaxBytes>::type Storage;
+
+  template <typename Stored>
+  static void Invoke(ReactorHandler* self, const boost::system::error_code& ec,
+                     size_t bytes) {
+    (*reinterpret_cast<Stored*>(&self->storage_))(ec, bytes);
+  }
+  // moves the handler of from to to, or destroys it if to is nullptr
+  template <typename Stored>
+  static void Manage(ReactorHandler* from, ReactorHandler* to) {
+    Stored* stored = reinterpret_cast<Stored*>(&from->storage_);
+    if (to != nullptr) {
+      new (&to->storage_) Stored(std::move(*stored));
+    }
+    stored->~Stored();
+  }
+
+  Storage storage_;
+  void (*invoke_)(ReactorHandler*, const boost::system::error_code&,
+                  size_t) = nullptr;
+  void (*manage_)(ReactorHandler*, ReactorHandler*) = nullptr;
+};
+
+// A minimal reactor of a worker, serving the client and backend connections
+// instead of the reactor of asio, which locks the state of the descriptor,
+// allocates and queues an operation, and posts its completion through the
+// scheduler, for each read or write.
+//
+// The sockets are registered once, edge triggered, for both the reads and
+// the writes, and are never modified. The epoll descriptor is watched by the
+// io_service of the worker, so that the timers and the handlers posted to
+// the worker still run in its thread: one asio wait costs a batch of events,
+// and the events are drained by epoll_wait until it returns less than a
+// batch. The completions are queued, and called once the batch is handled,
+// or from a handler posted once for the completions of the operations
+// started out of the reactor, e.g. by a timer.
+class EpollReactor : public boost::asio::io_service::service {
+public:
+  static boost::asio::io_service::id id;
+
+  explicit EpollReactor(boost::asio::io_service& io_service);
+  ~EpollReactor();
+
+  // the epoll_wait calls, and the events they returned
+  uint64_t batches() const {
+    return batches_;
+  }
+  uint64_t events() const {
+    return events_;
+  }
+
+private:
+  friend class ReactorSocket;
+  static const int kMaxEvents = 128;
+  static const uint32_t kNoSlot = ~uint32_t(0);
+
+  // destroys the handlers of the pending operations, which might hold their
+  // connections
+  void shutdown_service() override;
+
+  uint32_t Register(ReactorSocket* socket);
+  void Unregister(uint32_t slot);
+  // adds, or points to another socket, the descriptor of the socket
+  bool Watch(int fd, uint32_t slot, bool added,
+             boost::system::error_code& ec);
+  void Schedule(uint32_t slot, int op_type);
+
+  void AsyncWait();
+  void OnEpollReadable(const boost::system::error_code& ec);
+  void RunCompletions();
+  void PostCompletions();
+
+  boost::asio::io_service& io_service_;
+  boost::asio::posix::stream_descriptor epoll_descriptor_;
+  bool watching_ = false; // by an asio wait, or by a drain posted
+
+  // the registered sockets by slot. a slot is reused once its socket is
+  // destroyed, with its generation incremented, so that a stale event or
+  // completion of the previous socket is dropped
+  std::vector<ReactorSocket*> sockets_;
+  std::vector<uint32_t> generations_;
+  std::vector<uint32_t> free_slots_;
+
+  struct Completion {
+    uint32_t slot_;
+    uint32_t generation_;
+    int op_type_;
+  };
+  std::vector<Completion> completions_;
+  std::vector<Completion> running_completions_;
+  bool in_reactor_ = false;    // handling the events, or the completions
+  bool completions_posted_ = false;
+
+  epoll_event ready_events_[kMaxEvents];
+  uint64_t batches_ = 0;
+  uint64_t events_ = 0;
+};
+
+// A non-blocking TCP socket of the EpollReactor of its io_service, with the
+// subset of the asio socket interface the client and backend connections
+// use, i.e. the state machine of a connection on the reactor.
+//
+// The socket tracks its readiness. An operation is performed at once while
+// the socket is ready, so that a read or a write drains the socket, until
+// EAGAIN, or until a short read or write, which tells it's drained. It waits
+// for the next edge otherwise. As with asio, the handler is never called by
+// the function starting the operation, and closing the socket completes the
+// pending operations with operation_aborted.
+class ReactorSocket {
+public:
+  enum wait_type {
+    wait_read
+  };
+
+  explicit ReactorSocket(boost::asio::io_service& io_service);
+  ~ReactorSocket();
+  ReactorSocket(const ReactorSocket&) = delete;
+  ReactorSocket& operator=(const ReactorSocket&) = delete;
+  // closes this socket, and takes the descriptor of other, which has no
+  // pending operation
+  ReactorSocket& operator=(ReactorSocket&& other);
+
+  bool is_open() const {
+    return fd_ >= 0;
+  }
+  int native_handle() const {
+    return fd_;
+  }
+  // takes a connected descriptor, e.g. an accepted one
+  void assign(int fd, boost::system::error_code& ec);
+  void close();
+
+  template <typename Option>
+  void set_option(const Option& option, boost::system::error_code& ec) {
+    // the tcp options don't depend on the address family
+    boost::asio::ip::tcp protocol = boost::asio::ip::tcp::v4();
+    if (::setsockopt(fd_, option.level(protocol), option.name(protocol),
+                     option.data(protocol), option.size(protocol)) != 0) {
+      ec = boost::system::error_code(errno,
+               boost::asio::error::get_system_category());
+    } else {
+      ec = boost::system::error_code();
+    }
+  }
+  size_t available(boost::system::error_code& ec) const;
+
+  // handler(error)
+  template <typename Handler>
+  void async_connect(const boost::asio::ip::tcp::endpoint& endpoint,
+                     Handler&& handler) {
+    ops_[WRITE_OP].handler_.Set(
+        ErrorHandler<typename std::decay<Handler>::type>{
+            std::forward<Handler>(handler)});
+    StartConnect(endpoint);
+  }
+  // handler(error, bytes_transferred)
+  template <typename Handler>
+  void async_read_some(const boost::asio::mutable_buffer& buffer,
+                       Handler&& handler) {
+    Op& op = ops_[READ_OP];
+    op.handler_.Set(std::forward<Handler>(handler));
+    op.data_ = static_cast<char*>(buffer.data());
+    op.bytes_ = buffer.size();
+    StartOp(READ_OP);
+  }
+  // writes all the bytes, as boost::asio::async_write.
+  // handler(error, bytes_transferred)
+  template <typename Handler>
+  void async_write(const char* data, size_t bytes, Handler&& handler) {
+    Op& op = ops_[WRITE_OP];
+    op.handler_.Set(std::forward<Handler>(handler));
+    op.data_ = const_cast<char*>(data); // never written through
+    op.bytes_ = bytes;
+    StartOp(WRITE_OP);
+  }
+  // completes once the socket is readable, without reading. handler(error)
+  template <typename Handler>
+  void async_wait(wait_type, Handler&& handler) {
+    ops_[WAIT_OP].handler_.Set(
+        ErrorHandler<typename std::decay<Handler>::type>{
+            std::forward<Handler>(handler)});
+    StartOp(WAIT_OP);
+  }
+
+private:
+  friend class EpollReactor;
+
+  // the operations of each type are serialized by the connections, e.g. a
+  // read is started once the previous one is completed. the connect is a
+  // write operation, as no write is started before it's completed
+  enum OpType {
+    READ_OP,
+    WAIT_OP,
+    WRITE_OP,
+    OP_TYPES
+  };
+  enum OpState {
+    IDLE,
+    PENDING,   // waiting for the readiness
+    SCHEDULED, // its completion is queued by the reactor
+  };
+  struct Op {
+    ReactorHandler handler_;
+    OpState state_ = IDLE;
+    bool connecting_ = false;
+    char* data_ = nullptr;
+    size_t bytes_ = 0;
+    size_t transferred_ = 0;
+    boost::system::error_code ec_;
+  };
+
+  template <typename Handler>
+  struct ErrorHandler {
+    Handler handler_;
+    void operator()(const boost::system::error_code& ec, size_t) {
+      handler_(ec);
+    }
+  };
+
+  bool Open(int fd, bool connected, boost::system::error_code& ec);
+  void StartConnect(const boost::asio::ip::tcp::endpoint& endpoint);
+  void StartOp(OpType type);
+  // performs the operation if the socket is ready, and schedules its
+  // completion once it's done
+  void Perform(OpType type);
+  void Schedule(OpType type, const boost::system::error_code& ec);
+  // called by the reactor
+  void OnEvents(uint32_t events);
+  void Complete(int type);
+  void ReleaseHandlers();
+
+  EpollReactor& reactor_;
+  uint32_t slot_ = EpollReactor::kNoSlot; // registered on the first use
+  int fd_ = -1;
+  bool readable_ = false;
+  bool writable_ = false;
+  // the peer shut down or the connection failed, which is signaled once
+  bool peer_closed_ = false;
+  Op ops_[OP_TYPES];
+};
+
+}
+
+#endif // YARMPROXY_WITH_EPOLL_REACTOR
+
+#endif // _YARMPROXY_EPOLL_REACTOR_H_
@@ -25,6 +25,9 @@ const char* ErrorCodeString(ErrorCode ec) {
   case ErrorCode::E_BACKEND_READ_TIMEOUT:
     return "E_BACKEND_READ_TIMEOUT";
 
+  case ErrorCode::E_CIRCUIT_OPEN:
+    return "E_CIRCUIT_OPEN";
+
   default:
     return "E_UNKNOWN";
   }
@@ -19,6 +19,8 @@ enum class ErrorCode {
   E_BACKEND_WRITE_TIMEOUT   = 9,
   E_BACKEND_READ_TIMEOUT    = 10,
 
+  E_CIRCUIT_OPEN = 11,
+
   E_OTHERS   = 100,
 };
 
@@ -17,7 +17,7 @@ ErrorCommand::~ErrorCommand() {
 }
 
 bool ErrorCommand::StartWriteQuery() {
-  if (client_conn_->IsFirstCommand(shared_from_this())) {
+  if (client_conn_->IsFirstCommand(this)) {
     StartWriteReply();
   }
   return false;
@@ -25,7 +25,7 @@ bool ErrorCommand::StartWriteQuery() {
 
 void ErrorCommand::StartWriteReply() {
   client_conn_->WriteReply(reply_message_.data(), reply_message_.size(),
-          WeakBind(&Command::OnWriteReplyFinished, nullptr));
+                           shared_from_this(), nullptr);
 }
 
 void ErrorCommand::OnWriteReplyFinished(std::shared_ptr<BackendConn> backend,
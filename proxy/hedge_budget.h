@@ -0,0 +1,37 @@
+#ifndef _YARMPROXY_HEDGE_BUDGET_H_
+#define _YARMPROXY_HEDGE_BUDGET_H_
+
+#include <algorithm>
+
+namespace yarmproxy {
+
+// Per worker, per endpoint token bucket, limits hedged reads to `ratio`
+// percent of the hedgeable reads, with a small burst allowance.
+class HedgeBudget {
+public:
+  void set_ratio(int ratio) {
+    ratio_ = ratio;
+  }
+
+  void OnRead() {
+    tokens_ = std::min(tokens_ + ratio_, int(kMaxTokens));
+  }
+
+  bool TryAcquire() {
+    if (tokens_ < 100) {
+      return false;
+    }
+    tokens_ -= 100;
+    return true;
+  }
+
+private:
+  static const int kMaxTokens = 10 * 100; // burst of 10 hedges
+
+  int ratio_ = 0;  // in percent
+  int tokens_ = 0; // in 1/100 of a hedge
+};
+
+}
+
+#endif // _YARMPROXY_HEDGE_BUDGET_H_
@@ -1,70 +1,511 @@
 #include "key_distributer.h"
 
-#include "logging.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
 
-#include "doobs_hash.h"
+#include "logging.h"
 
 namespace yarmproxy {
 
-KeyDistributer::KeyDistributer(const std::vector<Config::Backend>& backends) {
-  for(auto& backend : backends) {
+const uint16_t KeyDistributer::kEjectedBucket;
+
+KeyDistributer::KeyDistributer(const Config::Cluster& cluster,
+                               const std::set<Endpoint>& ejected)
+    : distribution_(cluster.distribution_)
+    , hash_(GetKeyHashFunction(cluster.hash_))
+    , has_hash_tag_(cluster.hash_tag_.size() == 2)
+    , hash_tag_open_(has_hash_tag_ ? cluster.hash_tag_[0] : 0)
+    , hash_tag_close_(has_hash_tag_ ? cluster.hash_tag_[1] : 0) {
+  auto add_node = [this](const Endpoint& ep, size_t weight) {
+    for(auto& node : weighted_nodes_) {
+      if (node.first == ep) {
+        return;
+      }
+    }
+    weighted_nodes_.emplace_back(ep, weight);
+  };
+  for(auto& backend : cluster.backends_) {
     LOG_DEBUG << "KeyDistributerctor host=" << backend.host_
               << " port=" << backend.port_
               << " weight=" << backend.weight_;
     auto ep = Endpoint(boost::asio::ip::address_v4::from_string(backend.host_),
                                 backend.port_);
-    weighted_nodes_.emplace(ep, backend.weight_);
+    if (ejected.count(ep) > 0) {
+      LOG_WARN << "KeyDistributer skip ejected backend " << ep;
+      continue;
+    }
+    add_node(ep, backend.weight_);
   }
-  BuildCachePoints();
-}
 
+  if (weighted_nodes_.empty() && !ejected.empty()) {
+    LOG_ERROR << "KeyDistributer all backends ejected, keep them all";
+    for(auto& backend : cluster.backends_) {
+      add_node(Endpoint(
+          boost::asio::ip::address_v4::from_string(backend.host_),
+          backend.port_), backend.weight_);
+    }
+  }
 
-bool KeyDistributer::BuildCachePoints() {
   if (weighted_nodes_.empty()) {
-    LOG_WARN << "KeyDistributer::BuildCachePoints empty node list!";
-    return false;
+    LOG_WARN << "KeyDistributer empty node list!";
+    return;
+  }
+  if (weighted_nodes_.size() > UINT16_MAX) {
+    LOG_ERROR << "KeyDistributer too many nodes!";
+    return;
+  }
+  for(auto& node : weighted_nodes_) {
+    endpoints_.push_back(node.first);
+  }
+
+  switch(distribution_) {
+  case Config::Distribution::KETAMA:
+    BuildKetamaPoints();
+    break;
+  case Config::Distribution::MODULA:
+    BuildModulaSlots();
+    break;
+  case Config::Distribution::RANDOM:
+    break;
+  case Config::Distribution::JUMP:
+    BuildJumpBuckets(cluster);
+    break;
+  case Config::Distribution::MAGLEV:
+    BuildMaglevTable();
+    break;
+  case Config::Distribution::RENDEZVOUS:
+    BuildRendezvousSeeds();
+    break;
+  default:
+    BuildCachePoints();
   }
+}
+
+
+// fills the Eytzinger positions under `k` with sorted[i...], in order
+static size_t EytzingerFill(
+    const std::vector<std::pair<uint32_t, uint16_t>>& sorted, size_t i,
+    size_t k, std::vector<uint32_t>* hash_points,
+    std::vector<uint16_t>* endpoint_indexes) {
+  if (k < hash_points->size()) {
+    i = EytzingerFill(sorted, i, 2 * k, hash_points, endpoint_indexes);
+    (*hash_points)[k] = sorted[i].first;
+    (*endpoint_indexes)[k] = sorted[i].second;
+    ++i;
+    i = EytzingerFill(sorted, i, 2 * k + 1, hash_points, endpoint_indexes);
+  }
+  return i;
+}
+
+void KeyDistributer::FillContinuum(
+    std::vector<std::pair<uint32_t, uint16_t>>* points) {
+  std::sort(points->begin(), points->end(),
+      [](const std::pair<uint32_t, uint16_t>& l,
+         const std::pair<uint32_t, uint16_t>& r) {
+        return l.first < r.first;
+      });
+
+  hash_points_.resize(points->size() + 1);
+  endpoint_indexes_.resize(points->size() + 1);
+  EytzingerFill(*points, 0, 1, &hash_points_, &endpoint_indexes_);
 
-  std::vector<CachePoint> new_cache_points;
-  for(const auto& it : weighted_nodes_) {
+  // the leftmost node holds the smallest point
+  first_point_ = 1;
+  while (2 * first_point_ < hash_points_.size()) {
+    first_point_ *= 2;
+  }
+}
+
+bool KeyDistributer::BuildCachePoints() {
+  std::vector<std::pair<uint32_t, uint16_t>> sorted_points;
+  for(size_t i = 0; i < weighted_nodes_.size(); ++i) {
+    const Endpoint& ep = weighted_nodes_[i].first;
     char ss[64];
-    for(size_t k = 0; k < it.second; ++k) {
-      snprintf(ss, 63, "%lu-%lu-%u", k, it.first.address().to_v4().to_ulong(),
-                                    it.first.port());
-      // TODO : support various hash functions
-      uint32_t hash_point = doobs_hash(ss, strlen(ss));
-      new_cache_points.push_back(CachePoint(hash_point, it.first));
+    for(size_t k = 0; k < weighted_nodes_[i].second; ++k) {
+      snprintf(ss, 63, "%lu-%lu-%u", k, ep.address().to_v4().to_ulong(),
+                                    ep.port());
+      uint32_t hash_point = hash_(ss, strlen(ss));
+      sorted_points.emplace_back(hash_point, uint16_t(i));
+    }
+  }
+  FillContinuum(&sorted_points);
+  return true;
+}
+
+// the same points as ketama_update() of twemproxy, 160 points per server
+// in proportion to its weight, from the md5 of "<name>-<n>". the name of a
+// server is "ip:port", or "ip" if the port is 11211
+bool KeyDistributer::BuildKetamaPoints() {
+  static const uint32_t KETAMA_POINTS_PER_SERVER = 160;
+  static const uint32_t POINTS_PER_HASH = 4;
+
+  size_t total_weight = 0;
+  for(auto& node : weighted_nodes_) {
+    total_weight += node.second;
+  }
+  const float live_servers = float(weighted_nodes_.size());
+
+  std::vector<std::pair<uint32_t, uint16_t>> sorted_points;
+  for(size_t i = 0; i < weighted_nodes_.size(); ++i) {
+    const Endpoint& ep = weighted_nodes_[i].first;
+    std::string name = ep.address().to_string();
+    if (ep.port() != 11211) {
+      name.append(1, ':').append(std::to_string(ep.port()));
     }
+
+    // float arithmetic of twemproxy, for the same rounding
+    float pct = float(weighted_nodes_[i].second) / float(total_weight);
+    uint32_t points = uint32_t(floorf(float(pct * KETAMA_POINTS_PER_SERVER /
+        4 * live_servers + 0.0000000001)) * 4);
+    for(uint32_t n = 0; n < points / POINTS_PER_HASH; ++n) {
+      std::string host;
+      host.reserve(name.size() + 8);
+      host.append(name).append(1, '-').append(std::to_string(n));
+      unsigned char digest[16];
+      md5_signature(host.data(), host.size(), digest);
+      for(uint32_t x = 0; x < POINTS_PER_HASH; ++x) {
+        const unsigned char* d = digest + 4 * x;
+        uint32_t point = (uint32_t(d[3]) << 24) | (uint32_t(d[2]) << 16) |
+                         (uint32_t(d[1]) << 8) | d[0];
+        sorted_points.emplace_back(point, uint16_t(i));
+      }
+    }
+  }
+  FillContinuum(&sorted_points);
+  return true;
+}
+
+// the same as modula_update() of twemproxy, each server takes as many
+// slots as its weight, in the order of the config
+bool KeyDistributer::BuildModulaSlots() {
+  for(size_t i = 0; i < weighted_nodes_.size(); ++i) {
+    modula_slots_.insert(modula_slots_.end(), weighted_nodes_[i].second,
+                         uint16_t(i));
+  }
+  if (modula_slots_.empty()) {
+    LOG_WARN << "KeyDistributer::BuildModulaSlots zero total weight!";
+    modula_slots_.push_back(0);
   }
+  return true;
+}
 
-  std::sort(new_cache_points.begin(), new_cache_points.end());
+// splitmix64 finalizer, spreads a 32 bits key hash over 64 bits
+static inline uint64_t Mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
 
-  cache_points_.swap(new_cache_points);
+// two 64 bits hashes of "ip:port", for maglev and rendezvous
+static void EndpointHashes(const Endpoint& ep, uint64_t* h1, uint64_t* h2) {
+  std::string name = ep.address().to_string() + ":" +
+                     std::to_string(ep.port());
+  unsigned char digest[16];
+  md5_signature(name.data(), name.size(), digest);
+  memcpy(h1, digest, 8);
+  memcpy(h2, digest + 8, 8);
+}
+
+bool KeyDistributer::BuildJumpBuckets(const Config::Cluster& cluster) {
+  bool same_weight = true;
+  std::set<Endpoint> configured;
+  for(auto& backend : cluster.backends_) {
+    Endpoint ep(boost::asio::ip::address_v4::from_string(backend.host_),
+                backend.port_);
+    same_weight = same_weight &&
+                  backend.weight_ == cluster.backends_[0].weight_;
+    if (!configured.insert(ep).second) {
+      continue;
+    }
+    auto it = std::find(endpoints_.begin(), endpoints_.end(), ep);
+    jump_buckets_.push_back(it == endpoints_.end() ? kEjectedBucket
+                            : uint16_t(it - endpoints_.begin()));
+  }
+  if (!same_weight) {
+    LOG_WARN << "KeyDistributer jump distribution ignores the weights";
+  }
+  return true;
+}
+
+// the population of "Maglev: A Fast and Reliable Software Network Load
+// Balancer", where each endpoint takes turns in proportion to its weight
+bool KeyDistributer::BuildMaglevTable() {
+  // a prime, much larger than the number of endpoints, for an even spread
+  auto is_prime = [](size_t n) {
+    for(size_t d = 2; d * d <= n; ++d) {
+      if (n % d == 0) {
+        return false;
+      }
+    }
+    return true;
+  };
+  size_t size = std::max<size_t>(65537, 100 * endpoints_.size());
+  while (!is_prime(size)) {
+    ++size;
+  }
+
+  size_t max_weight = 0;
+  for(auto& node : weighted_nodes_) {
+    max_weight = std::max(max_weight, node.second);
+  }
+  std::vector<uint64_t> offsets, skips, nexts(endpoints_.size(), 0);
+  std::vector<double> weights, credits(endpoints_.size(), 0.0);
+  for(auto& node : weighted_nodes_) {
+    uint64_t h1, h2;
+    EndpointHashes(node.first, &h1, &h2);
+    offsets.push_back(h1 % size);
+    skips.push_back(h2 % (size - 1) + 1);
+    weights.push_back(max_weight > 0 ? double(node.second) / max_weight : 1.0);
+  }
+
+  maglev_table_.assign(size, kEjectedBucket);
+  for(size_t filled = 0; filled < size; ) {
+    for(size_t i = 0; i < endpoints_.size() && filled < size; ++i) {
+      credits[i] += weights[i];
+      if (credits[i] < 1.0) {
+        continue;
+      }
+      credits[i] -= 1.0;
+      size_t c;
+      do {
+        c = (offsets[i] + nexts[i]++ * skips[i]) % size;
+      } while (maglev_table_[c] != kEjectedBucket);
+      maglev_table_[c] = uint16_t(i);
+      ++filled;
+    }
+  }
+  return true;
+}
+
+bool KeyDistributer::BuildRendezvousSeeds() {
+  for(auto& node : weighted_nodes_) {
+    uint64_t h1, h2;
+    EndpointHashes(node.first, &h1, &h2);
+    rendezvous_nodes_.emplace_back(h1, double(node.second));
+  }
   return true;
 }
 
 Endpoint KeyDistributer::LocateCacheNode(const char * key,
                                            size_t len) const {
-  uint32_t hash = doobs_hash(key, len);
-  Endpoint ep;
+  if (endpoints_.empty()) {
+    return Endpoint();
+  }
+  if (hash_points_.empty()) {
+    return endpoints_[LocateWithoutContinuum(key, len)];
+  }
+  uint32_t hash = HashKey(key, len);
+
+  // branchless lower_bound over the Eytzinger layout. 16 points share a
+  // cache line, so prefetch the line 4 levels down
+  const uint32_t* points = hash_points_.data();
+  const size_t n = hash_points_.size();
+  size_t k = 1;
+  while (k < n) {
+    __builtin_prefetch(points + 16 * k);
+    k = 2 * k + (points[k] < hash);
+  }
+  // cancel the trailing right turns, and the last left turn
+  k >>= __builtin_ffsll(~k);
+  if (k == 0) {
+    k = first_point_; // wrap around the circle
+  }
+  return endpoints_[endpoint_indexes_[k]];
+}
 
-  auto it = std::lower_bound(cache_points_.begin(),
-                             cache_points_.end(),
-                             CachePoint(hash, ep));
-  if (it != cache_points_.end()) {
-    ep = it->endpoint;
-  } else {
-    if(!cache_points_.empty()) {
-      ep = cache_points_.front().endpoint;
+uint16_t KeyDistributer::LocateBounded(const char * key, size_t len,
+    const std::function<bool(uint16_t)>& acceptable) const {
+  assert(!endpoints_.empty());
+  if (hash_points_.empty()) {
+    const uint16_t primary = LocateWithoutContinuum(key, len);
+    for(size_t i = 0; i < endpoints_.size(); ++i) {
+      uint16_t index = uint16_t((primary + i) % endpoints_.size());
+      if (acceptable(index)) {
+        return index;
+      }
     }
+    return primary;
+  }
+
+  uint32_t hash = HashKey(key, len);
+  const size_t n = hash_points_.size();
+  size_t k = 1;
+  while (k < n) {
+    k = 2 * k + (hash_points_[k] < hash);
+  }
+  k >>= __builtin_ffsll(~k);
+  if (k == 0) {
+    k = first_point_;
+  }
+  const uint16_t primary = endpoint_indexes_[k];
+  if (acceptable(primary)) {
+    return primary;
   }
-  return ep;
+
+  // walks the points in order, trying each endpoint once
+  std::vector<bool> tried(endpoints_.size(), false);
+  tried[primary] = true;
+  size_t untried = endpoints_.size() - 1;
+  for(size_t steps = 1; steps < n - 1 && untried > 0; ++steps) {
+    if (2 * k + 1 < n) { // the leftmost node of the right subtree
+      k = 2 * k + 1;
+      while (2 * k < n) {
+        k *= 2;
+      }
+    } else { // up to the first ancestor of a left subtree
+      k >>= __builtin_ffsll(~k);
+      if (k == 0) {
+        k = first_point_;
+      }
+    }
+    uint16_t index = endpoint_indexes_[k];
+    if (!tried[index]) {
+      tried[index] = true;
+      --untried;
+      if (acceptable(index)) {
+        return index;
+      }
+    }
+  }
+  return primary;
+}
+
+void KeyDistributer::LocateBatch(const std::pair<const char*, size_t>* keys,
+                                 size_t count,
+                                 uint16_t* endpoint_indexes) const {
+  assert(!endpoints_.empty());
+  if (!maglev_table_.empty()) {
+    // the table is too large for the cache, prefetch the entries first
+    const size_t kGroupSize = 8;
+    uint32_t slots[kGroupSize];
+    for(size_t begin = 0; begin < count; begin += kGroupSize) {
+      const size_t group = std::min(kGroupSize, count - begin);
+      for(size_t i = 0; i < group; ++i) {
+        slots[i] = HashKey(keys[begin + i].first, keys[begin + i].second) %
+                   maglev_table_.size();
+        __builtin_prefetch(maglev_table_.data() + slots[i]);
+      }
+      for(size_t i = 0; i < group; ++i) {
+        endpoint_indexes[begin + i] = maglev_table_[slots[i]];
+      }
+    }
+    return;
+  }
+  if (hash_points_.empty()) {
+    for(size_t i = 0; i < count; ++i) {
+      endpoint_indexes[i] = LocateWithoutContinuum(keys[i].first,
+                                                   keys[i].second);
+    }
+    return;
+  }
+  const uint32_t* points = hash_points_.data();
+  const size_t n = hash_points_.size();
+
+  const size_t kGroupSize = 8;
+  uint32_t hashes[kGroupSize];
+  size_t k[kGroupSize];
+  for(size_t begin = 0; begin < count; begin += kGroupSize) {
+    const size_t group = std::min(kGroupSize, count - begin);
+    for(size_t i = 0; i < group; ++i) {
+      hashes[i] = HashKey(keys[begin + i].first, keys[begin + i].second);
+      k[i] = 1;
+    }
+    // the complete levels of the tree, where every search steps together
+    for(size_t level_end = 2; level_end <= n; level_end *= 2) {
+      for(size_t i = 0; i < group; ++i) {
+        __builtin_prefetch(points + 16 * k[i]);
+        k[i] = 2 * k[i] + (points[k[i]] < hashes[i]);
+      }
+    }
+    for(size_t i = 0; i < group; ++i) {
+      size_t j = k[i];
+      if (j < n) { // the incomplete last level
+        j = 2 * j + (points[j] < hashes[i]);
+      }
+      j >>= __builtin_ffsll(~j);
+      if (j == 0) {
+        j = first_point_;
+      }
+      endpoint_indexes[begin + i] = endpoint_indexes_[j];
+    }
+  }
+}
+
+uint16_t KeyDistributer::LocateWithoutContinuum(const char * key,
+                                                size_t len) const {
+  switch(distribution_) {
+  case Config::Distribution::MODULA:
+    return modula_slots_[HashKey(key, len) % modula_slots_.size()];
+  case Config::Distribution::JUMP:
+    return LocateJump(HashKey(key, len));
+  case Config::Distribution::MAGLEV:
+    return maglev_table_[HashKey(key, len) % maglev_table_.size()];
+  case Config::Distribution::RENDEZVOUS:
+    return LocateRendezvous(HashKey(key, len));
+  default:
+    break;
+  }
+  static thread_local std::minstd_rand random_engine(std::random_device{}());
+  return uint16_t(random_engine() % endpoints_.size());
+}
+
+// "A Fast, Minimal Memory, Consistent Hash Algorithm", Lamping & Veach
+static size_t JumpConsistentHash(uint64_t key, size_t buckets) {
+  int64_t b = -1, j = 0;
+  while (j < int64_t(buckets)) {
+    b = j;
+    key = key * 2862933555777941923ULL + 1;
+    j = int64_t(double(b + 1) * (double(1LL << 31) / double((key >> 33) + 1)));
+  }
+  return size_t(b);
+}
+
+uint16_t KeyDistributer::LocateJump(uint32_t hash) const {
+  uint64_t key = Mix64(hash);
+  for(int attempt = 0; attempt < 32; ++attempt) {
+    uint16_t index = jump_buckets_[JumpConsistentHash(key,
+                                                      jump_buckets_.size())];
+    if (index != kEjectedBucket) {
+      return index;
+    }
+    key = Mix64(key);
+  }
+  return uint16_t(key % endpoints_.size());
+}
+
+// the endpoint with the highest weight / -ln(u), where u in (0, 1) is the
+// hash of the key and the endpoint, gets the key
+uint16_t KeyDistributer::LocateRendezvous(uint32_t hash) const {
+  uint16_t best = 0;
+  double best_score = -1.0;
+  for(size_t i = 0; i < rendezvous_nodes_.size(); ++i) {
+    uint64_t h = Mix64(hash ^ rendezvous_nodes_[i].first);
+    double u = (double(h >> 11) + 0.5) / 9007199254740992.0; // 2^53
+    double score = rendezvous_nodes_[i].second / -std::log(u);
+    if (score > best_score) {
+      best_score = score;
+      best = uint16_t(i);
+    }
+  }
+  return best;
+}
+
+size_t KeyDistributer::memory_bytes() const {
+  return hash_points_.capacity() * sizeof(uint32_t) +
+         endpoint_indexes_.capacity() * sizeof(uint16_t) +
+         modula_slots_.capacity() * sizeof(uint16_t) +
+         jump_buckets_.capacity() * sizeof(uint16_t) +
+         maglev_table_.capacity() * sizeof(uint16_t) +
+         rendezvous_nodes_.capacity() * sizeof(rendezvous_nodes_[0]);
 }
 
 void KeyDistributer::Dump() {
-  for(auto& entry : cache_points_) {
-    LOG_DEBUG << "cache point dump - " << entry.endpoint
-              << " : " << entry.hash_point;
+  for(size_t k = 1; k < hash_points_.size(); ++k) {
+    LOG_DEBUG << "cache point dump - " << endpoints_[endpoint_indexes_[k]]
+              << " : " << hash_points_[k];
   }
 }
 
@@ -1,43 +1,112 @@
 #ifndef _YARMPROXY_KEY_DISTRIBUTER_H_
 #define _YARMPROXY_KEY_DISTRIBUTER_H_
 
+#include <functional>
 #include <string>
+#include <utility>
 #include <map>
+#include <set>
 #include <vector>
 #include <stdint.h>
+#include <string.h>
 
 #include <boost/asio/ip/tcp.hpp>
 
 #include "config.h"
+#include "key_hash.h"
 
 namespace yarmproxy {
 using Endpoint = boost::asio::ip::tcp::endpoint;
 
-// key distributer similar to katama consistent hash continuum 
+// key distributer similar to katama consistent hash continuum, or one of
+// the twemproxy compatible distributions
 class KeyDistributer {
 public:
-  KeyDistributer(const std::vector<Config::Backend>& backends);
+  // maps keys to the backends of `cluster`, by its hash, hash_tag and
+  // distribution. backends in `ejected` are left out, unless all the
+  // backends are ejected.
+  KeyDistributer(const Config::Cluster& cluster,
+                 const std::set<Endpoint>& ejected);
   Endpoint LocateCacheNode(const char * key, size_t len) const;
+  // locates `count` keys, writing the index into endpoints() of each. The
+  // keys are hashed first, then the continuum searches of a group of keys
+  // run level by level, so that their cache misses overlap. The continuum
+  // mustn't be empty.
+  void LocateBatch(const std::pair<const char*, size_t>* keys, size_t count,
+                   uint16_t* endpoint_indexes) const;
+  // the index into endpoints() of the key if it's `acceptable`, or of the
+  // first acceptable endpoint clockwise of the key, i.e. the next one on
+  // the continuum, or in endpoints() for the other distributions. the
+  // endpoint of the key if none is acceptable
+  uint16_t LocateBounded(const char * key, size_t len,
+      const std::function<bool(uint16_t)>& acceptable) const;
+  const std::vector<Endpoint>& endpoints() const {
+    return endpoints_;
+  }
+  // bytes of the lookup structures, for the benchmarks
+  size_t memory_bytes() const;
   void Dump();
 
+  // the hash of the key, or of its hash tag, the part between the first
+  // open character and the next close one, if not empty. as twemproxy
+  uint32_t HashKey(const char * key, size_t len) const {
+    if (has_hash_tag_) {
+      const char* open = static_cast<const char*>(
+          memchr(key, hash_tag_open_, len));
+      if (open != nullptr) {
+        const char* tag = open + 1;
+        const char* close = static_cast<const char*>(
+            memchr(tag, hash_tag_close_, key + len - tag));
+        if (close != nullptr && close > tag) {
+          return hash_(tag, close - tag);
+        }
+      }
+    }
+    return hash_(key, len);
+  }
+
 private:
   bool BuildCachePoints();
+  bool BuildKetamaPoints();
+  bool BuildModulaSlots();
+  bool BuildJumpBuckets(const Config::Cluster& cluster);
+  bool BuildMaglevTable();
+  bool BuildRendezvousSeeds();
+  void FillContinuum(std::vector<std::pair<uint32_t, uint16_t>>* points);
+  // by the distributions other than continuum and ketama
+  uint16_t LocateWithoutContinuum(const char * key, size_t len) const;
+  uint16_t LocateJump(uint32_t hash) const;
+  uint16_t LocateRendezvous(uint32_t hash) const;
+  // in the order of the config, as twemproxy
+  std::vector<std::pair<Endpoint, size_t>> weighted_nodes_; //服务器信息
+  Config::Distribution distribution_;
+  KeyHashFunction hash_;
+  bool has_hash_tag_;
+  char hash_tag_open_;
+  char hash_tag_close_;
+
+  // The continuum is kept in two dense arrays in Eytzinger(BFS) order,
+  // 1-based, so that a lookup touches a few cache lines, and the lines of
+  // the next levels can be prefetched. hash_points_[0] is unused.
+  std::vector<uint32_t> hash_points_;       // points on continuum circle
+  std::vector<uint16_t> endpoint_indexes_;  // index into endpoints_ per point
+  std::vector<Endpoint> endpoints_;
+  size_t first_point_ = 0; // position of the smallest point, for wrapping
 
-  // 每个 cache node 会对应 continuum 上数百个(按比例)cache point
-  struct CachePoint {
-    CachePoint(uint32_t hp, const Endpoint & ep)
-      : hash_point(hp)
-      , endpoint(ep)
-    {}
+  // index into endpoints_, repeated by the weight, for modula
+  std::vector<uint16_t> modula_slots_;
 
-    uint32_t hash_point;  // point on continuum circle
-    Endpoint endpoint;
+  // index into endpoints_ of every configured backend, or kEjectedBucket,
+  // for jump. ejected backends keep their buckets, the keys landing on them
+  // are rehashed, so that only their keys move
+  static const uint16_t kEjectedBucket = UINT16_MAX;
+  std::vector<uint16_t> jump_buckets_;
 
-    bool operator<(const CachePoint& r) const { return hash_point < r.hash_point; }
-  };
+  // index into endpoints_ per entry, the table size is a prime, for maglev
+  std::vector<uint16_t> maglev_table_;
 
-  std::map<Endpoint, size_t> weighted_nodes_; //服务器信息
-  std::vector<CachePoint> cache_points_;
+  // a hash seed and the weight of each endpoint, for rendezvous
+  std::vector<std::pair<uint64_t, double>> rendezvous_nodes_;
 };
 
 }
@@ -0,0 +1,181 @@
+#include "key_hash.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "doobs_hash.h"
+
+namespace yarmproxy {
+
+const char* const kKeyHashNames[] = {
+  "doobs", "fnv1a_64", "murmur3", "xxh3", "crc32c", "md5",
+  "fnv1_64", "fnv1_32", "fnv1a_32", "one_at_a_time", "murmur",
+  "crc16", "crc32", "crc32a", nullptr
+};
+
+KeyHashFunction GetKeyHashFunction(const std::string& name) {
+  if (name == "doobs") {
+    return hash_doobs;
+  } else if (name == "fnv1a_64") {
+    return hash_fnv1a_64;
+  } else if (name == "murmur3") {
+    return hash_murmur3;
+  } else if (name == "xxh3") {
+    return hash_xxh3;
+  } else if (name == "crc32c") {
+    return hash_crc32c;
+  } else if (name == "md5") {
+    return hash_md5;
+  } else if (name == "fnv1_64") {
+    return hash_fnv1_64;
+  } else if (name == "fnv1_32") {
+    return hash_fnv1_32;
+  } else if (name == "fnv1a_32") {
+    return hash_fnv1a_32;
+  } else if (name == "one_at_a_time") {
+    return hash_one_at_a_time;
+  } else if (name == "murmur") {
+    return hash_murmur;
+  } else if (name == "crc16") {
+    return hash_crc16;
+  } else if (name == "crc32") {
+    return hash_crc32;
+  } else if (name == "crc32a") {
+    return hash_crc32a;
+  }
+  return nullptr;
+}
+
+uint32_t hash_doobs(const char* key, size_t len) {
+  return doobs_hash(key, len);
+}
+
+uint32_t hash_fnv1a_64(const char* key, size_t len) {
+  static const uint64_t FNV_64_INIT = 0xcbf29ce484222325ULL;
+  static const uint64_t FNV_64_PRIME = 0x100000001b3ULL;
+  uint32_t hash = uint32_t(FNV_64_INIT);
+  for(size_t i = 0; i < len; ++i) {
+    hash ^= uint32_t(key[i]);
+    hash *= uint32_t(FNV_64_PRIME);
+  }
+  return hash;
+}
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t ReadLE32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v)); // little endian hosts only
+  return v;
+}
+
+uint32_t hash_murmur3(const char* key, size_t len) {
+  const uint32_t c1 = 0xcc9e2d51;
+  const uint32_t c2 = 0x1b873593;
+  const size_t nblocks = len / 4;
+  uint32_t h1 = 0;
+
+  for(size_t i = 0; i < nblocks; ++i) {
+    uint32_t k1 = ReadLE32(key + i * 4);
+    k1 *= c1;
+    k1 = rotl32(k1, 15);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = rotl32(h1, 13);
+    h1 = h1 * 5 + 0xe6546b64;
+  }
+
+  const uint8_t* tail = reinterpret_cast<const uint8_t*>(key + nblocks * 4);
+  uint32_t k1 = 0;
+  switch(len & 3) {
+  case 3:
+    k1 ^= uint32_t(tail[2]) << 16;
+    // fall through
+  case 2:
+    k1 ^= uint32_t(tail[1]) << 8;
+    // fall through
+  case 1:
+    k1 ^= tail[0];
+    k1 *= c1;
+    k1 = rotl32(k1, 15);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= uint32_t(len);
+  h1 ^= h1 >> 16;
+  h1 *= 0x85ebca6b;
+  h1 ^= h1 >> 13;
+  h1 *= 0xc2b2ae35;
+  h1 ^= h1 >> 16;
+  return h1;
+}
+
+uint32_t hash_xxh3(const char* key, size_t len) {
+  return uint32_t(xxh3_64(key, len));
+}
+
+static uint32_t kCrc32cTable[256];
+
+static bool InitCrc32cTable() {
+  for(uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for(int j = 0; j < 8; ++j) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+    }
+    kCrc32cTable[i] = crc;
+  }
+  return true;
+}
+
+static uint32_t crc32c_sw(const char* key, size_t len) {
+  static bool initialized = InitCrc32cTable();
+  (void)initialized;
+  uint32_t crc = 0xffffffff;
+  for(size_t i = 0; i < len; ++i) {
+    crc = kCrc32cTable[(crc ^ uint8_t(key[i])) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const char* key, size_t len) {
+  uint64_t crc = 0xffffffff;
+  for(; len >= 8; key += 8, len -= 8) {
+    uint64_t v;
+    memcpy(&v, key, sizeof(v));
+    crc = _mm_crc32_u64(crc, v);
+  }
+  uint32_t crc32 = uint32_t(crc);
+  for(; len > 0; ++key, --len) {
+    crc32 = _mm_crc32_u8(crc32, uint8_t(*key));
+  }
+  return ~crc32;
+}
+#endif
+
+uint32_t hash_crc32c(const char* key, size_t len) {
+#if defined(__x86_64__)
+  static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+  if (has_sse42) {
+    return crc32c_sse42(key, len);
+  }
+#endif
+  return crc32c_sw(key, len);
+}
+
+uint32_t hash_md5(const char* key, size_t len) {
+  unsigned char results[16];
+  md5_signature(key, len, results);
+  return (uint32_t(results[3]) << 24) | (uint32_t(results[2]) << 16) |
+         (uint32_t(results[1]) << 8) | results[0];
+}
+
+}
+
@@ -0,0 +1,51 @@
+#ifndef _YARMPROXY_KEY_HASH_H_
+#define _YARMPROXY_KEY_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace yarmproxy {
+
+// hashes a key into a point of the continuum
+typedef uint32_t (*KeyHashFunction)(const char* key, size_t len);
+
+// by the name of the `hash` config of a cluster, nullptr if it's unknown
+KeyHashFunction GetKeyHashFunction(const std::string& name);
+
+// names of all the supported hash functions, nullptr terminated
+extern const char* const kKeyHashNames[];
+
+uint32_t hash_doobs(const char* key, size_t len);
+
+// 32-bit arithmetic with the truncated 64-bit FNV constants, and the key
+// bytes sign-extended, exactly as twemproxy's fnv1a_64
+uint32_t hash_fnv1a_64(const char* key, size_t len);
+
+// MurmurHash3_x86_32, seed 0
+uint32_t hash_murmur3(const char* key, size_t len);
+
+// the lower 32 bits of XXH3_64bits, seed 0 and the default secret
+uint32_t hash_xxh3(const char* key, size_t len);
+uint64_t xxh3_64(const char* key, size_t len);
+
+// CRC-32C(Castagnoli), with the SSE4.2 crc32 instruction if it's supported
+uint32_t hash_crc32c(const char* key, size_t len);
+
+// the first 4 bytes of the md5 digest, little endian, as twemproxy's md5
+uint32_t hash_md5(const char* key, size_t len);
+void md5_signature(const char* key, size_t len, unsigned char result[16]);
+
+// the rest of twemproxy's hashkit, except hsieh and jenkins
+uint32_t hash_fnv1_64(const char* key, size_t len);
+uint32_t hash_fnv1_32(const char* key, size_t len);
+uint32_t hash_fnv1a_32(const char* key, size_t len);
+uint32_t hash_one_at_a_time(const char* key, size_t len);
+uint32_t hash_murmur(const char* key, size_t len); // MurmurHash2 variant
+uint32_t hash_crc16(const char* key, size_t len);
+uint32_t hash_crc32(const char* key, size_t len);
+uint32_t hash_crc32a(const char* key, size_t len);
+
+}
+
+#endif // _YARMPROXY_KEY_HASH_H_
@@ -1,78 +1,368 @@
 #include "key_locator.h"
 
+#include <algorithm>
+
 #include "logging.h"
 
 #include "config.h"
 #include "protocol_type.h"
 #include "key_distributer.h"
+#include "key_hash.h"
 
 namespace yarmproxy {
 
-static const char * ProtocolNs(ProtocolType protocol) {
+static const char * ProtocolName(ProtocolType protocol) {
   switch(protocol) {
   case ProtocolType::MEMCACHED:
-    return "m";
+    return "memcached";
   case ProtocolType::REDIS:
-    return "r";
+    return "redis";
   default:
-    return "";
+    return "none";
+  }
+}
+
+void KeyLocator::NamespaceTable::Add(const std::string& ns,
+                                     const Continuum* continuum) {
+  if (ns == "_") {
+    if (default_continuum_ == nullptr) {
+      default_continuum_ = continuum;
+    }
+    return;
+  }
+  if (2 * (entries_ + 1) > slots_.size()) {
+    std::vector<Slot> slots(std::max(size_t(8), 2 * slots_.size()));
+    slots.swap(slots_);
+    entries_ = 0;
+    for(auto& slot : slots) {
+      if (slot.continuum_ != nullptr) {
+        Insert(slot.ns_, slot.continuum_);
+      }
+    }
+  }
+  Insert(ns, continuum);
+}
+
+void KeyLocator::NamespaceTable::Insert(const std::string& ns,
+                                        const Continuum* continuum) {
+  size_t mask = slots_.size() - 1;
+  for(size_t i = hash_fnv1a_64(ns.data(), ns.size()) & mask; ;
+      i = (i + 1) & mask) {
+    Slot& slot = slots_[i];
+    if (slot.continuum_ == nullptr) {
+      slot.ns_ = ns;
+      slot.continuum_ = continuum;
+      ++entries_;
+      return;
+    }
+    if (slot.ns_ == ns) {
+      return; // the first cluster of a namespace wins
+    }
+  }
+}
+
+const KeyLocator::Continuum* KeyLocator::NamespaceTable::Find(
+    const char* key, size_t len, size_t max_len) const {
+  if (entries_ == 0) {
+    return default_continuum_;
+  }
+  const char * p = static_cast<const char *>(memchr(key, ':',
+        std::min(len, max_len + 1)));
+  if (p == nullptr) {
+    return default_continuum_;
+  }
+  size_t ns_len = p - key;
+  size_t mask = slots_.size() - 1;
+  for(size_t i = hash_fnv1a_64(key, ns_len) & mask; ; i = (i + 1) & mask) {
+    const Slot& slot = slots_[i];
+    if (slot.continuum_ == nullptr) {
+      return default_continuum_;
+    }
+    if (slot.ns_.size() == ns_len &&
+        memcmp(slot.ns_.data(), key, ns_len) == 0) {
+      return slot.continuum_;
+    }
   }
 }
 
-bool KeyLocator::Initialize() {
-  if (Config::Instance().clusters().empty()) {
+uint16_t KeyLocator::EndpointIndex(const Endpoint& ep) {
+  auto it = std::find(endpoints_.begin(), endpoints_.end(), ep);
+  if (it == endpoints_.end()) {
+    endpoints_.push_back(ep);
+    return uint16_t(endpoints_.size() - 1);
+  }
+  return uint16_t(it - endpoints_.begin());
+}
+
+void KeyLocator::InitializeSlots(const Config::Cluster& cluster,
+                                 const redis::ClusterSlots* slots,
+                                 Continuum* continuum) {
+  BackendOptions options;
+  options.min_timeout_ = cluster.min_timeout_;
+  options.max_timeout_ = cluster.max_timeout_;
+  options.redis_cluster_ = true;
+
+  // until the slot table is fetched, the redirections of the seeds lead
+  // the queries to the right nodes
+  std::vector<uint16_t> seeds;
+  for(auto& backend : cluster.backends_) {
+    Endpoint ep(boost::asio::ip::address_v4::from_string(backend.host_),
+                backend.port_);
+    seeds.push_back(EndpointIndex(ep));
+    backend_options_[ep] = options;
+  }
+  continuum->slots_.resize(redis::kClusterSlots, 0);
+  for(size_t slot = 0; !seeds.empty() && slot < redis::kClusterSlots; ++slot) {
+    continuum->slots_[slot] = seeds[slot % seeds.size()];
+  }
+
+  if (slots == nullptr) {
+    return;
+  }
+  for(auto& range : *slots) {
+    uint16_t index = EndpointIndex(range.master_);
+    backend_options_[range.master_] = options;
+    std::fill(continuum->slots_.begin() + range.first_,
+              continuum->slots_.begin() + range.last_ + 1, index);
+  }
+}
+
+bool KeyLocator::Initialize(
+    const std::set<Endpoint>& ejected_backends,
+    const std::map<size_t, redis::ClusterSlots>& cluster_slots) {
+  const auto& clusters = Config::Instance().clusters();
+  if (clusters.empty()) {
     return false;
   }
-  for(auto& cluster : Config::Instance().clusters()) {
-    std::shared_ptr<KeyDistributer> continuum(
-        new KeyDistributer(cluster.backends_));
+  endpoints_.push_back(Endpoint()); // index 0, for the unlocatable keys
+  for(size_t cluster_index = 0; cluster_index < clusters.size();
+      ++cluster_index) {
+    const Config::Cluster& cluster = clusters[cluster_index];
+    std::unique_ptr<Continuum> continuum(new Continuum);
+    if (cluster.redis_cluster_) {
+      has_redis_cluster_ = true;
+      auto it = cluster_slots.find(cluster_index);
+      InitializeSlots(cluster,
+          it == cluster_slots.end() ? nullptr : &it->second, continuum.get());
+      for(auto& ns : cluster.namespaces_) {
+        namespace_tables_[int(cluster.protocol_)].Add(ns, continuum.get());
+      }
+      continuums_.push_back(std::move(continuum));
+      continue;
+    }
+
+    continuum->distributer_.reset(
+        new KeyDistributer(cluster, ejected_backends));
+    for(auto& ep : continuum->distributer_->endpoints()) {
+      continuum->endpoint_indexes_.push_back(EndpointIndex(ep));
+    }
+    BackendOptions options;
+    options.min_timeout_ = cluster.min_timeout_;
+    options.max_timeout_ = cluster.max_timeout_;
+    options.hedge_percentile_ = cluster.hedge_percentile_;
+    options.hedge_budget_ = cluster.hedge_budget_;
+    options.read_from_replicas_ = cluster.read_from_replicas_;
+    options.bounded_load_ = cluster.bounded_load_;
+    for(auto& backend : cluster.backends_) {
+      std::vector<Endpoint> replica_set;
+      replica_set.emplace_back(
+          boost::asio::ip::address_v4::from_string(backend.host_),
+          backend.port_);
+      for(auto& replica : backend.replicas_) {
+        replica_set.emplace_back(
+            boost::asio::ip::address_v4::from_string(replica.first),
+            replica.second);
+      }
+      for(size_t i = 0; i < replica_set.size(); ++i) {
+        BackendOptions& member_options = backend_options_[replica_set[i]];
+        member_options = options;
+        for(size_t j = 0; j < replica_set.size(); ++j) {
+          if (j != i) {
+            member_options.replicas_.push_back(replica_set[j]);
+          }
+        }
+      }
+    }
     for(auto& ns : cluster.namespaces_) {
-      std::ostringstream oss;
-      oss << ProtocolNs(cluster.protocol_) << "/" << (ns == "_" ? "" : ns.c_str());
-      namespace_continum_.emplace(oss.str(), continuum);
-      LOG_DEBUG << "KeyLocator ns=" << oss.str()
-                << " continium=" << continuum;
+      namespace_tables_[int(cluster.protocol_)].Add(ns, continuum.get());
+      LOG_DEBUG << "KeyLocator protocol=" << ProtocolName(cluster.protocol_)
+                << " ns=" << ns << " continium=" << continuum.get();
+    }
+    continuums_.push_back(std::move(continuum));
+  }
+  for(auto protocol : {ProtocolType::REDIS, ProtocolType::MEMCACHED}) {
+    if (namespace_tables_[int(protocol)].default_continuum() == nullptr) {
+      LOG_WARN << "KeyLocator no default namespace for protocol "
+               << ProtocolName(protocol)
+               << ", keys out of the configured namespaces can't be located";
     }
   }
+  max_namespace_length_ = Config::Instance().max_namespace_length();
   return true;
 }
 
-static const std::string& DefaultNamespace(ProtocolType protocol) {
-  static std::string REDIS_NS_DEFAULT = "0/";
-  static std::string MEMCACHED_NS_DEFAULT = "1/";
-  switch(protocol) {
-  case ProtocolType::REDIS:
-    return REDIS_NS_DEFAULT;
-  case ProtocolType::MEMCACHED:
-    return MEMCACHED_NS_DEFAULT;
-  default:
-    assert(false);
-    return REDIS_NS_DEFAULT;
+Endpoint KeyLocator::Locate(const char * key, size_t len, ProtocolType protocol) {
+  const Continuum* continuum = namespace_tables_[int(protocol)].Find(
+      key, len, max_namespace_length_);
+  if (continuum == nullptr) {
+    return Endpoint();
+  }
+  if (!continuum->slots_.empty()) {
+    return endpoints_[continuum->slots_[redis::KeySlot(key, len)]];
   }
+  return continuum->distributer_->LocateCacheNode(key, len);
 }
 
-static std::string KeyNamespace(const char * key, size_t len, ProtocolType protocol) {
-  std::ostringstream oss;
-  oss << ProtocolNs(protocol) << "/";
-  const char * p = static_cast<const char *>(memchr(key, ':',
-        std::min(int(len), Config::Instance().max_namespace_length() + 1)));
-  if (p != nullptr) {
-    oss << std::string(key, p - key);
+Endpoint KeyLocator::LocateBounded(const char * key, size_t len,
+                                   ProtocolType protocol, int bounded_load,
+                                   const EndpointLoad& load,
+                                   LoadSum* load_sum, bool* spilled) const {
+  *spilled = false;
+  const Continuum* continuum = namespace_tables_[int(protocol)].Find(
+      key, len, max_namespace_length_);
+  if (continuum == nullptr) {
+    return Endpoint();
+  }
+  if (!continuum->slots_.empty()) {
+    return endpoints_[continuum->slots_[redis::KeySlot(key, len)]];
+  }
+  const std::vector<uint16_t>& indexes = continuum->endpoint_indexes_;
+  if (indexes.empty()) {
+    return Endpoint();
+  }
+
+  // ceil((1 + e) * (m + 1) / n), counting the load this read adds
+  LoadSum key_sum;
+  if (load_sum == nullptr) {
+    load_sum = &key_sum;
+  }
+  if (load_sum->continuum_ != continuum) {
+    load_sum->continuum_ = continuum;
+    load_sum->total_ = 0;
+    load_sum->added_ = 0;
+    for(uint16_t index : indexes) {
+      load_sum->total_ += load(endpoints_[index]);
+    }
   }
-  return oss.str();
+  const size_t total = load_sum->total_ + load_sum->added_ + 1;
+  const size_t capacity = (total * (100 + bounded_load) + 100 * indexes.size()
+                           - 1) / (100 * indexes.size());
+  // captured by one reference, so that the std::function doesn't allocate
+  struct {
+    const KeyLocator* locator_;
+    const std::vector<uint16_t>* indexes_;
+    const EndpointLoad* load_;
+    size_t capacity_;
+    size_t tried_;
+    bool accepted_;
+  } bound = {this, &indexes, &load, capacity, 0, false};
+  uint16_t located = continuum->distributer_->LocateBounded(key, len,
+      [&bound](uint16_t i) {
+        ++bound.tried_;
+        bound.accepted_ = (*bound.load_)(bound.locator_->endpoints_[
+                              (*bound.indexes_)[i]]) < bound.capacity_;
+        return bound.accepted_;
+      });
+  // the primary is located if all the endpoints are at the bound
+  *spilled = bound.accepted_ && bound.tried_ > 1;
+  return endpoints_[indexes[located]];
 }
 
-Endpoint KeyLocator::Locate(const char * key, size_t len, ProtocolType protocol) {
-  std::shared_ptr<KeyDistributer> continuum;
-  auto it = namespace_continum_.find(KeyNamespace(key, len, protocol));
-  if (it == namespace_continum_.end()) {
-    continuum = namespace_continum_[DefaultNamespace(protocol)];
-  } else {
-    continuum = it->second;
+int KeyLocator::ClusterSlot(const char * key, size_t len,
+                            ProtocolType protocol) const {
+  const Continuum* continuum = namespace_tables_[int(protocol)].Find(
+      key, len, max_namespace_length_);
+  if (continuum == nullptr || continuum->slots_.empty()) {
+    return -1;
   }
+  return redis::KeySlot(key, len);
+}
+
+void KeyLocator::Continuum::LocateBatch(const Key* keys, size_t count,
+                                        uint16_t* endpoint_indexes) const {
+  if (!slots_.empty()) {
+    for(size_t i = 0; i < count; ++i) {
+      endpoint_indexes[i] = slots_[redis::KeySlot(keys[i].first,
+                                                  keys[i].second)];
+    }
+    return;
+  }
+  if (distributer_->endpoints().empty()) {
+    std::fill(endpoint_indexes, endpoint_indexes + count, 0);
+    return;
+  }
+  distributer_->LocateBatch(keys, count, endpoint_indexes);
+  for(size_t i = 0; i < count; ++i) {
+    endpoint_indexes[i] = endpoint_indexes_[endpoint_indexes[i]];
+  }
+}
+
+void KeyLocator::LocateBatch(const Key* keys, size_t count,
+                             ProtocolType protocol,
+                             uint16_t* endpoint_indexes) const {
+  const NamespaceTable& table = namespace_tables_[int(protocol)];
+
+  // keys are processed in chunks, with the buffers on the stack
+  const size_t kChunkSize = 64;
+  const Continuum* continuums[kChunkSize];
+  bool located[kChunkSize];
+  Key grouped_keys[kChunkSize];
+  uint16_t grouped_indexes[kChunkSize];
+  size_t positions[kChunkSize];
 
-  Endpoint ep = continuum->LocateCacheNode(key, len);
-  return ep;
+  for(size_t begin = 0; begin < count; begin += kChunkSize) {
+    const size_t chunk = std::min(kChunkSize, count - begin);
+    bool single_continuum = true;
+    for(size_t i = 0; i < chunk; ++i) {
+      continuums[i] = table.Find(keys[begin + i].first, keys[begin + i].second,
+                                 max_namespace_length_);
+      located[i] = false;
+      single_continuum = single_continuum && continuums[i] == continuums[0];
+    }
+    if (single_continuum) { // the usual case, all keys in one namespace
+      if (continuums[0] == nullptr) {
+        std::fill(endpoint_indexes + begin, endpoint_indexes + begin + chunk,
+                  0);
+      } else {
+        continuums[0]->LocateBatch(keys + begin, chunk,
+                                   endpoint_indexes + begin);
+      }
+      continue;
+    }
+
+    // gather the keys of each continuum, and scatter back the results
+    for(size_t i = 0; i < chunk; ++i) {
+      if (located[i]) {
+        continue;
+      }
+      size_t grouped = 0;
+      for(size_t j = i; j < chunk; ++j) {
+        if (!located[j] && continuums[j] == continuums[i]) {
+          located[j] = true;
+          grouped_keys[grouped] = keys[begin + j];
+          positions[grouped] = begin + j;
+          ++grouped;
+        }
+      }
+      if (continuums[i] == nullptr) {
+        std::fill(grouped_indexes, grouped_indexes + grouped, 0);
+      } else {
+        continuums[i]->LocateBatch(grouped_keys, grouped, grouped_indexes);
+      }
+      for(size_t j = 0; j < grouped; ++j) {
+        endpoint_indexes[positions[j]] = grouped_indexes[j];
+      }
+    }
+  }
+}
+
+const KeyLocator::BackendOptions* KeyLocator::backend_options(
+    const Endpoint& ep) const {
+  auto it = backend_options_.find(ep);
+  if (it == backend_options_.end()) {
+    return nullptr;
+  }
+  return &it->second;
 }
 
 }
@@ -1,10 +1,19 @@
 #ifndef _YARMPROXY_KEY_LOCATOR_H_
 #define _YARMPROXY_KEY_LOCATOR_H_
 
-#include <string>
+#include <functional>
+#include <map>
 #include <memory>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
 #include <boost/asio/ip/tcp.hpp>
 
+#include "config.h"
+#include "redis_cluster.h"
+
 namespace yarmproxy {
 
 using Endpoint = boost::asio::ip::tcp::endpoint;
@@ -15,10 +24,117 @@ enum class ProtocolType;
 class KeyLocator {
 public:
   KeyLocator() {}
-  bool Initialize();
+  // the slot tables of the redis clusters are by the index of the cluster
+  // in Config::clusters(), the slots are spread over the seed backends of a
+  // cluster without a slot table
+  bool Initialize(const std::set<Endpoint>& ejected_backends,
+                  const std::map<size_t, redis::ClusterSlots>& cluster_slots);
   Endpoint Locate(const char * key, size_t len, ProtocolType protocol);
+  // like Locate(), but with the load of every endpoint of the continuum of
+  // the key bounded to (100 + bounded_load) percent of their average, as in
+  // "Consistent Hashing with Bounded Loads". A key whose endpoint is at the
+  // bound spills clockwise to the first endpoint under it, and `spilled` is
+  // set. Keys of redis clusters never spill.
+  using EndpointLoad = std::function<size_t(const Endpoint&)>;
+  // the load of the endpoints of a continuum, summed by LocateBounded() for
+  // the first key of a command and reused for its other keys on the same
+  // continuum, instead of once per key
+  class LoadSum {
+  public:
+    // a connection the command opened since, to the endpoint of a key
+    void AddLoad() {
+      ++added_;
+    }
+  private:
+    friend class KeyLocator;
+    const void* continuum_ = nullptr;
+    size_t total_ = 0;
+    size_t added_ = 0;
+  };
+  // `load_sum` may be nullptr, to sum the loads for this key only
+  Endpoint LocateBounded(const char * key, size_t len, ProtocolType protocol,
+                         int bounded_load, const EndpointLoad& load,
+                         LoadSum* load_sum, bool* spilled) const;
+  // the Redis Cluster slot of the key, -1 if it's not on a redis cluster
+  int ClusterSlot(const char * key, size_t len, ProtocolType protocol) const;
+  // whether some cluster is a redis cluster, whose nodes reject the commands
+  // with keys in different slots
+  bool has_redis_cluster() const {
+    return has_redis_cluster_;
+  }
+
+  using Key = std::pair<const char*, size_t>;
+  // locates `count` keys at once, writing the index of the endpoint of each
+  // key into `endpoint_indexes`, see endpoint(). Index 0 stands for an
+  // unspecified endpoint, if a key can't be located.
+  void LocateBatch(const Key* keys, size_t count, ProtocolType protocol,
+                   uint16_t* endpoint_indexes) const;
+  const Endpoint& endpoint(uint16_t index) const {
+    return endpoints_[index];
+  }
+
+  // per backend options, from the cluster config
+  struct BackendOptions {
+    int min_timeout_ = 0;
+    int max_timeout_ = 0; // 0 : adaptive timeout disabled
+    int hedge_percentile_ = 0; // 0 : hedged reads disabled
+    int hedge_budget_ = 0;
+    bool read_from_replicas_ = false;
+    bool redis_cluster_ = false; // follow MOVED/ASK redirections
+    int bounded_load_ = 0; // percent over the average load, 0 : unbounded
+    // the other members of the replica set, led by the primary backend for
+    // the replicas
+    std::vector<Endpoint> replicas_;
+  };
+  // nullptr if `ep` isn't a backend or replica of any cluster
+  const BackendOptions* backend_options(const Endpoint& ep) const;
 private:
-  std::map<std::string, std::shared_ptr<KeyDistributer>> namespace_continum_;
+  struct Continuum {
+    std::shared_ptr<KeyDistributer> distributer_;
+    // index into KeyLocator::endpoints_ by slot, instead of the distributer
+    // for a redis cluster
+    std::vector<uint16_t> slots_;
+    // index into KeyLocator::endpoints_, by the index into the endpoints of
+    // the distributer
+    std::vector<uint16_t> endpoint_indexes_;
+
+    void LocateBatch(const Key* keys, size_t count,
+                     uint16_t* endpoint_indexes) const;
+  };
+
+  // namespace -> continuum of one protocol. An open addressing table
+  // looked up with the key prefix in place, so that Locate() allocates
+  // nothing.
+  class NamespaceTable {
+  public:
+    void Add(const std::string& ns, const Continuum* continuum);
+    // the continuum of the namespace before the first ':' within the first
+    // `max_len + 1` bytes of the key, or of the default namespace
+    const Continuum* Find(const char* key, size_t len, size_t max_len) const;
+    const Continuum* default_continuum() const {
+      return default_continuum_;
+    }
+  private:
+    struct Slot {
+      std::string ns_;
+      const Continuum* continuum_ = nullptr; // nullptr : empty slot
+    };
+    void Insert(const std::string& ns, const Continuum* continuum);
+    size_t entries_ = 0;
+    std::vector<Slot> slots_; // size is a power of 2, at most half full
+    const Continuum* default_continuum_ = nullptr;
+  };
+
+  uint16_t EndpointIndex(const Endpoint& ep);
+  void InitializeSlots(const Config::Cluster& cluster,
+                       const redis::ClusterSlots* slots, Continuum* continuum);
+
+  std::map<Endpoint, BackendOptions> backend_options_;
+  std::vector<std::unique_ptr<Continuum>> continuums_;
+  std::vector<Endpoint> endpoints_; // of all the clusters, led by Endpoint()
+  NamespaceTable namespace_tables_[3]; // indexed by ProtocolType
+  size_t max_namespace_length_ = 0;
+  bool has_redis_cluster_ = false;
 };
 
 }
@@ -0,0 +1,99 @@
+#include "key_order_tracker.h"
+
+#include "key_hash.h"
+
+namespace yarmproxy {
+
+void KeyOrderTracker::BeginCommand() {
+  begun_keys_.clear();
+  begun_barrier_ = false;
+  conflicted_ = false;
+}
+
+bool KeyOrderTracker::AddKey(const char* key, size_t len, bool write) {
+  if (barriers_ > 0) {
+    conflicted_ = true;
+    return false;
+  }
+  uint64_t hash = xxh3_64(key, len);
+  auto it = uses_.find(hash);
+  if (it != uses_.end() &&
+      (it->second.writers_ > 0 || (write && it->second.readers_ > 0))) {
+    conflicted_ = true;
+    return false;
+  }
+  begun_keys_.emplace_back(hash, write);
+  return true;
+}
+
+bool KeyOrderTracker::AddUnknownKeys() {
+  if (keyed_commands_ > 0) {
+    conflicted_ = true;
+    return false;
+  }
+  begun_barrier_ = true;
+  return true;
+}
+
+void KeyOrderTracker::PushCommand() {
+  for(const KeyUse& use : begun_keys_) {
+    KeyUses& uses = uses_[use.first];
+    if (use.second) {
+      ++uses.writers_;
+    } else {
+      ++uses.readers_;
+    }
+    active_keys_.push_back(use);
+  }
+  active_key_counts_.push_back(begun_keys_.size());
+  active_barriers_.push_back(begun_barrier_);
+  if (!begun_keys_.empty() || begun_barrier_) {
+    ++keyed_commands_;
+  }
+  if (begun_barrier_) {
+    ++barriers_;
+  }
+  BeginCommand();
+}
+
+void KeyOrderTracker::PopCommand() {
+  if (active_key_counts_.empty()) {
+    return;
+  }
+  size_t count = active_key_counts_.front();
+  bool barrier = active_barriers_.front();
+  active_key_counts_.pop_front();
+  active_barriers_.pop_front();
+
+  if (count > 0 || barrier) {
+    --keyed_commands_;
+  }
+  if (barrier) {
+    --barriers_;
+  }
+  for(size_t i = 0; i < count; ++i) {
+    const KeyUse& use = active_keys_.front();
+    auto it = uses_.find(use.first);
+    if (use.second) {
+      --it->second.writers_;
+    } else {
+      --it->second.readers_;
+    }
+    if (it->second.readers_ == 0 && it->second.writers_ == 0) {
+      uses_.erase(it);
+    }
+    active_keys_.pop_front();
+  }
+}
+
+void KeyOrderTracker::Clear() {
+  uses_.clear();
+  active_keys_.clear();
+  active_key_counts_.clear();
+  active_barriers_.clear();
+  keyed_commands_ = 0;
+  barriers_ = 0;
+  BeginCommand();
+}
+
+}
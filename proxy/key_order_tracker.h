@@ -0,0 +1,69 @@
+#ifndef _YARMPROXY_KEY_ORDER_TRACKER_H_
+#define _YARMPROXY_KEY_ORDER_TRACKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace yarmproxy {
+
+// The pipelined commands of a client are executed in parallel, each on its
+// own backend connection, so a later command could be executed by a backend
+// before an earlier one. The tracker keeps the order of the commands on the
+// same key: a command conflicts with an earlier active command if both have
+// a key and either of them writes it. A conflicting command isn't started
+// until the earlier commands on its keys are finished, while the commands
+// on independent keys are still executed in parallel.
+//
+// The keys are tracked by their 64-bit hash, a collision only serializes
+// two independent commands.
+class KeyOrderTracker {
+public:
+  // begins the keys of the next command to start
+  void BeginCommand();
+  // return : false if an active command conflicts on the key
+  bool AddKey(const char* key, size_t len, bool write);
+  // the other keys of the command aren't received yet, e.g. of a big mset,
+  // so it conflicts with every active command having keys, and the later
+  // commands having keys conflict with it
+  // return : false if an active command has keys
+  bool AddUnknownKeys();
+  // whether the command begun conflicts with an active command
+  bool conflicted() const {
+    return conflicted_;
+  }
+
+  // the command begun is started, as the last active command
+  void PushCommand();
+  // the first active command is finished
+  void PopCommand();
+  void Clear();
+
+private:
+  struct KeyUses {
+    uint32_t readers_ = 0;
+    uint32_t writers_ = 0;
+  };
+  typedef std::pair<uint64_t, bool> KeyUse; // hash, write
+
+  std::unordered_map<uint64_t, KeyUses> uses_;
+  // the keys of the active commands, in their order, and the count of the
+  // keys and whether some are unknown, of each command
+  std::deque<KeyUse> active_keys_;
+  std::deque<size_t> active_key_counts_;
+  std::deque<bool> active_barriers_;
+  size_t keyed_commands_ = 0; // active commands having keys
+  size_t barriers_ = 0;       // active commands with unknown keys
+
+  std::vector<KeyUse> begun_keys_;
+  bool begun_barrier_ = false;
+  bool conflicted_ = false;
+};
+
+}
+
+#endif // _YARMPROXY_KEY_ORDER_TRACKER_H_
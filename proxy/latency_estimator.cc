@@ -0,0 +1,59 @@
+#include "latency_estimator.h"
+
+#include <algorithm>
+
+namespace yarmproxy {
+
+void LatencyEstimator::AddSample(Clock::duration latency) {
+  int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(
+      latency).count();
+  if (!has_sample_) {
+    srtt_ = sample;
+    rttvar_ = sample / 2;
+    has_sample_ = true;
+  } else {
+    int64_t delta = sample > srtt_ ? sample - srtt_ : srtt_ - sample;
+    rttvar_ += (delta - rttvar_) / 4; // beta = 1/4
+    srtt_ += (sample - srtt_) / 8;    // alpha = 1/8
+  }
+  backoff_ = 0;
+  recent_samples_[total_samples_++ % kRecentSamples] = sample;
+}
+
+void LatencyEstimator::OnTimeout() {
+  if (backoff_ < 16) {
+    ++backoff_;
+  }
+}
+
+LatencyEstimator::Clock::duration LatencyEstimator::Percentile(
+    int percentile) {
+  if (total_samples_ < kPercentileRefreshSamples) {
+    return Clock::duration::zero();
+  }
+  if (percentile != percentile_ ||
+      total_samples_ - percentile_samples_ >= kPercentileRefreshSamples) {
+    size_t count = std::min(total_samples_, size_t(kRecentSamples));
+    int64_t samples[kRecentSamples];
+    std::copy(recent_samples_, recent_samples_ + count, samples);
+    size_t nth = count * percentile / 100;
+    std::nth_element(samples, samples + nth, samples + count);
+    percentile_ = percentile;
+    percentile_samples_ = total_samples_;
+    percentile_value_ = samples[nth];
+  }
+  return std::chrono::microseconds(percentile_value_);
+}
+
+int LatencyEstimator::Timeout() const {
+  if (!has_sample_) {
+    return max_timeout_;
+  }
+  int64_t timeout = (srtt_ + 4 * rttvar_ + 999) / 1000;
+  timeout <<= backoff_;
+  return int(std::max(int64_t(min_timeout_),
+                      std::min(int64_t(max_timeout_), timeout)));
+}
+
+}
+
@@ -0,0 +1,60 @@
+#ifndef _YARMPROXY_LATENCY_ESTIMATOR_H_
+#define _YARMPROXY_LATENCY_ESTIMATOR_H_
+
+#include <chrono>
+#include <cstdint>
+
+namespace yarmproxy {
+
+// Per worker, per endpoint latency estimate, smoothed like the TCP
+// retransmission timer(RFC 6298). The backend timeouts are derived from it
+// and clamped to [min_timeout, max_timeout] of the cluster.
+class LatencyEstimator {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void AddSample(Clock::duration latency);
+  void OnTimeout();
+
+  // in milliseconds
+  int Timeout() const;
+
+  // smoothed latency in microseconds, 0 if there is no sample yet
+  int64_t srtt() const {
+    return srtt_;
+  }
+
+  // latency percentile of the recent samples, zero if there are too few
+  Clock::duration Percentile(int percentile);
+
+  void set_timeout_range(int min_timeout, int max_timeout) {
+    min_timeout_ = min_timeout;
+    max_timeout_ = max_timeout;
+  }
+  bool enabled() const {
+    return max_timeout_ > 0;
+  }
+
+private:
+  static const size_t kRecentSamples = 64;
+  // the cached percentile is recomputed after this count of samples
+  static const size_t kPercentileRefreshSamples = 16;
+
+  int64_t srtt_   = 0; // smoothed latency, in microseconds
+  int64_t rttvar_ = 0; // latency variation, in microseconds
+  bool has_sample_ = false;
+  int backoff_ = 0;    // timeout doubles on each timeout before a new sample
+
+  int min_timeout_ = 0;
+  int max_timeout_ = 0; // 0 : disabled
+
+  int64_t recent_samples_[kRecentSamples]; // ring buffer, in microseconds
+  size_t total_samples_ = 0;
+  size_t percentile_samples_ = 0; // total_samples_ of the cached percentile
+  int percentile_ = 0;
+  int64_t percentile_value_ = 0;
+};
+
+}
+
+#endif // _YARMPROXY_LATENCY_ESTIMATOR_H_
@@ -0,0 +1,105 @@
+#ifndef _YARMPROXY_LOG_RING_H_
+#define _YARMPROXY_LOG_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace base {
+
+// A single producer single consumer ring of variable sized records, e.g. the
+// log records of a worker thread, drained by the logging thread. A record is
+// kept contiguous, a record not fitting before the end of the ring is written
+// from its beginning, after a wrap marker. The producer never waits: a record
+// not fitting in the free space is dropped, and counted.
+class LogRing {
+public:
+  static const size_t kDefaultCapacity = 1 << 20;
+
+  // capacity : a multiple of 8
+  explicit LogRing(size_t capacity = kDefaultCapacity)
+      : capacity_(capacity), data_(new char[capacity]) {}
+  ~LogRing() {
+    delete [] data_;
+  }
+  LogRing(const LogRing&) = delete;
+  LogRing& operator=(const LogRing&) = delete;
+
+  // producer side
+  // return : false if the record is dropped
+  bool Push(const char* record, size_t bytes) {
+    size_t need = Align(kHeaderBytes + bytes);
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t offset = tail % capacity_;
+    size_t to_end = capacity_ - offset;
+    size_t total = need <= to_end ? need : to_end + need;
+    if (need > capacity_ / 2 || tail + total - head > capacity_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (need > to_end) {
+      uint32_t wrap = kWrapMarker;
+      memcpy(data_ + offset, &wrap, kHeaderBytes);
+      tail += to_end;
+      offset = 0;
+    }
+    uint32_t size = uint32_t(bytes);
+    memcpy(data_ + offset, &size, kHeaderBytes);
+    memcpy(data_ + offset + kHeaderBytes, record, bytes);
+    tail_.store(tail + need, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, calls handler(record, bytes) for the records pushed
+  // return : the count of the records drained
+  template <typename Handler>
+  size_t Drain(Handler&& handler) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (head != tail) {
+      size_t offset = head % capacity_;
+      uint32_t size;
+      memcpy(&size, data_ + offset, kHeaderBytes);
+      if (size == kWrapMarker) {
+        head += capacity_ - offset;
+        continue;
+      }
+      handler(data_ + offset + kHeaderBytes, size_t(size));
+      head += Align(kHeaderBytes + size);
+      ++count;
+    }
+    head_.store(head, std::memory_order_release);
+    return count;
+  }
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static const size_t kHeaderBytes = sizeof(uint32_t);
+  static const uint32_t kWrapMarker = ~uint32_t(0);
+  static size_t Align(size_t bytes) {
+    return (bytes + 7) & ~size_t(7);
+  }
+
+  const size_t capacity_;
+  char* data_;
+  // the positions only grow. the consumer and the producer ones are kept
+  // on their own cache lines
+  std::atomic<size_t> head_{0};
+  char head_padding_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}
+
+#endif // _YARMPROXY_LOG_RING_H_
@@ -1,9 +1,286 @@
 #include "logging.h"
 
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log_ring.h"
 
 namespace base {
 
+int g_log_verbosity = loguru::Verbosity_INFO;
+
+namespace {
+
+enum ValueTag : uint8_t {
+  TAG_STRING,
+  TAG_SIGNED,
+  TAG_UNSIGNED,
+  TAG_DOUBLE,
+  TAG_POINTER,
+  TAG_CHAR,
+  TAG_BOOL,
+  TAG_TRUNCATED, // the values after it didn't fit into the record
+};
+
+struct RecordHeader {
+  int64_t time_us; // since the epoch
+  const char* file;
+  uint32_t line;
+  int32_t verbosity;
+  uint32_t thread;
+};
+
+const size_t kMaxRecordBytes = 4096;
+
+}
+
+// the record being logged by a thread, and the ring its records are pushed
+// into, registered to the logging thread at the first push
+struct ThreadLog {
+  char record_[kMaxRecordBytes];
+  size_t bytes_ = 0;
+  bool truncated_ = false;
+  uint32_t thread_ = 0;
+
+  LogRing* ring_ = nullptr;
+  bool closed_ = false;        // the thread exited, guarded by the mutex
+  uint64_t reported_drops_ = 0;
+};
+
+namespace {
+
+std::atomic<uint32_t> s_thread_count(0);
+thread_local ThreadLog* t_log = nullptr;
+
+// the registered logs and the logging thread. it's never destroyed, as the
+// threads might log until the process exits
+struct LogState {
+  std::mutex mutex_; // guards the members below
+  std::condition_variable wakeup_;
+  std::vector<ThreadLog*> logs_;
+  std::thread* drainer_ = nullptr;
+  bool stopping_ = false;
+};
+LogState& State() {
+  static LogState* state = new LogState();
+  return *state;
+}
+
+std::atomic<bool> s_async(false);           // InitLogging was called
+std::atomic<bool> s_drainer_running(false);
+
+const std::chrono::milliseconds kDrainInterval(10);
+
+// closes the log of an exiting thread, freed once its ring is drained
+struct ThreadLogCloser {
+  ~ThreadLogCloser() {
+    if (t_log == nullptr) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(State().mutex_);
+    if (t_log->ring_ == nullptr) {
+      delete t_log;
+    } else {
+      t_log->closed_ = true;
+    }
+    t_log = nullptr;
+  }
+};
+thread_local ThreadLogCloser t_log_closer;
+
+ThreadLog* CurrentThreadLog() {
+  if (t_log == nullptr) {
+    (void)&t_log_closer; // registers the destructor of the thread
+    t_log = new ThreadLog();
+    t_log->thread_ = s_thread_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  return t_log;
+}
+
+const char* VerbosityName(int verbosity, char* buf, size_t size) {
+  switch(verbosity) {
+  case loguru::Verbosity_FATAL:
+    return "FATL";
+  case loguru::Verbosity_ERROR:
+    return " ERR";
+  case loguru::Verbosity_WARNING:
+    return "WARN";
+  case loguru::Verbosity_INFO:
+    return "INFO";
+  default:
+    snprintf(buf, size, "%4d", verbosity);
+    return buf;
+  }
+}
+
+template <typename T>
+T Read(const char*& p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return value;
+}
+
+// formats a record as loguru would, and writes it to the loguru sinks
+void WriteRecord(const char* record, size_t bytes) {
+  const char* p = record;
+  const char* end = record + bytes;
+  RecordHeader header = Read<RecordHeader>(p);
+
+  std::string text;
+  text.reserve(128 + bytes);
+  char buf[128];
+  time_t sec = time_t(header.time_us / 1000000);
+  struct tm tm;
+  localtime_r(&sec, &tm);
+  char level[8];
+  int n = snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%03d ",
+                   1900 + tm.tm_year, 1 + tm.tm_mon, tm.tm_mday, tm.tm_hour,
+                   tm.tm_min, tm.tm_sec, int(header.time_us / 1000 % 1000));
+  text.append(buf, n);
+  if (g_log_verbosity > loguru::Verbosity_INFO) {
+    const char* file = strrchr(header.file, '/');
+    n = snprintf(buf, sizeof(buf), "[T%u] %s:%u ", header.thread,
+                 file ? file + 1 : header.file, header.line);
+    // truncated to the buffer if the file name is too long
+    if (n > 0) {
+      text.append(buf, std::min<int>(n, sizeof(buf) - 1));
+    }
+  }
+  text.append(VerbosityName(header.verbosity, level, sizeof(level)));
+  text.append("| ");
+
+  while (p < end) {
+    switch(Read<uint8_t>(p)) {
+    case TAG_STRING: {
+        uint32_t len = Read<uint32_t>(p);
+        text.append(p, len);
+        p += len;
+      }
+      break;
+    case TAG_SIGNED:
+      n = snprintf(buf, sizeof(buf), "%lld", (long long)Read<int64_t>(p));
+      text.append(buf, n);
+      break;
+    case TAG_UNSIGNED:
+      n = snprintf(buf, sizeof(buf), "%llu",
+                   (unsigned long long)Read<uint64_t>(p));
+      text.append(buf, n);
+      break;
+    case TAG_DOUBLE:
+      n = snprintf(buf, sizeof(buf), "%g", Read<double>(p));
+      text.append(buf, n);
+      break;
+    case TAG_POINTER:
+      n = snprintf(buf, sizeof(buf), "%p", Read<const void*>(p));
+      text.append(buf, n);
+      break;
+    case TAG_CHAR:
+      text.push_back(Read<char>(p));
+      break;
+    case TAG_BOOL:
+      text.push_back(Read<char>(p) ? '1' : '0');
+      break;
+    case TAG_TRUNCATED:
+    default:
+      text.append("...");
+      p = end;
+      break;
+    }
+  }
+  loguru::raw_log(loguru::Verbosity(header.verbosity), header.file,
+                  header.line, "%s", text.c_str());
+}
+
+// return : the count of the records written
+size_t DrainLogs(std::vector<ThreadLog*>& logs) {
+  size_t count = 0;
+  for(size_t i = 0; i < logs.size(); ) {
+    ThreadLog* log = logs[i];
+    count += log->ring_->Drain(WriteRecord);
+    uint64_t drops = log->ring_->dropped();
+    if (drops != log->reported_drops_) {
+      loguru::raw_log(loguru::Verbosity_WARNING, __FILE__, __LINE__,
+                      "%llu log records of thread T%u dropped",
+                      (unsigned long long)(drops - log->reported_drops_),
+                      log->thread_);
+      log->reported_drops_ = drops;
+    }
+    if (log->closed_ && log->ring_->empty()) {
+      delete log->ring_;
+      delete log;
+      logs[i] = logs.back();
+      logs.pop_back();
+    } else {
+      ++i;
+    }
+  }
+  return count;
+}
+
+void DrainLoop() {
+  LogState& state = State();
+  std::unique_lock<std::mutex> lock(state.mutex_);
+  while (true) {
+    size_t count = DrainLogs(state.logs_);
+    if (state.stopping_ && count == 0) {
+      break;
+    }
+    if (count == 0) {
+      state.wakeup_.wait_for(lock, kDrainInterval);
+    }
+  }
+}
+
+// the logging thread doesn't survive a fork, e.g. of Daemonize, so it's
+// started by the first record pushed, in the parent or the child
+void StartDrainer() {
+  LogState& state = State();
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  if (!s_drainer_running.load(std::memory_order_relaxed)) {
+    state.stopping_ = false;
+    state.drainer_ = new std::thread(DrainLoop);
+    s_drainer_running.store(true, std::memory_order_release);
+  }
+}
+
+void PrepareFork() {
+  State().mutex_.lock();
+}
+void ParentAfterFork() {
+  State().mutex_.unlock();
+}
+void ChildAfterFork() {
+  State().mutex_.unlock();
+  State().drainer_ = nullptr; // not running in the child
+  s_drainer_running.store(false, std::memory_order_relaxed);
+}
+
+void PushRecord(ThreadLog* log) {
+  if (log->ring_ == nullptr) {
+    std::lock_guard<std::mutex> lock(State().mutex_);
+    log->ring_ = new LogRing();
+    State().logs_.push_back(log);
+  }
+  if (!s_drainer_running.load(std::memory_order_acquire)) {
+    StartDrainer();
+  }
+  log->ring_->Push(log->record_, log->bytes_);
+}
+
+}
+
 static loguru::Verbosity LevelVerbosity(const char* level) {
   if (strcmp("TRACE", level) == 0) {
     return 4;
@@ -48,7 +325,145 @@ void InitLogging(const char *path, const char *loglevel) {
   loguru::init(argc, argv);
   // loguru::add_file(path, loguru::Append, verbosity);
   loguru::add_file(path, loguru::Truncate, verbosity);
+
+  g_log_verbosity = verbosity;
+  static std::once_flag once;
+  std::call_once(once, []() {
+        pthread_atfork(PrepareFork, ParentAfterFork, ChildAfterFork);
+        // before the exit destroys the loguru sinks, registered before
+        atexit(ShutdownLogging);
+      });
+  s_async.store(true, std::memory_order_release);
+}
+
+void ShutdownLogging() {
+  s_async.store(false, std::memory_order_release);
+  LogState& state = State();
+  std::thread* drainer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex_);
+    state.stopping_ = true;
+    drainer = state.drainer_;
+    state.drainer_ = nullptr;
+  }
+  state.wakeup_.notify_one();
+  if (drainer != nullptr) {
+    drainer->join();
+    delete drainer;
+  }
+  std::lock_guard<std::mutex> lock(state.mutex_);
+  s_drainer_running.store(false, std::memory_order_relaxed);
+  DrainLogs(state.logs_); // the records pushed while it was stopping
+}
+
+LogRecord::LogRecord(int verbosity, const char* file, unsigned line)
+    : log_(CurrentThreadLog()) {
+  RecordHeader header;
+  header.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  header.file = file;
+  header.line = line;
+  header.verbosity = verbosity;
+  header.thread = log_->thread_;
+  memcpy(log_->record_, &header, sizeof(header));
+  log_->bytes_ = sizeof(header);
+  log_->truncated_ = false;
 }
 
+LogRecord::~LogRecord() {
+  RecordHeader header;
+  memcpy(&header, log_->record_, sizeof(header));
+  if (header.verbosity <= loguru::Verbosity_FATAL) {
+    {
+      std::lock_guard<std::mutex> lock(State().mutex_);
+      DrainLogs(State().logs_); // the records before it
+    }
+    WriteRecord(log_->record_, log_->bytes_);
+    loguru::flush();
+    abort();
+  }
+  if (s_async.load(std::memory_order_acquire)) {
+    PushRecord(log_);
+  } else {
+    WriteRecord(log_->record_, log_->bytes_);
+  }
 }
 
+// appends a tag and its value of `bytes`, unless the record is full
+static inline bool Append(ThreadLog* log, uint8_t tag, const void* value,
+                          size_t bytes) {
+  if (log->truncated_) {
+    return false;
+  }
+  // a byte is kept for the truncation tag
+  if (log->bytes_ + 1 + bytes + 1 > kMaxRecordBytes) {
+    log->record_[log->bytes_++] = char(TAG_TRUNCATED);
+    log->truncated_ = true;
+    return false;
+  }
+  log->record_[log->bytes_] = char(tag);
+  memcpy(log->record_ + log->bytes_ + 1, value, bytes);
+  log->bytes_ += 1 + bytes;
+  return true;
+}
+
+void LogRecord::AppendString(const char* data, size_t bytes) {
+  if (log_->truncated_) {
+    return;
+  }
+  // the part fitting into the record, with its length and the tags
+  size_t room = kMaxRecordBytes - log_->bytes_;
+  size_t overhead = 1 + sizeof(uint32_t) + 1;
+  bool fits = bytes + overhead <= room;
+  if (!fits) {
+    bytes = room > overhead ? room - overhead : 0;
+  }
+  uint32_t len = uint32_t(bytes);
+  if (Append(log_, TAG_STRING, &len, sizeof(len))) {
+    memcpy(log_->record_ + log_->bytes_, data, bytes);
+    log_->bytes_ += bytes;
+  }
+  if (!fits && !log_->truncated_) {
+    log_->record_[log_->bytes_++] = char(TAG_TRUNCATED);
+    log_->truncated_ = true;
+  }
+}
+
+void LogRecord::AppendSigned(int64_t value) {
+  Append(log_, TAG_SIGNED, &value, sizeof(value));
+}
+
+void LogRecord::AppendUnsigned(uint64_t value) {
+  Append(log_, TAG_UNSIGNED, &value, sizeof(value));
+}
+
+LogRecord& LogRecord::operator<<(const char* str) {
+  if (str == nullptr) {
+    str = "(null)";
+  }
+  AppendString(str, strlen(str));
+  return *this;
+}
+
+LogRecord& LogRecord::operator<<(char c) {
+  Append(log_, TAG_CHAR, &c, sizeof(c));
+  return *this;
+}
+
+LogRecord& LogRecord::operator<<(bool b) {
+  char c = b;
+  Append(log_, TAG_BOOL, &c, sizeof(c));
+  return *this;
+}
+
+LogRecord& LogRecord::operator<<(double d) {
+  Append(log_, TAG_DOUBLE, &d, sizeof(d));
+  return *this;
+}
+
+LogRecord& LogRecord::operator<<(const void* ptr) {
+  Append(log_, TAG_POINTER, &ptr, sizeof(ptr));
+  return *this;
+}
+
+}
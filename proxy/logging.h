@@ -1,20 +1,113 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
 #define LOGURU_WITH_STREAMS 1
 #include "loguru.h"
 
+// the most verbose level compiled in, see YARMPROXY_LOG_LEVEL in
+// CMakeLists.txt. the logs of the levels above it are compiled out, without
+// even the check of the runtime level.
+#ifndef YARMPROXY_LOG_MAX_VERBOSITY
+#define YARMPROXY_LOG_MAX_VERBOSITY 4 // TRACE
+#endif
+
 namespace base {
 
 void InitLogging(const char *path, const char *loglevel);
 #define LOG_INIT(path, loglevel) \
   base::InitLogging(path, loglevel);
+// writes the records logged, and stops the logging thread
+void ShutdownLogging();
+#define LOG_SHUTDOWN() \
+  base::ShutdownLogging();
 
-#define LOG_TRACE LOG_S(4)
-#define LOG_DEBUG LOG_S(2)
-#define LOG_INFO  LOG_S(INFO)
-#define LOG_WARN  LOG_S(WARNING)
-#define LOG_ERROR LOG_S(ERROR)
-#define LOG_FATAL LOG_S(FATAL)
+// the runtime level, set by InitLogging
+extern int g_log_verbosity;
 
-}
+struct ThreadLog;
+
+// A log statement, e.g. `LOG_DEBUG << "backend=" << backend`. The values are
+// encoded in a binary record, with the strings copied, and the record is
+// pushed into the ring of the thread when the statement ends. The logging
+// thread formats and writes the records, so a worker logging never formats
+// the values, nor takes the lock of loguru. Before InitLogging, or for the
+// FATAL logs, the record is written in place.
+class LogRecord {
+public:
+  LogRecord(int verbosity, const char* file, unsigned line);
+  ~LogRecord();
+  LogRecord(const LogRecord&) = delete;
+  LogRecord& operator=(const LogRecord&) = delete;
+
+  LogRecord& operator<<(const char* str);
+  LogRecord& operator<<(const std::string& str) {
+    AppendString(str.data(), str.size());
+    return *this;
+  }
+  LogRecord& operator<<(char c);
+  LogRecord& operator<<(bool b);
+  LogRecord& operator<<(double d);
+  LogRecord& operator<<(const void* ptr);
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value &&
+                          std::is_signed<T>::value, LogRecord&>::type
+  operator<<(T value) {
+    AppendSigned(int64_t(value));
+    return *this;
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value &&
+                          !std::is_signed<T>::value, LogRecord&>::type
+  operator<<(T value) {
+    AppendUnsigned(uint64_t(value));
+    return *this;
+  }
+  template <typename T>
+  LogRecord& operator<<(const std::shared_ptr<T>& ptr) {
+    return *this << static_cast<const void*>(ptr.get());
+  }
+  // the other types, e.g. the endpoints, are formatted in place
+  template <typename T>
+  typename std::enable_if<!std::is_arithmetic<T>::value &&
+                          !std::is_pointer<T>::value &&
+                          !std::is_array<T>::value, LogRecord&>::type
+  operator<<(const T& value) {
+    std::ostringstream os;
+    os << value;
+    return *this << os.str();
+  }
 
+private:
+  void AppendString(const char* data, size_t bytes);
+  void AppendSigned(int64_t value);
+  void AppendUnsigned(uint64_t value);
+
+  ThreadLog* log_;
+};
+
+class LogVoidify {
+public:
+  void operator&(const LogRecord&) {}
+};
+
+#define YARM_LOG(verbosity) \
+  ((verbosity) > YARMPROXY_LOG_MAX_VERBOSITY || \
+   (verbosity) > base::g_log_verbosity) ? (void)0 \
+      : base::LogVoidify() & base::LogRecord(verbosity, __FILE__, __LINE__)
+
+#define LOG_TRACE YARM_LOG(4)
+#define LOG_DEBUG YARM_LOG(2)
+#define LOG_INFO  YARM_LOG(loguru::Verbosity_INFO)
+#define LOG_WARN  YARM_LOG(loguru::Verbosity_WARNING)
+#define LOG_ERROR YARM_LOG(loguru::Verbosity_ERROR)
+#define LOG_FATAL YARM_LOG(loguru::Verbosity_FATAL)
+
+}
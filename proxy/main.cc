@@ -31,6 +31,7 @@ int main(int argc, char* argv[]) {
   server.Run();
   CleanupPidFile();
   LOG_ERROR << "YarmProxy stopped.";
+  LOG_SHUTDOWN();
   return 0;
 }
 
@@ -1,23 +1,37 @@
 #include "memc_basic_command.h"
 
+#include <cstring>
+
 #include "logging.h"
 
+#include "backend_conn.h"
 #include "key_locator.h"
 #include "backend_pool.h"
+#include "command_table.h"
 
 namespace yarmproxy {
 
 MemcBasicCommand::MemcBasicCommand(
-    std::shared_ptr<ClientConnection> client, const char* buf)
+    std::shared_ptr<ClientConnection> client, const char* cmd_line,
+    size_t cmd_size, const MemcCommandSpec& spec)
     : Command(client, ProtocolType::MEMCACHED) {
-  const char *p = buf;
-  while(*(p++) != ' ');
-
-  const char *q = p;
-  while(*(++q) != ' ' && *q != '\r');
+  const char* end = cmd_line + cmd_size - (sizeof("\r\n") - 1);
+  const char* p = spec.first_key(cmd_line, end);
+  const char* q = p;
+  while(q < end && *q != ' ') {
+    ++q;
+  }
 
   auto ep = key_locator()->Locate(p, q - p, ProtocolType::MEMCACHED);
-  replying_backend_ = backend_pool()->Allocate(ep);
+  // e.g. get or gets of keys on one backend
+  if (spec.flags_ & kCommandReadOnly) {
+    replying_backend_ = backend_pool()->Allocate(
+        backend_pool()->SelectReadEndpoint(ep, p, q - p,
+                                           ProtocolType::MEMCACHED));
+    replying_backend_->set_hedgeable();
+  } else {
+    replying_backend_ = backend_pool()->Allocate(ep);
+  }
 }
 
 MemcBasicCommand::~MemcBasicCommand() {
@@ -5,10 +5,13 @@
 
 namespace yarmproxy {
 
+struct MemcCommandSpec;
+
 class MemcBasicCommand: public Command {
 public:
   MemcBasicCommand(std::shared_ptr<ClientConnection> client,
-                   const char* buf);
+                   const char* cmd_line, size_t cmd_size,
+                   const MemcCommandSpec& spec);
   virtual ~MemcBasicCommand();
 
 private:
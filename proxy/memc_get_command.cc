@@ -8,6 +8,7 @@
 #include "key_locator.h"
 #include "backend_pool.h"
 #include "client_conn.h"
+#include "command_table.h"
 #include "read_buffer.h"
 
 namespace yarmproxy {
@@ -21,30 +22,73 @@ struct MemcGetCommand::Subquery {
 };
 
 MemcGetCommand::MemcGetCommand(std::shared_ptr<ClientConnection> client,
-                     const char* cmd_data, size_t cmd_size)
+                     const char* cmd_data, size_t cmd_size,
+                     const MemcCommandSpec& spec)
     : Command(client, ProtocolType::MEMCACHED)
 {
-  for(const char* p = cmd_data + (sizeof("get ") - 1);
-      p < cmd_data + cmd_size - (sizeof("\r\n") - 1); ++p) {
+  const char* end = cmd_data + cmd_size - (sizeof("\r\n") - 1);
+  const char* first_key = spec.first_key(cmd_data, end);
+  std::vector<KeyLocator::Key> keys;
+  for(const char* p = first_key; p < end; ++p) {
     const char* q = p;
     while(*q != ' ' && *q != '\r') {
       ++q;
     }
-    auto ep = key_locator()->Locate(p, q - p, ProtocolType::MEMCACHED);
+    keys.emplace_back(p, q - p);
+    p = q;
+  }
+  std::vector<uint16_t> primaries(keys.size());
+  auto locator = key_locator();
+  locator->LocateBatch(keys.data(), keys.size(), ProtocolType::MEMCACHED,
+                       primaries.data());
+
+  // primary -> selected replica, by the endpoint index of the primary.
+  // Endpoint() if selected by key, for the load bounded clusters. the
+  // primary itself for a write, e.g. gat
+  const bool read_only = (spec.flags_ & kCommandReadOnly) != 0;
+  std::map<uint16_t, Endpoint> read_endpoints;
+  KeyLocator::LoadSum load_sum;
+  for(size_t i = 0; i < keys.size(); ++i) {
+    const char* p = keys[i].first;
+    const char* q = p + keys[i].second;
+    uint16_t primary = primaries[i];
+    auto read_it = read_endpoints.find(primary);
+    if (read_it == read_endpoints.end()) {
+      const Endpoint& ep = locator->endpoint(primary);
+      if (!read_only) {
+        read_it = read_endpoints.emplace(primary, ep).first;
+      } else if (backend_pool()->LoadBounded(ep)) {
+        // by key, the keys of a primary may spill to different backends
+        read_it = read_endpoints.emplace(primary, Endpoint()).first;
+      } else {
+        read_it = read_endpoints.emplace(primary,
+                      backend_pool()->SelectReadEndpoint(ep)).first;
+      }
+    }
+    const Endpoint ep = read_it->second != Endpoint() ? read_it->second :
+        backend_pool()->SelectReadEndpoint(locator->endpoint(primary),
+                                           p, q - p, ProtocolType::MEMCACHED,
+                                           &load_sum);
     auto it = subqueries_.find(ep);
     if (it == subqueries_.end()) {
       client_conn_->buffer()->inc_recycle_lock();
 
       std::shared_ptr<Subquery> subquery(
           new Subquery(backend_pool()->Allocate(ep)));
+      if (read_only) {
+        subquery->backend_->set_hedgeable();
+      }
       it = subqueries_.emplace(ep, subquery).first;
+      if (read_it->second == Endpoint()) {
+        load_sum.AddLoad();
+      }
 
-      static const char prefix[] = "get";
-      it->second->segments_.emplace_back(prefix, sizeof(prefix) - 1);
+      // the name and the arguments before the keys, e.g. "gat <exptime>"
+      it->second->segments_.emplace_back(cmd_data,
+                                         first_key - 1 - cmd_data);
     }
 
     it->second->segments_.emplace_back(p - 1, 1 + q - p);
-    p = q;
   }
   for(auto& it : subqueries_) {
     static const char postfix[] = "\r\n";
@@ -63,9 +107,7 @@ bool MemcGetCommand::StartWriteQuery() {
     auto& query = item.second;
     auto backend = query->backend_;
     assert(backend);
-    backend->SetReadWriteCallback(
-        WeakBind(&Command::OnWriteQueryFinished, backend),
-        WeakBind(&Command::OnBackendReplyReceived, backend));
+    backend->SetHandler(shared_from_this());
     query->backend_->WriteQuery(query->segments_.front().first,
                                 query->segments_.front().second);
   }
@@ -75,7 +117,7 @@ bool MemcGetCommand::StartWriteQuery() {
 void MemcGetCommand::OnWriteQueryFinished(
     std::shared_ptr<BackendConn> backend, ErrorCode ec) {
   if (ec != ErrorCode::E_SUCCESS) {
-    if (ec == ErrorCode::E_CONNECT) {
+    if (ec == ErrorCode::E_CONNECT || ec == ErrorCode::E_CIRCUIT_OPEN) {
       OnBackendRecoverableError(backend, ec);
       // 等同于转发完成已收数据
       client_conn_->buffer()->dec_recycle_lock();
@@ -119,7 +161,7 @@ bool MemcGetCommand::TryActivateReplyingBackend(
 
 void MemcGetCommand::BackendReadyToReply(
     std::shared_ptr<BackendConn> backend) {
-  if (client_conn_->IsFirstCommand(shared_from_this())
+  if (client_conn_->IsFirstCommand(this)
       && TryActivateReplyingBackend(backend)) {
     if (backend->finished()) {
       // newly received data might needn't forwarding, eg. some "END\r\n"
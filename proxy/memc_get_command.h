@@ -12,10 +12,15 @@ namespace yarmproxy {
 
 using Endpoint = boost::asio::ip::tcp::endpoint;
 
+struct MemcCommandSpec;
+
+// "<name> <arg>* <key>*\r\n" of keys on different backends, e.g. get, gets,
+// or gat. each backend is sent the name and the arguments with its keys
 class MemcGetCommand : public Command {
 public:
   MemcGetCommand(std::shared_ptr<ClientConnection> client,
-                     const char* cmd_data, size_t cmd_size);
+                     const char* cmd_data, size_t cmd_size,
+                     const MemcCommandSpec& spec);
 
   virtual ~MemcGetCommand();
 
@@ -29,6 +34,9 @@ public:
   }
   void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
                            ErrorCode ec) override;
+  size_t backend_count() const override {
+    return subqueries_.size();
+  }
 
 private:
   bool BackendErrorRecoverable(std::shared_ptr<BackendConn> backend,
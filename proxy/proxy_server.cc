@@ -1,10 +1,15 @@
 #include "proxy_server.h"
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "logging.h"
 
+#include "backend_monitor.h"
 #include "key_locator.h"
 #include "client_conn.h"
 #include "config.h"
+#include "redis_cluster_monitor.h"
 #include "signal_watcher.h"
 #include "worker_pool.h"
 
@@ -23,13 +28,49 @@ static size_t DefaultConcurrency() {
   return hd_concurrency == 0 ? 4 : hd_concurrency;
 }
 
+// return : the CPU the last packet of the socket was received on, -1 if unknown
+static int IncomingCpu(int fd) {
+#ifdef SO_INCOMING_CPU
+  int cpu = -1;
+  socklen_t len = sizeof(cpu);
+  if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0) {
+    return cpu;
+  }
+#else
+  (void)fd;
+#endif
+  return -1;
+}
+
+// a client never started is destroyed on the thread of its worker, like the
+// others, since its read buffer is from the allocator of the worker
+static void DestroyOnWorker(std::shared_ptr<ClientConnection>&& client_conn) {
+  WorkerContext& worker = client_conn->context();
+  worker.io_context_.post(std::bind(
+      [](std::shared_ptr<ClientConnection>&) {}, std::move(client_conn)));
+}
+
 ProxyServer::ProxyServer(const std::string & addr, size_t worker_threads)
     : work_(io_context_)
     , acceptor_(io_context_)
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+    , accepted_socket_(io_context_)
+#endif
     , listen_addr_(addr)
     , stopped_(false)
+    , backend_monitor_(new BackendMonitor(io_context_, [this]() {
+          if (!UpdateKeyLocator()) {
+            LOG_ERROR << "BackendMonitor KeyLocator update error.";
+          }
+        }))
+    , redis_cluster_monitor_(new RedisClusterMonitor(io_context_, [this]() {
+          if (!UpdateKeyLocator()) {
+            LOG_ERROR << "RedisClusterMonitor KeyLocator update error.";
+          }
+        }))
     , worker_pool_(new WorkerPool(
-        worker_threads > 0 ? worker_threads : DefaultConcurrency())) {
+        worker_threads > 0 ? worker_threads : DefaultConcurrency(),
+        backend_monitor_.get(), redis_cluster_monitor_.get())) {
 }
 
 ProxyServer::~ProxyServer() {
@@ -45,13 +86,21 @@ SignalHandler ProxyServer::WrapThreadSafeHandler(std::function<void()> handler)
   };
 }
 
-void ProxyServer::Run() {
+bool ProxyServer::UpdateKeyLocator() {
   std::shared_ptr<KeyLocator> locator(new KeyLocator());
-  if (!locator->Initialize()) {
+  if (!locator->Initialize(backend_monitor_->ejected_backends(),
+                           redis_cluster_monitor_->cluster_slots())) {
+    return false;
+  }
+  worker_pool_->OnLocatorUpdated(locator);
+  return true;
+}
+
+void ProxyServer::Run() {
+  if (!UpdateKeyLocator()) {
     LOG_ERROR << "ProxyServer KeyLocator Initialize error ...";
     return;
   }
-  worker_pool_->OnLocatorUpdated(locator);
 
   auto endpoint = ParseEndpoint(listen_addr_);
   acceptor_.open(endpoint.protocol());
@@ -77,13 +126,12 @@ void ProxyServer::Run() {
         LOG_ERROR << "SIGHUP KeyLocator reload config error.";
         return;
       }
-      std::shared_ptr<KeyLocator> locator(new KeyLocator());
-      if (!locator->Initialize()) {
+      redis_cluster_monitor_->Start(); // cluster indexes might be changed
+      if (!UpdateKeyLocator()) {
         LOG_ERROR << "SIGHUP KeyLocator reload Initialize error.";
         return;
       }
       LOG_WARN << "SIGHUP KeyLocator::Reload OK.";
-      worker_pool_->OnLocatorUpdated(locator);
     }));
   SignalWatcher::Instance().RegisterHandler(SIGINT,
       WrapThreadSafeHandler([this]() {
@@ -96,6 +144,7 @@ void ProxyServer::Run() {
         Stop();
       }));
 
+  redis_cluster_monitor_->Start();
   worker_pool_->StartDispatching();
   StartAccept();
 
@@ -121,15 +170,93 @@ void ProxyServer::StartAccept() {
   std::shared_ptr<ClientConnection> client_conn(new ClientConnection(worker));
   LOG_DEBUG << "ProxyServer create new conn, client=" << client_conn;
 
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+  acceptor_.async_accept(accepted_socket_,
+#else
   acceptor_.async_accept(client_conn->socket(),
+#endif
       std::bind(&ProxyServer::HandleAccept, this, client_conn,
                 std::placeholders::_1));
 }
 
+WorkerContext* ProxyServer::IncomingCpuWorker(ClientConnection& client_conn,
+                                              int fd) {
+  if (!Config::Instance().worker_incoming_cpu()) {
+    return nullptr;
+  }
+  int cpu = IncomingCpu(fd);
+  WorkerContext* worker = cpu < 0 ? nullptr : worker_pool_->CpuWorker(cpu);
+  LOG_DEBUG << "ProxyServer incoming cpu=" << cpu << " worker=" << worker;
+  return worker == &client_conn.context() ? nullptr : worker;
+}
+
 void ProxyServer::HandleAccept(std::shared_ptr<ClientConnection> client_conn,
                                const boost::system::error_code& error) {
   if (!error) {
-    client_conn->StartRead();
+    // the timers of the connection are linked into the timing wheel of its
+    // worker, which only the worker thread touches
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+    // and so are the sockets of its reactor
+    boost::system::error_code release_ec;
+    int fd = accepted_socket_.release(release_ec);
+    if (release_ec) {
+      LOG_ERROR << "ProxyServer release accepted socket error "
+                << release_ec.message();
+      accepted_socket_.close(release_ec);
+      StartAccept();
+      return;
+    }
+    WorkerContext* worker = IncomingCpuWorker(*client_conn, fd);
+    if (worker != nullptr) {
+      DestroyOnWorker(std::move(client_conn));
+    } else {
+      worker = &client_conn->context();
+    }
+    worker->io_context_.post([client_conn, worker, fd]() mutable {
+          if (!client_conn) {
+            // handed to another worker, so created on its thread, as its read
+            // buffer is from the allocator of the worker
+            client_conn.reset(new ClientConnection(*worker));
+          }
+          boost::system::error_code assign_ec;
+          client_conn->socket().assign(fd, assign_ec);
+          if (assign_ec) {
+            LOG_WARN << "client assign error " << assign_ec.message();
+            ::close(fd);
+            return;
+          }
+          client_conn->StartRead();
+        });
+#else
+    WorkerContext* worker = IncomingCpuWorker(
+        *client_conn, client_conn->socket().native_handle());
+    boost::system::error_code ec;
+    auto protocol = acceptor_.local_endpoint(ec).protocol();
+    int fd = worker == nullptr ? -1 : client_conn->socket().release(ec);
+    if (fd >= 0 && !ec) {
+      // the socket is of the io_context of the worker, so it's moved by its
+      // descriptor
+      DestroyOnWorker(std::move(client_conn));
+      worker->io_context_.post([worker, protocol, fd]() {
+            // created on the thread of the worker, as its read buffer is from
+            // the allocator of the worker
+            std::shared_ptr<ClientConnection> client_conn(
+                new ClientConnection(*worker));
+            boost::system::error_code assign_ec;
+            client_conn->socket().assign(protocol, fd, assign_ec);
+            if (assign_ec) {
+              LOG_WARN << "client assign error " << assign_ec.message();
+              ::close(fd);
+              return;
+            }
+            client_conn->StartRead();
+          });
+    } else {
+      client_conn->context().io_context_.post([client_conn]() {
+            client_conn->StartRead();
+          });
+    }
+#endif
     StartAccept();
   } else {
     LOG_ERROR << "ProxyServer accept error!";
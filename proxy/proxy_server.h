@@ -7,7 +7,10 @@
 
 namespace yarmproxy {
 
+class BackendMonitor;
 class ClientConnection;
+class RedisClusterMonitor;
+class WorkerContext;
 class WorkerPool;
 
 using SignalHandler = std::function<void(int sigid)>;
@@ -26,14 +29,27 @@ private:
 
   void StartAccept();
   void HandleAccept(std::shared_ptr<ClientConnection> conn, const boost::system::error_code& error);
+  // the worker on the CPU receiving the packets of the accepted socket fd, if
+  // incoming_cpu is on and it isn't the worker of the client already
+  WorkerContext* IncomingCpuWorker(ClientConnection& client_conn,
+                                   int fd);
+
+  // rebuild the key locator, and dispatch it to the workers
+  bool UpdateKeyLocator();
 
 private:
   boost::asio::io_service io_context_;
   boost::asio::io_service::work work_;
   boost::asio::ip::tcp::acceptor acceptor_;
+#ifdef YARMPROXY_WITH_EPOLL_REACTOR
+  // accepted by asio, then handed over to the epoll reactor of the worker
+  boost::asio::ip::tcp::socket accepted_socket_;
+#endif
   std::string listen_addr_;
   bool stopped_;
 
+  std::unique_ptr<BackendMonitor> backend_monitor_;
+  std::unique_ptr<RedisClusterMonitor> redis_cluster_monitor_;
   std::unique_ptr<WorkerPool> worker_pool_;
 
   // SignalHandler WrapThreadSafeHandler(SignalHandler handler);
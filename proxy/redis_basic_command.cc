@@ -2,18 +2,30 @@
 
 #include "logging.h"
 
+#include "backend_conn.h"
 #include "key_locator.h"
 #include "backend_pool.h"
 #include "client_conn.h"
+#include "command_table.h"
 
 namespace yarmproxy {
 
 RedisBasicCommand::RedisBasicCommand(std::shared_ptr<ClientConnection> client,
-                                     const redis::BulkArray& ba)
+                                     const redis::BulkArray& ba,
+                                     const RedisCommandSpec& spec)
     : Command(client, ProtocolType::REDIS) {
   auto ep = key_locator()->Locate(ba[1].payload_data(),
                 ba[1].payload_size(), ProtocolType::REDIS);
-  replying_backend_ = backend_pool()->Allocate(ep);
+  if (spec.flags_ & kCommandReadOnly) {
+    replying_backend_ = backend_pool()->Allocate(
+        backend_pool()->SelectReadEndpoint(ep, ba[1].payload_data(),
+                                           ba[1].payload_size(),
+                                           ProtocolType::REDIS));
+    replying_backend_->set_hedgeable();
+  } else {
+    replying_backend_ = backend_pool()->Allocate(ep);
+  }
+  KeepQueryForRedirection(ba.raw_data(), ba.total_size());
 }
 
 RedisBasicCommand::~RedisBasicCommand() {
@@ -6,10 +6,12 @@
 
 namespace yarmproxy {
 
+struct RedisCommandSpec;
+
 class RedisBasicCommand: public Command {
 public:
   RedisBasicCommand(std::shared_ptr<ClientConnection> client,
-                    const redis::BulkArray& ba);
+                    const redis::BulkArray& ba, const RedisCommandSpec& spec);
 
   virtual ~RedisBasicCommand();
 
@@ -0,0 +1,233 @@
+#include "redis_cluster.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace yarmproxy {
+namespace redis {
+
+static uint16_t Crc16(const char* data, size_t len) {
+  static const struct Table {
+    Table() {
+      for(int i = 0; i < 256; ++i) {
+        uint16_t crc = uint16_t(i << 8);
+        for(int k = 0; k < 8; ++k) {
+          crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021)
+                               : uint16_t(crc << 1);
+        }
+        entries_[i] = crc;
+      }
+    }
+    uint16_t entries_[256];
+  } table;
+
+  uint16_t crc = 0;
+  for(size_t i = 0; i < len; ++i) {
+    crc = uint16_t((crc << 8) ^
+                   table.entries_[((crc >> 8) ^ uint8_t(data[i])) & 0xff]);
+  }
+  return crc;
+}
+
+uint16_t KeySlot(const char* key, size_t len) {
+  const char* open = static_cast<const char*>(memchr(key, '{', len));
+  if (open != nullptr) {
+    const char* tag = open + 1;
+    const char* close = static_cast<const char*>(
+        memchr(tag, '}', key + len - tag));
+    if (close != nullptr && close > tag) {
+      return Crc16(tag, close - tag) & (kClusterSlots - 1);
+    }
+  }
+  return Crc16(key, len) & (kClusterSlots - 1);
+}
+
+// a cursor over a RESP reply. a read fails if the data is malformed, or
+// incomplete, which is told by `incomplete_`
+class RespReader {
+public:
+  RespReader(const char* data, size_t bytes)
+      : begin_(data), p_(data), end_(data + bytes) {
+  }
+
+  bool ReadHeader(char type, long long* value) {
+    if (p_ >= end_) {
+      incomplete_ = true;
+      return false;
+    }
+    if (*p_ != type) {
+      return false;
+    }
+    const char* eol = static_cast<const char*>(memchr(p_, '\n', end_ - p_));
+    if (eol == nullptr) {
+      incomplete_ = true;
+      return false;
+    }
+    char* num_end = nullptr;
+    *value = strtoll(p_ + 1, &num_end, 10);
+    if (num_end != eol - 1 || *num_end != '\r') {
+      return false;
+    }
+    p_ = eol + 1;
+    return true;
+  }
+
+  bool ReadBulk(std::string* value) {
+    long long size = 0;
+    if (!ReadHeader('$', &size) || size < 0) {
+      return false;
+    }
+    if (end_ - p_ < size + 2) {
+      incomplete_ = true;
+      return false;
+    }
+    value->assign(p_, size);
+    p_ += size + 2;
+    return true;
+  }
+
+  bool Skip(int depth = 0) {
+    if (p_ >= end_) {
+      incomplete_ = true;
+      return false;
+    }
+    long long value = 0;
+    std::string bulk;
+    switch(*p_) {
+    case '+':
+    case '-':
+    case ':':
+      return ReadHeader(*p_, &value) || SkipLine();
+    case '$':
+      return ReadBulk(&bulk);
+    case '*':
+      if (depth > 8 || !ReadHeader('*', &value)) {
+        return false;
+      }
+      for(long long i = 0; i < value; ++i) {
+        if (!Skip(depth + 1)) {
+          return false;
+        }
+      }
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  size_t bytes() const {
+    return p_ - begin_;
+  }
+  bool incomplete() const {
+    return incomplete_;
+  }
+
+private:
+  // status and error lines aren't numbers
+  bool SkipLine() {
+    if (incomplete_) {
+      return false;
+    }
+    const char* eol = static_cast<const char*>(memchr(p_, '\n', end_ - p_));
+    p_ = eol + 1;
+    return true;
+  }
+
+  const char* begin_;
+  const char* p_;
+  const char* end_;
+  bool incomplete_ = false;
+};
+
+int ParseClusterSlots(const char* data, size_t bytes, const Endpoint& node,
+                      ClusterSlots* slots) {
+  RespReader reader(data, bytes);
+  long long ranges = 0;
+  bool ok = reader.ReadHeader('*', &ranges) && ranges >= 0;
+
+  slots->clear();
+  for(long long i = 0; ok && i < ranges; ++i) {
+    long long fields = 0, first = 0, last = 0, node_fields = 0, port = 0;
+    std::string ip;
+    ok = reader.ReadHeader('*', &fields) && fields >= 3 &&
+         reader.ReadHeader(':', &first) && reader.ReadHeader(':', &last) &&
+         reader.ReadHeader('*', &node_fields) && node_fields >= 2 &&
+         reader.ReadBulk(&ip) && reader.ReadHeader(':', &port);
+    // node id and metadata of the master, then the replicas
+    for(long long k = 2; ok && k < node_fields; ++k) {
+      ok = reader.Skip();
+    }
+    for(long long k = 3; ok && k < fields; ++k) {
+      ok = reader.Skip();
+    }
+    if (!ok) {
+      break;
+    }
+    if (first < 0 || last < first ||
+        last >= static_cast<long long>(kClusterSlots) ||
+        port <= 0 || port > 65535) {
+      return -1;
+    }
+
+    boost::system::error_code ec;
+    auto address = ip.empty() ? node.address()
+                              : boost::asio::ip::address::from_string(ip, ec);
+    if (ec) {
+      return -1;
+    }
+    slots->push_back(SlotRange{uint16_t(first), uint16_t(last),
+                               Endpoint(address, uint16_t(port))});
+  }
+
+  if (!ok) {
+    slots->clear();
+    return reader.incomplete() ? 0 : -1;
+  }
+  return int(reader.bytes());
+}
+
+size_t ParseRedirection(const char* data, size_t bytes, bool* ask,
+                        Endpoint* target) {
+  static const char kMoved[] = "-MOVED ";
+  static const char kAsk[] = "-ASK ";
+  const char* p = nullptr;
+  if (bytes >= sizeof(kMoved) - 1 &&
+      memcmp(data, kMoved, sizeof(kMoved) - 1) == 0) {
+    *ask = false;
+    p = data + sizeof(kMoved) - 1;
+  } else if (bytes >= sizeof(kAsk) - 1 &&
+             memcmp(data, kAsk, sizeof(kAsk) - 1) == 0) {
+    *ask = true;
+    p = data + sizeof(kAsk) - 1;
+  } else {
+    return 0;
+  }
+
+  const char* eol = static_cast<const char*>(memchr(p, '\n',
+                                                    data + bytes - p));
+  if (eol == nullptr || eol[-1] != '\r') {
+    return 0;
+  }
+  // "<slot> <ip>:<port>"
+  const char* space = static_cast<const char*>(memchr(p, ' ', eol - p));
+  if (space == nullptr) {
+    return 0;
+  }
+  std::string address(space + 1, eol - 1);
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return 0;
+  }
+  boost::system::error_code ec;
+  auto ip = boost::asio::ip::address::from_string(address.substr(0, colon), ec);
+  int port = atoi(address.c_str() + colon + 1);
+  if (ec || port <= 0 || port > 65535) {
+    return 0;
+  }
+  *target = Endpoint(ip, uint16_t(port));
+  return eol + 1 - data;
+}
+
+}
+}
+
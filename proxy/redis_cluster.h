@@ -0,0 +1,48 @@
+#ifndef _YARMPROXY_REDIS_CLUSTER_H_
+#define _YARMPROXY_REDIS_CLUSTER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+
+namespace yarmproxy {
+using Endpoint = boost::asio::ip::tcp::endpoint;
+
+namespace redis {
+
+const size_t kClusterSlots = 16384;
+
+// CRC16(XMODEM) of the key, or of its hash tag, the content of the first
+// non-empty {...}, modulo kClusterSlots. the same as the redis server
+uint16_t KeySlot(const char* key, size_t len);
+
+struct SlotRange {
+  uint16_t first_;
+  uint16_t last_;
+  Endpoint master_;
+
+  bool operator==(const SlotRange& r) const {
+    return first_ == r.first_ && last_ == r.last_ && master_ == r.master_;
+  }
+};
+typedef std::vector<SlotRange> ClusterSlots;
+
+// parses the reply of CLUSTER SLOTS, replicas are skipped. a master with an
+// empty ip is on the queried `node`.
+// return : bytes of the reply, 0 if it's incomplete, < 0 if it's malformed
+int ParseClusterSlots(const char* data, size_t bytes, const Endpoint& node,
+                      ClusterSlots* slots);
+
+// parses the first line of an error reply, "-MOVED <slot> <ip>:<port>\r\n"
+// or "-ASK <slot> <ip>:<port>\r\n".
+// return : bytes of the line, 0 if it's incomplete or not a redirection
+size_t ParseRedirection(const char* data, size_t bytes, bool* ask,
+                        Endpoint* target);
+
+}
+}
+
+#endif // _YARMPROXY_REDIS_CLUSTER_H_
+
@@ -0,0 +1,203 @@
+#include "redis_cluster_monitor.h"
+
+#include <algorithm>
+
+#include "logging.h"
+
+#include "config.h"
+#include "stats.h"
+
+namespace yarmproxy {
+
+// a CLUSTER SLOTS query to one of the nodes of a cluster
+struct RedisClusterMonitor::Fetch {
+  Fetch(boost::asio::io_service& io_context)
+      : socket_(io_context), timer_(io_context) {
+  }
+  size_t generation_ = 0;
+  size_t cluster_ = 0;
+  std::shared_ptr<std::vector<Endpoint>> nodes_;
+  size_t node_index_ = 0;
+
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::steady_timer timer_;
+  std::string reply_;
+  char buf_[4096];
+};
+
+void RedisClusterMonitor::Start() {
+  ++generation_;
+  fetching_ = 0;
+  cluster_slots_.clear();
+  Refresh();
+}
+
+void RedisClusterMonitor::RequestRefresh() {
+  io_context_.post([this]() {
+        // a burst of redirections triggers one refresh, deferred if the
+        // last one is too recent
+        auto earliest = last_refresh_ + std::chrono::milliseconds(100);
+        if (fetching_ > 0 || std::chrono::steady_clock::now() < earliest) {
+          if (refresh_timer_.expiry() > earliest) {
+            ScheduleRefresh(earliest);
+          }
+          return;
+        }
+        LOG_INFO << "RedisClusterMonitor refresh on redirection";
+        Refresh();
+      });
+}
+
+void RedisClusterMonitor::ScheduleRefresh(
+    std::chrono::steady_clock::time_point when) {
+  size_t generation = generation_;
+  refresh_timer_.expires_at(when);
+  refresh_timer_.async_wait([this, generation](
+        const boost::system::error_code& ec) {
+        if (!ec && generation == generation_) {
+          Refresh();
+        }
+      });
+}
+
+void RedisClusterMonitor::Refresh() {
+  last_refresh_ = std::chrono::steady_clock::now();
+  const auto& clusters = Config::Instance().clusters();
+  bool has_redis_cluster = false;
+  for(size_t i = 0; i < clusters.size(); ++i) {
+    if (!clusters[i].redis_cluster_) {
+      continue;
+    }
+    has_redis_cluster = true;
+
+    // the known masters first, then the seeds
+    std::shared_ptr<std::vector<Endpoint>> nodes(new std::vector<Endpoint>);
+    for(auto& range : cluster_slots_[i]) {
+      if (std::find(nodes->begin(), nodes->end(), range.master_) ==
+          nodes->end()) {
+        nodes->push_back(range.master_);
+      }
+    }
+    for(auto& backend : clusters[i].backends_) {
+      Endpoint seed(boost::asio::ip::address::from_string(backend.host_),
+                    backend.port_);
+      if (std::find(nodes->begin(), nodes->end(), seed) == nodes->end()) {
+        nodes->push_back(seed);
+      }
+    }
+    ++fetching_;
+    FetchSlots(i, nodes, 0);
+  }
+  if (has_redis_cluster) {
+    ScheduleRefresh(last_refresh_ + std::chrono::milliseconds(
+        Config::Instance().redis_cluster_refresh_interval()));
+  }
+}
+
+void RedisClusterMonitor::FetchSlots(
+    size_t cluster, std::shared_ptr<std::vector<Endpoint>> nodes,
+    size_t node_index) {
+  if (node_index >= nodes->size()) {
+    LOG_WARN << "RedisClusterMonitor cluster #" << cluster
+             << " CLUSTER SLOTS failed on all " << nodes->size() << " nodes";
+    --fetching_;
+    return;
+  }
+
+  std::shared_ptr<Fetch> fetch(new Fetch(io_context_));
+  fetch->generation_ = generation_;
+  fetch->cluster_ = cluster;
+  fetch->nodes_ = nodes;
+  fetch->node_index_ = node_index;
+
+  fetch->timer_.expires_after(std::chrono::milliseconds(
+      Config::Instance().socket_rw_timeout()));
+  fetch->timer_.async_wait([fetch](const boost::system::error_code& ec) {
+        if (!ec) {
+          fetch->socket_.close(); // timeout, abort the fetch
+        }
+      });
+
+  fetch->socket_.async_connect((*nodes)[node_index], [this, fetch](
+        const boost::system::error_code& ec) {
+        if (ec) {
+          OnFetchFinished(fetch, false);
+          return;
+        }
+        static const char kQuery[] = "*2\r\n$7\r\nCLUSTER\r\n$5\r\nSLOTS\r\n";
+        boost::asio::async_write(fetch->socket_,
+            boost::asio::buffer(kQuery, sizeof(kQuery) - 1),
+            [this, fetch](const boost::system::error_code& ec, size_t) {
+              if (ec) {
+                OnFetchFinished(fetch, false);
+              } else {
+                ReadSlots(fetch);
+              }
+            });
+      });
+}
+
+void RedisClusterMonitor::ReadSlots(std::shared_ptr<Fetch> fetch) {
+  fetch->socket_.async_read_some(
+      boost::asio::buffer(fetch->buf_, sizeof(fetch->buf_)),
+      [this, fetch](const boost::system::error_code& ec, size_t bytes) {
+        if (ec) {
+          OnFetchFinished(fetch, false);
+          return;
+        }
+        fetch->reply_.append(fetch->buf_, bytes);
+        redis::ClusterSlots slots;
+        int parsed = redis::ParseClusterSlots(fetch->reply_.data(),
+            fetch->reply_.size(), (*fetch->nodes_)[fetch->node_index_],
+            &slots);
+        if (parsed == 0 && fetch->reply_.size() < 16 * 1024 * 1024) {
+          ReadSlots(fetch);
+          return;
+        }
+        if (parsed < 0 || slots.empty()) {
+          LOG_WARN << "RedisClusterMonitor bad CLUSTER SLOTS reply from "
+                   << (*fetch->nodes_)[fetch->node_index_] << " ["
+                   << fetch->reply_.substr(0, 64) << "]";
+          OnFetchFinished(fetch, false);
+          return;
+        }
+
+        OnFetchFinished(fetch, true);
+        if (fetch->generation_ != generation_) {
+          return;
+        }
+        std::sort(slots.begin(), slots.end(),
+            [](const redis::SlotRange& l, const redis::SlotRange& r) {
+              return l.first_ < r.first_;
+            });
+        redis::ClusterSlots& current = cluster_slots_[fetch->cluster_];
+        if (slots != current) {
+          LOG_WARN << "RedisClusterMonitor cluster #" << fetch->cluster_
+                   << " slot table updated from "
+                   << (*fetch->nodes_)[fetch->node_index_]
+                   << ", ranges=" << slots.size();
+          current.swap(slots);
+          ++g_stats_.redis_cluster_slot_updates_;
+          on_slots_changed_();
+        }
+      });
+}
+
+void RedisClusterMonitor::OnFetchFinished(std::shared_ptr<Fetch> fetch,
+                                          bool ok) {
+  fetch->timer_.cancel();
+  boost::system::error_code ec;
+  fetch->socket_.close(ec);
+  if (fetch->generation_ != generation_) {
+    return;
+  }
+  if (ok) {
+    --fetching_;
+  } else {
+    LOG_INFO << "RedisClusterMonitor CLUSTER SLOTS failed on "
+             << (*fetch->nodes_)[fetch->node_index_];
+    FetchSlots(fetch->cluster_, fetch->nodes_, fetch->node_index_ + 1);
+  }
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef _YARMPROXY_REDIS_CLUSTER_MONITOR_H_
+#define _YARMPROXY_REDIS_CLUSTER_MONITOR_H_
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "redis_cluster.h"
+
+namespace yarmproxy {
+
+// Keeps the slot tables of the `protocol redis_cluster` clusters, fetched
+// with CLUSTER SLOTS from their known masters or seed backends. They are
+// refreshed every `redis_cluster_refresh_interval`, and on the redirections
+// seen by workers. All the members except RequestRefresh() should be
+// accessed in the thread running io_context.
+class RedisClusterMonitor {
+public:
+  RedisClusterMonitor(boost::asio::io_service& io_context,
+                      const std::function<void()>& on_slots_changed)
+      : io_context_(io_context)
+      , refresh_timer_(io_context)
+      , on_slots_changed_(on_slots_changed) {
+  }
+
+  // (re)starts with the clusters of the config, after it's (re)loaded
+  void Start();
+
+  // thread-safe, called by workers when a backend replies MOVED
+  void RequestRefresh();
+
+  // by the index of the cluster in Config::clusters()
+  const std::map<size_t, redis::ClusterSlots>& cluster_slots() const {
+    return cluster_slots_;
+  }
+
+private:
+  struct Fetch;
+
+  void ScheduleRefresh(std::chrono::steady_clock::time_point when);
+  void Refresh();
+  void FetchSlots(size_t cluster, std::shared_ptr<std::vector<Endpoint>> nodes,
+                  size_t node_index);
+  void ReadSlots(std::shared_ptr<Fetch> fetch);
+  void OnFetchFinished(std::shared_ptr<Fetch> fetch, bool ok);
+
+  boost::asio::io_service& io_context_;
+  boost::asio::steady_timer refresh_timer_;
+  std::function<void()> on_slots_changed_;
+
+  std::map<size_t, redis::ClusterSlots> cluster_slots_;
+  size_t fetching_ = 0;   // clusters with a fetch in flight
+  size_t generation_ = 0; // bumped by Start(), to drop the stale fetches
+  std::chrono::steady_clock::time_point last_refresh_;
+};
+
+}
+
+#endif // _YARMPROXY_REDIS_CLUSTER_MONITOR_H_
+
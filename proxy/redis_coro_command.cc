@@ -0,0 +1,129 @@
+#include "redis_coro_command.h"
+
+#ifdef YARMPROXY_WITH_COROUTINES
+
+#include "logging.h"
+
+#include "backend_conn.h"
+#include "client_conn.h"
+#include "error_code.h"
+#include "read_buffer.h"
+
+namespace yarmproxy {
+
+RedisCoroCommand::RedisCoroCommand(std::shared_ptr<ClientConnection> client,
+                                   const redis::BulkArray& ba,
+                                   const RedisCommandSpec& spec)
+    : RedisBasicCommand(client, ba, spec) {
+}
+
+bool RedisCoroCommand::StartWriteQuery() {
+  assert(replying_backend_);
+  replying_backend_->SetHandler(shared_from_this());
+  task_ = Execute(); // runs until the query is being written
+  return false;
+}
+
+void RedisCoroCommand::StartWriteReply() {
+  auto self = shared_from_this(); // the client might rotate it
+  turn_.Complete(ErrorCode::E_SUCCESS);
+}
+
+void RedisCoroCommand::OnWriteQueryFinished(std::shared_ptr<BackendConn>,
+                                            ErrorCode ec) {
+  query_written_.Complete(ec);
+}
+
+void RedisCoroCommand::OnBackendReplyReceived(std::shared_ptr<BackendConn>,
+                                              ErrorCode ec) {
+  reply_received_.Complete(ec);
+}
+
+void RedisCoroCommand::OnWriteReplyFinished(std::shared_ptr<BackendConn>,
+                                            ErrorCode ec) {
+  reply_written_.Complete(ec);
+}
+
+// the completions are kept until awaited, so a reply received while the
+// previous part is being written is handled after the write. the command is
+// held by the caller of the completion resuming it, so the frame isn't
+// destroyed before it returns, even if the client is aborted or rotated.
+Task RedisCoroCommand::Execute() {
+  std::shared_ptr<BackendConn> backend = replying_backend_;
+  ReadBuffer* query = client_conn_->buffer();
+
+  query->inc_recycle_lock();
+  backend->WriteQuery(query->unprocessed_data(), query->unprocessed_bytes());
+  ErrorCode ec = co_await query_written_;
+  query->dec_recycle_lock();
+  if (ec == ErrorCode::E_SUCCESS) {
+    backend->ReadReply();
+  }
+
+  bool first = client_conn_->IsFirstCommand(this);
+  while (true) {
+    if (ec == ErrorCode::E_SUCCESS) {
+      ec = co_await reply_received_;
+      if (ec == ErrorCode::E_SUCCESS && redirectable() &&
+          FollowRedirection(backend)) {
+        if (replying_backend_ != backend) { // the query is resent
+          backend = replying_backend_;
+          ec = co_await query_written_;
+          query->dec_recycle_lock();
+          if (ec == ErrorCode::E_SUCCESS) {
+            backend->ReadReply();
+          }
+        }
+        continue;
+      }
+      if (ec == ErrorCode::E_SUCCESS && !ParseReply(backend)) {
+        ec = ErrorCode::E_PROTOCOL;
+      }
+    }
+    if (ec != ErrorCode::E_SUCCESS) { // the error reply is written at once
+      LOG_DEBUG << "RedisCoroCommand " << this << " backend error, backend="
+                << backend << " ec=" << ErrorCodeString(ec);
+      if (!BackendErrorRecoverable(backend, ec)) {
+        client_conn_->Abort();
+        co_return;
+      }
+      auto& err_reply(ErrorReply(ec));
+      backend->SetReplyData(err_reply.data(), err_reply.size());
+      backend->set_reply_recv_complete();
+      backend->set_no_recycle();
+    }
+
+    if (!first) {
+      co_await turn_;
+      first = true;
+    }
+    while (backend->buffer()->unprocessed_bytes() > 0) {
+      TryWriteReply(backend);
+      backend->TryReadMoreReply();
+      ec = co_await reply_written_;
+      if (ec != ErrorCode::E_SUCCESS) {
+        LOG_WARN << "RedisCoroCommand write reply error, backend=" << backend;
+        client_conn_->Abort();
+        co_return;
+      }
+      is_writing_reply_ = false;
+      backend->buffer()->dec_recycle_lock();
+      if (backend->finished()) {
+        RotateReplyingBackend();
+        co_return;
+      }
+      if (reply_received_.completed()) {
+        break; // to parse it first
+      }
+    }
+    if (backend->finished()) { // e.g. a reply received while waiting turn
+      RotateReplyingBackend();
+      co_return;
+    }
+    backend->TryReadMoreReply();
+  }
+}
+
+}
+
+#endif // YARMPROXY_WITH_COROUTINES
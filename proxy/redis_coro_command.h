@@ -0,0 +1,46 @@
+#ifndef _YARMPROXY_REDIS_CORO_COMMAND_H_
+#define _YARMPROXY_REDIS_CORO_COMMAND_H_
+
+#ifdef YARMPROXY_WITH_COROUTINES
+
+#include "coro_task.h"
+#include "redis_basic_command.h"
+
+namespace yarmproxy {
+
+// A basic redis command executed as a coroutine: the query is written, the
+// reply is received, and streamed to the client in its turn, as linear code
+// awaiting the completions of the backend and the client connections,
+// instead of a chain of callbacks. Its frame is recycled by the FramePool of
+// the worker.
+class RedisCoroCommand : public RedisBasicCommand {
+public:
+  RedisCoroCommand(std::shared_ptr<ClientConnection> client,
+                   const redis::BulkArray& ba, const RedisCommandSpec& spec);
+
+  bool StartWriteQuery() override;
+  void StartWriteReply() override;
+
+  void OnWriteQueryFinished(std::shared_ptr<BackendConn> backend,
+                            ErrorCode ec) override;
+  void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend,
+                              ErrorCode ec) override;
+  void OnWriteReplyFinished(std::shared_ptr<BackendConn> backend,
+                            ErrorCode ec) override;
+
+private:
+  Task Execute();
+
+  Completion query_written_;
+  Completion reply_received_;
+  Completion reply_written_;
+  Completion turn_; // it's the first command of the client
+
+  Task task_; // destroyed first, with the frame referring to the members
+};
+
+}
+
+#endif // YARMPROXY_WITH_COROUTINES
+
+#endif // _YARMPROXY_REDIS_CORO_COMMAND_H_
@@ -0,0 +1,448 @@
+#include "redis_fanout_command.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "logging.h"
+
+#include "backend_conn.h"
+#include "key_locator.h"
+#include "backend_pool.h"
+#include "client_conn.h"
+#include "command_table.h"
+#include "error_code.h"
+#include "read_buffer.h"
+#include "redis_protocol.h"
+
+namespace yarmproxy {
+
+struct RedisFanoutCommand::Subquery {
+  Subquery(std::shared_ptr<BackendConn> backend,
+           const char* data, size_t present_bytes)
+      : backend_(backend) {
+    segments_.emplace_back(data, present_bytes);
+  }
+
+  enum Phase {
+    INIT_SEND_QUERY    = 0, // write query for the first time
+    SENDING_MORE_QUERY = 1, // sending more query data
+    READING_MORE_QUERY = 2, // waiting for more query
+    READING_REPLY      = 3, // read reply
+  };
+
+  std::shared_ptr<BackendConn> backend_;
+
+  size_t keys_count_ = 1;
+  Phase phase_ = INIT_SEND_QUERY;
+  bool query_recv_complete_ = false;
+  std::string prefix_; // "*<bulks>\r\n$<size>\r\n<name>\r\n"
+  std::list<std::pair<const char*, size_t>> segments_;
+  Redirection redirection_;
+};
+
+// the trailing bulks of `bulks` parsed ones, from a key, which can't be
+// taken yet : those of an incomplete key group, or an incomplete key.
+static size_t UntakenBulks(size_t bulks, bool last_completed, int key_step) {
+  size_t untaken = bulks % key_step;
+  if (key_step == 1 && bulks > 0 && !last_completed) {
+    untaken = 1;
+  }
+  return untaken;
+}
+
+size_t RedisFanoutCommand::TakenBytes(const redis::BulkArray& ba,
+                                      const RedisCommandSpec& spec) {
+  if (ba.present_bulks() <= size_t(spec.first_key_)) {
+    return 0;
+  }
+  size_t bulks = ba.present_bulks() - spec.first_key_;
+  size_t untaken = UntakenBulks(bulks, ba[ba.present_bulks() - 1].completed(),
+                                spec.key_step_);
+  if (untaken == bulks) {
+    return 0;
+  }
+  size_t bytes = ba.parsed_size();
+  for(size_t i = ba.present_bulks() - untaken; i < ba.present_bulks(); ++i) {
+    bytes -= ba[i].total_size();
+  }
+  return bytes;
+}
+
+// `bytes` from the `key` bulk, its key group
+void RedisFanoutCommand::PushSubquery(const KeyLocator& locator,
+                                      uint16_t endpoint,
+                                      const redis::Bulk& key, size_t bytes) {
+  const Endpoint& ep = locator.endpoint(endpoint);
+  const int slot = locator.has_redis_cluster() ? locator.ClusterSlot(
+      key.payload_data(), key.payload_size(), ProtocolType::REDIS) : -1;
+  const char* data = key.raw_data();
+  const auto& it = waiting_subqueries_.find(std::make_pair(ep, slot));
+  if (it == waiting_subqueries_.cend()) {
+    client_conn_->buffer()->inc_recycle_lock();
+
+    auto backend = backend_pool()->Allocate(ep);
+    std::shared_ptr<Subquery> query(new Subquery(backend, data, bytes));
+    auto res = waiting_subqueries_.emplace(std::make_pair(ep, slot), query);
+    tail_query_ = res.first->second;
+    return;
+  }
+  tail_query_ = it->second;
+  ++(it->second->keys_count_);
+
+  auto& segment = it->second->segments_.back();
+  if (segment.first + segment.second == data) {
+    segment.second += bytes;
+  } else {
+    it->second->segments_.emplace_back(data, bytes);
+  }
+}
+
+RedisFanoutCommand::RedisFanoutCommand(std::shared_ptr<ClientConnection> client,
+                                       const redis::BulkArray& ba,
+                                       const RedisCommandSpec& spec)
+    : Command(client, ProtocolType::REDIS)
+    , spec_(spec)
+    , unparsed_bulks_(ba.absent_bulks())
+{
+  const size_t step = spec_.key_step_;
+  const size_t end = ba.present_bulks() -
+      UntakenBulks(ba.present_bulks() - spec_.first_key_,
+                   ba[ba.present_bulks() - 1].completed(), step);
+  unparsed_bulks_ += ba.present_bulks() - end;
+
+  std::vector<KeyLocator::Key> keys;
+  for(size_t i = spec_.first_key_; i < end; i += step) {
+    keys.emplace_back(ba[i].payload_data(), ba[i].payload_size());
+  }
+  std::vector<uint16_t> endpoints(keys.size());
+  auto locator = key_locator();
+  locator->LocateBatch(keys.data(), keys.size(), ProtocolType::REDIS,
+                       endpoints.data());
+  for(size_t i = spec_.first_key_, k = 0; i < end; i += step, ++k) {
+    const redis::Bulk& last = ba[i + step - 1];
+    PushSubquery(*locator, endpoints[k], ba[i],
+        last.raw_data() + last.present_size() - ba[i].raw_data());
+  }
+}
+
+RedisFanoutCommand::~RedisFanoutCommand() {
+  if (pending_subqueries_.size() != 1) {
+    assert(client_conn_->aborted());
+  }
+
+  for(auto& it : pending_subqueries_) {
+    backend_pool()->Release(it.second->backend_);
+  }
+}
+
+bool RedisFanoutCommand::query_recv_complete() {
+  return tail_query_->query_recv_complete_ && query_parsing_complete();
+}
+
+bool RedisFanoutCommand::IsLastSubquery() const {
+  return unparsed_bulks_ == 0 && waiting_subqueries_.empty() &&
+         pending_subqueries_.size() == 1;
+}
+
+// the last subquery writes the merged reply, in place of its own
+void RedisFanoutCommand::WriteMergedReply(
+    std::shared_ptr<BackendConn> backend) {
+  if (!error_reply_.empty()) {
+    backend->SetReplyData(error_reply_.data(), error_reply_.size());
+  } else if (spec_.reply_merge_ == RedisReplyMerge::SUM) {
+    std::string reply;
+    reply.reserve(24);
+    reply.append(1, ':').append(std::to_string(integer_sum_)).append("\r\n");
+    backend->SetReplyData(reply.data(), reply.size());
+  } else if (spec_.reply_merge_ == RedisReplyMerge::ALL_ONE) {
+    static const std::string kOne(":1\r\n"), kZero(":0\r\n");
+    const std::string& reply = all_one_ ? kOne : kZero;
+    backend->SetReplyData(reply.data(), reply.size());
+  } // else the +OK of the backend
+
+  if (client_conn_->IsFirstCommand(this)) {
+    TryWriteReply(backend);
+  } else {
+    replying_backend_ = backend;
+  }
+}
+
+bool RedisFanoutCommand::ContinueWriteQuery() {
+  assert(tail_query_);
+  if (client_conn_->buffer()->parsed_unreceived_bytes() == 0) {
+    tail_query_->query_recv_complete_ = true;
+  }
+  auto tail_backend = tail_query_->backend_;
+
+  if (tail_backend->error()) {
+    if (!tail_query_->query_recv_complete_) {
+      return true; // no callback, try read more query directly
+    }
+
+    if (IsLastSubquery()) {
+      WriteMergedReply(tail_backend);
+    } else {
+      // not last pending, this subquery don't write reply
+      pending_subqueries_.erase(tail_backend);
+      backend_pool()->Release(tail_backend);
+    }
+    return false;
+  }
+
+  assert(tail_query_->phase_ == Subquery::READING_MORE_QUERY);
+  client_conn_->buffer()->inc_recycle_lock();
+
+  tail_query_->backend_->WriteQuery(client_conn_->buffer()->unprocessed_data(),
+      client_conn_->buffer()->unprocessed_bytes());
+  return false;
+}
+
+bool RedisFanoutCommand::StartWriteQuery() {
+  assert(tail_query_);
+  if (client_conn_->buffer()->parsed_unreceived_bytes() == 0) {
+    tail_query_->query_recv_complete_ = true;
+  }
+  ActivateWaitingSubquery();
+  return false;
+}
+
+void RedisFanoutCommand::OnBackendRecoverableError(
+    std::shared_ptr<BackendConn> backend, ErrorCode ec) {
+  assert(BackendErrorRecoverable(backend, ec));
+  LOG_DEBUG << "RedisFanoutCommand::OnBackendRecoverableError ec="
+            << ErrorCodeString(ec) << " backend=" << backend;
+  if (error_reply_.empty()) {
+    error_reply_ = RedisErrorReply(ec);
+  }
+  backend->set_reply_recv_complete();
+  backend->set_no_recycle();
+
+  auto& subquery = pending_subqueries_[backend];
+  if (subquery->query_recv_complete_) {
+    if (IsLastSubquery()) {
+      WriteMergedReply(backend);
+    } else {
+      // need not reply
+      pending_subqueries_.erase(backend);
+      backend_pool()->Release(backend);
+    }
+  } else {
+    // backend recoverrable error, waiting for more query
+  }
+}
+
+void RedisFanoutCommand::OnBackendReplyReceived(
+    std::shared_ptr<BackendConn> backend, ErrorCode ec) {
+  if (ec == ErrorCode::E_SUCCESS) {
+    std::shared_ptr<Subquery> subquery = pending_subqueries_[backend];
+    if (!subquery->redirection_.query_.empty() &&
+        FollowRedirection(&subquery->redirection_, &subquery->backend_)) {
+      if (subquery->backend_ != backend) { // resent to another node
+        pending_subqueries_.erase(backend);
+        pending_subqueries_.emplace(subquery->backend_, subquery);
+        subquery->phase_ = Subquery::READING_MORE_QUERY;
+      }
+      return;
+    }
+  }
+  if (ec != ErrorCode::E_SUCCESS || !ParseReply(backend)) {
+    client_conn_->Abort();
+    return;
+  }
+
+  if (!backend->reply_recv_complete()) {
+    backend->TryReadMoreReply();
+    return;
+  }
+
+  assert(waiting_subqueries_.size() == 0);
+  if (IsLastSubquery()) {
+    WriteMergedReply(backend);
+  } else {
+    assert(backend->buffer()->unparsed_bytes() == 0);
+    backend->buffer()->update_processed_bytes(
+        backend->buffer()->unprocessed_bytes());
+
+    pending_subqueries_.erase(backend);
+    backend_pool()->Release(backend);
+
+    if (unparsed_bulks_ > 0 &&
+        !client_conn_->buffer()->recycle_locked()) {
+      client_conn_->TryReadMoreQuery("redis_fanout_1");
+    }
+  }
+}
+
+// try to keep pace with parent class impl
+void RedisFanoutCommand::OnWriteQueryFinished(
+    std::shared_ptr<BackendConn> backend, ErrorCode ec) {
+  if (ec != ErrorCode::E_SUCCESS) {
+    if (ec == ErrorCode::E_CONNECT || ec == ErrorCode::E_CIRCUIT_OPEN) {
+      OnBackendRecoverableError(backend, ec);
+      // 等同于转发完成已收数据
+      client_conn_->buffer()->dec_recycle_lock();
+      if (!query_recv_complete() &&
+          !client_conn_->buffer()->recycle_locked()) {
+        client_conn_->TryReadMoreQuery("redis_fanout_2");
+      }
+    } else {
+      client_conn_->Abort();
+    }
+    return;
+  }
+
+  auto& query = pending_subqueries_[backend];
+  switch(query->phase_) {
+  case Subquery::INIT_SEND_QUERY:
+    query->phase_ = Subquery::SENDING_MORE_QUERY;
+    query->backend_->WriteQuery(query->segments_.front().first,
+                                query->segments_.front().second);
+    return;
+  case Subquery::SENDING_MORE_QUERY:
+    query->segments_.pop_front();
+    if (!query->segments_.empty()) {
+      query->backend_->WriteQuery(query->segments_.front().first,
+                                  query->segments_.front().second);
+      return;
+    }
+    if (!query->query_recv_complete_) {
+      query->phase_ = Subquery::READING_MORE_QUERY;
+    }
+    // fall through
+  case Subquery::READING_MORE_QUERY:
+    client_conn_->buffer()->dec_recycle_lock();
+
+    if (query->query_recv_complete_) {
+      query->phase_ = Subquery::READING_REPLY;
+      backend->ReadReply();
+    }
+
+    if (!query_recv_complete() &&
+        !client_conn_->buffer()->recycle_locked()) {
+      client_conn_->TryReadMoreQuery("redis_fanout_3");
+    }
+    return;
+  default:
+    assert(false);
+    return;
+  }
+}
+
+bool RedisFanoutCommand::query_parsing_complete() {
+  return unparsed_bulks_ == 0;
+}
+
+void RedisFanoutCommand::ActivateWaitingSubquery() {
+  for(auto& it : waiting_subqueries_) {
+    auto& query = it.second;
+    auto backend = query->backend_;
+
+    backend->SetHandler(shared_from_this());
+
+    pending_subqueries_[backend] = query;
+    if (query != tail_query_ ||
+        client_conn_->buffer()->parsed_unreceived_bytes() == 0) {
+      query->query_recv_complete_ = true;
+    }
+    // built per subquery, as the commands of the workers run concurrently
+    query->prefix_.append("*")
+        .append(std::to_string(query->keys_count_ * spec_.key_step_ +
+                               spec_.first_key_))
+        .append("\r\n$").append(std::to_string(spec_.name_size_))
+        .append("\r\n").append(spec_.name_, spec_.name_size_).append("\r\n");
+    if (query->query_recv_complete_ && IsRedirectable(backend)) {
+      // kept whole, as the client buffer gets recycled. like SET, a query
+      // still being received isn't redirected
+      query->redirection_.query_ = query->prefix_;
+      for(auto& segment : query->segments_) {
+        query->redirection_.query_.append(segment.first, segment.second);
+      }
+    }
+    backend->WriteQuery(query->prefix_.data(), query->prefix_.size());
+  }
+  waiting_subqueries_.clear();
+}
+
+bool RedisFanoutCommand::ProcessUnparsedPart() {
+  ReadBuffer* buffer = client_conn_->buffer();
+  std::vector<redis::Bulk> new_bulks;
+
+  int parsed_bytes = redis::BulkArray::ParseBulkItems(buffer->unparsed_data(),
+       buffer->unparsed_received_bytes(), unparsed_bulks_, &new_bulks);
+  if (parsed_bytes < 0) {
+    LOG_INFO << "RedisFanoutCommand ProcessUnparsedPart parse error, cmd="
+             << this;
+    return false;
+  }
+
+  for(size_t untaken = UntakenBulks(new_bulks.size(),
+          !new_bulks.empty() && new_bulks.back().completed(), spec_.key_step_);
+      untaken > 0; --untaken) {
+    parsed_bytes -= new_bulks.back().total_size();
+    new_bulks.pop_back();
+  }
+  if (new_bulks.empty()) {
+    if (!client_conn_->buffer()->recycle_locked()) {
+      client_conn_->TryReadMoreQuery("redis_fanout_4");
+    }
+    return true;
+  }
+
+  const size_t step = spec_.key_step_;
+  std::vector<KeyLocator::Key> keys;
+  for(size_t i = 0; i < new_bulks.size(); i += step) {
+    keys.emplace_back(new_bulks[i].payload_data(),
+                      new_bulks[i].payload_size());
+  }
+  std::vector<uint16_t> endpoints(keys.size());
+  auto locator = key_locator();
+  locator->LocateBatch(keys.data(), keys.size(), ProtocolType::REDIS,
+                       endpoints.data());
+  for(size_t i = 0; i < new_bulks.size(); i += step) {
+    const redis::Bulk& last = new_bulks[i + step - 1];
+    PushSubquery(*locator, endpoints[i / step], new_bulks[i],
+        last.raw_data() + last.present_size() - new_bulks[i].raw_data());
+  }
+
+  size_t to_process_bytes = parsed_bytes -
+    new_bulks.back().total_size() + new_bulks.back().present_size();
+  buffer->update_processed_bytes(to_process_bytes);
+  buffer->update_parsed_bytes(parsed_bytes);
+  unparsed_bulks_ -= new_bulks.size();
+  ActivateWaitingSubquery();
+  return true;
+}
+
+// a status, integer or error reply of one line
+bool RedisFanoutCommand::ParseReply(std::shared_ptr<BackendConn> backend) {
+  size_t unparsed = backend->buffer()->unparsed_bytes();
+  assert(unparsed > 0);
+  const char * entry = backend->buffer()->unparsed_data();
+  auto p = static_cast<const char *>(memchr(entry, '\n', unparsed));
+  if (p == nullptr) {
+    return true;
+  }
+
+  size_t bytes = p - entry + 1;
+  if (entry[0] == '-') {
+    if (error_reply_.empty()) {
+      error_reply_.assign(entry, bytes);
+    }
+  } else if (entry[0] == ':' &&
+             spec_.reply_merge_ != RedisReplyMerge::ALL_OK) {
+    long long value = strtoll(entry + 1, nullptr, 10);
+    integer_sum_ += value;
+    all_one_ = all_one_ && value == 1;
+  } else if (entry[0] != '+' ||
+             spec_.reply_merge_ != RedisReplyMerge::ALL_OK) {
+    LOG_WARN << "RedisFanoutCommand ParseReply error ["
+             << std::string(entry, bytes) << "]";
+    return false;
+  }
+
+  backend->buffer()->update_parsed_bytes(bytes);
+  backend->set_reply_recv_complete();
+  return true;
+}
+
+}
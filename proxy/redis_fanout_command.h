@@ -0,0 +1,83 @@
+#ifndef _YARMPROXY_REDIS_FANOUT_COMMAND_H_
+#define _YARMPROXY_REDIS_FANOUT_COMMAND_H_
+
+#include <map>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include "command.h"
+
+namespace yarmproxy {
+using Endpoint = boost::asio::ip::tcp::endpoint;
+
+namespace redis {
+class Bulk;
+class BulkArray;
+}
+
+class KeyLocator;
+
+struct RedisCommandSpec;
+
+// a multi-key command whose keys are on different backends, e.g. mset, del
+// or exists. it's sent to each backend with the keys located there, once per
+// slot on a redis cluster, and the replies are merged as the reply_merge_ of
+// the spec. the key_step_ bulks
+// from a key, its "key group", go to the backend of the key. the last bulk
+// of a group may be forwarded while it's being received.
+class RedisFanoutCommand : public Command {
+public:
+  RedisFanoutCommand(std::shared_ptr<ClientConnection> client,
+                     const redis::BulkArray& ba, const RedisCommandSpec& spec);
+  virtual ~RedisFanoutCommand();
+
+  // the parsed bytes of `ba` taken by the command, 0 if no key group is
+  // parsed yet
+  static size_t TakenBytes(const redis::BulkArray& ba,
+                           const RedisCommandSpec& spec);
+
+  void OnWriteQueryFinished(std::shared_ptr<BackendConn> backend, ErrorCode ec) override;
+  size_t backend_count() const override {
+    return waiting_subqueries_.size() + pending_subqueries_.size();
+  }
+
+private:
+  void OnBackendReplyReceived(std::shared_ptr<BackendConn> backend, ErrorCode ec) override;
+  void OnBackendRecoverableError(std::shared_ptr<BackendConn> backend, ErrorCode ec) override;
+
+  bool ProcessUnparsedPart() override;
+
+  bool StartWriteQuery() override;
+  bool ContinueWriteQuery() override;
+
+  bool ParseReply(std::shared_ptr<BackendConn> backend) override;
+
+  bool query_parsing_complete() override;
+  bool query_recv_complete() override;
+private:
+  struct Subquery;
+
+  const RedisCommandSpec& spec_;
+  size_t unparsed_bulks_;
+  // by endpoint, and by slot on a redis cluster, as its nodes reject the keys
+  // of different slots
+  std::map<std::pair<Endpoint, int>, std::shared_ptr<Subquery>>
+      waiting_subqueries_;
+  std::map<std::shared_ptr<BackendConn>, std::shared_ptr<Subquery>> pending_subqueries_;
+  std::shared_ptr<Subquery> tail_query_;
+
+  // the replies merged so far
+  std::string error_reply_; // the first error reply
+  long long integer_sum_ = 0;
+  bool all_one_ = true;
+private:
+  void ActivateWaitingSubquery();
+  void PushSubquery(const KeyLocator& locator, uint16_t endpoint,
+                    const redis::Bulk& key, size_t bytes);
+  bool IsLastSubquery() const;
+  void WriteMergedReply(std::shared_ptr<BackendConn> backend);
+};
+
+}
+
+#endif // _YARMPROXY_REDIS_FANOUT_COMMAND_H_
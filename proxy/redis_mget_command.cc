@@ -23,6 +23,7 @@ struct RedisMgetCommand::Subquery {
   std::list<std::pair<const char*, size_t>> segments_;
 
   size_t reply_absent_bulks_ = 0;
+  Redirection redirection_;
 };
 
 RedisMgetCommand::RedisMgetCommand(std::shared_ptr<ClientConnection> client,
@@ -30,31 +31,67 @@ RedisMgetCommand::RedisMgetCommand(std::shared_ptr<ClientConnection> client,
     : Command(client, ProtocolType::REDIS)
     , reply_prefix_(redis::BulkArray::SerializePrefix(ba.total_bulks() - 1))
 {
-  Endpoint last_endpoint;
+  std::vector<KeyLocator::Key> keys;
+  keys.reserve(ba.total_bulks() - 1);
+  for(size_t i = 1; i < ba.total_bulks(); ++i) {
+    keys.emplace_back(ba[i].payload_data(), ba[i].payload_size());
+  }
+  std::vector<uint16_t> primaries(keys.size());
+  auto locator = key_locator();
+  locator->LocateBatch(keys.data(), keys.size(), ProtocolType::REDIS,
+                       primaries.data());
+
+  // the subqueries by endpoint, and by slot on a redis cluster, as its nodes
+  // reject the keys of different slots
+  const bool by_slot = locator->has_redis_cluster();
+  std::map<std::pair<Endpoint, int>, std::shared_ptr<Subquery>> subqueries;
+  std::shared_ptr<Subquery> last_subquery;
+  // primary -> selected replica, by the endpoint index of the primary.
+  // Endpoint() if selected by key, for the load bounded clusters
+  std::map<uint16_t, Endpoint> read_endpoints;
+  KeyLocator::LoadSum load_sum;
   for(size_t i = 1; i < ba.total_bulks(); ++i) {
     const redis::Bulk& bulk = ba[i];
-    Endpoint endpoint = key_locator()->Locate(
-        bulk.payload_data(), bulk.payload_size(), ProtocolType::REDIS);
+    uint16_t primary = primaries[i - 1];
+    auto read_it = read_endpoints.find(primary);
+    if (read_it == read_endpoints.end()) {
+      const Endpoint& ep = locator->endpoint(primary);
+      if (backend_pool()->LoadBounded(ep)) {
+        // by key, the keys of a primary may spill to different backends
+        read_it = read_endpoints.emplace(primary, Endpoint()).first;
+      } else {
+        read_it = read_endpoints.emplace(primary,
+                      backend_pool()->SelectReadEndpoint(ep)).first;
+      }
+    }
+    const Endpoint endpoint = read_it->second != Endpoint() ?
+        read_it->second : backend_pool()->SelectReadEndpoint(
+            locator->endpoint(primary), bulk.payload_data(),
+            bulk.payload_size(), ProtocolType::REDIS, &load_sum);
+    const int slot = by_slot ? locator->ClusterSlot(bulk.payload_data(),
+        bulk.payload_size(), ProtocolType::REDIS) : -1;
 
     LOG_DEBUG << "RedisMgetCommand ctor key=" << bulk.to_string()
-              << " ep=" << endpoint;
-    std::shared_ptr<Subquery> subquery;
-    auto it = subqueries_.find(endpoint);
-    if (it != subqueries_.cend()) {
-      subquery = it->second;
-    } else {
+              << " ep=" << endpoint << " slot=" << slot;
+    std::shared_ptr<Subquery>& subquery =
+        subqueries[std::make_pair(endpoint, slot)];
+    if (!subquery) {
       client_conn_->buffer()->inc_recycle_lock();
 
       auto backend = backend_pool()->Allocate(endpoint);
+      backend->set_hedgeable();
+      if (read_it->second == Endpoint()) {
+        load_sum.AddLoad();
+      }
       subquery.reset(new Subquery(backend));
-      subqueries_.emplace(endpoint, subquery);
+      subqueries_.emplace(backend, subquery);
     }
     ++subquery->key_count_;
-    if (last_endpoint == endpoint) {
+    if (last_subquery == subquery) {
       subquery->segments_.back().second += bulk.total_size();
     } else {
       subquery->segments_.emplace_back(bulk.raw_data(), bulk.total_size());
-      last_endpoint = endpoint;
+      last_subquery = subquery;
     }
 
     if (waiting_reply_queue_.empty() ||
@@ -85,12 +122,17 @@ bool RedisMgetCommand::StartWriteQuery() {
     auto& query = it.second;
     auto backend = query->backend_;
     assert(backend);
-    backend->SetReadWriteCallback(
-        WeakBind(&Command::OnWriteQueryFinished, backend),
-        WeakBind(&Command::OnBackendReplyReceived, backend));
+    backend->SetHandler(shared_from_this());
 
     query->query_prefix_ = redis::BulkArray::SerializePrefix(query->key_count_ + 1);
     query->query_prefix_.append("$4\r\nmget\r\n");
+    if (IsRedirectable(backend)) { // kept whole, the keys are sent from the
+                                   // client buffer, which gets recycled
+      query->redirection_.query_ = query->query_prefix_;
+      for(auto& segment : query->segments_) {
+        query->redirection_.query_.append(segment.first, segment.second);
+      }
+    }
 
     query->segments_.emplace_front(nullptr, 0); // just a placeholder
 
@@ -105,7 +147,7 @@ bool RedisMgetCommand::StartWriteQuery() {
                                 query->query_prefix_.size());
   }
 
-  if (client_conn_->IsFirstCommand(shared_from_this())) {
+  if (client_conn_->IsFirstCommand(this)) {
     StartWriteReply();
   } else {
     LOG_DEBUG << "RedisMgetCommand no StartWriteReply cmd=" << this;
@@ -117,7 +159,7 @@ void RedisMgetCommand::OnWriteQueryFinished(
     std::shared_ptr<BackendConn> backend, ErrorCode ec) {
   if (ec != ErrorCode::E_SUCCESS) {
     LOG_DEBUG << "RedisMsetCommand OnWriteQueryFinished error.";
-    if (ec == ErrorCode::E_CONNECT) {
+    if (ec == ErrorCode::E_CONNECT || ec == ErrorCode::E_CIRCUIT_OPEN) {
       OnBackendRecoverableError(backend, ec);
       // 等同于转发完成已收数据
       client_conn_->buffer()->dec_recycle_lock();
@@ -128,7 +170,7 @@ void RedisMgetCommand::OnWriteQueryFinished(
     return;
   }
 
-  auto& query = subqueries_[backend->remote_endpoint()];
+  auto& query = subqueries_[backend];
   query->segments_.pop_front();
   if (!query->segments_.empty()) {
     LOG_DEBUG << "RedisMgetCommand WriteQuery left_segments=" << query->segments_.size();
@@ -188,7 +230,7 @@ void RedisMgetCommand::OnWriteReplyFinished(std::shared_ptr<BackendConn> backend
 
 void RedisMgetCommand::BackendReadyToReply(
     std::shared_ptr<BackendConn> backend) {
-  if (!client_conn_->IsFirstCommand(shared_from_this())) {
+  if (!client_conn_->IsFirstCommand(this)) {
     return;
   }
 
@@ -201,8 +243,9 @@ void RedisMgetCommand::BackendReadyToReply(
   if (!reply_prefix_complete()) {
     return;
   }
-  if (backend != waiting_reply_queue_.front().first) {
-    return;
+  if (backend != waiting_reply_queue_.front().first ||
+      !subqueries_[backend]->redirection_.query_.empty()) {
+    return; // not its turn, or maybe replying a redirection
   }
 
   replying_backend_ = backend;
@@ -227,6 +270,24 @@ void RedisMgetCommand::BackendReadyToReply(
 
 void RedisMgetCommand::OnBackendReplyReceived(
     std::shared_ptr<BackendConn> backend, ErrorCode ec) {
+  if (ec == ErrorCode::E_SUCCESS) {
+    std::shared_ptr<Subquery> subquery = subqueries_[backend];
+    if (!subquery->redirection_.query_.empty() &&
+        FollowRedirection(&subquery->redirection_, &subquery->backend_)) {
+      if (subquery->backend_ != backend) { // resent to another node
+        subqueries_.erase(backend);
+        subqueries_.emplace(subquery->backend_, subquery);
+        for(auto& waiting : waiting_reply_queue_) {
+          if (waiting.first == backend) {
+            waiting.first = subquery->backend_;
+          }
+        }
+        // a placeholder, popped by OnWriteQueryFinished
+        subquery->segments_.assign(1, std::make_pair(nullptr, 0));
+      }
+      return;
+    }
+  }
   if (ec != ErrorCode::E_SUCCESS) {
     LOG_DEBUG << "OnBackendReplyReceived error, backend=" << backend;
     if (backend == replying_backend_) { // the backend is replying
@@ -253,8 +314,9 @@ static std::string ErrorReplyBody(size_t keys) {
 
 void RedisMgetCommand::OnBackendRecoverableError(
     std::shared_ptr<BackendConn> backend, ErrorCode ec) {
-  auto err_reply = ErrorReplyBody(
-                       subqueries_[backend->remote_endpoint()]->key_count_);
+  auto& subquery = subqueries_[backend];
+  subquery->redirection_.query_.clear();
+  auto err_reply = ErrorReplyBody(subquery->key_count_);
   backend->SetReplyData(err_reply.data(), err_reply.size(), false);
   LOG_DEBUG << "RedisMgetCommand " << this
            << " OnBackendRecoverableError backend=" << backend
@@ -269,7 +331,7 @@ void RedisMgetCommand::OnBackendRecoverableError(
 void RedisMgetCommand::StartWriteReply() {
   LOG_DEBUG << "RedisMgetCommand " << this << " StartWriteReply";
   client_conn_->WriteReply(reply_prefix_.data(), reply_prefix_.size(),
-          WeakBind(&Command::OnWriteReplyFinished, nullptr));
+                           shared_from_this(), nullptr);
 }
 
 void RedisMgetCommand::NextBackendStartReply() {
@@ -304,7 +366,7 @@ void RedisMgetCommand::RotateReplyingBackend() {
 bool RedisMgetCommand::ParseReply(std::shared_ptr<BackendConn> backend) {
   if (backend->buffer()->unprocessed_bytes() > 0) {
     if (backend->buffer()->parsed_unreceived_bytes() == 0 &&
-        subqueries_[backend->remote_endpoint()]->reply_absent_bulks_ == 0) {
+        subqueries_[backend]->reply_absent_bulks_ == 0) {
       backend->set_reply_recv_complete();
     }
     return true;
@@ -315,7 +377,7 @@ bool RedisMgetCommand::ParseReply(std::shared_ptr<BackendConn> backend) {
     size_t unparsed_bytes = backend->buffer()->unparsed_bytes();
 
     size_t& absent_bulks =
-        subqueries_[backend->remote_endpoint()]->reply_absent_bulks_;
+        subqueries_[backend]->reply_absent_bulks_;
     if (absent_bulks == 0) {
       redis::BulkArray bulk_array(entry, unparsed_bytes);
       if (bulk_array.parsed_size() < 0) {
@@ -32,6 +32,9 @@ public:
                             ErrorCode ec) override;
   void OnWriteReplyFinished(std::shared_ptr<BackendConn> backend,
                             ErrorCode ec) override;
+  size_t backend_count() const override {
+    return subqueries_.size();
+  }
 
 private:
   bool BackendErrorRecoverable(std::shared_ptr<BackendConn> backend,
@@ -54,7 +57,7 @@ private:
     reply_prefix_.clear();
   }
 
-  std::map<Endpoint, std::shared_ptr<Subquery>> subqueries_;
+  std::map<std::shared_ptr<BackendConn>, std::shared_ptr<Subquery>> subqueries_;
   std::list<std::pair<std::shared_ptr<BackendConn>, int>> waiting_reply_queue_;
 };
 
@@ -99,14 +99,12 @@ public:
     return p + 1;
   }
   size_t payload_size() const {
-    try {
-      int sz = std::stoi(raw_data_ + 1);
-      return sz > 0 ? sz : 0;
-    } catch (...) {
-      LOG_WARN << "stoi payload_size error, prefix=["
-               << std::string(raw_data_, 5) << "]";
-      return 0;
+    const char* p = raw_data_ + 1;
+    size_t size = 0;
+    for(; *p >= '0' && *p <= '9'; ++p) { // 0 for the nil bulk
+      size = size * 10 + size_t(*p - '0');
     }
+    return size;
   }
 
   bool equals(const char* str, size_t size) const {
@@ -197,19 +195,20 @@ public:
 
   BulkArray(const char* data, size_t bytes)
       : raw_data_(data) {
+    const char* p = data;
+    size_t bulks = 0;
+    for(++p; p < data + bytes && isdigit(*p); ++p) {
+      bulks = bulks * 10 + size_t(*p - '0');
+    }
+    total_bulks_ = bulks;
     if (bytes < 4) {
       parsed_size_ = 0;
       return;
     }
-    const char* p = data;
-    if (*p != '*') {
+    if (*data != '*') {
       parsed_size_ = SIZE_PARSE_ERROR;
       return;
     }
-    size_t bulks = 0;
-    for(++p; p < data + bytes && isdigit(*p); ++p) {
-      bulks = bulks * 10 + size_t(*p - '0');
-    }
     if (p + 2 > data + bytes) {
       parsed_size_ = 0;
       return;
@@ -223,6 +222,8 @@ public:
     p += 2;
     parsed_size_ = p - data;
 
+    // grown one by one, a small request would realloc for each bulk
+    items_.reserve(bulks < kReservedBulks ? bulks : kReservedBulks);
     int ret = ParseBulkItems(p, data + bytes - p, bulks, &items_);
     if (ret < 0) {
       parsed_size_ = SIZE_PARSE_ERROR;
@@ -275,13 +276,8 @@ public:
     return total;
   }
 
-  size_t total_bulks() const {
-    try {
-      return std::stoi(raw_data_ + 1);
-    } catch (...) {
-      LOG_WARN << "stoi total_bulks error, prefix=[" << std::string(raw_data_, 5) << "]";
-      return 0;
-    }
+  size_t total_bulks() const { // 0 if absent
+    return total_bulks_;
   }
   size_t present_bulks() const {
     return items_.size();
@@ -290,8 +286,10 @@ public:
     return total_bulks() - present_bulks();
   }
 private:
+  static const size_t kReservedBulks = 16;
   const char* raw_data_;
   size_t parsed_size_;
+  size_t total_bulks_;
   std::vector<Bulk> items_;
 };
 
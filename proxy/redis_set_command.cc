@@ -18,6 +18,9 @@ RedisSetCommand::RedisSetCommand(std::shared_ptr<ClientConnection> client,
   LOG_DEBUG << "RedisSetCommand key=" << ba[1].to_string()
             << " ep=" << ep;
   replying_backend_ = backend_pool()->Allocate(ep);
+  if (ba.completed()) { // larger queries can't be redirected
+    KeepQueryForRedirection(ba.raw_data(), ba.total_size());
+  }
 }
 
 RedisSetCommand::~RedisSetCommand() {
@@ -28,6 +28,25 @@ struct Stats {
   std::atomic_llong backend_connect_timeouts_;
   std::atomic_llong backend_read_timeouts_;
   std::atomic_llong backend_write_timeouts_;
+
+  std::atomic_int   ejected_backends_;
+  std::atomic_llong backend_ejections_;
+  std::atomic_llong backend_recoveries_;
+
+  std::atomic_llong circuit_breaker_trips_;
+  std::atomic_llong circuit_breaker_rejections_;
+
+  std::atomic_llong hedged_reads_;
+  std::atomic_llong hedged_read_wins_;
+
+  std::atomic_llong redis_cluster_redirections_;
+  std::atomic_llong redis_cluster_slot_updates_;
+
+  std::atomic_llong bounded_load_reads_;
+  std::atomic_llong bounded_load_spills_;
+
+  std::atomic_llong pipeline_window_stalls_;
+  std::atomic_llong key_order_waits_;
 };
 
 }
@@ -13,10 +13,10 @@ Stats g_stats_;
 StatsCommand::StatsCommand(std::shared_ptr<ClientConnection> client,
                            ProtocolType protocol)
     : Command(client, protocol) {
+  reply_message_.reserve(256);
   if (protocol == ProtocolType::REDIS) {
-    reply_message_ = "+";
+    reply_message_.append(1, '+');
   }
-  reply_message_.reserve(256);
   reply_message_.append("alive_since=")
       .append(std::to_string(g_stats_.alive_since_))
       .append(",client_conns=")
@@ -43,6 +43,32 @@ StatsCommand::StatsCommand(std::shared_ptr<ClientConnection> client,
       .append(std::to_string(g_stats_.backend_read_timeouts_))
       .append(",backend_write_timeouts=")
       .append(std::to_string(g_stats_.backend_write_timeouts_))
+      .append(",ejected_backends=")
+      .append(std::to_string(g_stats_.ejected_backends_))
+      .append(",backend_ejections=")
+      .append(std::to_string(g_stats_.backend_ejections_))
+      .append(",backend_recoveries=")
+      .append(std::to_string(g_stats_.backend_recoveries_))
+      .append(",circuit_breaker_trips=")
+      .append(std::to_string(g_stats_.circuit_breaker_trips_))
+      .append(",circuit_breaker_rejections=")
+      .append(std::to_string(g_stats_.circuit_breaker_rejections_))
+      .append(",hedged_reads=")
+      .append(std::to_string(g_stats_.hedged_reads_))
+      .append(",hedged_read_wins=")
+      .append(std::to_string(g_stats_.hedged_read_wins_))
+      .append(",redis_cluster_redirections=")
+      .append(std::to_string(g_stats_.redis_cluster_redirections_))
+      .append(",redis_cluster_slot_updates=")
+      .append(std::to_string(g_stats_.redis_cluster_slot_updates_))
+      .append(",bounded_load_reads=")
+      .append(std::to_string(g_stats_.bounded_load_reads_))
+      .append(",bounded_load_spills=")
+      .append(std::to_string(g_stats_.bounded_load_spills_))
+      .append(",pipeline_window_stalls=")
+      .append(std::to_string(g_stats_.pipeline_window_stalls_))
+      .append(",key_order_waits=")
+      .append(std::to_string(g_stats_.key_order_waits_))
       .append("\r\n");
 }
 
@@ -50,7 +76,7 @@ StatsCommand::~StatsCommand() {
 }
 
 bool StatsCommand::StartWriteQuery() {
-  if (client_conn_->IsFirstCommand(shared_from_this())) {
+  if (client_conn_->IsFirstCommand(this)) {
     StartWriteReply();
   }
   return false;
@@ -58,7 +84,7 @@ bool StatsCommand::StartWriteQuery() {
 
 void StatsCommand::StartWriteReply() {
   client_conn_->WriteReply(reply_message_.data(), reply_message_.size(),
-       WeakBind(&Command::OnWriteReplyFinished, nullptr));
+                           shared_from_this(), nullptr);
 }
 
 void StatsCommand::OnWriteReplyFinished(std::shared_ptr<BackendConn> backend,
@@ -0,0 +1,168 @@
+#include "timing_wheel.h"
+
+namespace yarmproxy {
+
+WheelTimer::WheelTimer(TimingWheel& wheel, std::function<void()> on_expired)
+    : wheel_(wheel), on_expired_(std::move(on_expired)) {
+}
+
+WheelTimer::~WheelTimer() {
+  Disarm();
+}
+
+void WheelTimer::Arm(int timeout_ms) {
+  if (armed()) {
+    wheel_.Unlink(this);
+  }
+  uint64_t now = wheel_.NowTick();
+  if (wheel_.armed_timers_ == 0 && wheel_.current_tick_ < now) {
+    wheel_.current_tick_ = now; // nothing to expire in the idle ticks
+  }
+  expiry_ = now + uint64_t(timeout_ms > 0 ? timeout_ms : 1);
+  wheel_.Link(this);
+  wheel_.ArmDriver(expiry_);
+}
+
+void WheelTimer::Disarm() {
+  if (armed()) {
+    wheel_.Unlink(this);
+  }
+}
+
+TimingWheel::TimingWheel(boost::asio::io_service& io_context)
+    : start_(Clock::now()), driver_(io_context) {
+}
+
+TimingWheel::~TimingWheel() {
+  driver_.cancel();
+}
+
+uint64_t TimingWheel::NowTick() const {
+  return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - start_).count());
+}
+
+void TimingWheel::Link(WheelTimer* timer) {
+  if (timer->expiry_ < current_tick_) {
+    timer->expiry_ = current_tick_;
+  }
+  uint64_t delta = timer->expiry_ - current_tick_;
+  size_t level = 0;
+  while (level + 1 < kLevels &&
+         delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  if (level + 1 == kLevels &&
+      delta >= (uint64_t(1) << (kSlotBits * kLevels))) {
+    timer->expiry_ = current_tick_ +
+                     (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+  }
+  size_t index = (timer->expiry_ >> (kSlotBits * level)) & (kSlots - 1);
+  timer->slot_ = level * kSlots + index;
+
+  WheelTimer*& head = slots_[timer->slot_];
+  timer->next_ = head;
+  if (head != nullptr) {
+    head->pprev_ = &timer->next_;
+  }
+  head = timer;
+  timer->pprev_ = &head;
+  if (level == 0) {
+    occupied_[index / 64] |= uint64_t(1) << (index % 64);
+  }
+  ++armed_timers_;
+}
+
+void TimingWheel::Unlink(WheelTimer* timer) {
+  *timer->pprev_ = timer->next_;
+  if (timer->next_ != nullptr) {
+    timer->next_->pprev_ = timer->pprev_;
+  }
+  timer->next_ = nullptr;
+  timer->pprev_ = nullptr;
+  if (timer->slot_ < kSlots && slots_[timer->slot_] == nullptr) {
+    occupied_[timer->slot_ / 64] &= ~(uint64_t(1) << (timer->slot_ % 64));
+  }
+  --armed_timers_;
+}
+
+// moves the timers of the current slot of `level` to the lower levels
+void TimingWheel::Cascade(size_t level) {
+  size_t index = (current_tick_ >> (kSlotBits * level)) & (kSlots - 1);
+  WheelTimer* timer = slots_[level * kSlots + index];
+  slots_[level * kSlots + index] = nullptr;
+  while (timer != nullptr) {
+    WheelTimer* next = timer->next_;
+    --armed_timers_;
+    Link(timer);
+    timer = next;
+  }
+}
+
+void TimingWheel::Advance(uint64_t tick) {
+  while (current_tick_ <= tick) {
+    size_t index = current_tick_ & (kSlots - 1);
+    // a level is cascaded once the lower one starts a round
+    for(size_t level = 1; level < kLevels; ++level) {
+      if ((current_tick_ >> (kSlotBits * (level - 1))) & (kSlots - 1)) {
+        break;
+      }
+      Cascade(level);
+    }
+    WheelTimer*& head = slots_[index];
+    while (head != nullptr) {
+      WheelTimer* timer = head;
+      Unlink(timer);
+      timer->on_expired_(); // might arm or disarm any timer
+    }
+    ++current_tick_;
+  }
+}
+
+uint64_t TimingWheel::NextTick() const {
+  if (armed_timers_ == 0) {
+    return 0;
+  }
+  size_t index = current_tick_ & (kSlots - 1);
+  for(size_t word = index / 64; word < kSlots / 64; ++word) {
+    uint64_t bits = occupied_[word];
+    if (word == index / 64) {
+      bits &= ~uint64_t(0) << (index % 64);
+    }
+    if (bits != 0) {
+      return current_tick_ - index + word * 64 + __builtin_ctzll(bits);
+    }
+  }
+  // the timers are in the next round, or in the higher levels, cascaded at
+  // the start of a round
+  return (current_tick_ + kSlots - 1) & ~uint64_t(kSlots - 1);
+}
+
+void TimingWheel::ArmDriver(uint64_t tick) {
+  if (driver_tick_ != 0 && driver_tick_ <= tick) {
+    return;
+  }
+  driver_tick_ = tick;
+  uint64_t generation = ++driver_generation_;
+  ++driver_arms_;
+  driver_.expires_at(start_ + std::chrono::milliseconds(tick));
+  driver_.async_wait([this, generation](const boost::system::error_code& ec) {
+        if (!ec) {
+          OnDriverExpired(generation);
+        }
+      });
+}
+
+void TimingWheel::OnDriverExpired(uint64_t generation) {
+  if (generation != driver_generation_) {
+    return; // re-armed after it expired
+  }
+  driver_tick_ = 0;
+  Advance(NowTick());
+  uint64_t tick = NextTick();
+  if (tick != 0) {
+    ArmDriver(tick);
+  }
+}
+
+}
@@ -0,0 +1,101 @@
+#ifndef _YARMPROXY_TIMING_WHEEL_H_
+#define _YARMPROXY_TIMING_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace yarmproxy {
+
+class TimingWheel;
+
+// a timeout of a connection, served by the timing wheel of its worker. it's
+// armed and disarmed in O(1), without allocation, as it's linked into the
+// wheel. the callback is set once, and never called after the timer is
+// disarmed or destroyed.
+class WheelTimer {
+public:
+  WheelTimer(TimingWheel& wheel, std::function<void()> on_expired);
+  ~WheelTimer();
+  WheelTimer(const WheelTimer&) = delete;
+  WheelTimer& operator=(const WheelTimer&) = delete;
+
+  // re-arms the timer if it's armed
+  void Arm(int timeout_ms);
+  void Disarm();
+  bool armed() const {
+    return pprev_ != nullptr;
+  }
+
+private:
+  friend class TimingWheel;
+  TimingWheel& wheel_;
+  std::function<void()> on_expired_;
+  uint64_t expiry_ = 0; // in ticks of the wheel
+  WheelTimer* next_ = nullptr;
+  WheelTimer** pprev_ = nullptr; // the link to the timer, nullptr if disarmed
+  size_t slot_ = 0;              // of level 0, or the slots of all levels
+};
+
+// A hierarchical timing wheel(Varghese & Lauck) of millisecond ticks, one
+// per worker, serving the client and backend read/write timeouts. Each of
+// the 4 levels has 256 slots, a slot of level N spanning 256^N ticks, so
+// the timeouts up to 2^32 ms are served. The timers of a level slot are
+// cascaded to the lower level once the wheel reaches it.
+//
+// A steady_timer drives the wheel. It's only re-armed if a timer expires
+// before it, so that re-arming the timeout of a connection, several times
+// per request, costs no asio timer operation when the timeouts are equal.
+class TimingWheel {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit TimingWheel(boost::asio::io_service& io_context);
+  ~TimingWheel();
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  size_t armed_timers() const {
+    return armed_timers_;
+  }
+  // the asio timer operations of the driving timer
+  uint64_t driver_arms() const {
+    return driver_arms_;
+  }
+
+private:
+  friend class WheelTimer;
+  static const size_t kLevels = 4;
+  static const size_t kSlotBits = 8;
+  static const size_t kSlots = 1 << kSlotBits;
+
+  void Link(WheelTimer* timer);
+  void Unlink(WheelTimer* timer);
+  uint64_t NowTick() const;
+  void Advance(uint64_t tick);
+  void Cascade(size_t level);
+  // the next tick the wheel has to be advanced to, 0 if none
+  uint64_t NextTick() const;
+  void ArmDriver(uint64_t tick);
+  void OnDriverExpired(uint64_t generation);
+
+  WheelTimer* slots_[kLevels * kSlots] = {};
+  uint64_t occupied_[kSlots / 64] = {}; // the non empty slots of level 0
+  Clock::time_point start_;
+  uint64_t current_tick_ = 0; // the ticks before it are expired
+  size_t armed_timers_ = 0;
+
+  boost::asio::steady_timer driver_;
+  uint64_t driver_tick_ = 0; // 0 if the driver isn't waiting
+  uint64_t driver_generation_ = 0;
+  uint64_t driver_arms_ = 0;
+};
+
+}
+
+#endif // _YARMPROXY_TIMING_WHEEL_H_
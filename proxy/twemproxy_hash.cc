@@ -0,0 +1,140 @@
+#include "key_hash.h"
+
+// the other hash functions of twemproxy(nutcracker), which give the same
+// values as its hashkit, so that both proxies map keys to the same servers.
+// the key bytes are sign-extended where twemproxy converts a char.
+
+namespace yarmproxy {
+
+static const uint64_t FNV_64_INIT = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_64_PRIME = 0x100000001b3ULL;
+static const uint32_t FNV_32_INIT = 2166136261UL;
+static const uint32_t FNV_32_PRIME = 16777619;
+
+uint32_t hash_fnv1_64(const char* key, size_t len) {
+  uint64_t hash = FNV_64_INIT;
+  for(size_t i = 0; i < len; ++i) {
+    hash *= FNV_64_PRIME;
+    hash ^= uint64_t(key[i]);
+  }
+  return uint32_t(hash);
+}
+
+uint32_t hash_fnv1_32(const char* key, size_t len) {
+  uint32_t hash = FNV_32_INIT;
+  for(size_t i = 0; i < len; ++i) {
+    hash *= FNV_32_PRIME;
+    hash ^= uint32_t(key[i]);
+  }
+  return hash;
+}
+
+uint32_t hash_fnv1a_32(const char* key, size_t len) {
+  uint32_t hash = FNV_32_INIT;
+  for(size_t i = 0; i < len; ++i) {
+    hash ^= uint32_t(key[i]);
+    hash *= FNV_32_PRIME;
+  }
+  return hash;
+}
+
+uint32_t hash_one_at_a_time(const char* key, size_t len) {
+  uint32_t value = 0;
+  for(size_t i = 0; i < len; ++i) {
+    value += uint32_t(key[i]);
+    value += (value << 10);
+    value ^= (value >> 6);
+  }
+  value += (value << 3);
+  value ^= (value >> 11);
+  value += (value << 15);
+  return value;
+}
+
+uint32_t hash_murmur(const char* key, size_t len) {
+  const uint32_t m = 0x5bd1e995;
+  const int r = 24;
+  const uint32_t seed = 0xdeadbeef * uint32_t(len);
+  uint32_t h = seed ^ uint32_t(len);
+
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(key);
+  for(; len >= 4; data += 4, len -= 4) {
+    uint32_t k = uint32_t(data[0]) | (uint32_t(data[1]) << 8) |
+                 (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h *= m;
+    h ^= k;
+  }
+
+  switch(len) {
+  case 3:
+    h ^= uint32_t(data[2]) << 16;
+    // fall through
+  case 2:
+    h ^= uint32_t(data[1]) << 8;
+    // fall through
+  case 1:
+    h ^= data[0];
+    h *= m;
+  }
+
+  h ^= h >> 13;
+  h *= m;
+  h ^= h >> 15;
+  return h;
+}
+
+uint32_t hash_crc16(const char* key, size_t len) {
+  static const struct Table {
+    Table() {
+      for(uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i << 8;
+        for(int k = 0; k < 8; ++k) {
+          crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+        entries_[i] = crc & 0xffff;
+      }
+    }
+    uint32_t entries_[256];
+  } table;
+
+  // not truncated to 16 bits, as twemproxy
+  uint32_t crc = 0;
+  for(size_t i = 0; i < len; ++i) {
+    crc = (crc << 8) ^ table.entries_[((crc >> 8) ^ uint32_t(key[i])) & 0xff];
+  }
+  return crc;
+}
+
+static uint32_t crc32(const char* key, size_t len) {
+  static const struct Table {
+    Table() {
+      for(uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for(int k = 0; k < 8; ++k) {
+          crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+        }
+        entries_[i] = crc;
+      }
+    }
+    uint32_t entries_[256];
+  } table;
+
+  uint32_t crc = UINT32_MAX;
+  for(size_t i = 0; i < len; ++i) {
+    crc = (crc >> 8) ^ table.entries_[(crc ^ uint32_t(key[i])) & 0xff];
+  }
+  return ~crc;
+}
+
+uint32_t hash_crc32(const char* key, size_t len) {
+  return (crc32(key, len) >> 16) & 0x7fff;
+}
+
+uint32_t hash_crc32a(const char* key, size_t len) {
+  return crc32(key, len);
+}
+
+}
@@ -7,6 +7,7 @@
 #include "config.h"
 #include "logging.h"
 #include "key_locator.h"
+#include "timing_wheel.h"
 
 namespace yarmproxy {
 
@@ -16,7 +17,12 @@ WorkerContext::WorkerContext()
     : work_(io_context_)
     , backend_conn_pool_(nullptr)
     , allocator_(new Allocator(Config::Instance().buffer_size(),
-          Config::Instance().reserved_buffer_space())) {
+          Config::Instance().reserved_buffer_space()))
+    , timing_wheel_(new TimingWheel(io_context_))
+    , backend_monitor_(nullptr)
+    , redis_cluster_monitor_(nullptr)
+    , cpu_(-1)
+    , node_(-1) {
 }
 
 BackendConnPool* WorkerContext::backend_conn_pool() {
@@ -35,12 +41,61 @@ void WorkerPool::OnLocatorUpdated(std::shared_ptr<KeyLocator> locator) {
   }
 }
 
+WorkerContext* WorkerPool::CpuWorker(int cpu) {
+  int node = topology_.NodeOfCpu(cpu);
+  if (node < 0) {
+    return nullptr;
+  }
+  size_t cpu_workers = 0;
+  size_t node_workers = 0;
+  for(size_t i = 0; i < concurrency_; ++i) {
+    cpu_workers += workers_[i].cpu_ == cpu;
+    node_workers += workers_[i].node_ == node;
+  }
+  // in turn, if there are more workers than CPUs
+  bool on_cpu = cpu_workers > 0;
+  size_t candidates = on_cpu ? cpu_workers : node_workers;
+  if (candidates == 0) {
+    return nullptr;
+  }
+  size_t turn = next_cpu_worker_++ % candidates;
+  for(size_t i = 0; i < concurrency_; ++i) {
+    bool candidate = on_cpu ? workers_[i].cpu_ == cpu :
+                              workers_[i].node_ == node;
+    if (candidate && turn-- == 0) {
+      return &workers_[i];
+    }
+  }
+  return nullptr;
+}
+
 void WorkerPool::StartDispatching() {
+  if (Config::Instance().worker_cpu_affinity()) {
+    if (topology_.Load()) {
+      std::vector<int> cpus(topology_.PlaceWorkers(concurrency_));
+      for(size_t i = 0; i < concurrency_; ++i) {
+        workers_[i].cpu_ = cpus[i];
+        workers_[i].node_ = topology_.NodeOfCpu(cpus[i]);
+        // before any slab is touched, i.e. before accepting the clients
+        workers_[i].allocator_->BindToNode(workers_[i].node_);
+        LOG_INFO << "WorkerThread " << i << " cpu=" << workers_[i].cpu_
+                 << " node=" << workers_[i].node_;
+      }
+      LOG_INFO << "WorkerPool " << topology_.nodes().size()
+               << " NUMA nodes";
+    } else {
+      LOG_WARN << "WorkerPool no allowed CPU, the workers aren't pinned";
+    }
+  }
+
   for(size_t i = 0; i < concurrency_; ++i) {
     WorkerContext& woker = workers_[i];
     std::atomic_bool& stopped(stopped_);
     std::thread th([&woker, &stopped, i]() {
-        // SetThreadCpuAffinity(i % 4);
+        if (woker.cpu_ >= 0 && SetThreadCpuAffinity(woker.cpu_) != 0) {
+          LOG_WARN << "WorkerThread " << i
+                   << " SetThreadCpuAffinity error, cpu=" << woker.cpu_;
+        }
         while(!stopped) {
           try {
             woker.io_context_.run();
@@ -5,11 +5,16 @@
 #include <atomic>
 #include <boost/asio.hpp>
 
+#include "cpu_topology.h"
+
 namespace yarmproxy {
 
 class BackendConnPool;
+class BackendMonitor;
+class RedisClusterMonitor;
 class KeyLocator;
 class Allocator;
+class TimingWheel;
 
 class WorkerContext {
 public:
@@ -23,14 +28,24 @@ private:
   BackendConnPool* backend_conn_pool_;
 public:
   Allocator* allocator_;
+  TimingWheel* timing_wheel_; // the client and backend read/write timeouts
+  BackendMonitor* backend_monitor_;
+  RedisClusterMonitor* redis_cluster_monitor_;
+  int cpu_;  // the CPU the worker thread is pinned on, -1 if not pinned
+  int node_; // the NUMA node of cpu_
 };
 
 class WorkerPool {
 public:
-  explicit WorkerPool(size_t concurrency)
+  WorkerPool(size_t concurrency, BackendMonitor* backend_monitor,
+             RedisClusterMonitor* redis_cluster_monitor)
       : concurrency_(concurrency)
       , workers_(new WorkerContext[concurrency])
       , stopped_(false) {
+    for(size_t i = 0; i < concurrency_; ++i) {
+      workers_[i].backend_monitor_ = backend_monitor;
+      workers_[i].redis_cluster_monitor_ = redis_cluster_monitor;
+    }
   }
   ~WorkerPool() {
     delete []workers_;
@@ -43,12 +58,19 @@ public:
   WorkerContext& NextWorker() {
     return workers_[next_worker_++ % concurrency_];
   }
+  // one of the workers pinned on the CPU, or else on the NUMA node of the
+  // CPU, in turn
+  // return : nullptr if the workers aren't pinned, or none is on the node
+  WorkerContext* CpuWorker(int cpu);
 private:
   size_t concurrency_;
   WorkerContext* workers_;
 
   std::atomic_bool stopped_;
   size_t next_worker_ = 0;
+
+  CpuTopology topology_;
+  size_t next_cpu_worker_ = 0;
 };
 
 }
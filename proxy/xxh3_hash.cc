@@ -0,0 +1,238 @@
+#include "key_hash.h"
+
+#include <cstring>
+
+// XXH3_64bits(seed 0, default secret) of xxHash, by Yann Collet. BSD 2-Clause
+// License, see https://github.com/Cyan4973/xxHash . The portable scalar code
+// path only, which is short enough for the keys.
+
+namespace yarmproxy {
+
+namespace {
+
+const uint32_t PRIME32_1 = 0x9E3779B1U;
+const uint32_t PRIME32_2 = 0x85EBCA77U;
+const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+const size_t kSecretSize = 192;
+const size_t kStripeLen = 64;
+const size_t kSecretConsumeRate = 8;
+const size_t kMidSizeMax = 240;
+
+const unsigned char kSecret[kSecretSize] = {
+  0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+  0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+  0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+  0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+  0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+  0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+  0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+  0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+  0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+  0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+  0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+  0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+inline uint32_t ReadLE32(const void* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v)); // little endian hosts only
+  return v;
+}
+
+inline uint64_t ReadLE64(const void* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Mul128Fold64(uint64_t lhs, uint64_t rhs) {
+  unsigned __int128 product = (unsigned __int128)lhs * rhs;
+  return uint64_t(product) ^ uint64_t(product >> 64);
+}
+
+inline uint64_t XXH64Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= PRIME_MX1;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t rrmxmx(uint64_t h, uint64_t len) {
+  h ^= rotl64(h, 49) ^ rotl64(h, 24);
+  h *= PRIME_MX2;
+  h ^= (h >> 35) + len;
+  h *= PRIME_MX2;
+  h ^= h >> 28;
+  return h;
+}
+
+inline uint64_t Mix16B(const unsigned char* in, const unsigned char* secret) {
+  return Mul128Fold64(ReadLE64(in) ^ ReadLE64(secret),
+                      ReadLE64(in + 8) ^ ReadLE64(secret + 8));
+}
+
+uint64_t Len1To3(const unsigned char* in, size_t len) {
+  uint32_t combined = (uint32_t(in[0]) << 16) | (uint32_t(in[len >> 1]) << 24) |
+                      uint32_t(in[len - 1]) | (uint32_t(len) << 8);
+  uint64_t bitflip = ReadLE32(kSecret) ^ ReadLE32(kSecret + 4);
+  return XXH64Avalanche(uint64_t(combined) ^ bitflip);
+}
+
+uint64_t Len4To8(const unsigned char* in, size_t len) {
+  uint32_t input1 = ReadLE32(in);
+  uint32_t input2 = ReadLE32(in + len - 4);
+  uint64_t bitflip = ReadLE64(kSecret + 8) ^ ReadLE64(kSecret + 16);
+  uint64_t input64 = input2 + (uint64_t(input1) << 32);
+  return rrmxmx(input64 ^ bitflip, len);
+}
+
+uint64_t Len9To16(const unsigned char* in, size_t len) {
+  uint64_t bitflip1 = ReadLE64(kSecret + 24) ^ ReadLE64(kSecret + 32);
+  uint64_t bitflip2 = ReadLE64(kSecret + 40) ^ ReadLE64(kSecret + 48);
+  uint64_t input_lo = ReadLE64(in) ^ bitflip1;
+  uint64_t input_hi = ReadLE64(in + len - 8) ^ bitflip2;
+  uint64_t acc = len + __builtin_bswap64(input_lo) + input_hi +
+                 Mul128Fold64(input_lo, input_hi);
+  return Avalanche(acc);
+}
+
+uint64_t Len17To128(const unsigned char* in, size_t len) {
+  uint64_t acc = len * PRIME64_1;
+  if (len > 32) {
+    if (len > 64) {
+      if (len > 96) {
+        acc += Mix16B(in + 48, kSecret + 96);
+        acc += Mix16B(in + len - 64, kSecret + 112);
+      }
+      acc += Mix16B(in + 32, kSecret + 64);
+      acc += Mix16B(in + len - 48, kSecret + 80);
+    }
+    acc += Mix16B(in + 16, kSecret + 32);
+    acc += Mix16B(in + len - 32, kSecret + 48);
+  }
+  acc += Mix16B(in, kSecret);
+  acc += Mix16B(in + len - 16, kSecret + 16);
+  return Avalanche(acc);
+}
+
+uint64_t Len129To240(const unsigned char* in, size_t len) {
+  const size_t kMidSizeStartOffset = 3;
+  const size_t kMidSizeLastOffset = 17;
+  const size_t kSecretSizeMin = 136;
+
+  uint64_t acc = len * PRIME64_1;
+  size_t rounds = len / 16;
+  for(size_t i = 0; i < 8; ++i) {
+    acc += Mix16B(in + 16 * i, kSecret + 16 * i);
+  }
+  acc = Avalanche(acc);
+  for(size_t i = 8; i < rounds; ++i) {
+    acc += Mix16B(in + 16 * i, kSecret + 16 * (i - 8) + kMidSizeStartOffset);
+  }
+  acc += Mix16B(in + len - 16, kSecret + kSecretSizeMin - kMidSizeLastOffset);
+  return Avalanche(acc);
+}
+
+inline void Accumulate512(uint64_t* acc, const unsigned char* in,
+                          const unsigned char* secret) {
+  for(size_t i = 0; i < 8; ++i) {
+    uint64_t data_val = ReadLE64(in + 8 * i);
+    uint64_t data_key = data_val ^ ReadLE64(secret + 8 * i);
+    acc[i ^ 1] += data_val;
+    acc[i] += uint64_t(uint32_t(data_key)) * (data_key >> 32);
+  }
+}
+
+inline void ScrambleAcc(uint64_t* acc, const unsigned char* secret) {
+  for(size_t i = 0; i < 8; ++i) {
+    uint64_t a = acc[i];
+    a ^= a >> 47;
+    a ^= ReadLE64(secret + 8 * i);
+    a *= PRIME32_1;
+    acc[i] = a;
+  }
+}
+
+uint64_t LongHash(const unsigned char* in, size_t len) {
+  const size_t kLastAccStart = 7;
+  const size_t kMergeAccsStart = 11;
+  const size_t stripes_per_block =
+      (kSecretSize - kStripeLen) / kSecretConsumeRate;
+  const size_t block_len = kStripeLen * stripes_per_block;
+  const size_t blocks = (len - 1) / block_len;
+
+  uint64_t acc[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                      PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+  for(size_t n = 0; n < blocks; ++n) {
+    for(size_t s = 0; s < stripes_per_block; ++s) {
+      Accumulate512(acc, in + n * block_len + s * kStripeLen,
+                    kSecret + s * kSecretConsumeRate);
+    }
+    ScrambleAcc(acc, kSecret + kSecretSize - kStripeLen);
+  }
+
+  const size_t stripes = ((len - 1) - block_len * blocks) / kStripeLen;
+  for(size_t s = 0; s < stripes; ++s) {
+    Accumulate512(acc, in + blocks * block_len + s * kStripeLen,
+                  kSecret + s * kSecretConsumeRate);
+  }
+  Accumulate512(acc, in + len - kStripeLen,
+                kSecret + kSecretSize - kStripeLen - kLastAccStart);
+
+  uint64_t result = len * PRIME64_1;
+  for(size_t i = 0; i < 4; ++i) {
+    result += Mul128Fold64(
+        acc[2 * i] ^ ReadLE64(kSecret + kMergeAccsStart + 16 * i),
+        acc[2 * i + 1] ^ ReadLE64(kSecret + kMergeAccsStart + 16 * i + 8));
+  }
+  return Avalanche(result);
+}
+
+}
+
+uint64_t xxh3_64(const char* key, size_t len) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(key);
+  if (len <= 16) {
+    if (len > 8) {
+      return Len9To16(in, len);
+    }
+    if (len >= 4) {
+      return Len4To8(in, len);
+    }
+    if (len > 0) {
+      return Len1To3(in, len);
+    }
+    return XXH64Avalanche(ReadLE64(kSecret + 56) ^ ReadLE64(kSecret + 64));
+  }
+  if (len <= 128) {
+    return Len17To128(in, len);
+  }
+  if (len <= kMidSizeMax) {
+    return Len129To240(in, len);
+  }
+  return LongHash(in, len);
+}
+
+}
+
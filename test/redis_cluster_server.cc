@@ -0,0 +1,295 @@
+/*
+ * simulate a redis cluster of masters on several ports, in one process.
+ * supports get/set/mget/mset/del/exists, CLUSTER SLOTS, and replies
+ * MOVED/ASK like a redis cluster node. slots can be moved with
+ *   CLUSTER SETSLOT <slot> NODE <port>
+ *   CLUSTER SETSLOT <slot> MIGRATING <port>
+ * sent to any of the nodes.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "../proxy/redis_cluster.h"
+
+using boost::asio::ip::tcp;
+using yarmproxy::redis::KeySlot;
+using yarmproxy::redis::kClusterSlots;
+
+static std::vector<int> g_ports;
+static std::vector<int> g_slot_owner;     // port by slot
+static std::vector<int> g_slot_migrating; // target port by slot, or 0
+static std::map<int, std::map<std::string, std::string>> g_stores;
+
+static std::string Bulk(const std::string* value) {
+  if (value == nullptr) {
+    return "$-1\r\n";
+  }
+  return "$" + std::to_string(value->size()) + "\r\n" + *value + "\r\n";
+}
+
+static std::string Redirection(const char* type, int slot, int port) {
+  return std::string("-") + type + " " + std::to_string(slot) +
+         " 127.0.0.1:" + std::to_string(port) + "\r\n";
+}
+
+static std::string ClusterSlots() {
+  std::string ranges;
+  size_t count = 0;
+  for(int first = 0; first < int(kClusterSlots); ) {
+    int last = first;
+    while (last + 1 < int(kClusterSlots) &&
+           g_slot_owner[last + 1] == g_slot_owner[first]) {
+      ++last;
+    }
+    ranges += "*3\r\n:" + std::to_string(first) + "\r\n:" +
+              std::to_string(last) + "\r\n*2\r\n$9\r\n127.0.0.1\r\n:" +
+              std::to_string(g_slot_owner[first]) + "\r\n";
+    ++count;
+    first = last + 1;
+  }
+  return "*" + std::to_string(count) + "\r\n" + ranges;
+}
+
+static void MoveSlot(int slot, int port) {
+  auto& from = g_stores[g_slot_owner[slot]];
+  auto& to = g_stores[port];
+  for(auto it = from.begin(); it != from.end(); ) {
+    if (KeySlot(it->first.data(), it->first.size()) == slot) {
+      to[it->first] = it->second;
+      it = from.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  g_slot_owner[slot] = port;
+  g_slot_migrating[slot] = 0;
+}
+
+class session : public std::enable_shared_from_this<session>
+{
+public:
+  session(tcp::socket socket, int port)
+      : socket_(std::move(socket)), port_(port) {
+  }
+
+  void start() {
+    do_read();
+  }
+
+private:
+  void do_read() {
+    auto self(shared_from_this());
+    socket_.async_read_some(boost::asio::buffer(data_, max_length),
+        [this, self](boost::system::error_code ec, std::size_t length) {
+          if (ec) {
+            return;
+          }
+          query_.append(data_, length);
+          std::string reply;
+          std::vector<std::string> args;
+          while (parse_query(&args)) {
+            reply += execute(args);
+          }
+          if (reply.empty()) {
+            do_read();
+          } else {
+            do_write(std::move(reply));
+          }
+        });
+  }
+
+  void do_write(std::string reply) {
+    reply_ = std::move(reply);
+    auto self(shared_from_this());
+    boost::asio::async_write(socket_, boost::asio::buffer(reply_),
+        [this, self](boost::system::error_code ec, std::size_t) {
+          if (!ec) {
+            do_read();
+          }
+        });
+  }
+
+  bool parse_query(std::vector<std::string>* args) {
+    args->clear();
+    size_t pos = 0;
+    auto read_line = [this, &pos](char type, long* value) {
+      size_t eol = query_.find("\r\n", pos);
+      if (eol == std::string::npos || query_[pos] != type) {
+        return false;
+      }
+      *value = std::atol(query_.c_str() + pos + 1);
+      pos = eol + 2;
+      return true;
+    };
+    long count = 0, size = 0;
+    if (!read_line('*', &count)) {
+      return false;
+    }
+    for(long i = 0; i < count; ++i) {
+      if (!read_line('$', &size) || query_.size() < pos + size + 2) {
+        return false;
+      }
+      args->push_back(query_.substr(pos, size));
+      pos += size + 2;
+    }
+    query_.erase(0, pos);
+    return !args->empty();
+  }
+
+  // return : the error reply if the keys can't be served here
+  std::string check_slot(const std::vector<std::string>& args, size_t last,
+                         size_t step, bool asking) {
+    int slot = -1;
+    bool missing = false;
+    for(size_t i = 1; i < last; i += step) {
+      int s = KeySlot(args[i].data(), args[i].size());
+      if (slot >= 0 && s != slot) {
+        return "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+      }
+      slot = s;
+      missing = missing || g_stores[port_].count(args[i]) == 0;
+    }
+    if (slot < 0) {
+      return "-ERR wrong number of arguments\r\n";
+    }
+    if (g_slot_owner[slot] != port_) {
+      if (asking && g_slot_migrating[slot] == port_) {
+        return std::string();
+      }
+      return Redirection("MOVED", slot, g_slot_owner[slot]);
+    }
+    if (missing && g_slot_migrating[slot] != 0) {
+      return Redirection("ASK", slot, g_slot_migrating[slot]);
+    }
+    return std::string();
+  }
+
+  std::string execute(std::vector<std::string>& args) {
+    std::string cmd = args[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+    bool asking = asking_;
+    asking_ = false;
+
+    auto& store = g_stores[port_];
+    if (cmd == "asking") {
+      asking_ = true;
+      return "+OK\r\n";
+    } else if (cmd == "cluster" && args.size() == 2) {
+      return ClusterSlots();
+    } else if (cmd == "cluster" && args.size() == 5) {
+      int slot = std::atoi(args[2].c_str());
+      int port = std::atoi(args[4].c_str());
+      if (args[3] == "NODE") {
+        MoveSlot(slot, port);
+      } else {
+        g_slot_migrating[slot] = port;
+      }
+      return "+OK\r\n";
+    }
+
+    size_t step = (cmd == "mset") ? 2 : 1;
+    size_t last = (cmd == "get" || cmd == "set") ? 2 : args.size();
+    std::string error = check_slot(args, last, step, asking);
+    if (!error.empty()) {
+      return error;
+    }
+    if (cmd == "get" && args.size() == 2) {
+      auto it = store.find(args[1]);
+      return Bulk(it == store.end() ? nullptr : &it->second);
+    } else if (cmd == "set" && args.size() >= 3) {
+      store[args[1]] = args[2];
+      return "+OK\r\n";
+    } else if (cmd == "mget") {
+      std::string reply = "*" + std::to_string(args.size() - 1) + "\r\n";
+      for(size_t i = 1; i < args.size(); ++i) {
+        auto it = store.find(args[i]);
+        reply += Bulk(it == store.end() ? nullptr : &it->second);
+      }
+      return reply;
+    } else if (cmd == "mset" && args.size() % 2 == 1) {
+      for(size_t i = 1; i < args.size(); i += 2) {
+        store[args[i]] = args[i + 1];
+      }
+      return "+OK\r\n";
+    } else if (cmd == "del" || cmd == "exists") {
+      size_t count = 0;
+      for(size_t i = 1; i < args.size(); ++i) {
+        count += (cmd == "del") ? store.erase(args[i]) : store.count(args[i]);
+      }
+      return ":" + std::to_string(count) + "\r\n";
+    }
+    return "-ERR unknown command '" + args[0] + "'\r\n";
+  }
+
+  tcp::socket socket_;
+  int port_;
+  enum { max_length = 64 * 1024 };
+  char data_[max_length];
+  std::string query_;
+  std::string reply_;
+  bool asking_ = false;
+};
+
+class server
+{
+public:
+  server(boost::asio::io_context& io_context, int port)
+    : acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
+    , port_(port)
+  {
+    do_accept();
+  }
+
+private:
+  void do_accept() {
+    acceptor_.async_accept(
+        [this](boost::system::error_code ec, tcp::socket socket)
+        {
+          if (!ec)
+          {
+            std::make_shared<session>(std::move(socket), port_)->start();
+          }
+
+          do_accept();
+        });
+  }
+
+  tcp::acceptor acceptor_;
+  int port_;
+};
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <port> [port ...]\n";
+    return 1;
+  }
+
+  for(int i = 1; i < argc; ++i) {
+    g_ports.push_back(std::atoi(argv[i]));
+  }
+  // the slots are split evenly at startup
+  for(size_t slot = 0; slot < kClusterSlots; ++slot) {
+    g_slot_owner.push_back(g_ports[slot * g_ports.size() / kClusterSlots]);
+  }
+  g_slot_migrating.assign(kClusterSlots, 0);
+
+  try {
+    boost::asio::io_context io_context;
+    std::vector<std::unique_ptr<server>> servers;
+    for(int port : g_ports) {
+      servers.emplace_back(new server(io_context, port));
+    }
+    io_context.run();
+  } catch (std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+# Tests the `protocol redis_cluster` routing against redis_cluster_server.
+# The yarmproxy under test should have the default redis namespace on a
+# redis_cluster cluster, with one of 127.0.0.1:7000-7002 as backends.
+
+YARMPROXY_PORT=11311
+if [ $# -gt 0 ]; then
+  YARMPROXY_PORT=$1
+fi
+
+./redis_cluster_server 7000 7001 7002 &
+server_pid=$!
+trap "kill $server_pid" EXIT
+sleep 1
+
+function query() {
+  printf "$1" | ./yarmnc 127.0.0.1 $YARMPROXY_PORT | tr -d '\r'
+}
+
+function expect() {
+  if [ "$1" != "$2" ]; then
+    echo -e "\033[33mFail $3 : [$1] != [$2].\033[0m"
+    exit 1
+  fi
+}
+
+function control() {
+  printf "$1" | ./yarmnc 127.0.0.1 7000 > /dev/null
+}
+
+# "foo" is in slot 12182 of 7002, "{foo}bar" too. "bar" is in 5061 and "baz"
+# in 4813 of 7000, "qux" in 9995 of 7001
+expect "$(query '*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n$2\r\nv1\r\n')" "+OK" "set"
+expect "$(query '*2\r\n$3\r\nget\r\n$3\r\nfoo\r\n')" "$(printf '$2\nv1')" "get"
+expect "$(query '*3\r\n$4\r\nmget\r\n$3\r\nfoo\r\n$8\r\n{foo}bar\r\n')" \
+       "$(printf '*2\n$2\nv1\n$-1')" "mget"
+
+# the keys of different slots are sent once per slot, even on the same node
+expect "$(query '*7\r\n$4\r\nmset\r\n$8\r\n{foo}bar\r\n$2\r\nv2\r\n$3\r\nbar\r\n$2\r\nv3\r\n$3\r\nbaz\r\n$2\r\nv5\r\n')" \
+       "+OK" "mset crossslot"
+expect "$(query '*5\r\n$4\r\nmget\r\n$8\r\n{foo}bar\r\n$3\r\nbar\r\n$3\r\nbaz\r\n$3\r\nqux\r\n')" \
+       "$(printf '*4\n$2\nv2\n$2\nv3\n$2\nv5\n$-1')" "mget crossslot"
+expect "$(query '*4\r\n$3\r\ndel\r\n$3\r\nbaz\r\n$3\r\nqux\r\n$8\r\n{foo}bar\r\n')" \
+       ":2" "del crossslot"
+
+# ASK while the slot is migrating, then MOVED after it's moved
+control '*5\r\n$7\r\ncluster\r\n$7\r\nsetslot\r\n$5\r\n12182\r\n$9\r\nMIGRATING\r\n$4\r\n7001\r\n'
+expect "$(query '*3\r\n$3\r\nset\r\n$8\r\n{foo}baz\r\n$2\r\nv4\r\n')" "+OK" "set ask"
+expect "$(query '*2\r\n$3\r\nget\r\n$8\r\n{foo}baz\r\n')" "$(printf '$2\nv4')" "get ask"
+control '*5\r\n$7\r\ncluster\r\n$7\r\nsetslot\r\n$5\r\n12182\r\n$4\r\nNODE\r\n$4\r\n7001\r\n'
+expect "$(query '*2\r\n$3\r\nget\r\n$3\r\nfoo\r\n')" "$(printf '$2\nv1')" "get moved"
+sleep 0.5 # refreshed on MOVED
+expect "$(query '*3\r\n$4\r\nmget\r\n$3\r\nfoo\r\n$8\r\n{foo}baz\r\n')" \
+       "$(printf '*2\n$2\nv1\n$2\nv4')" "mget moved"
+
+# the subqueries of a crossslot command are redirected too
+control '*5\r\n$7\r\ncluster\r\n$7\r\nsetslot\r\n$4\r\n5061\r\n$4\r\nNODE\r\n$4\r\n7002\r\n'
+expect "$(query '*3\r\n$4\r\nmget\r\n$3\r\nbar\r\n$3\r\nfoo\r\n')" \
+       "$(printf '*2\n$2\nv3\n$2\nv1')" "mget subquery moved"
+sleep 0.5
+control '*5\r\n$7\r\ncluster\r\n$7\r\nsetslot\r\n$4\r\n4813\r\n$9\r\nMIGRATING\r\n$4\r\n7001\r\n'
+expect "$(query '*5\r\n$4\r\nmset\r\n$3\r\nbaz\r\n$2\r\nv6\r\n$3\r\nbar\r\n$2\r\nv7\r\n')" \
+       "+OK" "mset subquery ask"
+expect "$(query '*3\r\n$4\r\nmget\r\n$3\r\nbaz\r\n$3\r\nbar\r\n')" \
+       "$(printf '*2\n$2\nv6\n$2\nv7')" "mget subquery ask"
+expect "$(query '*3\r\n$3\r\ndel\r\n$3\r\nbaz\r\n$3\r\nbar\r\n')" \
+       ":2" "del subquery ask"
+
+echo -e "\033[32mPass.\033[0m"
@@ -0,0 +1,51 @@
+#include "../proxy/backend_pool.h"
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+using namespace yarmproxy;
+
+// the times each candidate is chosen, of their costs, led by the primary's
+static std::vector<int> Choices(const std::vector<uint64_t>& costs,
+                                int trials) {
+  std::minstd_rand random;
+  std::vector<int> chosen(costs.size(), 0);
+  for(int i = 0; i < trials; ++i) {
+    ++chosen[BackendConnPool::PowerOfTwoChoices(costs.size() - 1, random,
+        [&costs](size_t candidate) { return costs[candidate]; })];
+  }
+  return chosen;
+}
+
+void LessLoadedTest() {
+  // the cheaper of the primary and its replica
+  assert((Choices({5, 1}, 100) == std::vector<int>{0, 100}));
+  assert((Choices({1, 5}, 100) == std::vector<int>{100, 0}));
+
+  // the most loaded is never chosen, the least loaded whenever drawn
+  std::vector<int> chosen = Choices({10, 1, 5}, 3000);
+  assert(chosen[0] == 0);
+  assert(chosen[1] > 1800 && chosen[1] < 2200); // 2/3
+  assert(chosen[1] + chosen[2] == 3000);
+}
+
+void FallbackTest() {
+  // no replica
+  assert((Choices({7}, 10) == std::vector<int>{10}));
+
+  // the replicas of an open circuit are skipped
+  const uint64_t kOpen = UINT64_MAX;
+  assert((Choices({100, kOpen, kOpen}, 100) == std::vector<int>{100, 0, 0}));
+  assert((Choices({kOpen, 100}, 100) == std::vector<int>{0, 100}));
+  // the primary if no member is available
+  assert((Choices({kOpen, kOpen, kOpen}, 100) ==
+          std::vector<int>{100, 0, 0}));
+}
+
+int main() {
+  LessLoadedTest();
+  FallbackTest();
+  std::cout << "backend_pool_test ok" << std::endl;
+  return 0;
+}
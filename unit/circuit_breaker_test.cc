@@ -0,0 +1,121 @@
+#include "../proxy/circuit_breaker.h"
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+
+#include "../proxy/config.h"
+#include "../proxy/stats.h"
+
+namespace yarmproxy {
+Stats g_stats_; // of stats_command.cc, which isn't linked
+}
+
+using namespace yarmproxy;
+using Clock = CircuitBreaker::Clock;
+using std::chrono::milliseconds;
+
+static void LoadConfig(int error_rate) {
+  const char* file = "/tmp/circuit_breaker_test.conf";
+  std::ofstream(file) << "circuit_breaker {\n"
+                      << "  error_rate   " << error_rate << "\n"
+                      << "  min_requests 4\n"
+                      << "  window       1000\n"
+                      << "  open_time    100\n"
+                      << "}\n";
+  assert(Config::Instance().Initialize(file));
+}
+
+void ThresholdTest() {
+  LoadConfig(50);
+  CircuitBreaker breaker;
+  Clock::time_point now = Clock::now();
+
+  // under min_requests
+  for(int i = 0; i < 3; ++i) {
+    assert(breaker.AllowRequest(now));
+    breaker.OnRequestFinished(false, now);
+  }
+  assert(breaker.state() == CircuitBreaker::CLOSED);
+
+  // the failures of a past window don't count
+  now += milliseconds(1000);
+  breaker.OnRequestFinished(false, now);
+  breaker.OnRequestFinished(true, now);
+  breaker.OnRequestFinished(true, now);
+  breaker.OnRequestFinished(true, now);
+  assert(breaker.state() == CircuitBreaker::CLOSED); // 25%
+
+  breaker.OnRequestFinished(false, now);
+  assert(breaker.state() == CircuitBreaker::CLOSED); // 40%
+  breaker.OnRequestFinished(false, now); // at the threshold
+  assert(breaker.state() == CircuitBreaker::OPEN);
+}
+
+void TransitionTest() {
+  LoadConfig(50);
+  CircuitBreaker breaker;
+  Clock::time_point now = Clock::now();
+  for(int i = 0; i < 4; ++i) {
+    breaker.OnRequestFinished(false, now);
+  }
+  assert(breaker.state() == CircuitBreaker::OPEN);
+
+  // open : failing fast for open_time
+  long long rejections = g_stats_.circuit_breaker_rejections_;
+  assert(breaker.IsOpen(now + milliseconds(99)));
+  assert(!breaker.AllowRequest(now + milliseconds(99)));
+  assert(g_stats_.circuit_breaker_rejections_ == rejections + 1);
+  // the results of the requests sent before tripping are ignored
+  breaker.OnRequestFinished(true, now + milliseconds(99));
+  assert(breaker.state() == CircuitBreaker::OPEN);
+
+  // half-open : one trial, the others held for another open_time
+  now += milliseconds(100);
+  assert(!breaker.IsOpen(now));
+  assert(breaker.AllowRequest(now));
+  assert(breaker.state() == CircuitBreaker::HALF_OPEN);
+  assert(!breaker.AllowRequest(now + milliseconds(50)));
+  assert(breaker.IsOpen(now + milliseconds(50)));
+
+  // a failed trial opens it again, from the failure
+  now += milliseconds(50);
+  breaker.OnRequestFinished(false, now);
+  assert(breaker.state() == CircuitBreaker::OPEN);
+  assert(!breaker.AllowRequest(now + milliseconds(99)));
+
+  // a trial without result lets another one pass
+  now += milliseconds(100);
+  assert(breaker.AllowRequest(now));
+  now += milliseconds(100);
+  assert(breaker.AllowRequest(now));
+  assert(breaker.state() == CircuitBreaker::HALF_OPEN);
+
+  // a successful trial closes it, with a new window
+  breaker.OnRequestFinished(true, now);
+  assert(breaker.state() == CircuitBreaker::CLOSED);
+  assert(breaker.AllowRequest(now));
+  for(int i = 0; i < 3; ++i) {
+    breaker.OnRequestFinished(false, now);
+  }
+  assert(breaker.state() == CircuitBreaker::CLOSED);
+}
+
+void DisabledTest() {
+  LoadConfig(0);
+  CircuitBreaker breaker;
+  Clock::time_point now = Clock::now();
+  for(int i = 0; i < 100; ++i) {
+    breaker.OnRequestFinished(false, now);
+  }
+  assert(breaker.state() == CircuitBreaker::CLOSED);
+  assert(breaker.AllowRequest(now));
+}
+
+int main() {
+  ThresholdTest();
+  TransitionTest();
+  DisabledTest();
+  std::cout << "circuit_breaker_test ok" << std::endl;
+  return 0;
+}
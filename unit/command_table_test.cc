@@ -0,0 +1,147 @@
+#include "../proxy/command_table.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace yarmproxy;
+
+static const RedisCommandSpec* Redis(const char* name) {
+  return LookupRedisCommand(name, strlen(name));
+}
+
+static const MemcCommandSpec* Memc(const char* name) {
+  return LookupMemcCommand(name, strlen(name));
+}
+
+void RedisLookupTest() {
+  assert(Redis("get")->type_ == RedisCommandType::RCT_BASIC);
+  assert(Redis("GET") == Redis("get"));
+  assert(Redis("gEt") == Redis("get"));
+  assert(Redis("setnx") != Redis("setex"));
+  assert(Redis("setex")->type_ == RedisCommandType::RCT_SET);
+  assert(Redis("incrbyfloat")->type_ == RedisCommandType::RCT_BASIC);
+  assert(Redis("YarmStats")->type_ == RedisCommandType::RCT_YARMSTATS);
+
+  assert(Redis("ge") == nullptr);
+  assert(Redis("gett") == nullptr);
+  assert(Redis("hget") == nullptr);
+  assert(Redis("g") == nullptr);
+  assert(LookupRedisCommand("get", 0) == nullptr);
+  assert(LookupRedisCommand("GETX", 3) == Redis("get"));
+}
+
+void RedisSpecTest() {
+  const RedisCommandSpec* mset = Redis("mset");
+  assert(mset->type_ == RedisCommandType::RCT_FANOUT);
+  assert(mset->reply_merge_ == RedisReplyMerge::ALL_OK);
+  assert(mset->first_key_ == 1 && mset->key_step_ == 2);
+  assert(mset->last_key(7) == 6); // the keys are 1, 3 and 5
+  assert(mset->CheckArity(3) && mset->CheckArity(5));
+  assert(!mset->CheckArity(2));
+
+  const RedisCommandSpec* get = Redis("get");
+  assert(get->CheckArity(2) && !get->CheckArity(3) && !get->CheckArity(1));
+  assert(get->last_key(2) == 1);
+  assert(get->flags_ & kCommandReadOnly);
+
+  assert(Redis("mget")->flags_ & kCommandReadOnly);
+  assert(Redis("exists")->flags_ & kCommandReadOnly);
+  assert(Redis("del")->flags_ & kCommandWrite);
+  assert(Redis("touch")->flags_ & kCommandWrite);
+  assert(!(Redis("getset")->flags_ & kCommandReadOnly));
+  assert(Redis("yarmstats")->CheckArity(1));
+}
+
+void RedisFanoutSpecTest() {
+  assert(Redis("get")->reply_merge_ == RedisReplyMerge::NONE);
+  assert(Redis("mget")->type_ == RedisCommandType::RCT_MGET);
+  assert(Redis("del")->reply_merge_ == RedisReplyMerge::SUM);
+  assert(Redis("UNLINK")->type_ == RedisCommandType::RCT_FANOUT);
+  assert(Redis("unlink")->reply_merge_ == RedisReplyMerge::SUM);
+  assert(Redis("unlink")->key_step_ == 1);
+  assert(Redis("msetnx")->reply_merge_ == RedisReplyMerge::ALL_ONE);
+  assert(Redis("msetnx")->key_step_ == 2);
+  assert(!Redis("msetnx")->CheckArity(4));
+}
+
+void MemcLookupTest() {
+  assert(Memc("get")->type_ == MemcCommandType::MCT_GET);
+  assert(Memc("gets")->multi_key_);
+  assert(Memc("cas")->type_ == MemcCommandType::MCT_SET);
+  assert(!Memc("cas")->multi_key_);
+  assert(Memc("delete")->type_ == MemcCommandType::MCT_BASIC);
+  assert(Memc("yarmstats")->type_ == MemcCommandType::MCT_YARMSTATS);
+  // case sensitive, as memcached
+  assert(Memc("GET") == nullptr);
+  assert(Memc("getx") == nullptr);
+}
+
+void MemcFirstKeyTest() {
+  const char get[] = "get k1 k2\r\n";
+  const char* end = get + sizeof(get) - 1 - 2;
+  assert(Memc("get")->first_key(get, end) == get + 4);
+
+  const char gat[] = "gat 100 k1 k2\r\n";
+  end = gat + sizeof(gat) - 1 - 2;
+  assert(Memc("gat")->type_ == MemcCommandType::MCT_GET);
+  assert(!(Memc("gats")->flags_ & kCommandReadOnly));
+  assert(Memc("gat")->first_key(gat, end) == gat + 8);
+
+  const char no_key[] = "gat 100\r\n";
+  end = no_key + sizeof(no_key) - 1 - 2;
+  assert(Memc("gat")->first_key(no_key, end) == end);
+}
+
+static bool MemcCheckArity(const char* cmd_line) {
+  const char* end = cmd_line + strlen(cmd_line) - 2;
+  const char* name_end = strchr(cmd_line, ' ');
+  const MemcCommandSpec* spec = LookupMemcCommand(cmd_line,
+      (name_end != nullptr ? name_end : end) - cmd_line);
+  return spec->CheckArity(cmd_line, end);
+}
+
+void MemcCheckArityTest() {
+  assert(MemcCheckArity("get k1\r\n"));
+  assert(MemcCheckArity("gat 100 k1 k2\r\n"));
+  assert(MemcCheckArity("delete k1\r\n"));
+  assert(MemcCheckArity("yarmstats\r\n"));
+  // memcached replies ERROR to these
+  assert(!MemcCheckArity("get\r\n"));
+  assert(!MemcCheckArity("gets \r\n"));
+  assert(!MemcCheckArity("gat\r\n"));
+  assert(!MemcCheckArity("gat 10\r\n"));
+  assert(!MemcCheckArity("gats 10 \r\n"));
+  assert(!MemcCheckArity("delete\r\n"));
+  // an empty first key
+  assert(!MemcCheckArity("get  k1\r\n"));
+}
+
+void LookupCostTest() {
+  const char* names[] = {"get", "SET", "mget", "incrbyfloat", "hget"};
+  const size_t kLookups = 10000000;
+  size_t found = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < kLookups; ++i) {
+    const char* name = names[i % 5];
+    found += LookupRedisCommand(name, strlen(name)) != nullptr;
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin).count();
+  assert(found == kLookups / 5 * 4);
+  std::cout << "redis command lookup : " << double(ns) / kLookups
+            << " ns" << std::endl;
+}
+
+int main() {
+  RedisLookupTest();
+  RedisSpecTest();
+  RedisFanoutSpecTest();
+  MemcLookupTest();
+  MemcFirstKeyTest();
+  MemcCheckArityTest();
+  LookupCostTest();
+  std::cout << "command_table_test ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "../proxy/cpu_topology.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace yarmproxy;
+
+static std::vector<int> Range(int first, int last) {
+  std::vector<int> cpus;
+  for(int cpu = first; cpu <= last; ++cpu) {
+    cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+void ParseTest() {
+  std::vector<int> cpus;
+  assert(CpuTopology::ParseCpuList("0-3,8,10-11\n", &cpus));
+  assert((cpus == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  cpus.clear();
+  assert(CpuTopology::ParseCpuList("\n", &cpus) && cpus.empty());
+  assert(!CpuTopology::ParseCpuList("3-1", &cpus));
+  assert(!CpuTopology::ParseCpuList("1,x", &cpus));
+  assert(!CpuTopology::ParseCpuList("2-5x", &cpus));
+}
+
+// a dual socket box, 2 cores per socket with their hyper threads, and a
+// memory only node
+void TwoNodesTest() {
+  char dir_template[] = "/tmp/cpu_topology_testXXXXXX";
+  std::string dir(mkdtemp(dir_template));
+  const char* nodes[][2] = {{"node0", "0-1,4-5"}, {"node1", "2-3,6-7"},
+                            {"node2", ""}};
+  for(auto& node : nodes) {
+    std::string node_dir = dir + "/" + node[0];
+    mkdir(node_dir.c_str(), 0755);
+    std::ofstream(node_dir + "/cpulist") << node[1] << "\n";
+  }
+  mkdir((dir + "/power").c_str(), 0755);
+
+  CpuTopology topology;
+  assert(topology.Load(dir, Range(0, 7)));
+  assert(topology.nodes().size() == 2);
+  assert(topology.NodeOfCpu(5) == 0 && topology.NodeOfCpu(6) == 1);
+  assert(topology.NodeOfCpu(8) == -1);
+  // spread over the nodes, the physical cores first
+  assert((topology.PlaceWorkers(4) == std::vector<int>{0, 2, 1, 3}));
+  assert((topology.PlaceWorkers(10) ==
+          std::vector<int>{0, 2, 1, 3, 4, 6, 5, 7, 0, 2}));
+
+  // restricted to a node by the affinity of the process
+  assert(topology.Load(dir, std::vector<int>{2, 3}));
+  assert(topology.nodes().size() == 1 && topology.nodes()[0].id_ == 1);
+  assert((topology.PlaceWorkers(3) == std::vector<int>{2, 3, 2}));
+
+  assert(!topology.Load(dir, std::vector<int>()));
+  assert(system(("rm -rf " + dir).c_str()) == 0);
+}
+
+void NoNumaTest() {
+  CpuTopology topology;
+  assert(topology.Load("/nonexistent", Range(0, 2)));
+  assert(topology.nodes().size() == 1 && topology.nodes()[0].id_ == 0);
+  assert((topology.PlaceWorkers(4) == std::vector<int>{0, 1, 2, 0}));
+
+  assert(topology.Load());
+  assert(!topology.PlaceWorkers(1).empty());
+}
+
+int main() {
+  ParseTest();
+  TwoNodesTest();
+  NoNumaTest();
+  std::cout << "cpu_topology_test ok" << std::endl;
+  return 0;
+}
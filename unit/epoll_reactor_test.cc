@@ -0,0 +1,226 @@
+#include "../proxy/epoll_reactor.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace yarmproxy;
+using Endpoint = boost::asio::ip::tcp::endpoint;
+
+static int Listen(Endpoint* endpoint) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  assert(bind(fd, (sockaddr*)&addr, len) == 0);
+  assert(listen(fd, 16) == 0);
+  assert(getsockname(fd, (sockaddr*)&addr, &len) == 0);
+  *endpoint = Endpoint(boost::asio::ip::address_v4::loopback(),
+                       ntohs(addr.sin_port));
+  return fd;
+}
+
+template <typename Predicate>
+static void RunUntil(boost::asio::io_service& io_context, Predicate done) {
+  while(!done()) {
+    io_context.run_one();
+  }
+}
+
+void EchoTest() {
+  boost::asio::io_service io_context;
+  Endpoint endpoint;
+  int listener = Listen(&endpoint);
+
+  ReactorSocket socket(io_context);
+  int connected = 0;
+  socket.async_connect(endpoint, [&connected](
+        const boost::system::error_code& ec) {
+        assert(!ec);
+        ++connected;
+      });
+  assert(connected == 0); // never called by the function starting it
+  RunUntil(io_context, [&]() { return connected == 1; });
+  int peer = accept(listener, nullptr, nullptr);
+
+  bool written = false;
+  socket.async_write("ping", 4, [&written](const boost::system::error_code& ec,
+                                           size_t bytes) {
+        assert(!ec && bytes == 4);
+        written = true;
+      });
+  RunUntil(io_context, [&]() { return written; });
+  char buf[16];
+  assert(read(peer, buf, sizeof(buf)) == 4 && memcmp(buf, "ping", 4) == 0);
+
+  // a read waits for the readiness
+  std::string received;
+  bool eof = false;
+  auto read_handler = [&](const boost::system::error_code& ec, size_t bytes) {
+    if (ec == boost::asio::error::eof) {
+      eof = true;
+    } else {
+      assert(!ec);
+      received.append(buf, bytes);
+    }
+  };
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  io_context.poll();
+  assert(received.empty());
+  assert(write(peer, "pong", 4) == 4);
+  RunUntil(io_context, [&]() { return !received.empty(); });
+  assert(received == "pong");
+
+  close(peer);
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  RunUntil(io_context, [&]() { return eof; });
+  close(listener);
+}
+
+// the data and the hang up of the peer reported by the same edge
+void HalfCloseTest() {
+  boost::asio::io_service io_context;
+  Endpoint endpoint;
+  int listener = Listen(&endpoint);
+  ReactorSocket socket(io_context);
+  bool connected = false;
+  socket.async_connect(endpoint, [&](const boost::system::error_code&) {
+        connected = true;
+      });
+  RunUntil(io_context, [&]() { return connected; });
+  int peer = accept(listener, nullptr, nullptr);
+
+  std::string received;
+  bool eof = false;
+  char buf[16];
+  auto read_handler = [&](const boost::system::error_code& ec, size_t bytes) {
+    if (ec == boost::asio::error::eof) {
+      eof = true;
+    } else {
+      assert(!ec);
+      received.append(buf, bytes);
+    }
+  };
+  // a short read, then the next data raises a new edge
+  assert(write(peer, "GET", 3) == 3);
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  RunUntil(io_context, [&]() { return received == "GET"; });
+
+  assert(write(peer, "GET", 3) == 3);
+  assert(shutdown(peer, SHUT_WR) == 0);
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  RunUntil(io_context, [&]() { return received == "GETGET"; });
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  // no more edge, the eof must not wait for one
+  for(int i = 0; i < 20 && !eof; ++i) {
+    io_context.run_one_for(std::chrono::milliseconds(50));
+  }
+  assert(eof);
+  close(peer);
+  close(listener);
+}
+
+void RefusedTest() {
+  boost::asio::io_service io_context;
+  Endpoint endpoint;
+  close(Listen(&endpoint)); // nobody listens on it any more
+
+  ReactorSocket socket(io_context);
+  boost::system::error_code connect_ec;
+  bool connected = false;
+  socket.async_connect(endpoint, [&](const boost::system::error_code& ec) {
+        connect_ec = ec;
+        connected = true;
+      });
+  RunUntil(io_context, [&]() { return connected; });
+  assert(connect_ec == boost::asio::error::connection_refused);
+}
+
+void CloseTest() {
+  boost::asio::io_service io_context;
+  Endpoint endpoint;
+  int listener = Listen(&endpoint);
+  ReactorSocket socket(io_context);
+  bool connected = false;
+  socket.async_connect(endpoint, [&](const boost::system::error_code&) {
+        connected = true;
+      });
+  RunUntil(io_context, [&]() { return connected; });
+
+  char buf[16];
+  int completions = 0;
+  socket.async_read_some(boost::asio::buffer(buf, sizeof(buf)),
+      [&](const boost::system::error_code& ec, size_t) {
+        assert(ec == boost::asio::error::operation_aborted);
+        ++completions;
+      });
+  io_context.poll();
+  socket.close();
+  assert(!socket.is_open() && completions == 0);
+  io_context.poll();
+  assert(completions == 1);
+  close(listener);
+}
+
+void WaitMoveTest() {
+  boost::asio::io_service io_context;
+  Endpoint endpoint;
+  int listener = Listen(&endpoint);
+  ReactorSocket first(io_context);
+  bool connected = false;
+  first.async_connect(endpoint, [&](const boost::system::error_code&) {
+        connected = true;
+      });
+  RunUntil(io_context, [&]() { return connected; });
+  int peer = accept(listener, nullptr, nullptr);
+
+  // the wait consumes no data
+  bool readable = false;
+  first.async_wait(ReactorSocket::wait_read,
+      [&](const boost::system::error_code& ec) {
+        assert(!ec);
+        readable = true;
+      });
+  io_context.poll();
+  assert(!readable);
+  assert(write(peer, "hello", 5) == 5);
+  RunUntil(io_context, [&]() { return readable; });
+  boost::system::error_code ec;
+  assert(first.available(ec) == 5 && !ec);
+
+  // the events of the descriptor are reported to the socket it's moved to
+  ReactorSocket second(io_context);
+  second = std::move(first);
+  assert(!first.is_open() && second.is_open());
+  std::string received;
+  char buf[16];
+  auto read_handler = [&](const boost::system::error_code& ec, size_t bytes) {
+    assert(!ec);
+    received.append(buf, bytes);
+  };
+  second.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  RunUntil(io_context, [&]() { return received == "hello"; });
+  second.async_read_some(boost::asio::buffer(buf, sizeof(buf)), read_handler);
+  assert(write(peer, " world", 6) == 6);
+  RunUntil(io_context, [&]() { return received == "hello world"; });
+  close(peer);
+  close(listener);
+}
+
+int main() {
+  EchoTest();
+  HalfCloseTest();
+  RefusedTest();
+  CloseTest();
+  WaitMoveTest();
+  std::cout << "epoll_reactor_test ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "../proxy/hedge_budget.h"
+#include "../proxy/latency_estimator.h"
+
+#include <cassert>
+#include <iostream>
+
+using namespace yarmproxy;
+using std::chrono::milliseconds;
+
+void BudgetTest() {
+  HedgeBudget budget;
+  budget.set_ratio(10);
+  assert(!budget.TryAcquire()); // no read yet
+
+  // a hedge per 10 reads
+  for(int i = 0; i < 9; ++i) {
+    budget.OnRead();
+  }
+  assert(!budget.TryAcquire());
+  budget.OnRead();
+  assert(budget.TryAcquire());
+  assert(!budget.TryAcquire()); // used up
+
+  int hedges = 0;
+  for(int i = 0; i < 1000; ++i) {
+    budget.OnRead();
+    hedges += budget.TryAcquire() ? 1 : 0;
+  }
+  assert(hedges == 100);
+}
+
+void BurstTest() {
+  HedgeBudget budget;
+  budget.set_ratio(10);
+  // refilled up to a burst of 10 hedges
+  for(int i = 0; i < 1000; ++i) {
+    budget.OnRead();
+  }
+  for(int i = 0; i < 10; ++i) {
+    assert(budget.TryAcquire());
+  }
+  assert(!budget.TryAcquire());
+
+  budget.set_ratio(100);
+  budget.OnRead();
+  assert(budget.TryAcquire());
+  assert(!budget.TryAcquire());
+}
+
+// the hedge delay is the percentile of the recent latencies
+void DelayTest() {
+  LatencyEstimator estimator;
+  for(int i = 1; i <= 15; ++i) {
+    estimator.AddSample(milliseconds(i));
+  }
+  // too few samples, no hedge
+  assert(estimator.Percentile(90) == LatencyEstimator::Clock::duration::zero());
+
+  estimator.AddSample(milliseconds(16));
+  assert(estimator.Percentile(50) == milliseconds(9));
+  assert(estimator.Percentile(90) == milliseconds(15));
+
+  // cached until 16 more samples, unless the percentile changes
+  estimator.AddSample(milliseconds(100));
+  assert(estimator.Percentile(90) == milliseconds(15));
+  assert(estimator.Percentile(95) == milliseconds(100));
+
+  // the recent samples only
+  for(int i = 0; i < 64; ++i) {
+    estimator.AddSample(milliseconds(50));
+  }
+  assert(estimator.Percentile(95) == milliseconds(50));
+  assert(estimator.Percentile(1) == milliseconds(50));
+}
+
+int main() {
+  BudgetTest();
+  BurstTest();
+  DelayTest();
+  std::cout << "hedge_budget_test ok" << std::endl;
+  return 0;
+}
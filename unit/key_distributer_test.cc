@@ -0,0 +1,165 @@
+#include "../proxy/key_distributer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace yarmproxy;
+
+static Config::Cluster MakeCluster(const std::string& hash_tag,
+                                   size_t backends) {
+  Config::Cluster cluster;
+  cluster.hash_tag_ = hash_tag;
+  for(size_t i = 0; i < backends; ++i) {
+    cluster.backends_.emplace_back("10.0.0." + std::to_string(i + 1), 6379,
+                                   1000);
+  }
+  return cluster;
+}
+
+static uint32_t Hash(const KeyDistributer& distributer, const char* key) {
+  return distributer.HashKey(key, strlen(key));
+}
+
+void HashTagTest() {
+  KeyDistributer plain(MakeCluster("", 8), std::set<Endpoint>());
+  KeyDistributer tagged(MakeCluster("{}", 8), std::set<Endpoint>());
+
+  assert(Hash(tagged, "user{42}:name") == Hash(plain, "42"));
+  assert(Hash(tagged, "{42}") == Hash(plain, "42"));
+  assert(Hash(tagged, "user:{42}") == Hash(plain, "42")); // at the end
+  assert(Hash(tagged, "x{a}{b}") == Hash(plain, "a"));    // the first one
+  assert(Hash(tagged, "{{a}}") == Hash(plain, "{a"));
+  // a tag of multi-byte characters
+  assert(Hash(tagged, "order:{\xe7\x94\xa8\xe6\x88\xb7}:1") ==
+         Hash(plain, "\xe7\x94\xa8\xe6\x88\xb7"));
+
+  // the whole key without a tag
+  const char* untagged[] = {"user:42", "a{}b", "a{bc", "abc{", "a}b{c",
+                            "{}{b}"};
+  for(const char* key : untagged) {
+    assert(Hash(tagged, key) == Hash(plain, key));
+  }
+
+  // the same open and close characters
+  KeyDistributer colons(MakeCluster("::", 8), std::set<Endpoint>());
+  assert(Hash(colons, "user:42:name") == Hash(plain, "42"));
+  assert(Hash(colons, "user::name") == Hash(plain, "user::name"));
+  assert(Hash(colons, "user:42") == Hash(plain, "user:42"));
+}
+
+void TagLocateTest() {
+  KeyDistributer tagged(MakeCluster("{}", 8), std::set<Endpoint>());
+  const Endpoint ep = tagged.LocateCacheNode("42", 2);
+  for(int i = 0; i < 100; ++i) {
+    std::string key = "user" + std::to_string(i) + "{42}";
+    assert(tagged.LocateCacheNode(key.data(), key.size()) == ep);
+  }
+}
+
+// the sorted points of the default continuum, hashed as BuildCachePoints()
+static std::vector<std::pair<uint32_t, uint16_t>> SortedPoints(
+    const KeyDistributer& distributer, size_t weight) {
+  std::vector<std::pair<uint32_t, uint16_t>> points;
+  for(size_t i = 0; i < distributer.endpoints().size(); ++i) {
+    const Endpoint& ep = distributer.endpoints()[i];
+    for(size_t k = 0; k < weight; ++k) {
+      char name[64];
+      snprintf(name, sizeof(name), "%lu-%lu-%u", k,
+               ep.address().to_v4().to_ulong(), ep.port());
+      points.emplace_back(Hash(distributer, name), uint16_t(i));
+    }
+  }
+  std::sort(points.begin(), points.end());
+  return points;
+}
+
+// the first point at or after the hash of the key, of an acceptable
+// endpoint, walking the sorted points around the circle
+static uint16_t WalkPoints(
+    const std::vector<std::pair<uint32_t, uint16_t>>& points, uint32_t hash,
+    unsigned acceptable, bool* wrapped) {
+  size_t start = std::lower_bound(points.begin(), points.end(),
+                     std::make_pair(hash, uint16_t(0))) - points.begin();
+  start %= points.size();
+  *wrapped = false;
+  for(size_t i = start; i < start + points.size(); ++i) {
+    if (acceptable & (1u << points[i % points.size()].second)) {
+      *wrapped = i >= points.size();
+      return points[i % points.size()].second;
+    }
+  }
+  return points[start].second; // none acceptable
+}
+
+// the successor walk of LocateBounded(), over a small continuum so that
+// the walks wrap around
+void BoundedWalkTest() {
+  const size_t kWeight = 4;
+  Config::Cluster cluster = MakeCluster("", 4);
+  for(auto& backend : cluster.backends_) {
+    backend.weight_ = kWeight;
+  }
+  KeyDistributer distributer(cluster, std::set<Endpoint>());
+  const std::vector<std::pair<uint32_t, uint16_t>> points =
+      SortedPoints(distributer, kWeight);
+  assert(points.size() == 16);
+
+  const unsigned kAll = 15; // the acceptable endpoints by bit
+  size_t spilled = 0, wrapped = 0;
+  for(int i = 0; i < 2000; ++i) {
+    std::string key = "key:" + std::to_string(i);
+    const uint32_t hash = Hash(distributer, key.c_str());
+    bool wrap = false;
+    const uint16_t primary = WalkPoints(points, hash, kAll, &wrap);
+    assert(distributer.endpoints()[primary] ==
+           distributer.LocateCacheNode(key.data(), key.size()));
+
+    for(unsigned acceptable = 0; acceptable <= kAll; ++acceptable) {
+      uint16_t located = distributer.LocateBounded(key.data(), key.size(),
+          [acceptable](uint16_t index) {
+            return (acceptable & (1u << index)) != 0;
+          });
+      // the primary if all are overloaded
+      assert(located == WalkPoints(points, hash, acceptable, &wrap));
+      spilled += located != primary ? 1 : 0;
+      wrapped += wrap ? 1 : 0;
+    }
+  }
+  assert(spilled > 0);
+  assert(wrapped > 0);
+}
+
+// the endpoints in order, without a continuum
+void BoundedModulaTest() {
+  Config::Cluster cluster = MakeCluster("", 4);
+  cluster.distribution_ = Config::Distribution::MODULA;
+  for(auto& backend : cluster.backends_) {
+    backend.weight_ = 1;
+  }
+  KeyDistributer distributer(cluster, std::set<Endpoint>());
+  for(int i = 0; i < 100; ++i) {
+    std::string key = "key:" + std::to_string(i);
+    const uint16_t primary = distributer.LocateBounded(key.data(), key.size(),
+        [](uint16_t) { return true; });
+    uint16_t located = distributer.LocateBounded(key.data(), key.size(),
+        [primary](uint16_t index) { return index != primary; });
+    assert(located == (primary + 1) % 4); // 3 wraps around to 0
+    located = distributer.LocateBounded(key.data(), key.size(),
+        [](uint16_t) { return false; });
+    assert(located == primary);
+  }
+}
+
+int main() {
+  HashTagTest();
+  TagLocateTest();
+  BoundedWalkTest();
+  BoundedModulaTest();
+  std::cout << "key_distributer_test ok" << std::endl;
+  return 0;
+}
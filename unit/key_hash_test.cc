@@ -0,0 +1,63 @@
+#include "../proxy/key_hash.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+using namespace yarmproxy;
+
+// reference values from python hashlib, mmh3 and xxhash
+void KnownVectorTest() {
+  const char* key = "user:1000:profile";
+  size_t len = strlen(key);
+
+  assert(hash_crc32c("123456789", 9) == 0xE3069283);
+  assert(hash_crc32c("", 0) == 0);
+
+  assert(xxh3_64("", 0) == 0x2d06800538d394c2ULL);
+  assert(hash_xxh3("a", 1) == 0x1e964e1f);
+  assert(hash_xxh3(key, len) == 0x2ea288c9);
+
+  assert(hash_murmur3("", 0) == 0);
+  assert(hash_murmur3("a", 1) == 0x3c2569b2);
+  assert(hash_murmur3(key, len) == 0x5be70f3b);
+
+  assert(hash_md5("", 0) == 0xd98c1dd4);
+  assert(hash_md5("a", 1) == 0xb975c10c);
+  assert(hash_md5(key, len) == 0x9a1d90e7);
+
+  assert(hash_fnv1a_64("a", 1) == 0x8601ec8c);
+  assert(hash_fnv1a_64(key, len) == 0x550c719a);
+
+  // twemproxy hashkit, the key chars are signed
+  const char* latin1 = "\xe9t\xe9";
+  assert(hash_fnv1_64(key, len) == 0x3dd2185c);
+  assert(hash_fnv1_32(key, len) == 0x864fbf1c);
+  assert(hash_fnv1a_32(key, len) == 0x03f6e9fa);
+  assert(hash_fnv1a_32(latin1, 3) == 0xfb67177b);
+  assert(hash_one_at_a_time(key, len) == 0x1f256987);
+  assert(hash_one_at_a_time(latin1, 3) == 0x8c711b75);
+  assert(hash_murmur("a", 1) == 0x4b41757c);
+  assert(hash_murmur(key, len) == 0x04ae7988);
+  assert(hash_crc16(key, len) == 0xa072a2d6);
+  assert(hash_crc16(latin1, 3) == 0x6c94963a);
+  assert(hash_crc32(key, len) == 0x01d7);
+  assert(hash_crc32a(key, len) == 0x01d79a79);
+}
+
+void RegistryTest() {
+  for(size_t i = 0; kKeyHashNames[i] != nullptr; ++i) {
+    KeyHashFunction hash = GetKeyHashFunction(kKeyHashNames[i]);
+    assert(hash != nullptr);
+    std::cout << kKeyHashNames[i] << "\t: " << hash("abc", 3) << std::endl;
+  }
+  assert(GetKeyHashFunction("doobs") == hash_doobs);
+  assert(GetKeyHashFunction("unknown") == nullptr);
+}
+
+int main() {
+  KnownVectorTest();
+  RegistryTest();
+  std::cout << "key_hash_test ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include "../proxy/key_locator.h"
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "../proxy/config.h"
+#include "../proxy/protocol_type.h"
+
+using namespace yarmproxy;
+
+static void LoadConfig() {
+  const char* file = "/tmp/key_locator_test.conf";
+  std::ofstream(file) << "cluster {\n"
+                      << "  protocol redis\n"
+                      << "  namespace _\n"
+                      << "  bounded_load 25\n"
+                      << "  backends {\n"
+                      << "    backend 10.0.0.1:6379 1000\n"
+                      << "    backend 10.0.0.2:6379 1000\n"
+                      << "    backend 10.0.0.3:6379 1000\n"
+                      << "    backend 10.0.0.4:6379 1000\n"
+                      << "  }\n"
+                      << "}\n"
+                      << "cluster {\n"
+                      << "  protocol redis\n"
+                      << "  namespace ns\n"
+                      << "  bounded_load 25\n"
+                      << "  backends {\n"
+                      << "    backend 10.0.1.1:6379 1000\n"
+                      << "    backend 10.0.1.2:6379 1000\n"
+                      << "  }\n"
+                      << "}\n";
+  assert(Config::Instance().Initialize(file));
+}
+
+struct Loads {
+  std::map<Endpoint, size_t> in_flight_;
+  int calls_ = 0;
+
+  KeyLocator::EndpointLoad Function() {
+    return [this](const Endpoint& ep) {
+      ++calls_;
+      auto it = in_flight_.find(ep);
+      return it == in_flight_.end() ? size_t(0) : it->second;
+    };
+  }
+};
+
+static Endpoint Bounded(const KeyLocator& locator, const std::string& key,
+                        Loads* loads, KeyLocator::LoadSum* load_sum,
+                        bool* spilled) {
+  return locator.LocateBounded(key.data(), key.size(), ProtocolType::REDIS,
+                               25, loads->Function(), load_sum, spilled);
+}
+
+// ceil(1.25 * (the loads + 1) / 4) reads per endpoint
+void BoundTest() {
+  KeyLocator locator;
+  assert(locator.Initialize(std::set<Endpoint>(),
+                            std::map<size_t, redis::ClusterSlots>()));
+  const std::string key = "user:42";
+  const Endpoint primary = locator.Locate(key.data(), key.size(),
+                                          ProtocolType::REDIS);
+  Loads loads;
+  bool spilled = true;
+  assert(Bounded(locator, key, &loads, nullptr, &spilled) == primary);
+  assert(!spilled);
+
+  // ceil(1.25 * 2 / 4) = 1, the primary is at the bound
+  loads.in_flight_[primary] = 1;
+  Endpoint ep = Bounded(locator, key, &loads, nullptr, &spilled);
+  assert(spilled && ep != primary);
+  assert(ep.address().to_string().compare(0, 7, "10.0.0.") == 0);
+
+  // ceil(1.25 * 5 / 4) = 2
+  for(int i = 1; i <= 4; ++i) {
+    loads.in_flight_[Endpoint(boost::asio::ip::address_v4::from_string(
+        "10.0.0." + std::to_string(i)), 6379)] = 1;
+  }
+  assert(Bounded(locator, key, &loads, nullptr, &spilled) == primary);
+  assert(!spilled);
+  // ceil(1.25 * 6 / 4) = 2
+  loads.in_flight_[primary] = 2;
+  assert(Bounded(locator, key, &loads, nullptr, &spilled) != primary);
+  assert(spilled);
+}
+
+// the loads are summed once per command and continuum
+void LoadSumTest() {
+  KeyLocator locator;
+  assert(locator.Initialize(std::set<Endpoint>(),
+                            std::map<size_t, redis::ClusterSlots>()));
+  Loads loads;
+  bool spilled = false;
+  for(int i = 0; i < 10; ++i) {
+    Bounded(locator, "key:" + std::to_string(i), &loads, nullptr, &spilled);
+  }
+  assert(loads.calls_ == 10 * (4 + 1));
+
+  loads.calls_ = 0;
+  KeyLocator::LoadSum load_sum;
+  for(int i = 0; i < 10; ++i) {
+    Bounded(locator, "key:" + std::to_string(i), &loads, &load_sum, &spilled);
+  }
+  assert(loads.calls_ == 4 + 10);
+
+  // summed again for a key of another continuum
+  loads.calls_ = 0;
+  Bounded(locator, "ns:1", &loads, &load_sum, &spilled);
+  assert(loads.calls_ == 2 + 1);
+  Bounded(locator, "ns:2", &loads, &load_sum, &spilled);
+  assert(loads.calls_ == 2 + 1 + 1);
+  Bounded(locator, "key:1", &loads, &load_sum, &spilled);
+  assert(loads.calls_ == 2 + 1 + 1 + 4 + 1);
+
+  // with the connections the command opened since, ceil(1.25 * 9 / 4) = 3
+  // then ceil(1.25 * 10 / 4) = 4
+  const std::string key = "user:42";
+  const Endpoint primary = locator.Locate(key.data(), key.size(),
+                                          ProtocolType::REDIS);
+  for(int i = 1; i <= 4; ++i) {
+    loads.in_flight_[Endpoint(boost::asio::ip::address_v4::from_string(
+        "10.0.0." + std::to_string(i)), 6379)] = 2;
+  }
+  KeyLocator::LoadSum command_sum;
+  assert(Bounded(locator, key, &loads, &command_sum, &spilled) == primary);
+  loads.in_flight_[primary] = 3;
+  assert(Bounded(locator, key, &loads, &command_sum, &spilled) != primary);
+  command_sum.AddLoad();
+  assert(Bounded(locator, key, &loads, &command_sum, &spilled) == primary);
+  assert(!spilled);
+}
+
+int main() {
+  LoadConfig();
+  BoundTest();
+  LoadSumTest();
+  std::cout << "key_locator_test ok" << std::endl;
+  return 0;
+}
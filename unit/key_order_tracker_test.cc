@@ -0,0 +1,78 @@
+#include "../proxy/key_order_tracker.h"
+
+#include <cassert>
+#include <iostream>
+
+using namespace yarmproxy;
+
+void ReadWriteTest() {
+  KeyOrderTracker tracker;
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, false));
+  tracker.PushCommand();
+
+  // reads of a key don't conflict
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, false));
+  assert(!tracker.conflicted());
+  tracker.PushCommand();
+
+  // a write waits for the reads
+  tracker.BeginCommand();
+  assert(tracker.AddKey("b", 1, true));
+  assert(!tracker.AddKey("a", 1, true));
+  assert(tracker.conflicted());
+
+  tracker.PopCommand();
+  tracker.BeginCommand();
+  assert(!tracker.AddKey("a", 1, true));
+  tracker.PopCommand();
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, true));
+  tracker.PushCommand();
+
+  // a read waits for the write
+  tracker.BeginCommand();
+  assert(!tracker.AddKey("a", 1, false));
+  tracker.BeginCommand();
+  assert(tracker.AddKey("ab", 2, false));
+  tracker.PushCommand();
+}
+
+void UnknownKeysTest() {
+  KeyOrderTracker tracker;
+  // commands without keys
+  tracker.BeginCommand();
+  tracker.PushCommand();
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, true));
+  assert(tracker.AddUnknownKeys());
+  tracker.PushCommand();
+
+  tracker.BeginCommand();
+  assert(!tracker.AddKey("b", 1, false));
+  tracker.PushCommand(); // the conflicting key isn't tracked
+  tracker.BeginCommand();
+  assert(!tracker.AddUnknownKeys());
+
+  tracker.PopCommand();
+  tracker.PopCommand();
+  tracker.BeginCommand();
+  assert(tracker.AddUnknownKeys());
+  tracker.PopCommand();
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, true));
+
+  tracker.PushCommand();
+  tracker.Clear();
+  tracker.BeginCommand();
+  assert(tracker.AddKey("a", 1, false));
+  tracker.PopCommand();
+}
+
+int main() {
+  ReadWriteTest();
+  UnknownKeysTest();
+  std::cout << "key_order_tracker_test ok" << std::endl;
+  return 0;
+}
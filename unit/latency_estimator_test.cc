@@ -0,0 +1,80 @@
+#include "../proxy/latency_estimator.h"
+
+#include <cassert>
+#include <iostream>
+
+using namespace yarmproxy;
+using std::chrono::milliseconds;
+
+// srtt + 4 * rttvar, rounded up to milliseconds
+void SmoothingTest() {
+  LatencyEstimator estimator;
+  estimator.set_timeout_range(10, 1000);
+  assert(estimator.enabled());
+  assert(estimator.srtt() == 0);
+  assert(estimator.Timeout() == 1000); // max_timeout until a sample
+
+  // the first sample sets srtt, and rttvar to its half
+  estimator.AddSample(milliseconds(100));
+  assert(estimator.srtt() == 100000);
+  assert(estimator.Timeout() == 300); // 100000 + 4 * 50000
+
+  // srtt += (60000 - 100000) / 8, rttvar += (40000 - 50000) / 4
+  estimator.AddSample(milliseconds(60));
+  assert(estimator.srtt() == 95000);
+  assert(estimator.Timeout() == 285); // 95000 + 4 * 47500
+
+  // srtt += (140000 - 95000) / 8, rttvar += (45000 - 47500) / 4
+  estimator.AddSample(milliseconds(140));
+  assert(estimator.srtt() == 100625);
+  assert(estimator.Timeout() == 289); // 100625 + 4 * 46875
+
+  // converges to a steady latency
+  for(int i = 0; i < 200; ++i) {
+    estimator.AddSample(milliseconds(50));
+  }
+  assert(estimator.srtt() > 50000 && estimator.srtt() < 50100);
+  assert(estimator.Timeout() == 51);
+}
+
+void BackoffTest() {
+  LatencyEstimator estimator;
+  estimator.set_timeout_range(10, 1000);
+  estimator.AddSample(milliseconds(100));
+  assert(estimator.Timeout() == 300);
+
+  // doubles on each timeout, up to max_timeout
+  estimator.OnTimeout();
+  assert(estimator.Timeout() == 600);
+  estimator.OnTimeout();
+  assert(estimator.Timeout() == 1000);
+
+  // reset by a new sample
+  estimator.AddSample(milliseconds(100));
+  assert(estimator.Timeout() == 250); // 100000 + 4 * 37500
+
+  // at most 16 doublings
+  estimator.set_timeout_range(10, 1 << 30);
+  for(int i = 0; i < 20; ++i) {
+    estimator.OnTimeout();
+  }
+  assert(estimator.Timeout() == 250 << 16);
+}
+
+void ClampTest() {
+  LatencyEstimator estimator;
+  estimator.set_timeout_range(10, 1000);
+  estimator.AddSample(milliseconds(1));
+  assert(estimator.Timeout() == 10); // 1000 + 4 * 500, under min_timeout
+
+  LatencyEstimator disabled;
+  assert(!disabled.enabled());
+}
+
+int main() {
+  SmoothingTest();
+  BackoffTest();
+  ClampTest();
+  std::cout << "latency_estimator_test ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "../proxy/log_ring.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace base;
+
+void WrapTest() {
+  LogRing ring(64);
+  std::vector<std::string> drained;
+  auto handler = [&drained](const char* data, size_t bytes) {
+    drained.emplace_back(data, bytes);
+  };
+
+  assert(ring.empty());
+  assert(ring.Push("0123456789", 10)); // 16 bytes with the header
+  assert(ring.Push("abcdefghijklmnopqrst", 20)); // 24 bytes
+  assert(!ring.Push("abcdefghijklmnopqrstuvwxyz", 26)); // full
+  assert(ring.dropped() == 1);
+  assert(ring.Drain(handler) == 2);
+  assert(ring.empty());
+  assert(drained[0] == "0123456789");
+  assert(drained[1] == "abcdefghijklmnopqrst");
+
+  // 24 bytes left before the end, so it's wrapped
+  assert(ring.Push("abcdefghijklmnopqrstuvwxyz", 26));
+  assert(ring.Push("", 0));
+  assert(ring.Drain(handler) == 2);
+  assert(drained[2] == "abcdefghijklmnopqrstuvwxyz");
+  assert(drained[3] == "");
+
+  // larger than the half of the ring
+  assert(!ring.Push("abcdefghijklmnopqrstuvwxyz0123456789", 36));
+  assert(ring.dropped() == 2);
+}
+
+void ThreadsTest() {
+  LogRing ring(4096);
+  const size_t kRecords = 200000;
+  std::thread producer([&ring]() {
+        char record[64];
+        for(size_t i = 0; i < kRecords; ) {
+          size_t bytes = 9 + i % 40;
+          memset(record, char('a' + i % 26), bytes);
+          memcpy(record, &i, sizeof(i));
+          if (ring.Push(record, bytes)) {
+            ++i;
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      });
+
+  size_t expected = 0;
+  while (expected < kRecords) {
+    ring.Drain([&expected](const char* data, size_t bytes) {
+          size_t i;
+          memcpy(&i, data, sizeof(i));
+          assert(i == expected);
+          assert(bytes == 9 + i % 40);
+          assert(data[bytes - 1] == char('a' + i % 26));
+          ++expected;
+        });
+  }
+  producer.join();
+  assert(ring.empty());
+}
+
+int main() {
+  WrapTest();
+  ThreadsTest();
+  std::cout << "log_ring_test ok" << std::endl;
+  return 0;
+}
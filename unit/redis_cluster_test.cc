@@ -0,0 +1,76 @@
+#include "../proxy/redis_cluster.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+using namespace yarmproxy;
+
+void KeySlotTest() {
+  assert(redis::KeySlot("123456789", 9) == 0x31C3);
+  assert(redis::KeySlot("foo", 3) == 12182);
+  assert(redis::KeySlot("bar", 3) == 5061);
+  // hash tags
+  assert(redis::KeySlot("{foo}bar", 8) == 12182);
+  assert(redis::KeySlot("x{foo}{bar}", 11) == 12182);
+  assert(redis::KeySlot("{}foo", 5) != redis::KeySlot("foo", 3));
+  assert(redis::KeySlot("foo{", 4) != redis::KeySlot("foo", 3));
+  assert(redis::KeySlot("bar{foo}", 8) == 12182); // at the end
+  // the whole key, if the first tag is empty or not closed
+  assert(redis::KeySlot("{}{foo}", 7) == 2263);
+  assert(redis::KeySlot("foo{bar", 7) == 15278);
+  // a tag of multi-byte characters
+  assert(redis::KeySlot("x{\xe7\x94\xa8}", 6) ==
+         redis::KeySlot("\xe7\x94\xa8", 3));
+}
+
+void ParseClusterSlotsTest() {
+  Endpoint node(boost::asio::ip::address::from_string("10.0.0.9"), 7009);
+  const char* reply = "*2\r\n"
+      "*4\r\n:0\r\n:5460\r\n"
+          "*3\r\n$9\r\n127.0.0.1\r\n:7000\r\n$4\r\nid-0\r\n"
+          "*3\r\n$9\r\n127.0.0.1\r\n:7003\r\n$4\r\nid-3\r\n"
+      "*3\r\n:5461\r\n:16383\r\n"
+          "*2\r\n$0\r\n\r\n:7001\r\n";
+  size_t len = strlen(reply);
+
+  redis::ClusterSlots slots;
+  assert(redis::ParseClusterSlots(reply, len, node, &slots) == int(len));
+  assert(slots.size() == 2);
+  assert(slots[0].first_ == 0 && slots[0].last_ == 5460);
+  assert(slots[0].master_.port() == 7000);
+  assert(slots[1].first_ == 5461 && slots[1].last_ == 16383);
+  assert(slots[1].master_ == Endpoint(node.address(), 7001));
+
+  for(size_t i = 0; i < len; ++i) {
+    assert(redis::ParseClusterSlots(reply, i, node, &slots) == 0);
+  }
+  assert(redis::ParseClusterSlots("-ERR no cluster\r\n", 17, node, &slots) < 0);
+  const char* bad = "*1\r\n*3\r\n:0\r\n:16384\r\n*2\r\n$0\r\n\r\n:7001\r\n";
+  assert(redis::ParseClusterSlots(bad, strlen(bad), node, &slots) < 0);
+}
+
+void ParseRedirectionTest() {
+  bool ask = true;
+  Endpoint target;
+  const char* moved = "-MOVED 3999 127.0.0.1:6381\r\n$3\r\n";
+  assert(redis::ParseRedirection(moved, strlen(moved), &ask, &target) == 28);
+  assert(!ask && target.port() == 6381);
+
+  const char* asking = "-ASK 3999 10.1.2.3:7002\r\n";
+  assert(redis::ParseRedirection(asking, strlen(asking), &ask, &target) ==
+         strlen(asking));
+  assert(ask && target.address().to_string() == "10.1.2.3");
+
+  assert(redis::ParseRedirection(moved, 20, &ask, &target) == 0);
+  assert(redis::ParseRedirection("-ERR x\r\n", 8, &ask, &target) == 0);
+  assert(redis::ParseRedirection("-MOVED 1 bad\r\n", 14, &ask, &target) == 0);
+}
+
+int main() {
+  KeySlotTest();
+  ParseClusterSlotsTest();
+  ParseRedirectionTest();
+  std::cout << "redis_cluster_test ok" << std::endl;
+  return 0;
+}
@@ -202,7 +202,47 @@ void BulkTest() {
   }
 }
 
+// the counts and sizes of several digits, parsed in place
+void CountTest() {
+  using namespace yarmproxy;
+  {
+    char data[] = "*123\r\n$12\r\nabcdefghijkl\r\n$1024\r\nab";
+    redis::BulkArray bulkv(data, sizeof(data) - 1);
+    assert(bulkv.parsed_size() == 6 + 19 + 7 + 1024 + 2); // with the absent
+    assert(bulkv.total_bulks() == 123);
+    assert(bulkv.present_bulks() == 2);
+    assert(bulkv.absent_bulks() == 121);
+    assert(bulkv[0].payload_size() == 12);
+    assert(bulkv[0].completed());
+    assert(bulkv[1].payload_size() == 1024);
+    assert(bulkv[1].absent_size() == 1024 - 2 + 2); // and its \r\n
+  }
+
+  {
+    char data[] = "*10"; // the count of a partial first line
+    redis::BulkArray bulkv(data, sizeof(data) - 1);
+    assert(bulkv.parsed_size() == 0);
+    assert(bulkv.total_bulks() == 10);
+  }
+
+  {
+    char data[] = "$4294967296\r\n";
+    redis::Bulk bulk(data, sizeof(data) - 1);
+    assert(bulk.payload_size() == 4294967296ULL);
+  }
+
+  {
+    char data[] = "$65536\r\nab";
+    redis::Bulk bulk(data, sizeof(data) - 1);
+    assert(bulk.payload_size() == 65536);
+    assert(bulk.total_size() == 8 + 65536 + 2);
+  }
+}
+
 int main() {
+  std::cout << "============ CountTest ============" << std::endl;
+  CountTest();
+
   std::cout << "============ BulkTest ============" << std::endl;
   BulkTest();
 